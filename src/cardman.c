@@ -41,6 +41,7 @@
 #include "membuf.h"
 
 #include "gpagenkeycardop.h"
+#include "gpacontext.h"
 
 #include "cm-object.h"
 #include "cm-openpgp.h"
@@ -75,10 +76,13 @@ struct _GpaCardManager
   GtkWidget *status_text;
 
   const char *cardtypename;  /* String with the card type's name.  */
+  char *serialno;            /* The serial number of the card or NULL.  */
   GType cardtype;            /* Widget type of a supported card.  */
 
-  gpa_filewatch_id_t watch;  /* For watching the reader status file.  */
+  gpa_filewatch_id_t watch;  /* For watching the reader status files.  */
   int in_card_reload;        /* Sentinel for card_reload.  */
+  int reload_pending;        /* A reload has been queued.  */
+  int no_reader;             /* The last reload found no reader.  */
 
 
   gpgme_ctx_t gpgagent;      /* Gpgme context for the assuan
@@ -86,6 +90,8 @@ struct _GpaCardManager
 
 
   guint ticker_timeout_id;   /* Source Id of the timeout ticker or 0.  */
+  unsigned int ticker_interval; /* Seconds until the next tick.  */
+  GpaContext *ticker_context;   /* Context to poll the event counter.  */
 
 
   struct {
@@ -255,6 +261,11 @@ scd_status_cb (void *opaque, const char *status, const char *args)
         cardman->cardtypename = "Unknown";
 
     }
+  else if (!strcmp (status, "SERIALNO"))
+    {
+      g_free (cardman->serialno);
+      cardman->serialno = g_strndup (args, strcspn (args, " "));
+    }
   else if ( !strcmp (status, "EVENTCOUNTER") )
     {
       unsigned int count;
@@ -298,8 +309,6 @@ card_reload (GpaCardManager *cardman)
   if (!cardman->gpgagent)
     return;  /* No support for GPGME_PROTOCOL_ASSUAN.  */
 
-  /* Start the ticker if not yet done.  */
-  start_ticker (cardman);
   if (!cardman->in_card_reload)
     {
       cardman->in_card_reload++;
@@ -308,6 +317,8 @@ card_reload (GpaCardManager *cardman)
 
       cardman->cardtype = G_TYPE_NONE;
       cardman->cardtypename = "Unknown";
+      g_free (cardman->serialno);
+      cardman->serialno = NULL;
 
       /* The first thing we need to do is to issue the SERIALNO
          command; this makes sure that scdaemon initalizes the card if
@@ -361,6 +372,7 @@ card_reload (GpaCardManager *cardman)
         }
 
 
+      cardman->no_reader = (gpg_err_code (err) == GPG_ERR_ENODEV);
       if (gpg_err_code (err) == GPG_ERR_CARD_NOT_PRESENT
           || gpg_err_code (err) == GPG_ERR_CARD_REMOVED)
         {
@@ -441,6 +453,12 @@ card_reload (GpaCardManager *cardman)
       update_title (cardman);
 
       update_info_visibility (cardman);
+
+      /* Start the ticker if not yet done.  This is done after the
+         SERIALNO command so that scdaemon had a chance to create the
+         reader status file.  */
+      start_ticker (cardman);
+
       /* We decrement our lock using a idle handler with lo priority.
          This gives us a better chance not to do a reload a second
          time on behalf of the file watcher or ticker.  */
@@ -469,6 +487,7 @@ card_reload_idle_cb (void *user_data)
 {
   GpaCardManager *cardman = user_data;
 
+  cardman->reload_pending = 0;
   card_reload (cardman);
   g_object_unref (cardman);
 
@@ -476,6 +495,19 @@ card_reload_idle_cb (void *user_data)
 }
 
 
+/* Queue a reload unless one is already queued or the card manager
+   has been closed.  */
+static void
+queue_card_reload (GpaCardManager *cardman)
+{
+  if (cardman->reload_pending || cardman != this_instance)
+    return;
+  cardman->reload_pending = 1;
+  g_object_ref (cardman);
+  g_idle_add (card_reload_idle_cb, cardman);
+}
+
+
 static gpg_error_t
 geteventcounter_status_cb (void *opaque, const char *status, const char *args)
 {
@@ -498,8 +530,7 @@ geteventcounter_status_cb (void *opaque, const char *status, const char *args)
                  eventcounter but check the actual card status first.
                  However simply triggering a reload is not different
                  from the user hitting the reload button.  */
-              g_object_ref (cardman);
-              g_idle_add (card_reload_idle_cb, cardman);
+              queue_card_reload (cardman);
             }
           cardman->eventcounter.card_any = 1;
           cardman->eventcounter.card = count;
@@ -509,47 +540,98 @@ geteventcounter_status_cb (void *opaque, const char *status, const char *args)
   return 0;
 }
 
+/* The maximum number of seconds between two ticks.  The interval
+   grows up to this value while no card reader is present.  */
+#define MAX_TICKER_INTERVAL 32
+
+static gboolean ticker_cb (gpointer user_data);
+
+/* Schedule the next tick.  */
+static void
+schedule_ticker (GpaCardManager *cardman)
+{
+  if (cardman->ticker_timeout_id || !this_instance)
+    return;
+
+  /* Back off while there is no reader; a reader shows up far less
+     often than a card is inserted.  */
+  if (cardman->no_reader && cardman->ticker_interval)
+    cardman->ticker_interval = MIN (cardman->ticker_interval * 2,
+                                    MAX_TICKER_INTERVAL);
+  else
+    cardman->ticker_interval = 1;
+  cardman->ticker_timeout_id = g_timeout_add_seconds
+    (cardman->ticker_interval, ticker_cb, cardman);
+}
+
+
+/* The GETEVENTCOUNTER command of the ticker finished.  */
+static void
+ticker_done_cb (GpaContext *context, gpg_error_t err, GpaCardManager *cardman)
+{
+  if (err)
+    g_debug ("assuan command `GETEVENTCOUNTER' failed: %s <%s>",
+             gpg_strerror (err), gpg_strsource (err));
+  schedule_ticker (cardman);
+}
+
+
 /* This function is called by the timeout ticker started by
    start_ticker.  It is used to poll scdaemon to detect a card status
-   change.  */
+   change.  The command is run asynchronously, thus a slow agent does
+   not block the GUI.  */
 static gboolean
 ticker_cb (gpointer user_data)
 {
   GpaCardManager *cardman = user_data;
+  gpg_error_t err;
 
-  if (!cardman || !cardman->ticker_timeout_id || !cardman->gpgagent
-      || cardman->in_card_reload)
-    return TRUE;  /* Keep on ticking.  */
-
-  /* Note that we are single threaded and thus there is no need to
-     lock the assuan context.  */
+  cardman->ticker_timeout_id = 0;
+  if (cardman->in_card_reload || gpa_context_busy (cardman->ticker_context))
+    {
+      schedule_ticker (cardman);
+      return FALSE;
+    }
 
-  gpgme_op_assuan_transact_ext (cardman->gpgagent,
-                                "GETEVENTCOUNTER",
-                                NULL, NULL,
-                                NULL, NULL,
-                                geteventcounter_status_cb, cardman, NULL);
+  err = gpgme_op_assuan_transact_start (cardman->ticker_context->ctx,
+                                        "GETEVENTCOUNTER",
+                                        NULL, NULL,
+                                        NULL, NULL,
+                                        geteventcounter_status_cb, cardman);
+  if (err)
+    ticker_done_cb (cardman->ticker_context, err, cardman);
 
-  return TRUE;  /* Keep on ticking.  */
+  return FALSE;  /* The next tick is scheduled by ticker_done_cb.  */
 }
 
 
-/* If no ticker is active start one.  */
+/* Start watching for card status changes if not yet done.  If
+   scdaemon maintains a reader status file and the file watcher works,
+   a change is noticed by watcher_cb without any polling.  Otherwise a
+   ticker polls the event counter.  */
 static void
 start_ticker (GpaCardManager *cardman)
 {
-  if (disable_ticker)
+  char *fname;
+  int have_status_file;
+
+  if (disable_ticker || cardman->ticker_context)
     return;
 
-  if (!cardman->ticker_timeout_id)
+  if (cardman->watch)
     {
-#if GTK_CHECK_VERSION (2, 14, 0)
-      cardman->ticker_timeout_id = g_timeout_add_seconds (1,
-                                                          ticker_cb, cardman);
-#else
-      cardman->ticker_timeout_id = g_timeout_add (1000, ticker_cb, cardman);
-#endif
+      fname = g_build_filename (gnupg_homedir, "reader_0.status", NULL);
+      have_status_file = g_file_test (fname, G_FILE_TEST_EXISTS);
+      xfree (fname);
+      if (have_status_file)
+        return;
     }
+
+  cardman->ticker_context = gpa_context_new ();
+  gpgme_set_protocol (cardman->ticker_context->ctx, GPGME_PROTOCOL_ASSUAN);
+  g_signal_connect (G_OBJECT (cardman->ticker_context), "done",
+                    G_CALLBACK (ticker_done_cb), cardman);
+  schedule_ticker (cardman);
 }
 
 
@@ -617,14 +699,29 @@ card_genkey_action (GSimpleAction *simple, GVariant *parameter, gpointer user_da
 }
 
 
+/* The file watcher callback for the GnuPG home directory.  */
 static void
 watcher_cb (void *opaque, const char *filename, const char *reason)
 {
   GpaCardManager *cardman = opaque;
+  const char *name;
 
-  if (cardman && strchr (reason, 'w') && !cardman->in_card_reload)
+  /* Without a file name events have been lost and the status file
+     may have been written.  */
+  if (filename)
     {
-      card_reload (cardman);
+      name = strrchr (filename, G_DIR_SEPARATOR);
+      name = name? name + 1 : filename;
+      if (strncmp (name, "reader_", 7)
+          || !g_str_has_suffix (name, ".status"))
+        return;
+    }
+
+  if (cardman && (!filename || strchr (reason, 'w') || strchr (reason, 'y'))
+      && !cardman->in_card_reload)
+    {
+      /* The file is written for each reader; reload only once.  */
+      queue_card_reload (cardman);
     }
 }
 
@@ -929,7 +1026,18 @@ cardman_action_new (GpaCardManager *cardman, GtkWidget **menu_bar,
 static void
 card_manager_closed (GtkWidget *widget, gpointer param)
 {
+  GpaCardManager *cardman = param;
+
   this_instance = NULL;
+
+  /* Stop watching for card changes.  */
+  gpa_remove_filewatch (cardman->watch);
+  cardman->watch = NULL;
+  if (cardman->ticker_timeout_id)
+    {
+      g_source_remove (cardman->ticker_timeout_id);
+      cardman->ticker_timeout_id = 0;
+    }
 }
 
 
@@ -1015,6 +1123,9 @@ update_card_widget (GpaCardManager *cardman, const char *error_description)
 				"alert-dialog",
 				G_CALLBACK (alert_dialog_cb), cardman);
 
+      gpa_cm_object_set_serialno (GPA_CM_OBJECT (cardman->card_widget),
+                                  cardman->serialno);
+
       /* Fixme: We should use a signal to reload the card widget
          instead of using a class test in each reload fucntion.  */
       gpa_cm_openpgp_reload (cardman->card_widget, cardman->gpgagent);
@@ -1197,7 +1308,6 @@ gpa_card_manager_init (GTypeInstance *instance, void *class_ptr)
 {
   GpaCardManager *cardman = GPA_CARD_MANAGER (instance);
   gpg_error_t err;
-  char *fname;
 
   cardman->cardtype = G_TYPE_NONE;
   cardman->cardtypename = "Unknown";
@@ -1209,12 +1319,12 @@ gpa_card_manager_init (GTypeInstance *instance, void *class_ptr)
                     G_CALLBACK (card_manager_closed), cardman);
 
 
-  /* We use the file watcher to speed up card change detection.  If it
-     does not work (i.e. on non Linux based systems) the ticker takes
-     care of it.  */
-  fname = g_build_filename (gnupg_homedir, "reader_0.status", NULL);
-  cardman->watch = gpa_add_filewatch (fname, "w", watcher_cb, cardman);
-  xfree (fname);
+  /* We use the file watcher to detect card changes.  The directory is
+     watched because scdaemon creates the reader status files only
+     when it starts.  If the watcher does not work (i.e. on non Linux
+     based systems) the ticker takes care of it.  */
+  cardman->watch = gpa_add_filewatch (gnupg_homedir, "wy",
+                                      watcher_cb, cardman);
 
   err = gpgme_new (&cardman->gpgagent);
   if (err)
@@ -1257,8 +1367,19 @@ gpa_card_manager_finalize (GObject *object)
       g_source_remove (cardman->ticker_timeout_id);
       cardman->ticker_timeout_id = 0;
     }
+  if (cardman->ticker_context)
+    {
+      g_signal_handlers_disconnect_by_func (cardman->ticker_context,
+                                            ticker_done_cb, cardman);
+      g_object_unref (cardman->ticker_context);
+      cardman->ticker_context = NULL;
+    }
+  gpa_remove_filewatch (cardman->watch);
+  cardman->watch = NULL;
+  g_free (cardman->serialno);
+  cardman->serialno = NULL;
 
-  /* FIXME: Remove the watch object and all other resources.  */
+  /* FIXME: Remove all other resources.  */
 
   G_OBJECT_CLASS (g_type_class_peek_parent
                   (GPA_CM_OPENPGP_GET_CLASS (cardman)))->finalize (object);
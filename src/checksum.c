@@ -0,0 +1,713 @@
+/* checksum.c - The GNU Privacy Assistant checksum files.
+   Copyright (C) 2026 g10 Code GmbH.
+
+   This file is part of GPA
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Checksum files use the format of sha256sum and sha512sum: each line
+   has the hex encoded digest, two spaces (or a space and an asterisk)
+   and the name of the file relative to the directory of the checksum
+   file.
+
+   All file access is done by a pool of worker threads.  A job starts
+   with a task collecting the files to hash; then each file is hashed
+   by its own task.  The results are passed to the main thread by idle
+   handlers, which call the callbacks of the job.  The job is complete
+   when all collected files have been reported.  */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glib/gstdio.h>
+
+#ifdef G_OS_UNIX
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
+#include "checksum.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+
+/* The size of the buffer used to read the files.  */
+#define READ_BUFFER_SIZE (256 * 1024)
+
+/* The names of checksum files.  The first two are used for new
+   files.  */
+static const char *const sumfile_names[] =
+  {
+    "sha256sum.txt",
+    "sha512sum.txt",
+    "SHA256SUMS",
+    "SHA512SUMS",
+    NULL
+  };
+
+
+struct sumfile_s;
+
+/* A file listed in a checksum file.  */
+struct entry_s
+{
+  struct sumfile_s *sumfile;
+  char *name;         /* The name as listed in the checksum file.  */
+  char *expected;     /* The expected digest or NULL.  */
+  gpa_checksum_result_t result;
+  gpg_error_t err;
+  char *digest;       /* The computed digest.  */
+};
+
+
+/* A checksum file.  */
+struct sumfile_s
+{
+  char *filename;
+  char *dirname;
+  GChecksumType type;
+  GPtrArray *entries;
+  gint n_left;        /* The number of entries not yet hashed.  */
+};
+
+
+typedef struct checksum_job_s *checksum_job_t;
+struct checksum_job_s
+{
+  gboolean verify;
+  GChecksumType type;
+  char **files;
+  gpa_checksum_file_cb_t file_cb;
+  gpa_checksum_done_cb_t done_cb;
+  void *opaque;
+
+  /* The checksum files.  Only changed by the collecting task.  */
+  GPtrArray *sumfiles;
+
+  /* The following fields are only used by the main thread.  */
+  gboolean collected;
+  guint n_entries;
+  guint n_reported;
+  gpg_error_t err;
+};
+
+
+/* A task for the pool: collect the files of JOB if ENTRY is NULL or
+   hash ENTRY.  */
+struct task_s
+{
+  checksum_job_t job;
+  struct entry_s *entry;
+};
+
+
+/* A message from a task to the main thread.  Either ENTRY has been
+   hashed, FILENAME could not be processed or, if COLLECTED is set,
+   all N_ENTRIES files of the job have been collected.  */
+struct event_s
+{
+  checksum_job_t job;
+  struct entry_s *entry;
+  char *filename;
+  gpg_error_t err;
+  gboolean collected;
+  guint n_entries;
+};
+
+
+/* The pool of worker threads.  */
+static GThreadPool *pool;
+
+
+
+static gboolean
+is_sumfile_name (const char *name)
+{
+  int i;
+
+  for (i = 0; sumfile_names[i]; i++)
+    if (!strcmp (name, sumfile_names[i]))
+      return TRUE;
+  return FALSE;
+}
+
+
+/* Return the name of the file ENTRY.  */
+static char *
+entry_path (struct entry_s *entry)
+{
+  if (g_path_is_absolute (entry->name))
+    return g_strdup (entry->name);
+  return g_build_filename (entry->sumfile->dirname, entry->name, NULL);
+}
+
+
+static void
+free_entry (gpointer data)
+{
+  struct entry_s *entry = data;
+
+  g_free (entry->name);
+  g_free (entry->expected);
+  g_free (entry->digest);
+  g_free (entry);
+}
+
+
+static void
+free_sumfile (gpointer data)
+{
+  struct sumfile_s *sumfile = data;
+
+  g_free (sumfile->filename);
+  g_free (sumfile->dirname);
+  g_ptr_array_free (sumfile->entries, TRUE);
+  g_free (sumfile);
+}
+
+
+static void
+release_job (checksum_job_t job)
+{
+  g_strfreev (job->files);
+  g_ptr_array_free (job->sumfiles, TRUE);
+  g_free (job);
+}
+
+
+static struct sumfile_s *
+new_sumfile (checksum_job_t job, const char *filename, GChecksumType type)
+{
+  struct sumfile_s *sumfile = g_new0 (struct sumfile_s, 1);
+
+  sumfile->filename = g_strdup (filename);
+  sumfile->dirname = g_path_get_dirname (filename);
+  sumfile->type = type;
+  sumfile->entries = g_ptr_array_new_with_free_func (free_entry);
+  g_ptr_array_add (job->sumfiles, sumfile);
+
+  return sumfile;
+}
+
+
+static void
+add_entry (struct sumfile_s *sumfile, const char *name, const char *expected)
+{
+  struct entry_s *entry = g_new0 (struct entry_s, 1);
+
+  entry->sumfile = sumfile;
+  entry->name = g_strdup (name);
+  entry->expected = g_strdup (expected);
+  g_ptr_array_add (sumfile->entries, entry);
+}
+
+
+static gint
+compare_entries (gconstpointer a, gconstpointer b)
+{
+  const struct entry_s *entry_a = *(struct entry_s **) a;
+  const struct entry_s *entry_b = *(struct entry_s **) b;
+
+  return strcmp (entry_a->name, entry_b->name);
+}
+
+
+
+/* This function is called by the main event loop to pass a message
+   from a task to the callbacks of the job.  */
+static gboolean
+event_cb (void *data)
+{
+  struct event_s *event = data;
+  checksum_job_t job = event->job;
+
+  if (event->collected)
+    {
+      job->collected = TRUE;
+      job->n_entries = event->n_entries;
+    }
+  else
+    {
+      gpa_checksum_result_t result;
+      gpg_error_t err;
+      char *filename;
+
+      if (event->entry)
+        {
+          result = event->entry->result;
+          err = event->entry->err;
+          filename = entry_path (event->entry);
+          job->n_reported++;
+        }
+      else
+        {
+          result = GPA_CHECKSUM_ERROR;
+          err = event->err;
+          filename = g_strdup (event->filename);
+        }
+
+      if (!job->err && result == GPA_CHECKSUM_BAD)
+        job->err = gpg_error (GPG_ERR_CHECKSUM);
+      else if (!job->err && result == GPA_CHECKSUM_ERROR)
+        job->err = err;
+
+      if (job->file_cb)
+        job->file_cb (job->opaque, filename, result, err);
+      g_free (filename);
+    }
+
+  if (job->collected && job->n_reported == job->n_entries)
+    {
+      if (job->done_cb)
+        job->done_cb (job->opaque, job->err);
+      release_job (job);
+    }
+
+  g_free (event->filename);
+  g_free (event);
+  return FALSE;
+}
+
+
+static void
+post_event (checksum_job_t job, struct entry_s *entry,
+            const char *filename, gpg_error_t err)
+{
+  struct event_s *event = g_new0 (struct event_s, 1);
+
+  event->job = job;
+  event->entry = entry;
+  event->filename = g_strdup (filename);
+  event->err = err;
+  g_idle_add (event_cb, event);
+}
+
+
+
+/* Add all files below the directory PATH to SUMFILE.  PREFIX is the
+   name of PATH relative to the directory of SUMFILE or NULL.  */
+static void
+collect_directory (checksum_job_t job, struct sumfile_s *sumfile,
+                   const char *path, const char *prefix)
+{
+  GDir *dir;
+  const char *name;
+  char *child, *relname;
+
+  dir = g_dir_open (path, 0, NULL);
+  if (!dir)
+    {
+      post_event (job, NULL, path, gpg_error (GPG_ERR_EIO));
+      return;
+    }
+
+  while ((name = g_dir_read_name (dir)))
+    {
+      if (!prefix && is_sumfile_name (name))
+        continue;
+
+      child = g_build_filename (path, name, NULL);
+      relname = prefix? g_strconcat (prefix, "/", name, NULL) : g_strdup (name);
+      if (g_file_test (child, G_FILE_TEST_IS_DIR))
+        {
+          /* Do not follow links to directories to avoid loops.  */
+          if (!g_file_test (child, G_FILE_TEST_IS_SYMLINK))
+            collect_directory (job, sumfile, child, relname);
+        }
+      else if (g_file_test (child, G_FILE_TEST_IS_REGULAR))
+        add_entry (sumfile, relname, NULL);
+      g_free (relname);
+      g_free (child);
+    }
+  g_dir_close (dir);
+}
+
+
+/* Add the file or directory FILENAME to the checksum files of JOB.
+   DIRS maps directory names to their checksum file.  */
+static void
+collect_create (checksum_job_t job, GHashTable *dirs, const char *filename)
+{
+  const char *sumname;
+  struct sumfile_s *sumfile;
+  char *dirname, *basename, *fname;
+
+  if (g_file_test (filename, G_FILE_TEST_IS_DIR))
+    {
+      dirname = g_strdup (filename);
+      basename = NULL;
+    }
+  else if (g_file_test (filename, G_FILE_TEST_IS_REGULAR))
+    {
+      dirname = g_path_get_dirname (filename);
+      basename = g_path_get_basename (filename);
+    }
+  else
+    {
+      post_event (job, NULL, filename, gpg_error (GPG_ERR_ENOENT));
+      return;
+    }
+
+  sumfile = g_hash_table_lookup (dirs, dirname);
+  if (!sumfile)
+    {
+      sumname = job->type == G_CHECKSUM_SHA512? "sha512sum.txt"
+        /* */                                : "sha256sum.txt";
+      fname = g_build_filename (dirname, sumname, NULL);
+      sumfile = new_sumfile (job, fname, job->type);
+      g_free (fname);
+      g_hash_table_insert (dirs, sumfile->dirname, sumfile);
+    }
+
+  if (basename)
+    add_entry (sumfile, basename, NULL);
+  else
+    collect_directory (job, sumfile, dirname, NULL);
+
+  g_free (basename);
+  g_free (dirname);
+}
+
+
+/* Read the checksum file FILENAME into JOB.  */
+static void
+collect_verify_file (checksum_job_t job, const char *filename)
+{
+  struct sumfile_s *sumfile = NULL;
+  gchar *buffer, *line, *next;
+  gsize length;
+  size_t n;
+  int bad_lines = 0;
+
+  if (!g_file_get_contents (filename, &buffer, &length, NULL))
+    {
+      post_event (job, NULL, filename, gpg_error (GPG_ERR_EIO));
+      return;
+    }
+
+  for (line = buffer; line && *line; line = next)
+    {
+      next = strchr (line, '\n');
+      if (next)
+        *next++ = 0;
+      n = strlen (line);
+      if (n && line[n-1] == '\r')
+        line[--n] = 0;
+      if (!n || *line == '#')
+        continue;
+
+      for (n = 0; g_ascii_isxdigit (line[n]); n++)
+        ;
+      if ((n != 64 && n != 128)
+          || line[n] != ' ' || (line[n+1] != ' ' && line[n+1] != '*')
+          || !line[n+2]
+          || (sumfile && sumfile->type != (n == 64? G_CHECKSUM_SHA256
+                                           /* */  : G_CHECKSUM_SHA512)))
+        {
+          bad_lines++;
+          continue;
+        }
+      line[n] = 0;
+
+      if (!sumfile)
+        sumfile = new_sumfile (job, filename,
+                               n == 64? G_CHECKSUM_SHA256 : G_CHECKSUM_SHA512);
+      add_entry (sumfile, line + n + 2, line);
+    }
+  g_free (buffer);
+
+  if (bad_lines || !sumfile)
+    post_event (job, NULL, filename, gpg_error (GPG_ERR_INV_DATA));
+}
+
+
+/* Read the checksum file FILENAME or the checksum file in the
+   directory FILENAME into JOB.  */
+static void
+collect_verify (checksum_job_t job, const char *filename)
+{
+  char *fname;
+  int i;
+
+  if (!g_file_test (filename, G_FILE_TEST_IS_DIR))
+    {
+      collect_verify_file (job, filename);
+      return;
+    }
+
+  for (i = 0; sumfile_names[i]; i++)
+    {
+      fname = g_build_filename (filename, sumfile_names[i], NULL);
+      if (g_file_test (fname, G_FILE_TEST_IS_REGULAR))
+        {
+          collect_verify_file (job, fname);
+          g_free (fname);
+          return;
+        }
+      g_free (fname);
+    }
+  post_event (job, NULL, filename, gpg_error (GPG_ERR_ENOENT));
+}
+
+
+/* Collect the files of JOB and queue a task for each of them.  */
+static void
+collect_job (checksum_job_t job)
+{
+  GHashTable *dirs;
+  struct sumfile_s *sumfile;
+  struct task_s *task;
+  struct event_s *event;
+  guint i, j, n_entries = 0;
+
+  dirs = g_hash_table_new (g_str_hash, g_str_equal);
+  for (i = 0; job->files[i]; i++)
+    if (job->verify)
+      collect_verify (job, job->files[i]);
+    else
+      collect_create (job, dirs, job->files[i]);
+  g_hash_table_destroy (dirs);
+
+  /* All counters need to be set before the first task runs.  */
+  for (i = 0; i < job->sumfiles->len; i++)
+    {
+      sumfile = g_ptr_array_index (job->sumfiles, i);
+      if (!job->verify)
+        g_ptr_array_sort (sumfile->entries, compare_entries);
+      sumfile->n_left = sumfile->entries->len;
+      n_entries += sumfile->entries->len;
+    }
+
+  for (i = 0; i < job->sumfiles->len; i++)
+    {
+      sumfile = g_ptr_array_index (job->sumfiles, i);
+      for (j = 0; j < sumfile->entries->len; j++)
+        {
+          task = g_new (struct task_s, 1);
+          task->job = job;
+          task->entry = g_ptr_array_index (sumfile->entries, j);
+          g_thread_pool_push (pool, task, NULL);
+        }
+    }
+
+  event = g_new0 (struct event_s, 1);
+  event->job = job;
+  event->collected = TRUE;
+  event->n_entries = n_entries;
+  g_idle_add (event_cb, event);
+}
+
+
+
+/* Compute the digest of ENTRY.  */
+static void
+hash_entry (struct entry_s *entry)
+{
+  GChecksum *checksum;
+  char *fname, *buffer;
+  gssize nread;
+  int fd;
+
+  fname = entry_path (entry);
+  fd = g_open (fname, O_RDONLY | O_BINARY, 0);
+  g_free (fname);
+  if (fd == -1)
+    {
+      entry->err = gpg_error_from_syserror ();
+      entry->result = GPA_CHECKSUM_ERROR;
+      return;
+    }
+
+  checksum = g_checksum_new (entry->sumfile->type);
+  buffer = g_malloc (READ_BUFFER_SIZE);
+  do
+    {
+      nread = read (fd, buffer, READ_BUFFER_SIZE);
+      if (nread > 0)
+        g_checksum_update (checksum, (guchar *) buffer, nread);
+    }
+  while (nread > 0 || (nread == -1 && errno == EINTR));
+
+  if (nread == -1)
+    {
+      entry->err = gpg_error_from_syserror ();
+      entry->result = GPA_CHECKSUM_ERROR;
+    }
+  else
+    {
+      entry->digest = g_strdup (g_checksum_get_string (checksum));
+      if (entry->expected && g_ascii_strcasecmp (entry->expected,
+                                                 entry->digest))
+        entry->result = GPA_CHECKSUM_BAD;
+      else
+        entry->result = GPA_CHECKSUM_OK;
+    }
+
+  g_free (buffer);
+  g_checksum_free (checksum);
+  close (fd);
+}
+
+
+/* Write the checksum file SUMFILE with all successfully hashed
+   entries.  */
+static gpg_error_t
+write_sumfile (struct sumfile_s *sumfile)
+{
+  gpg_error_t err = 0;
+  struct entry_s *entry;
+  char *tmpname;
+  FILE *fp;
+  guint i;
+
+  tmpname = g_strconcat (sumfile->filename, ".tmp", NULL);
+  fp = g_fopen (tmpname, "wb");
+  if (!fp)
+    {
+      err = gpg_error_from_syserror ();
+      g_free (tmpname);
+      return err;
+    }
+
+  for (i = 0; i < sumfile->entries->len; i++)
+    {
+      entry = g_ptr_array_index (sumfile->entries, i);
+      if (entry->digest)
+        fprintf (fp, "%s  %s\n", entry->digest, entry->name);
+    }
+
+  if (ferror (fp))
+    {
+      err = gpg_error_from_syserror ();
+      fclose (fp);
+    }
+  else if (fclose (fp))
+    err = gpg_error_from_syserror ();
+#ifdef G_OS_WIN32
+  /* Windows does not allow renaming over an existing file.  */
+  if (!err)
+    g_remove (sumfile->filename);
+#endif
+  if (!err && g_rename (tmpname, sumfile->filename))
+    err = gpg_error_from_syserror ();
+  if (err)
+    g_remove (tmpname);
+
+  g_free (tmpname);
+  return err;
+}
+
+
+/* The function run by the worker threads.  */
+static void
+task_func (gpointer data, gpointer user_data)
+{
+  struct task_s *task = data;
+  struct entry_s *entry = task->entry;
+  gpg_error_t err;
+
+  (void)user_data;
+
+  if (!entry)
+    collect_job (task->job);
+  else
+    {
+      hash_entry (entry);
+      /* The last task of a new checksum file writes it.  Its failure
+         needs to be reported before the entry completes the job.  */
+      if (g_atomic_int_dec_and_test (&entry->sumfile->n_left)
+          && !task->job->verify)
+        {
+          err = write_sumfile (entry->sumfile);
+          if (err)
+            post_event (task->job, NULL, entry->sumfile->filename, err);
+        }
+      post_event (task->job, entry, NULL, 0);
+    }
+  g_free (task);
+}
+
+
+static void
+start_job (checksum_job_t job)
+{
+  struct task_s *task;
+
+  if (!pool)
+    pool = g_thread_pool_new (task_func, NULL, g_get_num_processors (),
+                              FALSE, NULL);
+
+  task = g_new (struct task_s, 1);
+  task->job = job;
+  task->entry = NULL;
+  g_thread_pool_push (pool, task, NULL);
+}
+
+
+static checksum_job_t
+new_job (const char *const *files, gpa_checksum_file_cb_t file_cb,
+         gpa_checksum_done_cb_t done_cb, void *opaque)
+{
+  checksum_job_t job = g_new0 (struct checksum_job_s, 1);
+
+  job->files = g_strdupv ((char **) files);
+  job->file_cb = file_cb;
+  job->done_cb = done_cb;
+  job->opaque = opaque;
+  job->sumfiles = g_ptr_array_new_with_free_func (free_sumfile);
+
+  return job;
+}
+
+
+
+/* Create checksum files in the sha256sum or sha512sum format for the
+   files and directories in the NULL terminated array FILES.  The
+   checksum file of a directory lists all files below it; listed files
+   go into the checksum file of their directory.  The files are hashed
+   in the background; FILE_CB is called for each of them and DONE_CB
+   at the end.  */
+void
+gpa_checksum_create (const char *const *files, GChecksumType type,
+                     gpa_checksum_file_cb_t file_cb,
+                     gpa_checksum_done_cb_t done_cb, void *opaque)
+{
+  checksum_job_t job = new_job (files, file_cb, done_cb, opaque);
+
+  job->type = type == G_CHECKSUM_SHA512? G_CHECKSUM_SHA512 : G_CHECKSUM_SHA256;
+  start_job (job);
+}
+
+
+/* Verify the checksum files in the NULL terminated array FILES.  A
+   directory stands for the checksum file in it.  The files are hashed
+   in the background; FILE_CB is called for each of them and DONE_CB
+   at the end.  */
+void
+gpa_checksum_verify (const char *const *files,
+                     gpa_checksum_file_cb_t file_cb,
+                     gpa_checksum_done_cb_t done_cb, void *opaque)
+{
+  checksum_job_t job = new_job (files, file_cb, done_cb, opaque);
+
+  job->verify = TRUE;
+  start_job (job);
+}
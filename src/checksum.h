@@ -0,0 +1,56 @@
+/* checksum.h - The GNU Privacy Assistant checksum files.
+   Copyright (C) 2026 g10 Code GmbH.
+
+   This file is part of GPA
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <glib.h>
+#include <gpgme.h>
+
+/* The result for a single file.  */
+typedef enum
+  {
+    GPA_CHECKSUM_OK,      /* The checksum has been created or matches.  */
+    GPA_CHECKSUM_BAD,     /* The checksum does not match.  */
+    GPA_CHECKSUM_ERROR    /* The file could not be processed.  */
+  }
+gpa_checksum_result_t;
+
+/* Called in the main thread for each processed file.  ERR describes
+   the problem if RESULT is GPA_CHECKSUM_ERROR.  */
+typedef void (*gpa_checksum_file_cb_t) (void *opaque, const char *filename,
+                                        gpa_checksum_result_t result,
+                                        gpg_error_t err);
+
+/* Called in the main thread after all files have been processed.  ERR
+   is the error of the first failed file or 0.  */
+typedef void (*gpa_checksum_done_cb_t) (void *opaque, gpg_error_t err);
+
+/* Create checksum files in the sha256sum or sha512sum format for the
+   files and directories in the NULL terminated array FILES.  */
+void gpa_checksum_create (const char *const *files, GChecksumType type,
+                          gpa_checksum_file_cb_t file_cb,
+                          gpa_checksum_done_cb_t done_cb, void *opaque);
+
+/* Verify the checksum files in the NULL terminated array FILES.  */
+void gpa_checksum_verify (const char *const *files,
+                          gpa_checksum_file_cb_t file_cb,
+                          gpa_checksum_done_cb_t done_cb, void *opaque);
+
+#endif /* CHECKSUM_H */
@@ -82,6 +82,9 @@ struct _GpaClipboard
   GList *selection_sensitive_actions;
   GList *paste_sensitive_actions;
   gboolean paste_p;
+
+  /* The number of operations running on the text.  */
+  int busy;
 };
 
 struct _GpaClipboardClass
@@ -271,6 +274,23 @@ file_created_cb (GpaFileOperation *op, gpa_file_item_t item, gpointer data)
   gboolean suc;
   const gchar *end;
 
+  if (item->direct_text)
+    {
+      gssize pos = gpa_text_data_commit (item->direct_text);
+
+      if (pos != -1)
+        {
+          gchar *str;
+
+          str = g_strdup_printf ("No valid UTF-8 encoding at position %i.\n"
+                                 "Assuming Latin-1 encoding instead.",
+                                 (int) pos);
+          gpa_window_message (str, GTK_WIDGET (clipboard));
+          g_free (str);
+        }
+      return;
+    }
+
   suc = g_utf8_validate (item->direct_out, item->direct_out_len, &end);
   if (! suc)
     {
@@ -302,12 +322,75 @@ file_created_cb (GpaFileOperation *op, gpa_file_item_t item, gpointer data)
 }
 
 
+/* Release the text data of ITEM and make the text editable again
+   once no operation is using it.  */
+static void
+release_text_item (GpaClipboard *clipboard, gpa_file_item_t item)
+{
+  if (!item->direct_text)
+    return;
+
+  gpa_text_data_release (item->direct_text);
+  item->direct_text = NULL;
+  if (!--clipboard->busy)
+    gtk_text_view_set_editable (GTK_TEXT_VIEW (clipboard->text_view), TRUE);
+}
+
+
+/* The operation on the text is finished.  */
+static void
+file_done_cb (GpaFileOperation *op, gpa_file_item_t item, gpointer data)
+{
+  release_text_item (data, item);
+}
+
+
+/* The operation ended, possibly without processing the text.  */
+static void
+operation_completed_cb (GpaFileOperation *op, gpg_error_t err,
+                        gpointer data)
+{
+  GList *cur;
+
+  for (cur = op->input_files; cur; cur = cur->next)
+    release_text_item (data, cur->data);
+}
+
+
+/* Return a list with an item for the text of CLIPBOARD.  The text is
+   not copied; it is read by the operation in place.  Returns NULL if
+   another operation is still using the text.  */
+static GList *
+text_item_list (GpaClipboard *clipboard, gboolean include_hidden)
+{
+  gpa_file_item_t file_item;
+
+  if (clipboard->busy)
+    return NULL;
+
+  file_item = g_malloc0 (sizeof (*file_item));
+  file_item->direct_name = g_strdup (_("Clipboard"));
+  file_item->direct_text = gpa_text_data_new (clipboard->text_buffer,
+                                              include_hidden);
+
+  /* The text must not change while the operation reads it.  */
+  clipboard->busy++;
+  gtk_text_view_set_editable (GTK_TEXT_VIEW (clipboard->text_view), FALSE);
+
+  return g_list_append (NULL, file_item);
+}
+
+
 /* Do whatever is required with a file operation, to ensure proper clean up */
 static void
 register_operation (GpaClipboard *clipboard, GpaFileOperation *op)
 {
   g_signal_connect (G_OBJECT (op), "created_file",
 		    G_CALLBACK (file_created_cb), clipboard);
+  g_signal_connect (G_OBJECT (op), "file_done",
+		    G_CALLBACK (file_done_cb), clipboard);
+  g_signal_connect (G_OBJECT (op), "completed",
+		    G_CALLBACK (operation_completed_cb), clipboard);
   g_signal_connect (G_OBJECT (op), "completed",
 		    G_CALLBACK (g_object_unref), NULL);
 }
@@ -323,6 +406,8 @@ file_clear (GSimpleAction *simple, GVariant *parameter, gpointer param)
 {
   GpaClipboard *clipboard = param;
 
+  if (clipboard->busy)
+    return;
   gtk_text_buffer_set_text (clipboard->text_buffer, "", -1);
 }
 
@@ -387,6 +472,9 @@ file_open (GSimpleAction *simple, GVariant *parameter, gpointer param)
   GError *err = NULL;
   const gchar *end;
 
+  if (clipboard->busy)
+    return;
+
   filename = get_load_file_name (GTK_WIDGET (clipboard), _("Open File"));
   if (! filename)
     return;
@@ -584,22 +672,11 @@ file_verify (GSimpleAction *simple, GVariant *parameter, gpointer param)
 {
   GpaClipboard *clipboard = (GpaClipboard *) param;
   GpaFileVerifyOperation *op;
-  GList *files = NULL;
-  gpa_file_item_t file_item;
-  GtkTextIter begin;
-  GtkTextIter end;
-
-  gtk_text_buffer_get_bounds (clipboard->text_buffer, &begin, &end);
-
-  file_item = g_malloc0 (sizeof (*file_item));
-  file_item->direct_name = g_strdup (_("Clipboard"));
-  file_item->direct_in
-    = gtk_text_buffer_get_slice (clipboard->text_buffer, &begin, &end, TRUE);
-  /* FIXME: One would think there exists a function to get the number
-     of bytes between two GtkTextIter, but no, that's too obvious.  */
-  file_item->direct_in_len = strlen (file_item->direct_in);
+  GList *files;
 
-  files = g_list_append (files, file_item);
+  files = text_item_list (clipboard, TRUE);
+  if (!files)
+    return;
 
   /* Start the operation.  */
   op = gpa_file_verify_operation_new (GTK_WIDGET (clipboard), files);
@@ -614,22 +691,11 @@ file_sign (GSimpleAction *simple, GVariant *parameter, gpointer param)
 {
   GpaClipboard *clipboard = (GpaClipboard *) param;
   GpaFileSignOperation *op;
-  GList *files = NULL;
-  gpa_file_item_t file_item;
-  GtkTextIter begin;
-  GtkTextIter end;
-
-  gtk_text_buffer_get_bounds (clipboard->text_buffer, &begin, &end);
-
-  file_item = g_malloc0 (sizeof (*file_item));
-  file_item->direct_name = g_strdup (_("Clipboard"));
-  file_item->direct_in
-    = gtk_text_buffer_get_text (clipboard->text_buffer, &begin, &end, FALSE);
-  /* FIXME: One would think there exists a function to get the number
-     of bytes between two GtkTextIter, but no, that's too obvious.  */
-  file_item->direct_in_len = strlen (file_item->direct_in);
+  GList *files;
 
-  files = g_list_append (files, file_item);
+  files = text_item_list (clipboard, FALSE);
+  if (!files)
+    return;
 
   /* Start the operation.  */
   op = gpa_file_sign_operation_new (GTK_WIDGET (clipboard), files, TRUE);
@@ -644,22 +710,11 @@ file_encrypt (GSimpleAction *simple, GVariant *parameter, gpointer param)
 {
   GpaClipboard *clipboard = (GpaClipboard *) param;
   GpaFileEncryptOperation *op;
-  GList *files = NULL;
-  gpa_file_item_t file_item;
-  GtkTextIter begin;
-  GtkTextIter end;
-
-  gtk_text_buffer_get_bounds (clipboard->text_buffer, &begin, &end);
+  GList *files;
 
-  file_item = g_malloc0 (sizeof (*file_item));
-  file_item->direct_name = g_strdup (_("Clipboard"));
-  file_item->direct_in
-    = gtk_text_buffer_get_text (clipboard->text_buffer, &begin, &end, FALSE);
-  /* FIXME: One would think there exists a function to get the number
-     of bytes between two GtkTextIter, but no, that's too obvious.  */
-  file_item->direct_in_len = strlen (file_item->direct_in);
-
-  files = g_list_append (files, file_item);
+  files = text_item_list (clipboard, FALSE);
+  if (!files)
+    return;
 
   /* Start the operation.  */
   op = gpa_file_encrypt_operation_new (GTK_WIDGET (clipboard), files, TRUE);
@@ -674,22 +729,11 @@ file_decrypt (GSimpleAction *simple, GVariant *parameter, gpointer param)
 {
   GpaClipboard *clipboard = (GpaClipboard *) param;
   GpaFileDecryptOperation *op;
-  GList *files = NULL;
-  gpa_file_item_t file_item;
-  GtkTextIter begin;
-  GtkTextIter end;
-
-  gtk_text_buffer_get_bounds (clipboard->text_buffer, &begin, &end);
+  GList *files;
 
-  file_item = g_malloc0 (sizeof (*file_item));
-  file_item->direct_name = g_strdup (_("Clipboard"));
-  file_item->direct_in
-    = gtk_text_buffer_get_text (clipboard->text_buffer, &begin, &end, FALSE);
-  /* FIXME: One would think there exists a function to get the number
-     of bytes between two GtkTextIter, but no, that's too obvious.  */
-  file_item->direct_in_len = strlen (file_item->direct_in);
-
-  files = g_list_append (files, file_item);
+  files = text_item_list (clipboard, FALSE);
+  if (!files)
+    return;
 
   /* Start the operation.  */
   op = gpa_file_decrypt_operation_new (GTK_WIDGET (clipboard), files);
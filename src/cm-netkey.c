@@ -43,6 +43,7 @@
 
 #include "cm-object.h"
 #include "cm-netkey.h"
+#include "gpacontext.h"
 
 
 
@@ -74,6 +75,16 @@ struct pininfo_s
 
 
 
+/* A key pair of the card as announced by a KEYPAIRINFO line.  */
+struct keypair_s
+{
+  char *keygrip;        /* The keygrip of the key.  */
+  char *keyid;          /* The key reference on the card.  */
+  gpgme_key_t key;      /* The listed key or NULL if not known.  */
+};
+
+
+
 /* Object's class definition.  */
 struct _GpaCMNetkeyClass
 {
@@ -102,6 +113,13 @@ struct _GpaCMNetkey
 
 
   int  reloading;   /* Sentinel to avoid recursive reloads.  */
+  int  reload_pending;  /* Reload again after the current reload.  */
+
+  GpaContext *keylist_ctx;  /* Context to list the keys of the card.  */
+  GPtrArray *keypairs;      /* The key pairs of the card.  */
+  int listing;              /* The keys are being listed.  */
+  int learn_failed;         /* The LEARN command of the reload failed.  */
+  int any_unknown;          /* At least one key is not known.  */
 
 };
 
@@ -248,306 +266,386 @@ update_entry_chv_status (GpaCMNetkey *card, int entry_id, char *string)
 }
 
 
-/* Structure form comminucation between reload_more_data and
-   reload_more_data_cb.  */
-struct reload_more_data_parm
+/* The commands run by reload_data.  Keep them in sync with the
+   CMD_ constants.  */
+static const char *const reload_commands[] =
+  {
+    "SCD GETATTR SERIALNO",
+    "SCD GETATTR NKS-VERSION",
+    "SCD GETATTR CHV-STATUS",
+    "SCD LEARN --keypairinfo",
+    NULL
+  };
+enum
+  {
+    CMD_SERIALNO,
+    CMD_NKS_VERSION,
+    CMD_CHV_STATUS,
+    CMD_LEARN
+  };
+
+
+static void reload_data (GpaCMNetkey *card);
+
+
+/* Replace the content of the keys frame by an empty vbox.  */
+static void
+reset_keys_frame (GpaCMNetkey *card)
 {
-  GpaCMNetkey *card; /* self  */
-  gpgme_ctx_t ctx;   /* A prepared context for relaod_more_data_cb.  */
-  int any_unknown;   /* Set if at least one key is not known.  */
-};
+  GtkWidget *vbox;
+
+  vbox = gtk_bin_get_child (GTK_BIN (card->keys_frame));
+  if (vbox)
+    gtk_widget_destroy (vbox);
+  vbox = gtk_box_new (GTK_ORIENTATION_VERTICAL, 5);
+  gtk_container_add (GTK_CONTAINER (card->keys_frame), vbox);
+  gtk_widget_show (vbox);
+  g_ptr_array_set_size (card->keypairs, 0);
+  card->any_unknown = 0;
+}
 
 
-/* Helper for relaod_more_data.  This is actually an Assuan status
-   callback  */
-static gpg_error_t
-reload_more_data_cb (void *opaque, const char *status, const char *args)
+/* Release the key pair KP.  */
+static void
+release_keypair (void *kp_arg)
+{
+  struct keypair_s *kp = kp_arg;
+
+  g_free (kp->keygrip);
+  g_free (kp->keyid);
+  if (kp->key)
+    gpgme_key_unref (kp->key);
+  g_free (kp);
+}
+
+
+/* Remember the key described by the KEYPAIRINFO status line ARGS.
+   The keys are listed after the load has finished.  */
+static void
+add_keypair (GpaCMNetkey *card, const char *args)
 {
-  struct reload_more_data_parm *parm = opaque;
-  gpgme_key_t key = NULL;
+  struct keypair_s *kp;
   const char *s;
-  char pattern[100];
-  int idx;
-  gpg_error_t err;
-  const char *keyid;
-  int any = 0;
-
-  g_debug ("  reload_more_data (%s=%s)", status, args);
-  if (strcmp (status, "KEYPAIRINFO") )
-    return 0;
-
-  g_debug ("   start search");
-  idx = 0;
-  pattern[idx++] = '&';
-  for (s=args; hexdigitp (s) && idx < sizeof pattern - 1; s++)
-    pattern[idx++] = *s;
-  pattern[idx] = 0;
+
+  for (s=args; hexdigitp (s); s++)
+    ;
   if (!spacep (s) || (s - args != 40))
-    return 0;  /* Invalid formatted keygrip.  */
+    return;  /* Invalid formatted keygrip.  */
+
+  kp = g_new0 (struct keypair_s, 1);
+  kp->keygrip = g_strndup (args, 40);
   while (spacep (s))
     s++;
-  keyid = s;
+  kp->keyid = g_strdup (s);
+  g_ptr_array_add (card->keypairs, kp);
+}
 
-  if (!(err=gpgme_op_keylist_start (parm->ctx, pattern, 0)))
+
+/* Add a row for the key pair KP to the keys frame.  */
+static void
+add_keypair_row (GpaCMNetkey *card, struct keypair_s *kp)
+{
+  GtkWidget *vbox, *expander, *details, *hbox, *label;
+
+  vbox = gtk_bin_get_child (GTK_BIN (card->keys_frame));
+  if (!vbox)
     {
-      if (!(err=gpgme_op_keylist_next (parm->ctx, &key)))
-        {
-          GtkWidget *vbox, *expander, *details, *hbox, *label;
-
-          vbox = gtk_bin_get_child (GTK_BIN (parm->card->keys_frame));
-          if (!vbox)
-            g_debug ("Ooops, vbox missing in key frame");
-          else
-            {
-              expander = gtk_expander_new (keyid);
-              details = gpa_key_details_new ();
-              gtk_container_add (GTK_CONTAINER (expander), details);
-              gpa_key_details_update (details, key, 1);
-
-              hbox = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 0);
-              label = gtk_label_new (NULL);
-              gtk_label_set_width_chars  (GTK_LABEL (label), 22);
-              gtk_widget_set_halign (GTK_WIDGET (label), 0);
-              gtk_widget_set_valign (GTK_WIDGET (label), 0);
-              gtk_box_pack_start (GTK_BOX (hbox), label, FALSE, FALSE, 0);
-              gtk_box_pack_start (GTK_BOX (hbox), expander, TRUE, TRUE, 0);
-              gtk_box_pack_start (GTK_BOX (vbox), hbox, FALSE, FALSE, 0);
-
-              any = 1;
-            }
-          gpgme_key_unref (key);
-        }
+      g_debug ("Ooops, vbox missing in key frame");
+      return;
     }
-  gpgme_op_keylist_end (parm->ctx);
-  if (!any)
-    parm->any_unknown = 1;
-  g_debug ("   ready");
-  return 0;
+
+  expander = gtk_expander_new (kp->keyid);
+  details = gpa_key_details_new ();
+  gtk_container_add (GTK_CONTAINER (expander), details);
+  gpa_key_details_update (details, kp->key, 1);
+
+  hbox = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 0);
+  label = gtk_label_new (NULL);
+  gtk_label_set_width_chars  (GTK_LABEL (label), 22);
+  gtk_widget_set_halign (GTK_WIDGET (label), 0);
+  gtk_widget_set_valign (GTK_WIDGET (label), 0);
+  gtk_box_pack_start (GTK_BOX (hbox), label, FALSE, FALSE, 0);
+  gtk_box_pack_start (GTK_BOX (hbox), expander, TRUE, TRUE, 0);
+  gtk_box_pack_start (GTK_BOX (vbox), hbox, FALSE, FALSE, 0);
+  gtk_widget_show_all (hbox);
 }
 
 
-/* Reload more data.  This function is called from the idle handler.  */
+/* Add a button to learn the keys of the card.  */
 static void
-reload_more_data (GpaCMNetkey *card)
+add_learn_button (GpaCMNetkey *card)
 {
-  gpg_error_t err, operr;
-  gpgme_ctx_t gpgagent;
-  GtkWidget *vbox;
-  struct reload_more_data_parm parm;
-
-  g_debug ("start reload_more_data (count=%d)", card->reloading);
-  gpgagent = GPA_CM_OBJECT (card)->agent_ctx;
-  g_return_if_fail (gpgagent);
-  g_return_if_fail (card->keys_frame);
-  g_debug ("  gpgagent=%p", gpgagent);
+  GtkWidget *vbox, *button;
 
-  /* We remove any existing children of the keys frame and then we add
-     a new vbox to be filled with new widgets by the callback.  */
   vbox = gtk_bin_get_child (GTK_BIN (card->keys_frame));
-  if (vbox)
-    gtk_widget_destroy (vbox);
-  vbox = gtk_box_new (GTK_ORIENTATION_VERTICAL, 5);
-  gtk_container_add (GTK_CONTAINER (card->keys_frame), vbox);
+  g_return_if_fail (vbox);
 
-  /* Create a context for key listings.  */
-  parm.any_unknown = 0;
-  parm.card = card;
-  err = gpgme_new (&parm.ctx);
-  if (err)
+  button = gtk_button_new_with_label (_("Learn keys"));
+
+  gtk_widget_set_halign (GTK_WIDGET (button), 0.5);
+  gtk_widget_set_valign (GTK_WIDGET (button), 0);
+
+  gpa_add_tooltip
+    (button, _("For some or all of the keys available on the card, "
+               "the GnuPG crypto engine does not yet know the "
+               "corresponding certificates.\n"
+               "\n"
+               "If you click this button, GnuPG will be asked to "
+               "\"learn\" "
+               "this card and import all certificates stored on the "
+               "card into its own certificate store.  This is not done "
+               "automatically because it may take several seconds to "
+               "read all certificates from the card.\n"
+               "\n"
+               "If you are unsure what to do, just click the button."));
+  gtk_box_pack_start (GTK_BOX (vbox), button, FALSE, FALSE, 5);
+  gtk_box_reorder_child (GTK_BOX (vbox), button, 0);
+
+  g_signal_connect (G_OBJECT (button), "clicked",
+                    G_CALLBACK (learn_keys_clicked_cb), card);
+}
+
+
+/* Status callback for the data loaded by reload_data.  */
+static void
+reload_status_cb (GpaCMObject *obj, const char *status, const char *args)
+{
+  GpaCMNetkey *card = GPA_CM_NETKEY (obj);
+  int entry_id;
+  char *tmp;
+
+  if (!status)
     {
-      /* We don't want an error window because we are run from an idle
-         handler and the information is not that important.  */
-      g_debug ("failed to create a context: %s", gpg_strerror (err));
+      /* The cached data was outdated.  */
+      clear_card_data (card);
+      reset_keys_frame (card);
       return;
     }
-  gpgme_set_protocol (parm.ctx, GPGME_PROTOCOL_CMS);
-  /* We include ephemeral keys in the listing.  */
-  gpgme_set_keylist_mode (parm.ctx, GPGME_KEYLIST_MODE_EPHEMERAL);
 
-  g_debug ("  parm.ctx=%p", parm.ctx);
+  if (!strcmp (status, "KEYPAIRINFO"))
+    {
+      add_keypair (card, args);
+      return;
+    }
+  else if (!strcmp (status, "SERIALNO"))
+    entry_id = ENTRY_SERIALNO;
+  else if (!strcmp (status, "NKS-VERSION"))
+    entry_id = ENTRY_NKS_VERSION;
+  else if (!strcmp (status, "CHV-STATUS"))
+    entry_id = ENTRY_PIN_RETRYCOUNTER;
+  else
+    return;
 
-  err = gpgme_op_assuan_transact_ext (gpgagent,
-                                      "SCD LEARN --keypairinfo",
-                                      NULL, NULL, NULL, NULL,
-                                      reload_more_data_cb, &parm, &operr);
-  g_debug ("  assuan ret=%d", err);
-  if (!err)
-    err = operr;
+  tmp = xstrdup (args);
+  percent_unescape (tmp, 1);
+  if (entry_id == ENTRY_PIN_RETRYCOUNTER)
+    update_entry_chv_status (card, entry_id, tmp);
+  else
+    gtk_label_set_text (GTK_LABEL (card->entries[entry_id]), tmp);
+  xfree (tmp);
+}
 
-  if (err)
-    g_debug ("SCD LEARN failed: %s", gpg_strerror (err));
 
-  if (parm.any_unknown)
+/* The reload including the listing of the keys has finished.  */
+static void
+finish_reload (GpaCMNetkey *card)
+{
+  if (card->any_unknown && !card->learn_failed)
+    add_learn_button (card);
+  gtk_widget_show_all (card->keys_frame);
+
+  card->reloading--;
+
+  if (card->reload_pending)
     {
-      GtkWidget *button;
-
-      button = gtk_button_new_with_label (_("Learn keys"));
-
-      gtk_widget_set_halign (GTK_WIDGET (button), 0.5);
-      gtk_widget_set_valign (GTK_WIDGET (button), 0);
-
-      gpa_add_tooltip
-        (button, _("For some or all of the keys available on the card, "
-                   "the GnuPG crypto engine does not yet know the "
-                   "corresponding certificates.\n"
-                   "\n"
-                   "If you click this button, GnuPG will be asked to "
-                   "\"learn\" "
-                   "this card and import all certificates stored on the "
-                   "card into its own certificate store.  This is not done "
-                   "automatically because it may take several seconds to "
-                   "read all certificates from the card.\n"
-                   "\n"
-                   "If you are unsure what to do, just click the button."));
-      gtk_box_pack_start (GTK_BOX (vbox), button, FALSE, FALSE, 5);
-      gtk_box_reorder_child (GTK_BOX (vbox), button, 0);
-
-      g_signal_connect (G_OBJECT (button), "clicked",
-                        G_CALLBACK (learn_keys_clicked_cb), card);
+      card->reload_pending = 0;
+      reload_data (card);
     }
-
-  gpgme_release (parm.ctx);
-  gtk_widget_show_all (card->keys_frame);
-  g_debug ("end   reload_more_data (count=%d)", card->reloading);
-  return;
 }
 
 
-/* Idle queue callback to reload more data.  */
-static gboolean
-reload_more_data_idle_cb (void *user_data)
+/* Signal handler for the keys listed by list_keypairs.  */
+static void
+keylist_next_key_cb (GpaContext *context, gpgme_key_t key, void *user_data)
 {
   GpaCMNetkey *card = user_data;
+  gpgme_subkey_t subkey;
+  unsigned int i;
 
-  if (card->reloading)
+  for (i = 0; i < card->keypairs->len; i++)
     {
-      g_debug ("already reloading (count=%d)", card->reloading);
-    return TRUE; /* Just in case we are still reloading, wait for the
-                    next idle slot.  */
-    }
-
-  card->reloading++;
-  reload_more_data (card);
-  g_object_unref (card);
-  card->reloading--;
+      struct keypair_s *kp = g_ptr_array_index (card->keypairs, i);
 
-  return FALSE;  /* Remove us from the idle queue.  */
+      if (kp->key)
+        continue;
+      for (subkey = key->subkeys; subkey; subkey = subkey->next)
+        if (subkey->keygrip
+            && !g_ascii_strcasecmp (subkey->keygrip, kp->keygrip))
+          break;
+      if (subkey)
+        {
+          gpgme_key_ref (key);
+          kp->key = key;
+        }
+    }
+  gpgme_key_unref (key);
 }
 
 
-struct scd_getattr_parm
+/* Signal handler for the end of the listing started by
+   list_keypairs.  */
+static void
+keylist_done_cb (GpaContext *context, gpg_error_t err, void *user_data)
 {
-  GpaCMNetkey *card;  /* The object.  */
-  const char *name;   /* Name of expected attribute.  */
-  int entry_id;       /* The identifier for the entry.  */
-  void (*updfnc) (GpaCMNetkey *card, int entry_id, char *string);
-};
+  GpaCMNetkey *card = user_data;
+  unsigned int i;
+
+  if (!card->listing)
+    return;
+  card->listing = 0;
+
+  if (err && gpg_err_code (err) != GPG_ERR_EOF)
+    g_debug ("listing the card keys failed: %s", gpg_strerror (err));
 
+  for (i = 0; i < card->keypairs->len; i++)
+    {
+      struct keypair_s *kp = g_ptr_array_index (card->keypairs, i);
 
+      if (kp->key)
+        add_keypair_row (card, kp);
+      else
+        card->any_unknown = 1;
+    }
+
+  finish_reload (card);
+}
+
+
+/* Start one listing of all key pairs of the card.  */
 static gpg_error_t
-scd_getattr_cb (void *opaque, const char *status, const char *args)
+list_keypairs (GpaCMNetkey *card)
 {
-  struct scd_getattr_parm *parm = opaque;
-  int entry_id;
-
-/*   g_debug ("STATUS_CB: status=`%s'  args=`%s'", status, args); */
+  const char **patterns;
+  gpg_error_t err;
+  unsigned int i;
 
-  if (!strcmp (status, parm->name) )
+  if (!card->keylist_ctx)
     {
-      entry_id = parm->entry_id;
-
-      if (entry_id < ENTRY_LAST)
+      card->keylist_ctx = gpa_context_new ();
+      err = gpgme_set_protocol (card->keylist_ctx->ctx, GPGME_PROTOCOL_CMS);
+      if (err)
         {
-          char *tmp = xstrdup (args);
-
-          percent_unescape (tmp, 1);
-          if (parm->updfnc)
-            parm->updfnc (parm->card, entry_id, tmp);
-          else if (GTK_IS_LABEL (parm->card->entries[entry_id]))
-            gtk_label_set_text
-              (GTK_LABEL (parm->card->entries[entry_id]), tmp);
-          else
-            gtk_entry_set_text
-              (GTK_ENTRY (parm->card->entries[entry_id]), tmp);
-          xfree (tmp);
+          g_object_unref (card->keylist_ctx);
+          card->keylist_ctx = NULL;
+          return err;
         }
+      /* We include ephemeral keys in the listing.  */
+      gpgme_set_keylist_mode (card->keylist_ctx->ctx,
+                              GPGME_KEYLIST_MODE_EPHEMERAL);
+      g_signal_connect (G_OBJECT (card->keylist_ctx), "next_key",
+                        G_CALLBACK (keylist_next_key_cb), card);
+      g_signal_connect (G_OBJECT (card->keylist_ctx), "done",
+                        G_CALLBACK (keylist_done_cb), card);
+    }
+
+  patterns = g_new (const char *, card->keypairs->len + 1);
+  for (i = 0; i < card->keypairs->len; i++)
+    {
+      struct keypair_s *kp = g_ptr_array_index (card->keypairs, i);
+
+      patterns[i] = g_strconcat ("&", kp->keygrip, NULL);
     }
+  patterns[i] = NULL;
 
-  return 0;
+  err = gpgme_op_keylist_ext_start (card->keylist_ctx->ctx, patterns, 0, 0);
+  g_strfreev ((char **) patterns);
+  if (!err)
+    card->listing = 1;
+  return err;
 }
 
 
-/* Use the assuan machinery to load the bulk of the OpenPGP card data.  */
+/* All data requested by reload_data has been received.  The keys of
+   the card are then listed in the background.  */
 static void
-reload_data (GpaCMNetkey *card)
+reload_done_cb (GpaCMObject *obj, gpg_error_t *errs)
 {
-  static struct {
-    const char *name;
-    int entry_id;
-    void (*updfnc) (GpaCMNetkey *card, int entry_id, char *string);
-  } attrtbl[] = {
-    { "SERIALNO",    ENTRY_SERIALNO },
-    { "NKS-VERSION", ENTRY_NKS_VERSION },
-    { "CHV-STATUS",  ENTRY_PIN_RETRYCOUNTER, update_entry_chv_status },
-    { NULL }
-  };
-  int attridx;
-  gpg_error_t err = 0;
-  gpg_error_t operr;
-  char command[100];
-  struct scd_getattr_parm parm;
-  gpgme_ctx_t gpgagent;
-
-  gpgagent = GPA_CM_OBJECT (card)->agent_ctx;
-  g_return_if_fail (gpgagent);
+  GpaCMNetkey *card = GPA_CM_NETKEY (obj);
+  gpg_error_t err;
 
-  card->reloading++;
-  g_debug ("uped reloading counter (count=%d)", card->reloading);
+  if (errs[CMD_SERIALNO] || errs[CMD_CHV_STATUS])
+    {
+      /* Either we lost the card or the error has already been
+         logged.  */
+      clear_card_data (card);
+    }
+  else if (errs[CMD_NKS_VERSION])
+    {
+      /* The NKS-VERSION is only supported by GnuPG > 2.0.11 thus we
+         ignore the error.  */
+      gtk_label_set_text (GTK_LABEL (card->entries[ENTRY_NKS_VERSION]),
+                          _("unknown"));
+    }
+  card->learn_failed = !!errs[CMD_LEARN];
 
-  /* Show all attributes.  */
-  parm.card = card;
-  for (attridx=0; attrtbl[attridx].name; attridx++)
+  if (card->keypairs->len)
     {
-      parm.name     = attrtbl[attridx].name;
-      parm.entry_id = attrtbl[attridx].entry_id;
-      parm.updfnc   = attrtbl[attridx].updfnc;
-      snprintf (command, sizeof command, "SCD GETATTR %s", parm.name);
-      err = gpgme_op_assuan_transact_ext (gpgagent,
-                                          command,
-                                          NULL, NULL,
-                                          NULL, NULL,
-                                          scd_getattr_cb, &parm, &operr);
+      err = list_keypairs (card);
       if (!err)
-        err = operr;
+        return;
+      /* We don't want an error window because the information is not
+         that important.  */
+      g_debug ("listing the card keys failed: %s", gpg_strerror (err));
+      card->any_unknown = 1;
+    }
 
-      if (err && attrtbl[attridx].entry_id == ENTRY_NKS_VERSION)
-        {
-          /* The NKS-VERSION is only supported by GnuPG > 2.0.11
-             thus we ignore the error.  */
-          gtk_label_set_text
-            (GTK_LABEL (card->entries[attrtbl[attridx].entry_id]),
-             _("unknown"));
-        }
-      else if (err)
-        {
-          if (gpg_err_code (err) == GPG_ERR_CARD_NOT_PRESENT)
-            ; /* Lost the card.  */
-          else
-            {
-              g_debug ("assuan command `%s' failed: %s <%s>\n",
-                       command, gpg_strerror (err), gpg_strsource (err));
-            }
-          clear_card_data (card);
-          break;
-        }
+  finish_reload (card);
+}
+
+
+/* Load the card data including the keys.  All commands are run as
+   one batch in the background; the fields are updated as the data
+   arrives.  */
+static void
+reload_data (GpaCMNetkey *card)
+{
+  gpg_error_t err;
+
+  g_return_if_fail (GPA_CM_OBJECT (card)->agent_ctx);
+  g_return_if_fail (card->keys_frame);
+
+  if (gpa_cm_object_loading (GPA_CM_OBJECT (card)) || card->listing)
+    {
+      card->reload_pending = 1;
+      return;
     }
-  if (!err)
+
+  /* We remove any existing children of the keys frame and then we add
+     a new vbox to be filled with new widgets after the keys have been
+     listed.  */
+  reset_keys_frame (card);
+
+  card->reloading++;
+  err = gpa_cm_object_load (GPA_CM_OBJECT (card), reload_commands,
+                            reload_status_cb, reload_done_cb);
+  if (err)
     {
-      g_object_ref (card);
-      g_idle_add (reload_more_data_idle_cb, card);
+      g_debug ("loading the card data failed: %s", gpg_strerror (err));
+      card->reloading--;
     }
-  card->reloading--;
-  g_debug ("downed reloading counter (count=%d)", card->reloading);
+}
+
+
+/* Idle queue callback to reload the data.  */
+static gboolean
+reload_data_idle_cb (void *user_data)
+{
+  GpaCMNetkey *card = user_data;
+
+  reload_data (card);
+  g_object_unref (card);
+
+  return FALSE;  /* Remove us from the idle queue.  */
 }
 
 
@@ -571,7 +669,7 @@ learn_keys_gpg_status_cb (void *opaque, char *line)
       /* We are finished with the command.  */
       /* Trigger a reload of the key data.  */
       g_object_ref (parm->card);
-      g_idle_add (reload_more_data_idle_cb, parm->card);
+      g_idle_add (reload_data_idle_cb, parm->card);
       /* Cleanup.  */
       gtk_widget_destroy (parm->button);
       g_object_unref (parm->button);
@@ -704,7 +802,11 @@ change_nullpin (GpaCMNetkey *card)
     }
   gtk_widget_destroy (GTK_WIDGET (dialog));
   if (okay)
-    reload_data (card);
+    {
+      /* The PIN status has changed.  */
+      gpa_cm_object_forget_cache (GPA_CM_OBJECT (card));
+      reload_data (card);
+    }
 }
 
 
@@ -816,7 +918,11 @@ change_or_reset_pin (GpaCMNetkey *card, int info_idx)
     }
   gtk_widget_destroy (GTK_WIDGET (dialog));
   if (okay)
-    reload_data (card);
+    {
+      /* The PIN status has changed.  */
+      gpa_cm_object_forget_cache (GPA_CM_OBJECT (card));
+      reload_data (card);
+    }
 }
 
 
@@ -1034,6 +1140,7 @@ gpa_cm_netkey_init (GTypeInstance *instance, void *class_ptr)
 {
   GpaCMNetkey *card = GPA_CM_NETKEY (instance);
 
+  card->keypairs = g_ptr_array_new_with_free_func (release_keypair);
   construct_data_widget (card);
 
 }
@@ -1042,7 +1149,15 @@ gpa_cm_netkey_init (GTypeInstance *instance, void *class_ptr)
 static void
 gpa_cm_netkey_finalize (GObject *object)
 {
-/*   GpaCMNetkey *card = GPA_CM_NETKEY (object); */
+  GpaCMNetkey *card = GPA_CM_NETKEY (object);
+
+  if (card->keylist_ctx)
+    {
+      g_signal_handlers_disconnect_by_data (card->keylist_ctx, card);
+      g_object_unref (card->keylist_ctx);
+      card->keylist_ctx = NULL;
+    }
+  g_ptr_array_unref (card->keypairs);
 
   parent_class->finalize (object);
 }
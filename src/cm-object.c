@@ -57,7 +57,13 @@ static GObjectClass *parent_class;
 /* The signal vector.  */
 static guint signals [LAST_SIGNAL];
 
+/* The status lines received by gpa_cm_object_load.  This maps the
+   serial number of the card and the commands to an array with lines
+   of the form "STATUS ARGS".  */
+static GHashTable *load_cache;
+
 /* Local prototypes */
+static void gpa_cm_object_dispose (GObject *object);
 static void gpa_cm_object_finalize (GObject *object);
 
 
@@ -66,6 +72,189 @@ static void gpa_cm_object_finalize (GObject *object);
  *******************   Implementation   *********************
  ************************************************************/
 
+/* Return the key into LOAD_CACHE for the current load of OBJ.  */
+static char *
+make_cache_key (GpaCMObject *obj)
+{
+  char *commands, *key;
+
+  commands = g_strjoinv ("\n", obj->load.commands);
+  key = g_strconcat (obj->serialno, "\n", commands, NULL);
+  g_free (commands);
+  return key;
+}
+
+
+/* Return true if the arrays of status lines A and B are equal.  */
+static int
+same_lines (GPtrArray *a, GPtrArray *b)
+{
+  unsigned int i;
+
+  if (!a || !b || a->len != b->len)
+    return 0;
+  for (i = 0; i < a->len; i++)
+    if (strcmp (g_ptr_array_index (a, i), g_ptr_array_index (b, i)))
+      return 0;
+  return 1;
+}
+
+
+/* Pass the status line LINE of the form "STATUS ARGS" to the status
+   callback.  */
+static void
+pass_line (GpaCMObject *obj, const char *line)
+{
+  const char *args;
+  char *status;
+
+  args = strchr (line, ' ');
+  if (!args)
+    {
+      obj->load.status_cb (obj, line, "");
+      return;
+    }
+  status = g_strndup (line, args - line);
+  obj->load.status_cb (obj, status, args + 1);
+  g_free (status);
+}
+
+
+/* Release the state of the current load.  */
+static void
+clear_load (GpaCMObject *obj)
+{
+  if (obj->load.idle_id)
+    {
+      g_source_remove (obj->load.idle_id);
+      obj->load.idle_id = 0;
+    }
+  g_strfreev (obj->load.commands);
+  obj->load.commands = NULL;
+  g_free (obj->load.errs);
+  obj->load.errs = NULL;
+  if (obj->load.lines)
+    {
+      g_ptr_array_free (obj->load.lines, TRUE);
+      obj->load.lines = NULL;
+    }
+}
+
+
+static gpg_error_t
+load_status_cb (void *opaque, const char *status, const char *args)
+{
+  GpaCMObject *obj = opaque;
+
+  if (!args)
+    args = "";
+  g_ptr_array_add (obj->load.lines, g_strconcat (status, " ", args, NULL));
+
+  /* If cached lines have been passed, the current lines are passed
+     at the end and only if they differ.  */
+  if (!obj->load.replayed)
+    obj->load.status_cb (obj, status, args);
+
+  return 0;
+}
+
+
+/* All commands have been run.  */
+static void
+finish_load (GpaCMObject *obj)
+{
+  gpa_cm_done_cb_t done_cb = obj->load.done_cb;
+  GPtrArray *cached = NULL;
+  gpg_error_t *errs;
+  char *key = NULL;
+  unsigned int i;
+  int any_err = 0;
+
+  for (i = 0; obj->load.commands[i]; i++)
+    if (obj->load.errs[i])
+      any_err = 1;
+
+  if (obj->serialno)
+    {
+      key = make_cache_key (obj);
+      cached = g_hash_table_lookup (load_cache, key);
+    }
+
+  if (obj->load.replayed && !same_lines (cached, obj->load.lines))
+    {
+      obj->load.status_cb (obj, NULL, NULL);
+      for (i = 0; i < obj->load.lines->len; i++)
+        pass_line (obj, g_ptr_array_index (obj->load.lines, i));
+    }
+
+  if (key && !any_err)
+    {
+      g_hash_table_replace (load_cache, key, obj->load.lines);
+      obj->load.lines = NULL;
+    }
+  else if (key)
+    {
+      g_hash_table_remove (load_cache, key);
+      g_free (key);
+    }
+
+  /* Detach the errors so that the callback may start a new load.  */
+  errs = obj->load.errs;
+  obj->load.errs = NULL;
+  clear_load (obj);
+  done_cb (obj, errs);
+  g_free (errs);
+}
+
+
+static gboolean
+load_next_idle_cb (void *user_data)
+{
+  GpaCMObject *obj = user_data;
+  const char *command;
+  gpg_error_t err;
+
+  obj->load.idle_id = 0;
+  command = obj->load.commands[obj->load.current];
+  if (!command)
+    {
+      finish_load (obj);
+      return FALSE;
+    }
+
+  err = gpgme_op_assuan_transact_start (obj->load.context->ctx, command,
+                                        NULL, NULL, NULL, NULL,
+                                        load_status_cb, obj);
+  if (err)
+    {
+      g_debug ("assuan command `%s' failed: %s <%s>",
+               command, gpg_strerror (err), gpg_strsource (err));
+      obj->load.errs[obj->load.current++] = err;
+      obj->load.idle_id = g_idle_add (load_next_idle_cb, obj);
+    }
+
+  return FALSE;  /* Remove us from the idle queue.  */
+}
+
+
+static void
+load_done_cb (GpaContext *context, gpg_error_t err, GpaCMObject *obj)
+{
+  if (!obj->load.commands)
+    return;
+
+  if (err)
+    g_debug ("assuan command `%s' failed: %s <%s>",
+             obj->load.commands[obj->load.current],
+             gpg_strerror (err), gpg_strsource (err));
+  obj->load.errs[obj->load.current++] = err;
+
+  /* A new operation may not be started from within the done event of
+     the context.  */
+  obj->load.idle_id = g_idle_add (load_next_idle_cb, obj);
+}
+
+
 
 
 
@@ -80,6 +269,7 @@ gpa_cm_object_class_init (void *class_ptr, void *class_data)
 
   parent_class = g_type_class_peek_parent (klass);
 
+  G_OBJECT_CLASS (klass)->dispose = gpa_cm_object_dispose;
   G_OBJECT_CLASS (klass)->finalize = gpa_cm_object_finalize;
 
   signals[UPDATE_STATUS] =
@@ -110,10 +300,32 @@ gpa_cm_object_init (GTypeInstance *instance, void *class_ptr)
 }
 
 
+static void
+gpa_cm_object_dispose (GObject *object)
+{
+  GpaCMObject *card = GPA_CM_OBJECT (object);
+
+  /* The widgets are going away; stop loading data into them.  */
+  clear_load (card);
+  if (card->load.context)
+    {
+      g_signal_handlers_disconnect_by_func (card->load.context,
+                                            load_done_cb, card);
+      g_object_unref (card->load.context);
+      card->load.context = NULL;
+    }
+
+  parent_class->dispose (object);
+}
+
+
 static void
 gpa_cm_object_finalize (GObject *object)
 {
-/*   GpaCMObject *card = GPA_CM_OBJECT (object); */
+  GpaCMObject *card = GPA_CM_OBJECT (object);
+
+  g_free (card->serialno);
+  card->serialno = NULL;
 
 
   parent_class->finalize (object);
@@ -177,3 +389,115 @@ gpa_cm_object_alert_dialog (GpaCMObject *obj, const gchar *messageg)
 
   g_signal_emit (obj, signals[ALERT_DIALOG], 0, messageg);
 }
+
+
+/* Set the serial number of the card to SERIALNO.  It is used to cache
+   the data loaded by gpa_cm_object_load.  */
+void
+gpa_cm_object_set_serialno (GpaCMObject *obj, const char *serialno)
+{
+  g_return_if_fail (GPA_IS_CM_OBJECT (obj));
+
+  g_free (obj->serialno);
+  obj->serialno = serialno? g_strdup (serialno) : NULL;
+}
+
+
+/* Run the NULL terminated list of Assuan COMMANDS asynchronously on a
+   connection of its own and pass each status line to STATUS_CB as it
+   arrives.  DONE_CB is called after the last command; a failed
+   command does not stop the others.  If the serial number of the card
+   is known, the lines of the last load with the same commands are
+   passed right away and the current ones only if they differ.  */
+gpg_error_t
+gpa_cm_object_load (GpaCMObject *obj, const char *const *commands,
+                    gpa_cm_status_cb_t status_cb, gpa_cm_done_cb_t done_cb)
+{
+  GPtrArray *cached = NULL;
+  gpg_error_t err;
+  char *key;
+  unsigned int i;
+
+  g_return_val_if_fail (GPA_IS_CM_OBJECT (obj), gpg_error (GPG_ERR_INV_VALUE));
+  g_return_val_if_fail (commands && status_cb && done_cb,
+                        gpg_error (GPG_ERR_INV_VALUE));
+
+  if (obj->load.commands)
+    return gpg_error (GPG_ERR_EBUSY);
+
+  if (!obj->load.context)
+    {
+      obj->load.context = gpa_context_new ();
+      err = gpgme_set_protocol (obj->load.context->ctx,
+                                GPGME_PROTOCOL_ASSUAN);
+      if (err)
+        {
+          g_object_unref (obj->load.context);
+          obj->load.context = NULL;
+          return err;
+        }
+      g_signal_connect (G_OBJECT (obj->load.context), "done",
+                        G_CALLBACK (load_done_cb), obj);
+    }
+  if (!load_cache)
+    load_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                        (GDestroyNotify) g_ptr_array_unref);
+
+  obj->load.commands = g_strdupv ((char **) commands);
+  obj->load.errs = g_new0 (gpg_error_t,
+                           g_strv_length (obj->load.commands) + 1);
+  obj->load.current = 0;
+  obj->load.lines = g_ptr_array_new_with_free_func (g_free);
+  obj->load.replayed = 0;
+  obj->load.status_cb = status_cb;
+  obj->load.done_cb = done_cb;
+
+  /* Show the data of the last load right away.  */
+  if (obj->serialno)
+    {
+      key = make_cache_key (obj);
+      cached = g_hash_table_lookup (load_cache, key);
+      g_free (key);
+    }
+  if (cached)
+    {
+      obj->load.replayed = 1;
+      for (i = 0; i < cached->len; i++)
+        pass_line (obj, g_ptr_array_index (cached, i));
+    }
+
+  obj->load.idle_id = g_idle_add (load_next_idle_cb, obj);
+  return 0;
+}
+
+
+/* Return true if gpa_cm_object_load is running.  */
+gboolean
+gpa_cm_object_loading (GpaCMObject *obj)
+{
+  g_return_val_if_fail (GPA_IS_CM_OBJECT (obj), FALSE);
+
+  return !!obj->load.commands;
+}
+
+
+/* Forget the cached data of the card.  This is used after the data
+   on the card has been changed.  */
+void
+gpa_cm_object_forget_cache (GpaCMObject *obj)
+{
+  GHashTableIter iter;
+  const char *key;
+  size_t n;
+
+  g_return_if_fail (GPA_IS_CM_OBJECT (obj));
+
+  if (!obj->serialno || !load_cache)
+    return;
+
+  n = strlen (obj->serialno);
+  g_hash_table_iter_init (&iter, load_cache);
+  while (g_hash_table_iter_next (&iter, (void **) &key, NULL))
+    if (!strncmp (key, obj->serialno, n) && key[n] == '\n')
+      g_hash_table_iter_remove (&iter);
+}
@@ -31,6 +31,9 @@
 #define CM_OBJECT_H
 
 #include <gtk/gtk.h>
+#include <gpgme.h>
+
+#include "gpacontext.h"
 
 /* Declare the Object. */
 typedef struct _GpaCMObject      GpaCMObject;
@@ -58,6 +61,17 @@ GType gpa_cm_object_get_type (void) G_GNUC_CONST;
                               GPA_CM_OBJECT_TYPE, GpaCMObjectClass))
 
 
+/* Called by gpa_cm_object_load for each status line.  A STATUS of
+   NULL tells that the lines passed so far are outdated and that the
+   current data follows.  */
+typedef void (*gpa_cm_status_cb_t) (GpaCMObject *obj,
+                                    const char *status, const char *args);
+
+/* Called after all commands of gpa_cm_object_load have been run.
+   ERRS has the error of each command.  */
+typedef void (*gpa_cm_done_cb_t) (GpaCMObject *obj, gpg_error_t *errs);
+
+
 /* Object's class definition.  */
 struct _GpaCMObjectClass
 {
@@ -76,6 +90,22 @@ struct _GpaCMObject
 
   /* Private.  Fixme:  Hide them.  */
   gpgme_ctx_t agent_ctx;
+
+  /* The serial number of the card or NULL.  */
+  char *serialno;
+
+  /* The state of gpa_cm_object_load.  */
+  struct {
+    GpaContext *context;      /* The context running the commands.  */
+    char **commands;          /* The commands to run.  */
+    unsigned int current;     /* The index of the running command.  */
+    gpg_error_t *errs;        /* The errors of the commands.  */
+    guint idle_id;            /* Source starting the next command.  */
+    GPtrArray *lines;         /* The status lines received so far.  */
+    int replayed;             /* Cached lines have been passed.  */
+    gpa_cm_status_cb_t status_cb;
+    gpa_cm_done_cb_t done_cb;
+  } load;
 };
 
 
@@ -85,6 +115,13 @@ struct _GpaCMObject
 
 void gpa_cm_object_update_status (GpaCMObject *obj, const char *text);
 void gpa_cm_object_alert_dialog (GpaCMObject *obj, const gchar *messageg);
+void gpa_cm_object_set_serialno (GpaCMObject *obj, const char *serialno);
+gpg_error_t gpa_cm_object_load (GpaCMObject *obj,
+                                const char *const *commands,
+                                gpa_cm_status_cb_t status_cb,
+                                gpa_cm_done_cb_t done_cb);
+gboolean gpa_cm_object_loading (GpaCMObject *obj);
+void gpa_cm_object_forget_cache (GpaCMObject *obj);
 
 
 #endif /*CM_OBJECT_H*/
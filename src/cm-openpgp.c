@@ -118,6 +118,13 @@ struct _GpaCMOpenpgp
 
   /* This flag is set while we are reloading data.  */
   int  reloading;
+
+  /* This flag is set while the fields are set to the card data; the
+     changed signals are then not caused by the user.  */
+  int  updating;
+
+  /* Set if another reload has been requested while reloading.  */
+  int  reload_pending;
 };
 
 /* The parent class.  */
@@ -125,6 +132,7 @@ static GObjectClass *parent_class;
 
 /* Local prototypes */
 static void gpa_cm_openpgp_finalize (GObject *object);
+static gpg_error_t save_entry_sex (GpaCMOpenpgp *card);
 
 
 
@@ -210,14 +218,17 @@ show_admin_pin_notice (GpaCMOpenpgp *card)
 }
 
 
-/* Clears the info contained in the card widget. */
+/* Clears the info contained in the card widget.  Fields changed by
+   the user are kept.  */
 static void
 clear_card_data (GpaCMOpenpgp *card)
 {
   int idx;
 
   for (idx=0; idx < ENTRY_LAST; idx++)
-    if (idx == ENTRY_SEX)
+    if (card->changed[idx])
+      ;
+    else if (idx == ENTRY_SEX)
       gtk_combo_box_set_active (GTK_COMBO_BOX (card->entries[idx]), 2);
     else if (idx == ENTRY_SIG_FORCE_PIN)
       gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (card->entries[idx]), 0);
@@ -584,73 +595,146 @@ scd_getattr_cb (void *opaque, const char *status, const char *args)
 
 
 
-/* Use the assuan machinery to load the bulk of the OpenPGP card data.  */
+/* The attributes loaded by reload_data.  */
+static const struct {
+  const char *name;
+  int entry_id;
+  void (*updfnc) (GpaCMOpenpgp *card, int entry_id,  const char *string);
+} attrtbl[] = {
+  { "SERIALNO",   ENTRY_SERIALNO, update_entry_serialno },
+  { "DISP-NAME",  ENTRY_LAST_NAME, update_entry_name },
+  { "DISP-LANG",  ENTRY_LANGUAGE },
+  { "DISP-SEX",   ENTRY_SEX, update_entry_sex },
+  { "PUBKEY-URL", ENTRY_PUBKEY_URL },
+  { "LOGIN-DATA", ENTRY_LOGIN },
+  { "SIG-COUNTER",ENTRY_SIG_COUNTER },
+  { "CHV-STATUS", ENTRY_PIN_RETRYCOUNTER,  update_entry_chv_status },
+  { "KEY-FPR",    ENTRY_LAST, update_entry_fpr },
+/*   { "CA-FPR", }, */
+  { "KEY-ATTR",   ENTRY_LAST, update_entry_key_attr },
+  { NULL }
+};
+
+
+static void reload_data (GpaCMOpenpgp *card);
+
+
+/* Status callback for the data loaded by reload_data.  */
 static void
-reload_data (GpaCMOpenpgp *card)
+reload_status_cb (GpaCMObject *obj, const char *status, const char *args)
 {
-  static struct {
-    const char *name;
-    int entry_id;
-    void (*updfnc) (GpaCMOpenpgp *card, int entry_id,  const char *string);
-  } attrtbl[] = {
-    { "SERIALNO",   ENTRY_SERIALNO, update_entry_serialno },
-    { "DISP-NAME",  ENTRY_LAST_NAME, update_entry_name },
-    { "DISP-LANG",  ENTRY_LANGUAGE },
-    { "DISP-SEX",   ENTRY_SEX, update_entry_sex },
-    { "PUBKEY-URL", ENTRY_PUBKEY_URL },
-    { "LOGIN-DATA", ENTRY_LOGIN },
-    { "SIG-COUNTER",ENTRY_SIG_COUNTER },
-    { "CHV-STATUS", ENTRY_PIN_RETRYCOUNTER,  update_entry_chv_status },
-    { "KEY-FPR",    ENTRY_LAST, update_entry_fpr },
-/*     { "CA-FPR", }, */
-    { "KEY-ATTR",   ENTRY_LAST, update_entry_key_attr },
-    { NULL }
-  };
-  int attridx;
-  gpg_error_t err, operr;
-  char command[100];
+  GpaCMOpenpgp *card = GPA_CM_OPENPGP (obj);
   struct scd_getattr_parm parm;
-  gpgme_ctx_t gpgagent;
+  int attridx;
 
-  show_edit_error (card, NULL);
+  card->updating++;
+  if (!status)
+    {
+      /* The cached data was outdated.  */
+      clear_card_data (card);
+      card->updating--;
+      return;
+    }
 
-  gpgagent = GPA_CM_OBJECT (card)->agent_ctx;
-  g_return_if_fail (gpgagent);
+  for (attridx=0; attrtbl[attridx].name; attridx++)
+    if (!strcmp (status, attrtbl[attridx].name))
+      {
+        parm.card     = card;
+        parm.name     = attrtbl[attridx].name;
+        parm.entry_id = attrtbl[attridx].entry_id;
+        parm.updfnc   = attrtbl[attridx].updfnc;
+        /* Do not overwrite what the user typed during the load.  */
+        if (parm.entry_id < ENTRY_LAST
+            && (card->changed[parm.entry_id]
+                || (parm.entry_id == ENTRY_LAST_NAME
+                    && card->changed[ENTRY_FIRST_NAME])))
+          break;
+        scd_getattr_cb (&parm, status, args);
+        break;
+      }
+  card->updating--;
+}
 
-  card->reloading++;
-  parm.card = card;
+
+/* All attributes requested by reload_data have been received.  */
+static void
+reload_done_cb (GpaCMObject *obj, gpg_error_t *errs)
+{
+  GpaCMOpenpgp *card = GPA_CM_OPENPGP (obj);
+  int attridx;
+
+  card->updating++;
   for (attridx=0; attrtbl[attridx].name; attridx++)
+    if (errs[attridx])
+      {
+        /* Either we lost the card or the error has already been
+           logged.  The changes can't be saved anymore.  */
+        clear_changed_flags (card);
+        clear_card_data (card);
+        break;
+      }
+
+  update_entry_key_attr (card, 0, NULL);  /* Append ky attributes.  */
+  card->updating--;
+  card->reloading--;
+
+  /* The combo box is saved when it is changed, but not during the
+     load.  */
+  if (card->changed[ENTRY_SEX])
     {
-      parm.name     = attrtbl[attridx].name;
-      parm.entry_id = attrtbl[attridx].entry_id;
-      parm.updfnc   = attrtbl[attridx].updfnc;
-      snprintf (command, sizeof command, "SCD GETATTR %s", parm.name);
-
-      err = gpgme_op_assuan_transact_ext (gpgagent,
-                                          command,
-                                          NULL, NULL,
-                                          NULL, NULL,
-                                          scd_getattr_cb, &parm, &operr);
-      if (!err)
-        err = operr;
+      if (!save_entry_sex (card))
+        show_edit_error (card, NULL);
+      card->changed[ENTRY_SEX] = 0;
+    }
 
-      if (err)
-        {
-          if (gpg_err_code (err) == GPG_ERR_CARD_NOT_PRESENT)
-            ; /* Lost the card.  */
-          else
-            {
-              g_debug ("assuan command `%s' failed: %s <%s>\n",
-                       command, gpg_strerror (err), gpg_strsource (err));
-            }
-          clear_card_data (card);
-          break;
-        }
+  if (card->reload_pending)
+    {
+      card->reload_pending = 0;
+      reload_data (card);
+    }
+}
+
+
+/* Use the assuan machinery to load the bulk of the OpenPGP card data.
+   All attributes are requested as one batch which runs in the
+   background; the fields are updated as the data arrives.  */
+static void
+reload_data (GpaCMOpenpgp *card)
+{
+  char *commands[DIM (attrtbl)];
+  int attridx;
+  gpg_error_t err;
+
+  show_edit_error (card, NULL);
+
+  g_return_if_fail (GPA_CM_OBJECT (card)->agent_ctx);
 
+  if (gpa_cm_object_loading (GPA_CM_OBJECT (card)))
+    {
+      card->reload_pending = 1;
+      return;
     }
-  update_entry_key_attr (card, 0, NULL);  /* Append ky attributes.  */
+
+  for (attridx=0; attrtbl[attridx].name; attridx++)
+    commands[attridx] = g_strdup_printf ("SCD GETATTR %s",
+                                         attrtbl[attridx].name);
+  commands[attridx] = NULL;
+
+  /* The fields are replaced by the card data; only the changes made
+     during the load are kept.  */
   clear_changed_flags (card);
-  card->reloading--;
+  card->reloading++;
+  err = gpa_cm_object_load (GPA_CM_OBJECT (card),
+                            (const char *const *) commands,
+                            reload_status_cb, reload_done_cb);
+  if (err)
+    {
+      g_debug ("loading the card data failed: %s", gpg_strerror (err));
+      card->reloading--;
+    }
+
+  for (attridx=0; commands[attridx]; attridx++)
+    g_free (commands[attridx]);
 }
 
 
@@ -688,8 +772,10 @@ save_attr (GpaCMOpenpgp *card, const char *name,
   if (!err)
     err = operr;
 
-  if (err && !(gpg_err_code (err) == GPG_ERR_CANCELED
-               && gpg_err_source (err) == GPG_ERR_SOURCE_PINENTRY))
+  if (!err)
+    gpa_cm_object_forget_cache (GPA_CM_OBJECT (card));
+  else if (!(gpg_err_code (err) == GPG_ERR_CANCELED
+             && gpg_err_source (err) == GPG_ERR_SOURCE_PINENTRY))
     {
       char *message = g_strdup_printf
         (_("Error saving the changed values.\n"
@@ -908,6 +994,9 @@ edit_changed_cb (GtkEditable *editable, void *opaque)
   GpaCMOpenpgp *card = opaque;
   int idx;
 
+  if (card->updating)
+    return;
+
   for (idx=0; idx < ENTRY_LAST; idx++)
     if (GTK_IS_EDITABLE (card->entries[idx])
         && GTK_EDITABLE (card->entries[idx]) == editable)
@@ -932,6 +1021,9 @@ edit_changed_combo_box_cb (GtkComboBox *cbox, void *opaque)
   GpaCMOpenpgp *card = opaque;
   int idx;
 
+  if (card->updating)
+    return;
+
   for (idx=0; idx < ENTRY_LAST; idx++)
     if (GTK_IS_COMBO_BOX (card->entries[idx])
         && GTK_COMBO_BOX (card->entries[idx]) == cbox)
@@ -970,6 +1062,9 @@ edit_toggled_cb (GtkToggleButton *toggle, void *opaque)
   GpaCMOpenpgp *card = opaque;
   int idx;
 
+  if (card->updating)
+    return;
+
   for (idx=0; idx < ENTRY_LAST; idx++)
     if (GTK_IS_TOGGLE_BUTTON (card->entries[idx])
         && GTK_TOGGLE_BUTTON (card->entries[idx]) == toggle)
@@ -1200,7 +1295,11 @@ change_pin (GpaCMOpenpgp *card, int pinno)
     }
   gtk_widget_destroy (GTK_WIDGET (dialog));
   if (okay)
-    reload_data (card);
+    {
+      /* The retry counters have changed.  */
+      gpa_cm_object_forget_cache (GPA_CM_OBJECT (card));
+      reload_data (card);
+    }
 }
 
 
@@ -180,29 +180,29 @@ get_selected_files (GtkWidget *list)
   GtkTreeModel *model = gtk_tree_view_get_model (GTK_TREE_VIEW (list));
   GtkTreeSelection *sel = gtk_tree_view_get_selection (GTK_TREE_VIEW (list));
   GList *selection = gtk_tree_selection_get_selected_rows (sel, &model);
-  GList *files = NULL;
+  GQueue files = G_QUEUE_INIT;
+  GList *cur;
 
-  while (selection)
+  for (cur = selection; cur; cur = g_list_next (cur))
     {
       gpa_file_item_t file_item;
       gchar *filename;
       GtkTreeIter iter;
 
-      gtk_tree_model_get_iter (model, &iter, (GtkTreePath*) selection->data);
+      gtk_tree_model_get_iter (model, &iter, (GtkTreePath*) cur->data);
       gtk_tree_model_get (model, &iter, FILE_NAME_COLUMN, &filename, -1);
 
       file_item = g_malloc0 (sizeof (*file_item));
       file_item->filename_in = filename;
 
-      files = g_list_append (files, file_item);
-      selection = g_list_next (selection);
+      g_queue_push_tail (&files, file_item);
     }
 
   /* Free the selection */
   g_list_foreach (selection, (GFunc) gtk_tree_path_free, NULL);
   g_list_free (selection);
 
-  return files;
+  return files.head;
 }
 
 
@@ -223,3 +223,107 @@ is_cms_data_ext (gpgme_data_t dh)
   return 0;
 #endif
 }
+
+
+/* Return a pointer to the first armor line in the Nul terminated
+   DATA or NULL if there is none.  */
+static const char *
+find_armor_line (const char *data)
+{
+  const char *s;
+
+  for (s = data; s && *s; s = (*s=='\n')?(s+1):((s=strchr (s,'\n'))?(s+1):s))
+    if (!strncmp (s, "-----BEGIN ", 11))
+      return s;
+  return NULL;
+}
+
+
+/* Identify the data object DH and store the result at INFO.  Only a
+   prefix of the data is read and the read position is restored, thus
+   the object may be passed on to the actual operation.  There is no
+   error return; if nothing could be found out the data is assumed to
+   be plain OpenPGP.  */
+void
+gpa_identify_data (gpgme_data_t dh, gpa_data_info_t *info)
+{
+  char *data;
+  const char *armor;
+  off_t pos;
+  ssize_t datalen;
+
+  memset (info, 0, sizeof *info);
+  info->protocol = GPGME_PROTOCOL_OpenPGP;
+
+  pos = gpgme_data_seek (dh, 0, SEEK_CUR);
+  if (pos == -1)
+    return;  /* Not seekable.  */
+
+  data = malloc (CMS_BUFFER_SIZE);
+  if (!data)
+    return; /* Oops */
+  datalen = gpgme_data_read (dh, data, CMS_BUFFER_SIZE - 1);
+  gpgme_data_seek (dh, pos, SEEK_SET);
+  if (datalen <= 0)
+    {
+      free (data);
+      return;
+    }
+  data[datalen] = 0;
+
+  /* Binary PGP data may contain an armored message; see detect_cms.  */
+  armor = (data[0] & 0x80)? NULL : find_armor_line (data);
+  if (armor)
+    info->armored = 1;
+
+#ifdef HAVE_GPGME_DATA_IDENTIFY
+  {
+    /* Identify the prefix we already have instead of letting gpgme
+       read the file again.  */
+    gpgme_data_t prefix;
+
+    if (!gpgme_data_new_from_mem (&prefix, data, datalen, 0))
+      {
+        switch (gpgme_data_identify (prefix, 0))
+          {
+          case GPGME_DATA_TYPE_PGP_SIGNATURE:
+            info->detached_sig = 1;
+            break;
+          case GPGME_DATA_TYPE_PGP_KEY:
+            info->keys = 1;
+            break;
+          case GPGME_DATA_TYPE_PGP_SIGNED:
+          case GPGME_DATA_TYPE_PGP_ENCRYPTED:
+            info->message = 1;
+            break;
+          case GPGME_DATA_TYPE_CMS_ENCRYPTED:
+            info->message = 1;
+            info->protocol = GPGME_PROTOCOL_CMS;
+            break;
+          case GPGME_DATA_TYPE_CMS_SIGNED:
+          case GPGME_DATA_TYPE_CMS_OTHER:
+          case GPGME_DATA_TYPE_X509_CERT:
+          case GPGME_DATA_TYPE_PKCS12:
+            info->protocol = GPGME_PROTOCOL_CMS;
+            break;
+          default:
+            break;
+          }
+        gpgme_data_release (prefix);
+      }
+  }
+#else
+  if (detect_cms (data, datalen))
+    info->protocol = GPGME_PROTOCOL_CMS;
+  else if (armor && !strncmp (armor + 11, "PGP SIGNATURE-----", 18))
+    info->detached_sig = 1;
+  else if (armor && (!strncmp (armor + 11, "PGP MESSAGE-----", 16)
+                     || !strncmp (armor + 11, "PGP SIGNED MESSAGE-----", 23)))
+    info->message = 1;
+  else if (armor && (!strncmp (armor + 11, "PGP PUBLIC KEY BLOCK-----", 25)
+                     || !strncmp (armor + 11, "PGP PRIVATE KEY BLOCK-----", 26)))
+    info->keys = 1;
+#endif
+
+  free (data);
+}
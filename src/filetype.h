@@ -22,5 +22,18 @@ int is_cms_file (const char *fname);
 int is_cms_data (const char *data, size_t datalen);
 int is_cms_data_ext (gpgme_data_t dh);
 
+/* What gpa_identify_data found out about a data object.  */
+typedef struct
+{
+  gpgme_protocol_t protocol;  /* GPGME_PROTOCOL_CMS or _OpenPGP.  */
+  int armored;                /* The data is ASCII armored.  */
+  int detached_sig;           /* The data is a detached signature.  */
+  int message;                /* The data is a signed or encrypted
+                                 message and not a detached signature.  */
+  int keys;                   /* The data holds OpenPGP keys.  */
+} gpa_data_info_t;
+
+void gpa_identify_data (gpgme_data_t dh, gpa_data_info_t *info);
+
 
 #endif /*FILETYPE_H*/
@@ -31,6 +31,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
 #ifdef HAVE_INOTIFY_INIT
 # include <sys/inotify.h>
 #endif /*HAVE_INOTIFY_INIT*/
@@ -42,97 +43,331 @@
 /* The object used to identify a file watch within GPA.  */
 struct gpa_filewatch_id_s
 {
-  gpa_filewatch_id_t next;
+  gpa_filewatch_id_t next;  /* Next watch with the same WD.  */
   int wd;
+  unsigned int mask;
   gpa_filewatch_cb_t callback;
   void *callback_data;
   char fname[1];
 };
 
 
+/* An event waiting to be passed to the callback.  All events for the
+   same file of a watch are merged into one.  */
+struct pending_event_s
+{
+  gpa_filewatch_id_t watch;
+  char *fname;
+  char reason[20];
+};
+
+
+/* The time in milliseconds the queue needs to be quiet before the
+   collected events are passed to the callbacks.  */
+#define QUIET_PERIOD 100
+
+/* The longest time in milliseconds an event is held back while new
+   events keep arriving.  */
+#define MAX_EVENT_DELAY 1000
+
+
 /* The file descriptor used for the inotify queue.  */
 static int queue_fd = -1;
 
-/* We need to keep a list of active file watches.  */
-static gpa_filewatch_id_t watch_list;
+/* The active file watches indexed by their inotify watch descriptor.
+   Each value is the list of watches sharing that descriptor.  */
+static GHashTable *watch_table;
 
-/* We set this flag to true while walking thewatch_list.  */
+/* We set this flag to true while calling the callbacks.  */
 static int walking_watch_list_p;
 
+/* Watches removed while walking_watch_list_p was set.  */
+static GSList *dead_watches;
+
+/* The events not yet passed to the callbacks in the order of their
+   arrival, and an index on them.  */
+static GQueue pending_events = G_QUEUE_INIT;
+static GHashTable *pending_table;
+
+/* The timer to flush the pending events and the time the oldest of
+   them arrived.  */
+static guint flush_timer;
+static gint64 first_pending_time;
+
+
+#ifdef HAVE_INOTIFY_INIT
+static guint
+pending_event_hash (gconstpointer key)
+{
+  const struct pending_event_s *pev = key;
+
+  return (g_direct_hash (pev->watch)
+          ^ (pev->fname? g_str_hash (pev->fname) : 0));
+}
+
+
+static gboolean
+pending_event_equal (gconstpointer a, gconstpointer b)
+{
+  const struct pending_event_s *pa = a;
+  const struct pending_event_s *pb = b;
+
+  return pa->watch == pb->watch && !g_strcmp0 (pa->fname, pb->fname);
+}
+
+
+static void
+release_pending_event (struct pending_event_s *pev)
+{
+  xfree (pev->fname);
+  xfree (pev);
+}
+
+
+/* Record the event REASON for the file FNAME of WATCH.  FNAME is
+   malloced and taken over by this function; it is NULL if events have
+   been lost.  */
+static void
+add_pending_event (gpa_filewatch_id_t watch, char *fname,
+                   const char *reason)
+{
+  struct pending_event_s *pev, key;
+  int idx;
+
+  key.watch = watch;
+  key.fname = fname;
+  pev = g_hash_table_lookup (pending_table, &key);
+  if (!pev)
+    {
+      pev = xcalloc (1, sizeof *pev);
+      pev->watch = watch;
+      pev->fname = fname;
+      g_queue_push_tail (&pending_events, pev);
+      g_hash_table_insert (pending_table, pev, pev);
+    }
+  else
+    xfree (fname);
+
+  /* Merge the reasons.  */
+  idx = strlen (pev->reason);
+  for (; *reason; reason++)
+    if (!strchr (pev->reason, *reason) && idx < sizeof pev->reason - 1)
+      pev->reason[idx++] = *reason;
+  pev->reason[idx] = 0;
+}
+
+
+/* Unlink WATCH from the watch table and release it along with its
+   pending events.  */
+static void
+unlink_watch (gpa_filewatch_id_t watch)
+{
+  gpa_filewatch_id_t first, *link;
+  GList *item, *next;
+
+  for (item = pending_events.head; item; item = next)
+    {
+      struct pending_event_s *pev = item->data;
+
+      next = item->next;
+      if (pev->watch == watch)
+        {
+          g_hash_table_remove (pending_table, pev);
+          g_queue_delete_link (&pending_events, item);
+          release_pending_event (pev);
+        }
+    }
+
+  first = g_hash_table_lookup (watch_table, GINT_TO_POINTER (watch->wd));
+  for (link = &first; *link; link = &(*link)->next)
+    if (*link == watch)
+      {
+        *link = watch->next;
+        break;
+      }
+
+  /* Remove the inotify watch unless it is still used by another
+     watch.  */
+  if (first)
+    g_hash_table_insert (watch_table, GINT_TO_POINTER (watch->wd), first);
+  else
+    {
+      g_hash_table_remove (watch_table, GINT_TO_POINTER (watch->wd));
+      inotify_rm_watch (queue_fd, watch->wd);
+    }
+
+  xfree (watch);
+}
+
+
+/* Pass the pending events to the callbacks.  */
+static gboolean
+flush_events_cb (void *data)
+{
+  GQueue events = pending_events;
+  struct pending_event_s *pev;
+
+  flush_timer = 0;
+  g_queue_init (&pending_events);
+  g_hash_table_remove_all (pending_table);
+
+  walking_watch_list_p++;
+  while ((pev = g_queue_pop_head (&events)))
+    {
+      if (pev->watch->callback)
+        pev->watch->callback (pev->watch->callback_data,
+                              pev->fname, pev->reason);
+      release_pending_event (pev);
+    }
+  walking_watch_list_p--;
+
+  if (!walking_watch_list_p)
+    {
+      while (dead_watches)
+        {
+          unlink_watch (dead_watches->data);
+          dead_watches = g_slist_delete_link (dead_watches, dead_watches);
+        }
+    }
+
+  return FALSE;  /* Remove this timer.  */
+}
+
+
+/* Dispatch the inotify event EV.  */
+static void
+dispatch_event (struct inotify_event *ev)
+{
+  gpa_filewatch_id_t watch;
+  char reason[20];
+  int  reasonidx;
+
+#define MAKEREASON(a,b) do { if ((ev->mask & (b))                   \
+                                  && reasonidx < sizeof reason - 1) \
+                                reason[reasonidx++] = (a);      \
+                           } while (0)
+  reasonidx = 0;
+  MAKEREASON ('a', IN_ACCESS);
+  MAKEREASON ('c', IN_MODIFY);
+  MAKEREASON ('e', IN_ATTRIB);
+  MAKEREASON ('w', IN_CLOSE_WRITE);
+  MAKEREASON ('0', IN_CLOSE_NOWRITE);
+  MAKEREASON ('r', IN_OPEN);
+  MAKEREASON ('m', IN_MOVED_FROM);
+  MAKEREASON ('y', IN_MOVED_TO);
+  MAKEREASON ('n', IN_CREATE);
+  MAKEREASON ('d', IN_DELETE);
+  MAKEREASON ('D', IN_DELETE_SELF);
+  MAKEREASON ('M', IN_MOVE_SELF);
+  MAKEREASON ('u', IN_UNMOUNT);
+  MAKEREASON ('o', IN_Q_OVERFLOW);
+  MAKEREASON ('x', IN_IGNORED);
+#undef MAKEREASON
+  reason[reasonidx] = 0;
+/*   g_debug ("event: wd=%d mask=%#x (%s) cookie=%#x len=%u name=`%.*s'", */
+/*            ev->wd, ev->mask, reason, ev->cookie, ev->len,  */
+/*            (int)ev->len, ev->name); */
+
+  if (ev->mask & IN_Q_OVERFLOW)
+    {
+      GHashTableIter iter;
+      void *value;
+
+      /* Events have been lost; tell everyone that any file may have
+         changed.  */
+      g_hash_table_iter_init (&iter, watch_table);
+      while (g_hash_table_iter_next (&iter, NULL, &value))
+        for (watch = value; watch; watch = watch->next)
+          if (watch->callback)
+            add_pending_event (watch, NULL, reason);
+      return;
+    }
+
+  watch = g_hash_table_lookup (watch_table, GINT_TO_POINTER (ev->wd));
+  for (; watch; watch = watch->next)
+    {
+      if (!watch->callback || !(ev->mask & (watch->mask | IN_IGNORED)))
+        continue;
+      /* For an event about a file in a watched directory the name of
+         that file is passed.  */
+      if (ev->len && *ev->name)
+        add_pending_event (watch,
+                           g_build_filename (watch->fname, ev->name, NULL),
+                           reason);
+      else
+        add_pending_event (watch, xstrdup (watch->fname), reason);
+    }
+}
+
 
 /* This function is called by the main event loop if the file watcher
    fd is readable.  This is currently only used under Linux if the
    inotify interface is available. */
-#ifdef HAVE_INOTIFY_INIT
 static gboolean 
 filewatch_cb (GIOChannel *channel, 
               GIOCondition condition, void *data)
 {
+  /* The buffer needs to be aligned for struct inotify_event and large
+     enough to hold several events with a maximum length name.  */
+  static union
+  {
+    struct inotify_event ev;
+    char buffer[32 * (sizeof (struct inotify_event) + NAME_MAX + 1)];
+  } u;
   gsize nread;
   GIOStatus status;
   GError *err = NULL;
-  char buffer[512];
+  int any = 0;
 
-  status = g_io_channel_read_chars (channel, buffer, sizeof buffer,
-                                    &nread, &err);
-  if (err)
+  /* Drain the queue so that a burst of events is handled at once.  */
+  for (;;)
     {
-      g_debug ("error reading inotify queue: status=%d, err=%s",
-               status, err->message);
-      g_error_free (err);
+      char *p = u.buffer;
+
+      status = g_io_channel_read_chars (channel, u.buffer, sizeof u.buffer,
+                                        &nread, &err);
+      if (err)
+        {
+          g_debug ("error reading inotify queue: status=%d, err=%s",
+                   status, err->message);
+          g_error_free (err);
+          err = NULL;
+        }
+      if (status != G_IO_STATUS_NORMAL || !nread)
+        break;
+/*       g_debug ("new file watch event, nread=%u", (unsigned int)nread); */
+
+      /* The kernel returns only complete events.  */
+      while (nread >= sizeof (struct inotify_event))
+        {
+          struct inotify_event *ev = (void *)p;
+          gsize evlen = sizeof *ev + ev->len;
+
+          if (evlen > nread)
+            break;
+          dispatch_event (ev);
+          any = 1;
+          nread -= evlen;
+          p += evlen;
+        }
     }
-/*   g_debug ("new file watch event, nread=%u", (unsigned int)nread); */
-  
-  if (status == G_IO_STATUS_NORMAL)
+
+  if (any && !g_queue_is_empty (&pending_events))
     {
-      struct inotify_event *ev;
-      char *p = buffer;
-      gpa_filewatch_id_t watch;
-      char reason[20];
-      int  reasonidx;
-      
-      while (nread >= sizeof *ev) 
+      gint64 now = g_get_monotonic_time ();
+
+      /* Restart the timer so that the callbacks are called once the
+         queue has been quiet for a while, but do not hold back events
+         for too long under a constant stream of them.  */
+      if (!flush_timer)
+        first_pending_time = now;
+      else if (now - first_pending_time < MAX_EVENT_DELAY * 1000)
         {
-          ev = (void *)p;
-#define MAKEREASON(a,b) do { if ((ev->mask & (b))                   \
-                                  && reasonidx < sizeof reason) \
-                                reason[reasonidx++] = (a);      \
-                           } while (0)
-          reasonidx = 0;
-          MAKEREASON ('a', IN_ACCESS);
-          MAKEREASON ('c', IN_MODIFY);
-          MAKEREASON ('e', IN_ATTRIB);
-          MAKEREASON ('w', IN_CLOSE_WRITE);
-          MAKEREASON ('0', IN_CLOSE_NOWRITE);
-          MAKEREASON ('r', IN_OPEN);
-          MAKEREASON ('m', IN_MOVED_FROM);
-          MAKEREASON ('y', IN_MOVED_TO);
-          MAKEREASON ('n', IN_CREATE);
-          MAKEREASON ('d', IN_DELETE);
-          MAKEREASON ('D', IN_DELETE_SELF);
-          MAKEREASON ('M', IN_MOVE_SELF);
-          MAKEREASON ('u', IN_UNMOUNT);
-          MAKEREASON ('o', IN_Q_OVERFLOW);
-          MAKEREASON ('x', IN_IGNORED);
-#undef MAKEREASON
-          reason[reasonidx] = 0;
-/*           g_debug ("event: wd=%d mask=%#x (%s) cookie=%#x len=%u name=`%.*s'", */
-/*                    ev->wd, ev->mask, reason, ev->cookie, ev->len,  */
-/*                    (int)ev->len, ev->name); */
-
-          walking_watch_list_p++;
-          for (watch=watch_list; watch; watch = watch->next)
-            {
-              if (ev->wd == watch->wd && watch->callback)
-                watch->callback (watch->callback_data, watch->fname, reason);
-            }
-          walking_watch_list_p--;
-
-          nread -= sizeof *ev;
-          nread -= (nread > ev->len)?  ev->len : nread;
-          p += sizeof *ev + ev->len;
+          g_source_remove (flush_timer);
+          flush_timer = 0;
         }
-      
+      if (!flush_timer)
+        flush_timer = g_timeout_add (QUIET_PERIOD, flush_events_cb, NULL);
     }
 
   return TRUE; /* Keep the file watcher fd in the event loop.  */
@@ -173,6 +408,10 @@ gpa_init_filewatch (void)
     }
   g_io_channel_set_encoding (channel, NULL, NULL);
   g_io_channel_set_buffered (channel, FALSE);
+  g_io_channel_set_flags (channel, G_IO_FLAG_NONBLOCK, NULL);
+
+  watch_table = g_hash_table_new (g_direct_hash, g_direct_equal);
+  pending_table = g_hash_table_new (pending_event_hash, pending_event_equal);
 
   source_id = g_io_add_watch (channel, G_IO_IN, filewatch_cb, NULL);
   if (!source_id)
@@ -207,7 +446,13 @@ gpa_init_filewatch (void)
 	"x"  File is no longer watched
 
    CALLBACK is the callback function to be called for all matching
-   events.  
+   events.  If FILENAME is a directory, the callback is passed the
+   name of the file in the directory the event is about.  The events
+   are collected until no new ones arrive for a short time; the
+   callback is then called once for each file with all the reasons.
+   If events have been lost, the callback is called with FILENAME
+   NULL and the reason "o" regardless of MASKSTRING; any file may
+   have changed then.
 
    The function returns NULL on error or an object used for other
    operations.
@@ -244,7 +489,9 @@ gpa_add_filewatch (const char *filename, const char *maskstring,
         return NULL;
       }
 
-  wd = inotify_add_watch (queue_fd, filename, mask);
+  /* Several watches for the same file share the inotify watch, thus
+     we add to the mask of an existing one.  */
+  wd = inotify_add_watch (queue_fd, filename, mask | IN_MASK_ADD);
   if (wd == -1)
     {
       g_debug ("adding watch for `%s' failed: %s", filename, strerror (errno));
@@ -254,11 +501,12 @@ gpa_add_filewatch (const char *filename, const char *maskstring,
   handle = xcalloc (1, sizeof *handle + strlen (filename));
   strcpy (handle->fname, filename);
   handle->wd = wd;
+  handle->mask = mask;
   handle->callback = callback;
   handle->callback_data = callback_data;
-  
-  handle->next = watch_list;
-  watch_list = handle;
+
+  handle->next = g_hash_table_lookup (watch_table, GINT_TO_POINTER (wd));
+  g_hash_table_insert (watch_table, GINT_TO_POINTER (wd), handle);
 
   return handle;
 
@@ -266,3 +514,27 @@ gpa_add_filewatch (const char *filename, const char *maskstring,
   return NULL;
 #endif /*!HAVE_INOTIFY_INIT*/  
 }
+
+
+/* Remove the file watch WATCH.  */
+void
+gpa_remove_filewatch (gpa_filewatch_id_t watch)
+{
+#ifdef HAVE_INOTIFY_INIT
+  if (!watch)
+    return;
+
+  /* Never call the callback again.  */
+  watch->callback = NULL;
+  if (walking_watch_list_p)
+    {
+      /* The callbacks may still refer to it; release it later.  */
+      dead_watches = g_slist_prepend (dead_watches, watch);
+      return;
+    }
+
+  unlink_watch (watch);
+#else /*!HAVE_INOTIFY_INIT*/
+  (void)watch;
+#endif /*!HAVE_INOTIFY_INIT*/
+}
@@ -126,29 +126,63 @@ signatures_uid_changed (GtkComboBox *combo, gpointer user_data)
 }
 
 
-/* Fill the details page with the properties of the public key.  */
+/* A pending lookup of the secret key for the details page.  */
+struct seckey_lookup_s
+{
+  GpaKeyDetails *kdt;
+  GtkWidget *label;
+  gpgme_key_t key;
+};
+
+
+/* Show whether the key shown has the secret key SECKEY.  This is
+   called by gpa_keytable_lookup_key_async.  */
 static void
-details_page_fill_key (GpaKeyDetails *kdt, gpgme_key_t key)
+secret_key_found_cb (gpgme_key_t seckey, gpointer data)
 {
-  gpgme_user_id_t uid;
-  gpgme_key_t seckey;
-  char *text;
+  struct seckey_lookup_s *lookup = data;
+  GtkLabel *label = GTK_LABEL (lookup->label);
 
-  seckey = gpa_keytable_lookup_key (gpa_keytable_get_secret_instance(),
-                                    key->subkeys->fpr);
-  if (seckey)
+  /* Ignore the result if another key is shown meanwhile.  */
+  if (lookup->kdt->current_key != lookup->key)
+    ;
+  else if (seckey)
     {
       if (seckey->subkeys && seckey->subkeys->is_cardkey)
-        gtk_label_set_text (GTK_LABEL (kdt->detail_public_private),
+        gtk_label_set_text (label,
                             _("The key has both a smartcard based private part"
                               " and a public part"));
       else
-        gtk_label_set_text (GTK_LABEL (kdt->detail_public_private),
+        gtk_label_set_text (label,
                             _("The key has both a private and a public part"));
     }
   else
-    gtk_label_set_text (GTK_LABEL (kdt->detail_public_private),
-			_("The key has only a public part"));
+    gtk_label_set_text (label, _("The key has only a public part"));
+
+  gpgme_key_unref (lookup->key);
+  g_object_unref (lookup->label);
+  g_object_unref (lookup->kdt);
+  g_free (lookup);
+}
+
+
+/* Fill the details page with the properties of the public key.  */
+static void
+details_page_fill_key (GpaKeyDetails *kdt, gpgme_key_t key)
+{
+  struct seckey_lookup_s *lookup;
+  gpgme_user_id_t uid;
+  char *text;
+
+  gtk_label_set_text (GTK_LABEL (kdt->detail_public_private), "");
+  lookup = g_new (struct seckey_lookup_s, 1);
+  lookup->kdt = g_object_ref (kdt);
+  lookup->label = g_object_ref (kdt->detail_public_private);
+  gpgme_key_ref (key);
+  lookup->key = key;
+  gpa_keytable_lookup_key_async (gpa_keytable_get_secret_instance (),
+                                 key->subkeys->fpr,
+                                 secret_key_found_cb, lookup);
 
   gtk_label_set_text (GTK_LABEL (kdt->detail_capabilities),
 		      gpa_get_key_capabilities_text (key));
@@ -63,6 +63,13 @@ gboolean debug_edit_fsm;
 /* True if verbose messages are requested.  */
 gboolean verbose;
 
+/* True if the UI server shall not show progress or result dialogs.  */
+gboolean headless_server;
+
+/* The maximum number of UI server operations running at the same
+   time.  If not positive the number of processors is used.  */
+int server_jobs;
+
 /* Local variables.  */
 typedef struct
 {
@@ -120,6 +127,10 @@ static GOptionEntry option_entries[] =
       N_("Open the settings dialog"), NULL },
     { "daemon", 'd', 0, G_OPTION_ARG_NONE, &args.start_only_server,
       N_("Only start the UI server"), NULL },
+    { "headless", 0, 0, G_OPTION_ARG_NONE, &headless_server,
+      N_("Do not show dialogs for UI server operations"), NULL },
+    { "server-jobs", 0, 0, G_OPTION_ARG_INT, &server_jobs,
+      N_("Run at most N UI server operations at once"), "N" },
     { "disable-x509", 0, 0, G_OPTION_ARG_NONE, &args.disable_x509,
       N_("Disable support for X.509"), NULL },
     { "options", 'o', 0, G_OPTION_ARG_FILENAME, &args.options_filename,
@@ -63,6 +63,8 @@ extern gboolean cms_hack;
 extern gboolean disable_ticker;
 extern gboolean debug_edit_fsm;
 extern gboolean verbose;
+extern gboolean headless_server;
+extern int server_jobs;
 
 /* Show the keyring editor dialog.  */
 void gpa_open_key_manager (GSimpleAction *simple, GVariant *parameter, gpointer user_data);
@@ -120,6 +122,7 @@ gpa_filewatch_id_t gpa_add_filewatch (const char *filename,
                                       const char *maskstring,
                                       gpa_filewatch_cb_t cb,
                                       void *cb_data);
+void gpa_remove_filewatch (gpa_filewatch_id_t watch);
 
 GtkApplication *get_gpa_application();
 
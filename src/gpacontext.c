@@ -375,12 +375,13 @@ register_callback (struct gpa_io_cb_data *cb)
 
 /* Queuing callbacks until the START event arrives */
 
-/* Add a callback to the list, until the START event arrives
+/* Add a callback to the list, until the START event arrives.  The
+   order of the callbacks does not matter; thus we prepend.
  */
 static void
 add_callback (GpaContext *context, struct gpa_io_cb_data *cb)
 {
-  context->cbs = g_list_append (context->cbs, cb);
+  context->cbs = g_list_prepend (context->cbs, cb);
 }
 
 
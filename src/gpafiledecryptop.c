@@ -41,12 +41,15 @@
 
 /* Internal functions */
 static gboolean gpa_file_decrypt_operation_idle_cb (gpointer data);
-static void gpa_file_decrypt_operation_done_cb (GpaContext *context,
-						gpg_error_t err,
-						GpaFileDecryptOperation *op);
-static void gpa_file_decrypt_operation_done_error_cb (GpaContext *context,
-						      gpg_error_t err,
-						      GpaFileDecryptOperation *op);
+static gpg_error_t gpa_file_decrypt_operation_start
+	(GpaFileOperation *op, gpa_file_worker_t worker);
+static void gpa_file_decrypt_operation_done_cb (GpaFileOperation *op,
+						gpa_file_worker_t worker,
+						gpg_error_t err);
+static void gpa_file_decrypt_operation_done_error_cb
+	(GpaFileOperation *op, gpa_file_worker_t worker, gpg_error_t err);
+static void gpa_file_decrypt_operation_finish (GpaFileOperation *op,
+					       gpg_error_t err);
 
 /* GObject */
 
@@ -111,10 +114,9 @@ gpa_file_decrypt_operation_finalize (GObject *object)
 static void
 gpa_file_decrypt_operation_init (GpaFileDecryptOperation *op)
 {
-  op->cipher_fd = -1;
-  op->plain_fd = -1;
-  op->cipher = NULL;
-  op->plain = NULL;
+  op->err = 0;
+  op->signed_files = 0;
+  op->dialog = NULL;
 }
 
 
@@ -145,16 +147,11 @@ gpa_file_decrypt_operation_constructor
   /* Initialize */
   /* Start with the first file after going back into the main loop */
   g_idle_add (gpa_file_decrypt_operation_idle_cb, op);
-  /* Connect to the "done" signal */
-  g_signal_connect (G_OBJECT (GPA_OPERATION (op)->context), "done",
-		    G_CALLBACK (gpa_file_decrypt_operation_done_error_cb), op);
-  g_signal_connect (G_OBJECT (GPA_OPERATION (op)->context), "done",
-		    G_CALLBACK (gpa_file_decrypt_operation_done_cb), op);
   /* Give a title to the progress dialog */
   gtk_window_set_title (GTK_WINDOW (GPA_FILE_OPERATION (op)->progress_dialog),
 			_("Decrypting..."));
 
-  if (op->verify)
+  if (op->verify && !GPA_FILE_OPERATION (op)->batch)
     {
       /* Create the verification dialog */
       op->dialog = gpa_file_verify_dialog_new (GPA_OPERATION (op)->window);
@@ -170,6 +167,7 @@ static void
 gpa_file_decrypt_operation_class_init (GpaFileDecryptOperationClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GpaFileOperationClass *file_op_class = GPA_FILE_OPERATION_CLASS (klass);
 
   parent_class = g_type_class_peek_parent (klass);
 
@@ -178,6 +176,11 @@ gpa_file_decrypt_operation_class_init (GpaFileDecryptOperationClass *klass)
   object_class->set_property = gpa_file_decrypt_operation_set_property;
   object_class->get_property = gpa_file_decrypt_operation_get_property;
 
+  file_op_class->start_item = gpa_file_decrypt_operation_start;
+  file_op_class->show_error = gpa_file_decrypt_operation_done_error_cb;
+  file_op_class->item_done = gpa_file_decrypt_operation_done_cb;
+  file_op_class->finish = gpa_file_decrypt_operation_finish;
+
   /* Properties */
   g_object_class_install_property (object_class,
 				   PROP_VERIFY,
@@ -248,6 +251,25 @@ gpa_file_decrypt_verify_operation_new (GtkWidget *window,
 }
 
 
+/* Create a new decrypt operation for FILES which runs without any
+   dialogs.  If VERIFY is set, a file without a valid signature is
+   reported as an error.  Existing output files are not
+   overwritten.  */
+GpaFileDecryptOperation*
+gpa_file_decrypt_operation_new_batch (GList *files, gboolean verify)
+{
+  GpaFileDecryptOperation *op;
+
+  op = g_object_new (GPA_FILE_DECRYPT_OPERATION_TYPE,
+		     "input_files", files,
+		     "verify", verify,
+		     "batch", TRUE,
+		     NULL);
+
+  return op;
+}
+
+
 /* Internal */
 
 static gchar *
@@ -274,196 +296,112 @@ destination_filename (const gchar *filename)
 }
 
 static gpg_error_t
-gpa_file_decrypt_operation_start (GpaFileDecryptOperation *op,
-				  gpa_file_item_t file_item)
+gpa_file_decrypt_operation_start (GpaFileOperation *op,
+				  gpa_file_worker_t worker)
 {
+  gpa_file_item_t file_item = worker->item;
   gpg_error_t err;
 
-  if (file_item->direct_in)
+  if (GPA_FILE_ITEM_IS_DIRECT (file_item))
     {
-      /* No copy is made.  */
-      err = gpgme_data_new_from_mem (&op->cipher, file_item->direct_in,
-				     file_item->direct_in_len, 0);
-      if (err)
-	{
-	  gpa_gpgme_warning (err);
-	  return err;
-	}
+      gpa_data_info_t info;
 
-      err = gpgme_data_new (&op->plain);
+      /* No copy is made.  */
+      err = gpa_file_operation_open_direct (op, file_item,
+					    &worker->in, &worker->out);
       if (err)
 	{
 	  gpa_gpgme_warning (err);
-	  gpgme_data_release (op->cipher);
-	  op->plain = NULL;
 	  return err;
 	}
 
-      gpgme_set_protocol (GPA_OPERATION (op)->context->ctx,
-                          is_cms_data (file_item->direct_in,
-                                       file_item->direct_in_len) ?
-                          GPGME_PROTOCOL_CMS : GPGME_PROTOCOL_OpenPGP);
+      gpa_identify_data (worker->in, &info);
+      gpgme_set_protocol (worker->context->ctx, info.protocol);
     }
   else
     {
       gchar *cipher_filename = file_item->filename_in;
       char *filename_used;
+      gpa_data_info_t info;
 
       file_item->filename_out = destination_filename (cipher_filename);
       /* Open the files */
-      op->cipher_fd = gpa_open_input (cipher_filename, &op->cipher,
-				  GPA_OPERATION (op)->window);
-      if (op->cipher_fd == -1)
-	/* FIXME: Error value.  */
-	return gpg_error (GPG_ERR_GENERAL);
-
-      op->plain_fd = gpa_open_output (file_item->filename_out, &op->plain,
-				      GPA_OPERATION (op)->window,
-                                      &filename_used);
-      if (op->plain_fd == -1)
+      err = gpa_file_operation_open_input (op, cipher_filename,
+					   &worker->in, &worker->in_fd);
+      if (err)
+	{
+	  g_free (file_item->filename_out);
+	  file_item->filename_out = NULL;
+	  return err;
+	}
+
+      err = gpa_file_operation_open_output (op, file_item->filename_out,
+					    &worker->out, &worker->out_fd,
+					    &filename_used);
+      if (err)
 	{
-	  gpgme_data_release (op->cipher);
-	  close (op->cipher_fd);
           xfree (filename_used);
-	  /* FIXME: Error value.  */
-	  return gpg_error (GPG_ERR_GENERAL);
+	  g_free (file_item->filename_out);
+	  file_item->filename_out = NULL;
+	  return err;
 	}
 
       xfree (file_item->filename_out);
       file_item->filename_out = filename_used;
 
-      gpgme_set_protocol (GPA_OPERATION (op)->context->ctx,
-                          is_cms_file (cipher_filename) ?
-                          GPGME_PROTOCOL_CMS : GPGME_PROTOCOL_OpenPGP);
+      gpa_identify_data (worker->in, &info);
+      gpgme_set_protocol (worker->context->ctx, info.protocol);
     }
 
   /* Start the operation.  */
-  err = gpgme_op_decrypt_verify_start (GPA_OPERATION (op)->context->ctx,
-				       op->cipher, op->plain);
+  err = gpgme_op_decrypt_verify_start (worker->context->ctx,
+				       worker->in, worker->out);
   if (err)
     {
       gpa_gpgme_warning (err);
-
-      gpgme_data_release (op->plain);
-      op->plain = NULL;
-      close (op->plain_fd);
-      op->plain_fd = -1;
-      gpgme_data_release (op->cipher);
-      op->cipher = NULL;
-      close (op->cipher_fd);
-      op->cipher_fd = -1;
-
       return err;
     }
 
-  /* Show and update the progress dialog.  */
-  gtk_widget_show_all (GPA_FILE_OPERATION (op)->progress_dialog);
-  gpa_progress_dialog_set_label (GPA_PROGRESS_DIALOG
-				 (GPA_FILE_OPERATION (op)->progress_dialog),
-				 file_item->direct_name
-				 ? file_item->direct_name
-				 : file_item->filename_in);
   return 0;
 }
 
 
 static void
-gpa_file_decrypt_operation_next (GpaFileDecryptOperation *op)
-{
-  gpg_error_t err;
-
-  if (! GPA_FILE_OPERATION (op)->current)
-    {
-      if (op->verify && op->signed_files)
-	{
-	  op->err = 0;
-	  gtk_widget_show_all (op->dialog);
-	}
-      else
-	g_signal_emit_by_name (GPA_OPERATION (op), "completed", 0);
-      return;
-    }
-
-  err = gpa_file_decrypt_operation_start
-    (op, GPA_FILE_OPERATION (op)->current->data);
-  if (err)
-    {
-      if (op->verify && op->signed_files)
-	{
-	  /* All files have been verified: show the results dialog */
-	  op->err = err;
-	  gtk_widget_show_all (op->dialog);
-	}
-      else
-	g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
-    }
-}
-
-
-static void
-gpa_file_decrypt_operation_done_cb (GpaContext *context,
-				    gpg_error_t err,
-				    GpaFileDecryptOperation *op)
+gpa_file_decrypt_operation_done_cb (GpaFileOperation *file_op,
+				    gpa_file_worker_t worker,
+				    gpg_error_t err)
 {
-  gpa_file_item_t file_item = GPA_FILE_OPERATION (op)->current->data;
-
-  if (file_item->direct_in)
-    {
-      size_t len;
-      char *plain_gpgme = gpgme_data_release_and_get_mem (op->plain, &len);
-      op->plain = NULL;
-      /* Do the memory allocation dance.  */
+  GpaFileDecryptOperation *op = GPA_FILE_DECRYPT_OPERATION (file_op);
+  gpa_file_item_t file_item = worker->item;
 
-      if (plain_gpgme)
-	{
-	  /* Conveniently make ASCII stuff into a string.  */
-	  file_item->direct_out = g_malloc (len + 1);
-	  memcpy (file_item->direct_out, plain_gpgme, len);
-	  gpgme_free (plain_gpgme);
-	  file_item->direct_out[len] = '\0';
-	  /* Yep, excluding the trailing zero.  */
-	  file_item->direct_out_len = len;
-	}
-      else
-	{
-	  file_item->direct_out = NULL;
-	  file_item->direct_out_len = 0;
-	}
-    }
-
-  /* Do clean up on the operation */
-  gpgme_data_release (op->plain);
-  op->plain = NULL;
-  close (op->plain_fd);
-  op->plain_fd = -1;
-  gpgme_data_release (op->cipher);
-  op->cipher = NULL;
-  close (op->cipher_fd);
-  op->cipher_fd = -1;
-  gtk_widget_hide (GPA_FILE_OPERATION (op)->progress_dialog);
   if (err)
     {
-      if (! file_item->direct_in)
+      if (! file_item->direct_in && file_item->filename_out)
 	{
 	  /* If an error happened, (or the user canceled) delete the
-	     created file and abort further decryptions.  */
+	     created file.  */
 	  g_unlink (file_item->filename_out);
 	  g_free (file_item->filename_out);
 	  file_item->filename_out = NULL;
 	}
-      /* FIXME:CLIPBOARD: Server finish?  */
-      g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
     }
   else
     {
       /* We've just created a file */
       g_signal_emit_by_name (GPA_OPERATION (op), "created_file", file_item);
 
-      if (op->verify)
+      if (op->verify && file_op->batch)
+	{
+	  /* There is no dialog; report a missing or bad signature as
+	     the result of the file.  */
+	  file_item->err = gpa_gpgme_signature_error
+	    (gpgme_op_verify_result (worker->context->ctx));
+	}
+      else if (op->verify)
 	{
 	  gpgme_verify_result_t result;
 
-	  result = gpgme_op_verify_result (GPA_OPERATION (op)->context->ctx);
+	  result = gpgme_op_verify_result (worker->context->ctx);
 	  if (result->signatures)
 	    {
 	      /* Add the file to the result dialog.  FIXME: Maybe we
@@ -477,12 +415,27 @@ gpa_file_decrypt_operation_done_cb (GpaContext *context,
 	      op->signed_files++;
 	    }
 	}
+    }
+}
+
+
+/* All files have been decrypted or an error occurred.  */
+static void
+gpa_file_decrypt_operation_finish (GpaFileOperation *file_op,
+				   gpg_error_t err)
+{
+  GpaFileDecryptOperation *op = GPA_FILE_DECRYPT_OPERATION (file_op);
 
-      /* Go to the next file in the list and decrypt it */
-      GPA_FILE_OPERATION (op)->current = g_list_next
-	(GPA_FILE_OPERATION (op)->current);
-      gpa_file_decrypt_operation_next (op);
+  /* FIXME:CLIPBOARD: Server finish?  */
+  if (op->dialog && op->signed_files)
+    {
+      /* Show the results dialog; the operation is completed when it
+	 is closed.  */
+      op->err = err;
+      gtk_widget_show_all (op->dialog);
     }
+  else
+    g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
 }
 
 
@@ -491,17 +444,18 @@ gpa_file_decrypt_operation_idle_cb (gpointer data)
 {
   GpaFileDecryptOperation *op = data;
 
-  gpa_file_decrypt_operation_next (op);
+  gpa_file_operation_start_files (GPA_FILE_OPERATION (op));
 
   return FALSE;
 }
 
 
 static void
-gpa_file_decrypt_operation_done_error_cb (GpaContext *context, gpg_error_t err,
-					  GpaFileDecryptOperation *op)
+gpa_file_decrypt_operation_done_error_cb (GpaFileOperation *op,
+					  gpa_file_worker_t worker,
+					  gpg_error_t err)
 {
-  gpa_file_item_t file_item = GPA_FILE_OPERATION (op)->current->data;
+  gpa_file_item_t file_item = worker->item;
 
   switch (gpg_err_code (err))
     {
@@ -510,7 +464,7 @@ gpa_file_decrypt_operation_done_error_cb (GpaContext *context, gpg_error_t err,
       /* Ignore these */
       break;
     case GPG_ERR_NO_DATA:
-      gpa_show_warn (GPA_OPERATION (op)->window, GPA_OPERATION (op)->context,
+      gpa_show_warn (GPA_OPERATION (op)->window, worker->context,
                      file_item->direct_name
                      ? _("\"%s\" contained no OpenPGP data.")
                      : _("The file \"%s\" contained no OpenPGP"
@@ -520,7 +474,7 @@ gpa_file_decrypt_operation_done_error_cb (GpaContext *context, gpg_error_t err,
                      : file_item->filename_in);
       break;
     case GPG_ERR_DECRYPT_FAILED:
-      gpa_show_warn (GPA_OPERATION (op)->window, GPA_OPERATION (op)->context,
+      gpa_show_warn (GPA_OPERATION (op)->window, worker->context,
                      file_item->direct_name
                      ? _("\"%s\" contained no valid "
                          "encrypted data.")
@@ -531,11 +485,11 @@ gpa_file_decrypt_operation_done_error_cb (GpaContext *context, gpg_error_t err,
                      : file_item->filename_in);
       break;
     case GPG_ERR_BAD_PASSPHRASE:
-      gpa_show_warn (GPA_OPERATION (op)->window, GPA_OPERATION (op)->context,
+      gpa_show_warn (GPA_OPERATION (op)->window, worker->context,
                      _("Wrong passphrase!"));
       break;
     default:
-      gpa_gpgme_warn (err, NULL, GPA_OPERATION (op)->context);
+      gpa_gpgme_warn (err, NULL, worker->context);
       break;
     }
 }
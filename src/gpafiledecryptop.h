@@ -40,9 +40,6 @@ typedef struct _GpaFileDecryptOperationClass GpaFileDecryptOperationClass;
 struct _GpaFileDecryptOperation {
   GpaFileOperation parent;
 
-  int cipher_fd, plain_fd;
-  gpgme_data_t cipher, plain;
- 
   gboolean verify;
   gpg_error_t err;
   int signed_files;
@@ -65,4 +62,9 @@ GpaFileDecryptOperation *gpa_file_decrypt_operation_new (GtkWidget *window,
 GpaFileDecryptOperation *gpa_file_decrypt_verify_operation_new
   (GtkWidget *window, GList *files);
 
+/* Creates a new decryption operation without dialogs, for example
+   for the UI server.  */
+GpaFileDecryptOperation *gpa_file_decrypt_operation_new_batch
+  (GList *files, gboolean verify);
+
 #endif
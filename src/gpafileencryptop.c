@@ -41,15 +41,19 @@
 #include "gpawidgets.h"
 
 /* Internal functions */
-static void gpa_file_encrypt_operation_done_error_cb (GpaContext *context,
-						      gpg_error_t err,
-						      GpaFileEncryptOperation *op);
-static void gpa_file_encrypt_operation_done_cb (GpaContext *context,
-						gpg_error_t err,
-						GpaFileEncryptOperation *op);
+static gpg_error_t gpa_file_encrypt_operation_start
+	(GpaFileOperation *op, gpa_file_worker_t worker);
+static void gpa_file_encrypt_operation_done_error_cb
+	(GpaFileOperation *op, gpa_file_worker_t worker, gpg_error_t err);
+static void gpa_file_encrypt_operation_done_cb (GpaFileOperation *op,
+						gpa_file_worker_t worker,
+						gpg_error_t err);
+static void gpa_file_encrypt_operation_finish (GpaFileOperation *op,
+					       gpg_error_t err);
 static void gpa_file_encrypt_operation_response_cb (GtkDialog *dialog,
 						    gint response,
 						    gpointer user_data);
+static gboolean gpa_file_encrypt_operation_idle_cb (gpointer data);
 
 /* GObject */
 
@@ -106,7 +110,10 @@ gpa_file_encrypt_operation_finalize (GObject *object)
   /* FIXME: The use of RSET is messed up.  There is no clear concept
      on who owns the key.  This should be fixed by refing the keys
      object.  I doubt that the keys are at all released. */
-  g_free (op->rset);
+  if (GPA_FILE_OPERATION (op)->batch)
+    gpa_gpgme_release_keyarray (op->rset);
+  else
+    g_free (op->rset);
   op->rset = NULL;
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
@@ -117,12 +124,9 @@ static void
 gpa_file_encrypt_operation_init (GpaFileEncryptOperation *op)
 {
   op->rset = NULL;
-  op->cipher_fd = -1;
-  op->plain_fd = -1;
-  op->cipher = NULL;
-  op->plain = NULL;
   op->encrypt_dialog = NULL;
   op->force_armor = FALSE;
+  op->sign = FALSE;
 }
 
 static GObject*
@@ -140,16 +144,18 @@ gpa_file_encrypt_operation_constructor
 				      construct_properties);
   op = GPA_FILE_ENCRYPT_OPERATION (object);
   /* Initialize */
+  if (GPA_FILE_OPERATION (op)->batch)
+    {
+      /* The recipients are set by the caller; start with the first
+	 file after going back into the main loop.  */
+      g_idle_add (gpa_file_encrypt_operation_idle_cb, op);
+      return object;
+    }
   /* Create the "Encrypt" dialog */
   op->encrypt_dialog = gpa_file_encrypt_dialog_new
     (GPA_OPERATION (op)->window, op->force_armor);
   g_signal_connect (G_OBJECT (op->encrypt_dialog), "response",
 		    G_CALLBACK (gpa_file_encrypt_operation_response_cb), op);
-  /* Connect to the "done" signal */
-  g_signal_connect (G_OBJECT (GPA_OPERATION (op)->context), "done",
-		    G_CALLBACK (gpa_file_encrypt_operation_done_error_cb), op);
-  g_signal_connect (G_OBJECT (GPA_OPERATION (op)->context), "done",
-		    G_CALLBACK (gpa_file_encrypt_operation_done_cb), op);
   /* Give a title to the progress dialog */
   gtk_window_set_title (GTK_WINDOW (GPA_FILE_OPERATION (op)->progress_dialog),
 			_("Encrypting..."));
@@ -163,6 +169,7 @@ static void
 gpa_file_encrypt_operation_class_init (GpaFileEncryptOperationClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GpaFileOperationClass *file_op_class = GPA_FILE_OPERATION_CLASS (klass);
 
   parent_class = g_type_class_peek_parent (klass);
 
@@ -171,6 +178,11 @@ gpa_file_encrypt_operation_class_init (GpaFileEncryptOperationClass *klass)
   object_class->set_property = gpa_file_encrypt_operation_set_property;
   object_class->get_property = gpa_file_encrypt_operation_get_property;
 
+  file_op_class->start_item = gpa_file_encrypt_operation_start;
+  file_op_class->show_error = gpa_file_encrypt_operation_done_error_cb;
+  file_op_class->item_done = gpa_file_encrypt_operation_done_cb;
+  file_op_class->finish = gpa_file_encrypt_operation_finish;
+
   g_object_class_install_property (object_class,
 				   PROP_FORCE_ARMOR,
 				   g_param_spec_boolean
@@ -245,16 +257,34 @@ gpa_file_encrypt_sign_operation_new (GtkWidget *window, GList *files,
 }
 
 
+/* Create a new encryption operation for FILES which runs without any
+   dialogs.  The files are encrypted to the keys in the NULL
+   terminated array RECIPIENTS, which must all be of the same
+   protocol, and signed with SIGNER if it is not NULL.  Existing
+   output files are not overwritten.  */
 GpaFileEncryptOperation*
-gpa_file_encrypt_operation_new_for_server (GList *files, void *server_ctx)
+gpa_file_encrypt_operation_new_batch (GList *files, gpgme_key_t *recipients,
+				      gpgme_key_t signer, gboolean armor)
 {
   GpaFileEncryptOperation *op;
+  gpgme_ctx_t ctx;
 
   op = g_object_new (GPA_FILE_ENCRYPT_OPERATION_TYPE,
 		     "input_files", files,
-                     "server-ctx", server_ctx,
+		     "batch", TRUE,
 		     NULL);
 
+  ctx = GPA_OPERATION (op)->context->ctx;
+  op->rset = gpa_gpgme_copy_keyarray (recipients);
+  if (recipients && recipients[0])
+    gpgme_set_protocol (ctx, recipients[0]->protocol);
+  gpgme_set_armor (ctx, armor);
+  if (signer)
+    {
+      gpgme_signers_add (ctx, signer);
+      op->sign = TRUE;
+    }
+
   return op;
 }
 
@@ -282,30 +312,23 @@ destination_filename (const gchar *filename, gboolean armor)
 
 
 static gpg_error_t
-gpa_file_encrypt_operation_start (GpaFileEncryptOperation *op,
-				  gpa_file_item_t file_item)
+gpa_file_encrypt_operation_start (GpaFileOperation *file_op,
+				  gpa_file_worker_t worker)
 {
+  GpaFileEncryptOperation *op = GPA_FILE_ENCRYPT_OPERATION (file_op);
+  gpa_file_item_t file_item = worker->item;
   gpg_error_t err;
 
-  if (file_item->direct_in)
+  if (GPA_FILE_ITEM_IS_DIRECT (file_item))
     {
       /* No copy is made.  */
-      err = gpgme_data_new_from_mem (&op->plain, file_item->direct_in,
-				     file_item->direct_in_len, 0);
+      err = gpa_file_operation_open_direct (file_op, file_item,
+					    &worker->in, &worker->out);
       if (err)
 	{
 	  gpa_gpgme_warning (err);
 	  return err;
 	}
-
-      err = gpgme_data_new (&op->cipher);
-      if (err)
-	{
-	  gpa_gpgme_warning (err);
-	  gpgme_data_release (op->plain);
-	  op->plain = NULL;
-	  return err;
-	}
     }
   else
     {
@@ -313,25 +336,26 @@ gpa_file_encrypt_operation_start (GpaFileEncryptOperation *op,
       char *filename_used;
 
       file_item->filename_out = destination_filename
-	(plain_filename, gpgme_get_armor (GPA_OPERATION (op)->context->ctx));
+	(plain_filename, gpgme_get_armor (worker->context->ctx));
       /* Open the files */
-      op->plain_fd = gpa_open_input (plain_filename, &op->plain,
-				     GPA_OPERATION (op)->window);
-      if (op->plain_fd == -1)
-	/* FIXME: Error value.  */
-	return gpg_error (GPG_ERR_GENERAL);
-
-      op->cipher_fd = gpa_open_output (file_item->filename_out, &op->cipher,
-				       GPA_OPERATION (op)->window,
-                                       &filename_used);
-      if (op->cipher_fd == -1)
+      err = gpa_file_operation_open_input (file_op, plain_filename,
+					   &worker->in, &worker->in_fd);
+      if (err)
+	{
+	  g_free (file_item->filename_out);
+	  file_item->filename_out = NULL;
+	  return err;
+	}
+
+      err = gpa_file_operation_open_output (file_op, file_item->filename_out,
+					    &worker->out, &worker->out_fd,
+					    &filename_used);
+      if (err)
 	{
-	  gpgme_data_release (op->plain);
-	  close (op->plain_fd);
-	  op->plain_fd = -1;
           xfree (filename_used);
-	  /* FIXME: Error value.  */
-	  return gpg_error (GPG_ERR_GENERAL);
+	  g_free (file_item->filename_out);
+	  file_item->filename_out = NULL;
+	  return err;
 	}
 
       xfree (file_item->filename_out);
@@ -341,127 +365,71 @@ gpa_file_encrypt_operation_start (GpaFileEncryptOperation *op,
   /* Start the operation.  */
   /* Always trust keys, because any untrusted keys were already
      confirmed by the user.  */
-  if (gpa_file_encrypt_dialog_get_sign
-      (GPA_FILE_ENCRYPT_DIALOG (op->encrypt_dialog)))
-    err = gpgme_op_encrypt_sign_start (GPA_OPERATION (op)->context->ctx,
+  if (op->encrypt_dialog
+      ? gpa_file_encrypt_dialog_get_sign
+      (GPA_FILE_ENCRYPT_DIALOG (op->encrypt_dialog))
+      : op->sign)
+    err = gpgme_op_encrypt_sign_start (worker->context->ctx,
 				       op->rset, GPGME_ENCRYPT_ALWAYS_TRUST,
-				       op->plain, op->cipher);
+				       worker->in, worker->out);
   else
-    err = gpgme_op_encrypt_start (GPA_OPERATION (op)->context->ctx,
+    err = gpgme_op_encrypt_start (worker->context->ctx,
 				  op->rset, GPGME_ENCRYPT_ALWAYS_TRUST,
-				  op->plain, op->cipher);
-
+				  worker->in, worker->out);
   if (err)
     {
       gpa_gpgme_warning (err);
-
-      gpgme_data_release (op->plain);
-      op->plain = NULL;
-      close (op->plain_fd);
-      op->plain_fd = -1;
-      gpgme_data_release (op->cipher);
-      op->cipher = NULL;
-      close (op->cipher_fd);
-      op->cipher_fd = -1;
-
       return err;
     }
 
-  /* Show and update the progress dialog.  */
-  gtk_widget_show_all (GPA_FILE_OPERATION (op)->progress_dialog);
-  gpa_progress_dialog_set_label (GPA_PROGRESS_DIALOG
-				 (GPA_FILE_OPERATION (op)->progress_dialog),
-				 file_item->direct_name
-				 ? file_item->direct_name
-				 : file_item->filename_in);
   return 0;
 }
 
-static void
-gpa_file_encrypt_operation_next (GpaFileEncryptOperation *op)
-{
-  gpg_error_t err;
-
-  if (! GPA_FILE_OPERATION (op)->current)
-    {
-      g_signal_emit_by_name (GPA_OPERATION (op), "completed", 0);
-      return;
-    }
-
-  err = gpa_file_encrypt_operation_start
-    (op, GPA_FILE_OPERATION (op)->current->data);
-  if (err)
-    g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
-}
-
 
 static void
-gpa_file_encrypt_operation_done_cb (GpaContext *context,
-				    gpg_error_t err,
-				    GpaFileEncryptOperation *op)
+gpa_file_encrypt_operation_done_cb (GpaFileOperation *op,
+				    gpa_file_worker_t worker,
+				    gpg_error_t err)
 {
-  gpa_file_item_t file_item = GPA_FILE_OPERATION (op)->current->data;
-
-  if (file_item->direct_in)
-    {
-      size_t len;
-      char *cipher_gpgme = gpgme_data_release_and_get_mem (op->cipher,
-							   &len);
-      op->cipher = NULL;
-      /* Do the memory allocation dance.  */
-
-      if (cipher_gpgme)
-	{
-	  /* Conveniently make ASCII stuff into a string.  */
-	  file_item->direct_out = g_malloc (len + 1);
-	  memcpy (file_item->direct_out, cipher_gpgme, len);
-	  gpgme_free (cipher_gpgme);
-	  file_item->direct_out[len] = '\0';
-	  /* Yep, excluding the trailing zero.  */
-	  file_item->direct_out_len = len;
-	}
-      else
-	{
-	  file_item->direct_out = NULL;
-	  file_item->direct_out_len = 0;
-	}
-    }
-
-  /* Do clean up on the operation */
-  gpgme_data_release (op->plain);
-  op->plain = NULL;
-  close (op->plain_fd);
-  op->plain_fd = -1;
-  gpgme_data_release (op->cipher);
-  op->cipher = NULL;
-  close (op->cipher_fd);
-  op->cipher_fd = -1;
-  gtk_widget_hide (GPA_FILE_OPERATION (op)->progress_dialog);
+  gpa_file_item_t file_item = worker->item;
 
   if (err)
     {
-      if (! file_item->direct_in)
+      if (! file_item->direct_in && file_item->filename_out)
 	{
 	  /* If an error happened, (or the user canceled) delete the
-	    created file and abort further encryptions.  */
+	    created file.  */
 	  g_unlink (file_item->filename_out);
 	  g_free (file_item->filename_out);
 	  file_item->filename_out = NULL;
 	}
-      g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
     }
   else
     {
       /* We've just created a file */
       g_signal_emit_by_name (GPA_OPERATION (op), "created_file", file_item);
-
-      /* Go to the next file in the list and encrypt it */
-      GPA_FILE_OPERATION (op)->current = g_list_next
-	(GPA_FILE_OPERATION (op)->current);
-      gpa_file_encrypt_operation_next (op);
     }
 }
 
+
+/* All files have been encrypted or an error occurred.  */
+static void
+gpa_file_encrypt_operation_finish (GpaFileOperation *op, gpg_error_t err)
+{
+  g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
+}
+
+
+static gboolean
+gpa_file_encrypt_operation_idle_cb (gpointer data)
+{
+  GpaFileEncryptOperation *op = data;
+
+  gpa_file_operation_start_files (GPA_FILE_OPERATION (op));
+
+  return FALSE;
+}
+
 /*
  * Setting the recipients for the context.
  */
@@ -751,7 +719,7 @@ static void gpa_file_encrypt_operation_response_cb (GtkDialog *dialog,
 
       /* Actually run the operation or abort.  */
       if (success)
-	gpa_file_encrypt_operation_next (op);
+	gpa_file_operation_start_files (GPA_FILE_OPERATION (op));
       else
 	g_signal_emit_by_name (GPA_OPERATION (op), "completed",
 				 gpg_error (GPG_ERR_GENERAL));
@@ -769,8 +737,9 @@ static void gpa_file_encrypt_operation_response_cb (GtkDialog *dialog,
 }
 
 static void
-gpa_file_encrypt_operation_done_error_cb (GpaContext *context, gpg_error_t err,
-					  GpaFileEncryptOperation *op)
+gpa_file_encrypt_operation_done_error_cb (GpaFileOperation *op,
+					  gpa_file_worker_t worker,
+					  gpg_error_t err)
 {
   switch (gpg_err_code (err))
     {
@@ -779,11 +748,11 @@ gpa_file_encrypt_operation_done_error_cb (GpaContext *context, gpg_error_t err,
       /* Ignore these */
       break;
     case GPG_ERR_BAD_PASSPHRASE:
-      gpa_show_warn (GPA_OPERATION (op)->window, GPA_OPERATION (op)->context,
+      gpa_show_warn (GPA_OPERATION (op)->window, worker->context,
                      _("Wrong passphrase!"));
       break;
     default:
-      gpa_gpgme_warn (err, NULL, GPA_OPERATION (op)->context);
+      gpa_gpgme_warn (err, NULL, worker->context);
       break;
     }
 }
@@ -57,10 +57,11 @@ struct _GpaFileEncryptOperation
   
   GtkWidget *encrypt_dialog;
   gpgme_key_t *rset;
-  int cipher_fd, plain_fd;
-  gpgme_data_t cipher, plain;
 
   gboolean force_armor;
+
+  /* Whether to sign as well.  This is only used without the dialog.  */
+  gboolean sign;
 };
 
 
@@ -82,8 +83,9 @@ GpaFileEncryptOperation *gpa_file_encrypt_operation_new (GtkWidget *window,
 GpaFileEncryptOperation *gpa_file_encrypt_sign_operation_new
 (GtkWidget *window, GList *files, gboolean force_armor);
 
-/* Create a new encryption operaion for the UI server.  */
-GpaFileEncryptOperation*
-gpa_file_encrypt_operation_new_for_server (GList *files, void *server_ctx);
+/* Create a new encryption operation without dialogs, for example
+   for the UI server.  */
+GpaFileEncryptOperation *gpa_file_encrypt_operation_new_batch
+(GList *files, gpgme_key_t *recipients, gpgme_key_t signer, gboolean armor);
 
 #endif
@@ -22,6 +22,8 @@
 #endif
 
 #include <glib.h>
+#include <glib/gstdio.h>
+#include <fcntl.h>
 
 #ifdef G_OS_UNIX
 #include <unistd.h>
@@ -37,15 +39,84 @@
 #include "filetype.h"
 #include "gpafileimportop.h"
 
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+
+/* OpenPGP files with keys of the same kind, armored or binary, are
+   concatenated and imported at once.  All other files are imported
+   one by one.  The OpenPGP and the CMS imports run concurrently.  */
+enum
+  {
+    LANE_OPENPGP,
+    LANE_CMS,
+    N_LANES
+  };
+
+/* A file of an import job.  */
+struct import_file_s
+{
+  /* The item of the file; it is not owned.  */
+  gpa_file_item_t item;
+  /* The descriptor opened to identify the file, which is then read by
+     the import, or -1.  */
+  int fd;
+  /* The error reading the file; the file is then skipped.  */
+  gpg_error_t err;
+};
+
+/* A set of files imported by one gpgme_op_import.  */
+struct import_job_s
+{
+  /* The struct import_file_s of the job.  */
+  GList *items;
+  guint n_items;
+  gpgme_protocol_t protocol;
+  /* Set if the files are armored and need a line break between
+     them.  */
+  gboolean armored;
+};
+
+/* The jobs of one protocol.  */
+struct gpa_import_lane_s
+{
+  GpaFileImportOperation *op;
+  GpaContext *context;
+  gulong done_id;
+
+  /* The jobs waiting to be started and the running job.  */
+  GQueue jobs;
+  struct import_job_s *job;
+
+  /* The data object of the running job.  For files it reads one file
+     after the other: NEXT_ITEM is the next file and FILE the file
+     being read or NULL.  SEPARATOR is set if a line break is to be
+     read before the next file.  */
+  gpgme_data_t data;
+  GList *next_item;
+  struct import_file_s *file;
+  gboolean separator;
+};
+
+
+/* Signals */
+enum
+{
+  IMPORTED_KEYS,
+  IMPORTED_SECRET_KEYS,
+  LAST_SIGNAL
+};
+
+static guint signals [LAST_SIGNAL] = { 0 };
+
 
 /* Internal functions */
 static gboolean gpa_file_import_operation_idle_cb (gpointer data);
-static void gpa_file_import_operation_done_error_cb (GpaContext *context,
-						     gpg_error_t err,
-						   GpaFileImportOperation *op);
-static void gpa_file_import_operation_done_cb (GpaContext *context,
-						gpg_error_t err,
-						GpaFileImportOperation *op);
+static void lane_done_cb (GpaContext *context, gpg_error_t err,
+                          struct gpa_import_lane_s *lane);
+static void release_job (struct gpa_import_lane_s *lane);
+static void free_job (struct import_job_s *job);
 
 /* GObject */
 
@@ -54,7 +125,28 @@ static GObjectClass *parent_class = NULL;
 static void
 gpa_file_import_operation_finalize (GObject *object)
 {
-  /* GpaFileImportOperation *op = GPA_FILE_IMPORT_OPERATION (object); */
+  GpaFileImportOperation *op = GPA_FILE_IMPORT_OPERATION (object);
+  struct gpa_import_lane_s *lane;
+  struct import_job_s *job;
+  int i;
+
+  for (i = 0; i < N_LANES; i++)
+    {
+      lane = op->lanes[i];
+      if (!lane)
+        continue;
+      if (lane->context)
+        {
+          g_signal_handler_disconnect (lane->context, lane->done_id);
+          g_object_unref (lane->context);
+        }
+      if (lane->job)
+        release_job (lane);
+      while ((job = g_queue_pop_head (&lane->jobs)))
+        free_job (job);
+      g_free (lane);
+    }
+  g_hash_table_destroy (op->fprs);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -64,6 +156,10 @@ static void
 gpa_file_import_operation_init (GpaFileImportOperation *op)
 {
   memset (&op->counters, 0, sizeof op->counters);
+  op->fprs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  op->lanes[LANE_OPENPGP] = NULL;
+  op->lanes[LANE_CMS] = NULL;
+  op->canceled = FALSE;
 }
 
 
@@ -83,11 +179,6 @@ gpa_file_import_operation_constructor (GType type,
   /* Initialize */
   /* Start with the first file after going back into the main loop */
   g_idle_add (gpa_file_import_operation_idle_cb, op);
-  /* Connect to the "done" signal */
-  g_signal_connect (G_OBJECT (GPA_OPERATION (op)->context), "done",
-		    G_CALLBACK (gpa_file_import_operation_done_error_cb), op);
-  g_signal_connect (G_OBJECT (GPA_OPERATION (op)->context), "done",
-		    G_CALLBACK (gpa_file_import_operation_done_cb), op);
   /* Give a title to the progress dialog */
   gtk_window_set_title (GTK_WINDOW (GPA_FILE_OPERATION (op)->progress_dialog),
 			_("Importing..."));
@@ -105,6 +196,31 @@ gpa_file_import_operation_class_init (GpaFileImportOperationClass *klass)
 
   object_class->constructor = gpa_file_import_operation_constructor;
   object_class->finalize = gpa_file_import_operation_finalize;
+
+  klass->imported_keys = NULL;
+  klass->imported_secret_keys = NULL;
+
+  /* Signals */
+  signals[IMPORTED_KEYS] =
+    g_signal_new ("imported_keys",
+		  G_TYPE_FROM_CLASS (object_class),
+		  G_SIGNAL_RUN_FIRST,
+		  G_STRUCT_OFFSET (GpaFileImportOperationClass,
+				   imported_keys),
+		  NULL, NULL,
+		  g_cclosure_marshal_VOID__POINTER,
+		  G_TYPE_NONE, 1,
+		  G_TYPE_POINTER);
+  signals[IMPORTED_SECRET_KEYS] =
+    g_signal_new ("imported_secret_keys",
+		  G_TYPE_FROM_CLASS (object_class),
+		  G_SIGNAL_RUN_FIRST,
+		  G_STRUCT_OFFSET (GpaFileImportOperationClass,
+				   imported_secret_keys),
+		  NULL, NULL,
+		  g_cclosure_marshal_VOID__POINTER,
+		  G_TYPE_NONE, 1,
+		  G_TYPE_POINTER);
 }
 
 
@@ -154,83 +270,301 @@ gpa_file_import_operation_new (GtkWidget *window, GList *files)
 }
 
 
+
+
 /* Internal */
 
 
-static gboolean
-proc_one_file (GpaFileImportOperation *op, gpa_file_item_t file_item)
+/* Return a displayable name for the files of JOB.  */
+static gchar *
+job_name (struct import_job_s *job)
 {
-  gpg_error_t err;
-  int fd;
-  gpgme_data_t data;
+  struct import_file_s *file = job->items->data;
+  gpa_file_item_t file_item = file->item;
+
+  if (job->n_items > 1)
+    return g_strdup_printf (_("%u files"), job->n_items);
+  return g_strdup (file_item->direct_name
+                   ? file_item->direct_name : file_item->filename_in);
+}
+
+
+/* Read the files of the running job of LANE one after the other.  A
+   file which can't be read is skipped and reported when the job is
+   done.  */
+static ssize_t
+concat_read_cb (void *handle, void *buffer, size_t size)
+{
+  struct gpa_import_lane_s *lane = handle;
+  ssize_t nread;
 
-  if (file_item->direct_in)
+  for (;;)
     {
-      /* No copy is made.  */
-      err = gpgme_data_new_from_mem (&data, file_item->direct_in,
-				     file_item->direct_in_len, 0);
-      if (err)
-	{
-	  gpa_gpgme_warning (err);
-	  return FALSE;
-	}
-
-      gpgme_set_protocol (GPA_OPERATION (op)->context->ctx,
-                          is_cms_data (file_item->direct_in,
-                                       file_item->direct_in_len) ?
-                          GPGME_PROTOCOL_CMS : GPGME_PROTOCOL_OpenPGP);
+      if (lane->separator && size)
+        {
+          lane->separator = FALSE;
+          *(char *)buffer = '\n';
+          return 1;
+        }
+      if (!lane->file)
+        {
+          if (!lane->next_item)
+            return 0;
+          lane->file = lane->next_item->data;
+          lane->next_item = g_list_next (lane->next_item);
+        }
+
+      do
+        nread = read (lane->file->fd, buffer, size);
+      while (nread == -1 && errno == EINTR);
+      if (nread == -1)
+        lane->file->err = gpg_error_from_syserror ();
+      else if (nread)
+        return nread;
+
+      close (lane->file->fd);
+      lane->file->fd = -1;
+      lane->file = NULL;
+      lane->separator = lane->job->armored && lane->next_item;
     }
-  else
+}
+
+
+static struct gpgme_data_cbs concat_cbs =
+  {
+    concat_read_cb,
+    NULL,
+    NULL,
+    NULL
+  };
+
+
+/* Release JOB and close its files.  */
+static void
+free_job (struct import_job_s *job)
+{
+  GList *cur;
+
+  for (cur = job->items; cur; cur = g_list_next (cur))
     {
-      const char *filename = file_item->filename_in;
+      struct import_file_s *file = cur->data;
+
+      if (file->fd != -1)
+        close (file->fd);
+      g_free (file);
+    }
+  g_list_free (job->items);
+  g_free (job);
+}
+
+
+/* Release the running job of LANE and its data.  */
+static void
+release_job (struct gpa_import_lane_s *lane)
+{
+  if (lane->data)
+    gpgme_data_release (lane->data);
+  lane->data = NULL;
+  lane->file = NULL;
+  lane->next_item = NULL;
+  lane->separator = FALSE;
+  free_job (lane->job);
+  lane->job = NULL;
+}
 
-      fd = gpa_open_input (filename, &data, GPA_OPERATION (op)->window);
-      if (fd == -1)
-        return FALSE;
 
-      gpgme_set_protocol (GPA_OPERATION (op)->context->ctx,
-                          is_cms_file (filename) ?
-                          GPGME_PROTOCOL_CMS : GPGME_PROTOCOL_OpenPGP);
+/* All jobs are done: report the merged result of all files.  */
+static void
+maybe_finish (GpaFileImportOperation *op)
+{
+  const char **fprs;
+  int i;
+
+  /* After a cancel the waiting jobs are not started anymore.  */
+  for (i = 0; i < N_LANES; i++)
+    if (op->lanes[i]->job
+        || (!op->canceled && !g_queue_is_empty (&op->lanes[i]->jobs)))
+      return;
+  if (GPA_FILE_OPERATION (op)->finished)
+    return;
+  GPA_FILE_OPERATION (op)->finished = TRUE;
+
+  gtk_widget_hide (GPA_FILE_OPERATION (op)->progress_dialog);
+  fprs = gpa_gpgme_get_import_fprs (op->fprs);
+  if (fprs)
+    {
+      g_signal_emit (op, signals[op->counters.secret_imported
+                                 ? IMPORTED_SECRET_KEYS : IMPORTED_KEYS],
+                     0, fprs);
+      g_free (fprs);
     }
+  if (!op->canceled)
+    gpa_gpgme_show_import_results (GPA_OPERATION (op)->window,
+                                   &op->counters);
+  g_signal_emit_by_name (GPA_OPERATION (op), "completed",
+                         op->canceled ? gpg_error (GPG_ERR_CANCELED) : 0);
+}
 
 
-  /* Start importing one file.  */
-  err = gpgme_op_import_start (GPA_OPERATION (op)->context->ctx, data);
-  if (err)
+/* Start the next job of LANE.  */
+static void
+start_next_job (struct gpa_import_lane_s *lane)
+{
+  GpaFileImportOperation *op = lane->op;
+  struct import_job_s *job;
+  gpa_file_item_t file_item;
+  gpg_error_t err;
+  gchar *name;
+
+  while (!op->canceled && (job = g_queue_pop_head (&lane->jobs)))
     {
+      lane->job = job;
+      file_item = ((struct import_file_s *) job->items->data)->item;
+      if (GPA_FILE_ITEM_IS_DIRECT (file_item))
+        err = gpa_file_operation_open_direct (GPA_FILE_OPERATION (op),
+                                              file_item, &lane->data, NULL);
+      else
+        {
+          lane->next_item = job->items;
+          err = gpgme_data_new_from_cbs (&lane->data, &concat_cbs, lane);
+        }
+      if (!err)
+        {
+          gpgme_set_protocol (lane->context->ctx, job->protocol);
+          err = gpgme_op_import_start (lane->context->ctx, lane->data);
+        }
+      if (!err)
+        {
+          /* Show and update the progress dialog */
+          name = job_name (job);
+          gtk_widget_show_all (GPA_FILE_OPERATION (op)->progress_dialog);
+          gpa_progress_dialog_set_label (GPA_PROGRESS_DIALOG
+                                         (GPA_FILE_OPERATION
+                                          (op)->progress_dialog), name);
+          g_free (name);
+          return;
+        }
+
       gpa_gpgme_warning (err);
-      return FALSE;
+      gpa_gpgme_update_import_results (&op->counters, job->n_items,
+                                       job->n_items, NULL);
+      release_job (lane);
     }
 
-  /* Show and update the progress dialog */
-  gtk_widget_show_all (GPA_FILE_OPERATION (op)->progress_dialog);
-  gpa_progress_dialog_set_label (GPA_PROGRESS_DIALOG
-				 (GPA_FILE_OPERATION (op)->progress_dialog),
-				 file_item->direct_name
-				 ? file_item->direct_name
-				 : file_item->filename_in);
+  maybe_finish (op);
+}
 
-  return TRUE;
+
+/* Add a job for the files ITEMS to the lane of PROTOCOL.  */
+static void
+add_job (GpaFileImportOperation *op, GList *items,
+         gpgme_protocol_t protocol, gboolean armored)
+{
+  struct import_job_s *job;
+
+  job = g_new0 (struct import_job_s, 1);
+  job->items = items;
+  job->n_items = g_list_length (items);
+  job->protocol = protocol;
+  job->armored = armored;
+  g_queue_push_tail (&op->lanes[protocol == GPGME_PROTOCOL_CMS
+                                ? LANE_CMS : LANE_OPENPGP]->jobs, job);
 }
 
 
+/* Identify all files of OP, sort them into jobs and start the
+   lanes.  The files stay open for the import.  */
 static void
-gpa_file_import_operation_next (GpaFileImportOperation *op)
+start_import (GpaFileImportOperation *op)
 {
-  if (!GPA_FILE_OPERATION (op)->current
-      || !proc_one_file (op, GPA_FILE_OPERATION (op)->current->data))
+  struct gpa_import_lane_s *lane;
+  GList *armored = NULL;
+  GList *binary = NULL;
+  GList *cur;
+  gboolean first = TRUE;
+  int i;
+
+  for (i = 0; i < N_LANES; i++)
     {
-      /* Finished all files.  */
-      gtk_widget_hide (GPA_FILE_OPERATION (op)->progress_dialog);
-      if (op->counters.imported > 0)
+      lane = g_new0 (struct gpa_import_lane_s, 1);
+      lane->op = op;
+      g_queue_init (&lane->jobs);
+      op->lanes[i] = lane;
+    }
+
+  for (cur = GPA_FILE_OPERATION (op)->input_files; cur; cur = g_list_next (cur))
+    {
+      gpa_file_item_t file_item = cur->data;
+      struct import_file_s *file;
+      gpa_data_info_t info;
+      gpgme_data_t data;
+      gpg_error_t err;
+      int fd = -1;
+
+      if (GPA_FILE_ITEM_IS_DIRECT (file_item))
+        {
+          err = gpa_file_operation_open_direct (GPA_FILE_OPERATION (op),
+                                                file_item, &data, NULL);
+          if (err)
+            {
+              gpa_gpgme_warning (err);
+              gpa_gpgme_update_import_results (&op->counters, 1, 1, NULL);
+              continue;
+            }
+        }
+      else
         {
-          if (op->counters.secret_imported)
-            g_signal_emit_by_name (GPA_OPERATION (op), "imported_secret_keys");
+          fd = gpa_open_input (file_item->filename_in, &data,
+                               GPA_OPERATION (op)->window);
+          if (fd == -1)
+            {
+              gpa_gpgme_update_import_results (&op->counters, 1, 1, NULL);
+              continue;
+            }
+        }
+      /* The data is left at the start of the file.  */
+      gpa_identify_data (data, &info);
+      gpgme_data_release (data);
+
+      file = g_new0 (struct import_file_s, 1);
+      file->item = file_item;
+      file->fd = fd;
+      if (info.protocol == GPGME_PROTOCOL_OpenPGP && info.keys
+          && !GPA_FILE_ITEM_IS_DIRECT (file_item))
+        {
+          if (info.armored)
+            armored = g_list_prepend (armored, file);
           else
-            g_signal_emit_by_name (GPA_OPERATION (op), "imported_keys");
-	}
-      gpa_gpgme_show_import_results (GPA_OPERATION (op)->window, &op->counters);
+            binary = g_list_prepend (binary, file);
+        }
+      else
+        add_job (op, g_list_append (NULL, file), info.protocol, FALSE);
+    }
+  if (armored)
+    add_job (op, g_list_reverse (armored), GPGME_PROTOCOL_OpenPGP, TRUE);
+  if (binary)
+    add_job (op, g_list_reverse (binary), GPGME_PROTOCOL_OpenPGP, FALSE);
+
+  /* The first lane uses the context of the operation, so that the
+     progress dialog can cancel it.  */
+  for (i = 0; i < N_LANES; i++)
+    {
+      lane = op->lanes[i];
+      if (g_queue_is_empty (&lane->jobs))
+        continue;
+      if (first)
+        lane->context = g_object_ref (GPA_OPERATION (op)->context);
+      else
+        lane->context = gpa_context_new ();
+      first = FALSE;
+      lane->done_id = g_signal_connect (G_OBJECT (lane->context), "done",
+                                        G_CALLBACK (lane_done_cb), lane);
     }
+
+  for (i = 0; i < N_LANES; i++)
+    if (op->lanes[i]->context)
+      start_next_job (op->lanes[i]);
+  maybe_finish (op);
 }
 
 
@@ -239,45 +573,45 @@ gpa_file_import_operation_idle_cb (gpointer data)
 {
   GpaFileImportOperation *op = data;
 
-  gpa_file_import_operation_next (op);
+  start_import (op);
 
   return FALSE;
 }
 
 
-static void
-gpa_file_import_operation_done_cb (GpaContext *context,
-                                   gpg_error_t err,
-                                   GpaFileImportOperation *op)
+/* Show the errors of the files of JOB which could not be read and
+   return their number.  */
+static unsigned int
+show_file_errors (GpaFileImportOperation *op, struct import_job_s *job)
 {
-  if (err)
-    {
-      gpa_gpgme_update_import_results (&op->counters, 1, 1, NULL);
-    }
-  else
-    {
-      gpgme_import_result_t res;
+  unsigned int n_bad = 0;
+  GList *cur;
 
-      res = gpgme_op_import_result (GPA_OPERATION (op)->context->ctx);
-      gpa_gpgme_update_import_results (&op->counters, 1, 0, res);
+  for (cur = job->items; cur; cur = g_list_next (cur))
+    {
+      struct import_file_s *file = cur->data;
 
+      if (!file->err)
+        continue;
+      gpa_show_warn (GPA_OPERATION (op)->window, GPA_OPERATION (op)->context,
+                     _("Error reading \"%s\": %s <%s>"),
+                     file->item->filename_in, gpg_strerror (file->err),
+                     gpg_strsource (file->err));
+      n_bad++;
     }
 
-  if (gpg_err_code (err) != GPG_ERR_CANCELED)
-    {
-      /* Go to the next file in the list and import it.  */
-      GPA_FILE_OPERATION (op)->current = (g_list_next
-                                          (GPA_FILE_OPERATION (op)->current));
-      gpa_file_import_operation_next (op);
-    }
+  return n_bad;
 }
 
 
+/* Show the error ERR of JOB.  */
 static void
-gpa_file_import_operation_done_error_cb (GpaContext *context, gpg_error_t err,
-					 GpaFileImportOperation *op)
+show_job_error (GpaFileImportOperation *op, struct import_job_s *job,
+                gpg_error_t err)
 {
-  gpa_file_item_t file_item = GPA_FILE_OPERATION (op)->current->data;
+  struct import_file_s *file = job->items->data;
+  gpa_file_item_t file_item = file->item;
+  gchar *name;
 
   /* FIXME: Add the errors to a list and show a dialog with all import
      errors, similar to the verify status.  */
@@ -289,24 +623,63 @@ gpa_file_import_operation_done_error_cb (GpaContext *context, gpg_error_t err,
       break;
 
     case GPG_ERR_NO_DATA:
-      gpa_show_warn (GPA_OPERATION (op)->window, GPA_OPERATION (op)->context,
-                        file_item->direct_name
-                        ? _("\"%s\" contained no OpenPGP data.")
-                        : _("The file \"%s\" contained no OpenPGP"
-                            "data."),
-                        file_item->direct_name
-                        ? file_item->direct_name
-                        : file_item->filename_in);
+      if (job->n_items > 1)
+        gpa_show_warn (GPA_OPERATION (op)->window, GPA_OPERATION (op)->context,
+                       _("The %u files contained no OpenPGP data."),
+                       job->n_items);
+      else
+        gpa_show_warn (GPA_OPERATION (op)->window, GPA_OPERATION (op)->context,
+                       file_item->direct_name
+                       ? _("\"%s\" contained no OpenPGP data.")
+                       : _("The file \"%s\" contained no OpenPGP"
+                           "data."),
+                       file_item->direct_name
+                       ? file_item->direct_name
+                       : file_item->filename_in);
       break;
 
     default:
+      name = job_name (job);
       gpa_show_warn (GPA_OPERATION (op)->window, GPA_OPERATION (op)->context,
-                        _("Error importing \"%s\": %s <%s>"),
-                        file_item->direct_name
-                        ? file_item->direct_name
-                        : file_item->filename_in,
-                        gpg_strerror (err), gpg_strsource (err));
+                     _("Error importing \"%s\": %s <%s>"),
+                     name, gpg_strerror (err), gpg_strsource (err));
+      g_free (name);
       gpa_gpgme_warn (err, NULL, GPA_OPERATION (op)->context);
       break;
     }
 }
+
+
+static void
+lane_done_cb (GpaContext *context, gpg_error_t err,
+              struct gpa_import_lane_s *lane)
+{
+  GpaFileImportOperation *op = lane->op;
+  struct import_job_s *job = lane->job;
+  unsigned int n_bad;
+
+  if (!job)
+    return;
+
+  n_bad = show_file_errors (op, job);
+  show_job_error (op, job, err);
+  if (err)
+    {
+      gpa_gpgme_update_import_results (&op->counters, job->n_items,
+                                       job->n_items, NULL);
+    }
+  else
+    {
+      gpgme_import_result_t res;
+
+      res = gpgme_op_import_result (context->ctx);
+      gpa_gpgme_update_import_results (&op->counters, job->n_items, n_bad,
+                                       res);
+      gpa_gpgme_add_import_fprs (op->fprs, res);
+    }
+  release_job (lane);
+
+  if (gpg_err_code (err) == GPG_ERR_CANCELED)
+    op->canceled = TRUE;
+  start_next_job (lane);
+}
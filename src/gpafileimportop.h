@@ -57,12 +57,28 @@ struct _GpaFileImportOperation
   GpaFileOperation parent;
 
   struct gpa_import_result_s counters;
+
+  /* The fingerprints of the changed keys.  */
+  GHashTable *fprs;
+
+  /* The OpenPGP and the CMS files are imported concurrently, each on
+     its own context.  */
+  struct gpa_import_lane_s *lanes[2];
+
+  /* Set if the user canceled the import.  */
+  gboolean canceled;
 };
 
 
 struct _GpaFileImportOperationClass
 {
   GpaFileOperationClass parent_class;
+
+  /* Signal handlers.  FPRS is a NULL terminated array with the
+     fingerprints of the changed keys.  */
+  void (*imported_keys) (GpaFileImportOperation *op, const char **fprs);
+  void (*imported_secret_keys) (GpaFileImportOperation *op,
+                                const char **fprs);
 };
 
 
@@ -21,14 +21,30 @@
 
 #include <config.h>
 
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <fcntl.h>
+
+#ifdef G_OS_UNIX
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
 #include "i18n.h"
 #include "gtktools.h"
+#include "gpgmetools.h"
 #include "gpafileop.h"
 
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
 /* Signals */
 enum
 {
   CREATED_FILE,
+  FILE_DONE,
   LAST_SIGNAL
 };
 
@@ -36,12 +52,15 @@ enum
 enum
 {
   PROP_0,
-  PROP_INPUT_FILES
+  PROP_INPUT_FILES,
+  PROP_BATCH
 };
 
 static GObjectClass *parent_class = NULL;
 static guint signals [LAST_SIGNAL] = { 0 };
 
+static void release_worker_data (gpa_file_worker_t worker);
+
 static void
 gpa_file_operation_get_property (GObject     *object,
 				 guint        prop_id,
@@ -55,6 +74,9 @@ gpa_file_operation_get_property (GObject     *object,
     case PROP_INPUT_FILES:
       g_value_set_pointer (value, op->input_files);
       break;
+    case PROP_BATCH:
+      g_value_set_boolean (value, op->batch);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -75,6 +97,9 @@ gpa_file_operation_set_property (GObject     *object,
       op->input_files = (GList*) g_value_get_pointer (value);
       op->current = op->input_files;
       break;
+    case PROP_BATCH:
+      op->batch = g_value_get_boolean (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -95,6 +120,7 @@ free_file_item (gpa_file_item_t item)
     g_free (item->direct_in);
   if (item->direct_out)
     g_free (item->direct_out);
+  gpa_text_data_release (item->direct_text);
 }
 
 
@@ -102,7 +128,21 @@ static void
 gpa_file_operation_finalize (GObject *object)
 {
   GpaFileOperation *op = GPA_FILE_OPERATION (object);
+  gpa_file_worker_t worker;
+  guint i;
 
+  if (op->workers)
+    {
+      for (i = 0; i < op->workers->len; i++)
+        {
+          worker = g_ptr_array_index (op->workers, i);
+          g_signal_handler_disconnect (worker->context, worker->done_id);
+          release_worker_data (worker);
+          g_object_unref (worker->context);
+          g_free (worker);
+        }
+      g_ptr_array_free (op->workers, TRUE);
+    }
   g_list_foreach (op->input_files, (GFunc) free_file_item, NULL);
   g_list_free (op->input_files);
   gtk_widget_destroy (op->progress_dialog);
@@ -116,6 +156,12 @@ gpa_file_operation_init (GpaFileOperation *op)
   op->input_files = NULL;
   op->current = NULL;
   op->progress_dialog = NULL;
+  op->workers = NULL;
+  op->n_items = 0;
+  op->n_done = 0;
+  op->err = 0;
+  op->finished = FALSE;
+  op->batch = FALSE;
 }
 
 static GObject*
@@ -151,6 +197,7 @@ gpa_file_operation_class_init (GpaFileOperationClass *klass)
   object_class->get_property = gpa_file_operation_get_property;
 
   klass->created_file = NULL;
+  klass->file_done = NULL;
 
   /* Signals */
   signals[CREATED_FILE] =
@@ -162,6 +209,15 @@ gpa_file_operation_class_init (GpaFileOperationClass *klass)
 		  g_cclosure_marshal_VOID__POINTER,
 		  G_TYPE_NONE, 1,
 		  G_TYPE_POINTER);
+  signals[FILE_DONE] =
+    g_signal_new ("file_done",
+		  G_TYPE_FROM_CLASS (object_class),
+		  G_SIGNAL_RUN_FIRST,
+		  G_STRUCT_OFFSET (GpaFileOperationClass, file_done),
+		  NULL, NULL,
+		  g_cclosure_marshal_VOID__POINTER,
+		  G_TYPE_NONE, 1,
+		  G_TYPE_POINTER);
   /* Properties */
   g_object_class_install_property (object_class,
 				   PROP_INPUT_FILES,
@@ -169,6 +225,12 @@ gpa_file_operation_class_init (GpaFileOperationClass *klass)
 				   ("input_files", "Files",
 				    "Files",
 				    G_PARAM_WRITABLE|G_PARAM_CONSTRUCT_ONLY));
+  g_object_class_install_property (object_class,
+				   PROP_BATCH,
+				   g_param_spec_boolean
+				   ("batch", "Batch",
+				    "Run without dialogs", FALSE,
+				    G_PARAM_READWRITE|G_PARAM_CONSTRUCT_ONLY));
 }
 
 GType
@@ -230,3 +292,342 @@ gpa_file_operation_current_file (GpaFileOperation *op)
   else
     return NULL;
 }
+
+
+/* Release the data objects of WORKER and close their files.  */
+static void
+release_worker_data (gpa_file_worker_t worker)
+{
+  if (worker->in)
+    gpgme_data_release (worker->in);
+  worker->in = NULL;
+  if (worker->in_fd != -1)
+    close (worker->in_fd);
+  worker->in_fd = -1;
+  if (worker->out)
+    gpgme_data_release (worker->out);
+  worker->out = NULL;
+  if (worker->out_fd != -1)
+    close (worker->out_fd);
+  worker->out_fd = -1;
+  if (worker->sig)
+    gpgme_data_release (worker->sig);
+  worker->sig = NULL;
+  if (worker->sig_fd != -1)
+    close (worker->sig_fd);
+  worker->sig_fd = -1;
+}
+
+
+/* Return a new context with the settings of CONTEXT for use by an
+   additional worker.  */
+static GpaContext *
+clone_context (GpaContext *context)
+{
+  GpaContext *clone = gpa_context_new ();
+  gpgme_key_t key;
+  int i;
+
+  gpgme_set_protocol (clone->ctx, gpgme_get_protocol (context->ctx));
+  gpgme_set_armor (clone->ctx, gpgme_get_armor (context->ctx));
+  gpgme_set_textmode (clone->ctx, gpgme_get_textmode (context->ctx));
+  for (i = 0; (key = gpgme_signers_enum (context->ctx, i)); i++)
+    {
+      gpgme_signers_add (clone->ctx, key);
+      gpgme_key_unref (key);
+    }
+
+  return clone;
+}
+
+
+/* Update the progress dialog after ITEM has been started.  */
+static void
+update_progress (GpaFileOperation *op, gpa_file_item_t item)
+{
+  GpaProgressDialog *dialog = GPA_PROGRESS_DIALOG (op->progress_dialog);
+  gchar *text;
+
+  if (op->batch)
+    return;
+
+  gtk_widget_show_all (op->progress_dialog);
+  if (item)
+    gpa_progress_dialog_set_label (dialog, item->direct_name
+                                   ? item->direct_name : item->filename_in);
+
+  /* With a single item the progress bar shows the progress of the
+     backend.  */
+  if (op->n_items < 2)
+    return;
+
+  gpa_progress_dialog_set_fraction (dialog,
+                                    (gdouble) op->n_done / op->n_items);
+  text = g_strdup_printf (_("%u of %u files"), op->n_done, op->n_items);
+  gpa_progress_dialog_set_text (dialog, text);
+  g_free (text);
+}
+
+
+/* Record the result ERR for the item of WORKER and make the worker
+   idle again.  */
+static void
+item_done (GpaFileOperation *op, gpa_file_worker_t worker, gpg_error_t err)
+{
+  GpaFileOperationClass *klass = GPA_FILE_OPERATION_GET_CLASS (op);
+  gpa_file_item_t item = worker->item;
+
+  if (item->direct_in && worker->out)
+    {
+      size_t len;
+      char *out_gpgme = gpgme_data_release_and_get_mem (worker->out, &len);
+      worker->out = NULL;
+      /* Do the memory allocation dance.  */
+
+      if (out_gpgme)
+	{
+	  /* Conveniently make ASCII stuff into a string.  */
+	  item->direct_out = g_malloc (len + 1);
+	  memcpy (item->direct_out, out_gpgme, len);
+	  gpgme_free (out_gpgme);
+	  item->direct_out[len] = '\0';
+	  /* Yep, excluding the trailing zero.  */
+	  item->direct_out_len = len;
+	}
+      else
+	{
+	  item->direct_out = NULL;
+	  item->direct_out_len = 0;
+	}
+    }
+  release_worker_data (worker);
+
+  item->err = err;
+  item->elapsed = g_get_monotonic_time () - worker->start_time;
+  if (err && !op->err)
+    op->err = err;
+  op->n_done++;
+
+  if (klass->item_done)
+    klass->item_done (op, worker, err);
+  g_signal_emit (op, signals[FILE_DONE], 0, item);
+
+  g_free (worker->signed_file);
+  worker->signed_file = NULL;
+  g_free (worker->signature_file);
+  worker->signature_file = NULL;
+  worker->item = NULL;
+}
+
+
+/* Start the next items on the idle workers.  Once all items have
+   been processed the operation is finished.  */
+static void
+start_next_items (GpaFileOperation *op)
+{
+  GpaFileOperationClass *klass = GPA_FILE_OPERATION_GET_CLASS (op);
+  gpa_file_worker_t worker;
+  gpg_error_t err;
+  guint i;
+
+  /* Starting an item may run a dialog and thus call this function
+     recursively; a worker is marked busy before its item is
+     started.  If an item fails to start, the same worker is tried
+     with the next item, so that in batch mode we do not stop with
+     items left but no busy worker.  */
+  i = 0;
+  while (i < op->workers->len && op->current && (!op->err || op->batch))
+    {
+      worker = g_ptr_array_index (op->workers, i);
+      if (worker->item)
+        {
+          i++;
+          continue;
+        }
+
+      worker->item = op->current->data;
+      worker->start_time = g_get_monotonic_time ();
+      op->current = g_list_next (op->current);
+      err = klass->start_item (op, worker);
+      if (err)
+        item_done (op, worker, err);
+      else
+        {
+          update_progress (op, worker->item);
+          i++;
+        }
+    }
+
+  if (op->finished)
+    return;
+  for (i = 0; i < op->workers->len; i++)
+    if (((gpa_file_worker_t) g_ptr_array_index (op->workers, i))->item)
+      return;
+  if (op->current && (!op->err || op->batch))
+    return;
+
+  op->finished = TRUE;
+  gtk_widget_hide (op->progress_dialog);
+  klass->finish (op, op->err);
+}
+
+
+static void
+worker_done_cb (GpaContext *context, gpg_error_t err, gpointer user_data)
+{
+  GpaFileOperation *op = user_data;
+  GpaFileOperationClass *klass = GPA_FILE_OPERATION_GET_CLASS (op);
+  gpa_file_worker_t worker = NULL;
+  guint i;
+
+  for (i = 0; i < op->workers->len; i++)
+    {
+      worker = g_ptr_array_index (op->workers, i);
+      if (worker->context == context)
+        break;
+    }
+  if (i == op->workers->len || !worker->item)
+    return;
+
+  if (err && !op->err && !op->batch && klass->show_error)
+    klass->show_error (op, worker, err);
+  item_done (op, worker, err);
+
+  if (!op->finished)
+    update_progress (op, NULL);
+  start_next_items (op);
+}
+
+
+/* Process all input files of OP.  One worker per processor is used,
+   but not more than there are files.  The first worker uses the
+   context of the operation; the others use a copy of its settings.
+   The operation's class methods are invoked for each item and
+   FINISH is called once all items have been processed or, after an
+   error, once the running items are done.  In batch mode an error
+   does not stop the operation.  */
+void
+gpa_file_operation_start_files (GpaFileOperation *op)
+{
+  gpa_file_worker_t worker;
+  guint n_workers, i;
+
+  g_return_if_fail (GPA_IS_FILE_OPERATION (op));
+  g_return_if_fail (!op->workers);
+
+  op->n_items = g_list_length (op->current);
+  n_workers = MAX (1, MIN (op->n_items, g_get_num_processors ()));
+
+  op->workers = g_ptr_array_sized_new (n_workers);
+  for (i = 0; i < n_workers; i++)
+    {
+      worker = g_new0 (struct gpa_file_worker_s, 1);
+      if (i)
+        worker->context = clone_context (GPA_OPERATION (op)->context);
+      else
+        worker->context = g_object_ref (GPA_OPERATION (op)->context);
+      worker->in_fd = -1;
+      worker->out_fd = -1;
+      worker->sig_fd = -1;
+      worker->done_id = g_signal_connect (G_OBJECT (worker->context), "done",
+                                          G_CALLBACK (worker_done_cb), op);
+      g_ptr_array_add (op->workers, worker);
+    }
+
+  start_next_items (op);
+}
+
+
+/* Open the input file FILENAME for an item of OP and store the data
+   object at DATA and the file descriptor at R_FD.  Unless in batch
+   mode an error is shown to the user.  */
+gpg_error_t
+gpa_file_operation_open_input (GpaFileOperation *op, const char *filename,
+                               gpgme_data_t *data, int *r_fd)
+{
+  gpg_error_t err;
+  int fd;
+
+  if (!op->batch)
+    {
+      *r_fd = gpa_open_input (filename, data, GPA_OPERATION (op)->window);
+      /* FIXME: Error value.  */
+      return *r_fd == -1 ? gpg_error (GPG_ERR_GENERAL) : 0;
+    }
+
+  *r_fd = -1;
+  fd = g_open (filename, O_RDONLY | O_BINARY, 0);
+  if (fd == -1)
+    return gpg_error_from_syserror ();
+  err = gpgme_data_new_from_fd (data, fd);
+  if (err)
+    {
+      close (fd);
+      return err;
+    }
+  *r_fd = fd;
+  return 0;
+}
+
+
+/* Open the output file FILENAME for an item of OP and store the data
+   object at DATA and the file descriptor at R_FD.  The name of the
+   file actually used is stored at R_FILENAME_USED; the user may
+   choose another one if the file already exists.  In batch mode an
+   existing file is never overwritten.  */
+gpg_error_t
+gpa_file_operation_open_output (GpaFileOperation *op, const char *filename,
+                                gpgme_data_t *data, int *r_fd,
+                                char **r_filename_used)
+{
+  gpg_error_t err;
+  int fd;
+
+  if (!op->batch)
+    {
+      *r_fd = gpa_open_output (filename, data, GPA_OPERATION (op)->window,
+                               r_filename_used);
+      /* FIXME: Error value.  */
+      return *r_fd == -1 ? gpg_error (GPG_ERR_GENERAL) : 0;
+    }
+
+  *r_fd = -1;
+  *r_filename_used = NULL;
+  fd = g_open (filename, O_WRONLY | O_CREAT | O_EXCL | O_BINARY, 0666);
+  if (fd == -1)
+    return gpg_error_from_syserror ();
+  err = gpgme_data_new_from_fd (data, fd);
+  if (err)
+    {
+      close (fd);
+      g_unlink (filename);
+      return err;
+    }
+  *r_fd = fd;
+  *r_filename_used = xstrdup (filename);
+  return 0;
+}
+
+
+/* Create the data objects for the input and, if R_OUT is not NULL,
+   the output of the direct item ITEM of OP.  A text buffer is read
+   and written in place; no copy of the text is made.  */
+gpg_error_t
+gpa_file_operation_open_direct (GpaFileOperation *op, gpa_file_item_t item,
+                                gpgme_data_t *r_in, gpgme_data_t *r_out)
+{
+  gpg_error_t err;
+
+  if (item->direct_text)
+    err = gpa_text_data_new_input (item->direct_text, r_in);
+  else
+    err = gpgme_data_new_from_mem (r_in, item->direct_in,
+                                   item->direct_in_len, 0);
+  if (err || !r_out)
+    return err;
+
+  if (item->direct_text)
+    return gpa_text_data_new_output (item->direct_text, r_out);
+  else
+    return gpgme_data_new (r_out);
+}
@@ -27,6 +27,7 @@
 #include <glib-object.h>
 #include "gpaoperation.h"
 #include "gpaprogressdlg.h"
+#include "textdata.h"
 
 /* GObject stuff */
 #define GPA_FILE_OPERATION_TYPE	  (gpa_file_operation_get_type ())
@@ -47,22 +48,77 @@ struct gpa_file_item_s
   gchar *direct_out;
   /* Length of DIRECT_OUT (minus trailing zero).  */
   gsize direct_out_len;
+  /* If not NULL, the text buffer to operate on.  The output is
+     written into the buffer and replaces the text once it is
+     committed by the "created_file" handler.  */
+  gpa_text_data_t direct_text;
   /* A displayable string identifying the text.  */
   gchar *direct_name;
 
   /* The filename to operate on (if DIRECT_IN is NULL).  */
   gchar *filename_in;
   gchar *filename_out;
+
+  /* The result of the operation for this item.  */
+  gpg_error_t err;
+  /* The time in microseconds it took to process this item.  */
+  gint64 elapsed;
 };
 typedef struct gpa_file_item_s *gpa_file_item_t; 
 
+/* True if ITEM is a text and not a file.  */
+#define GPA_FILE_ITEM_IS_DIRECT(item) \
+  ((item)->direct_in || (item)->direct_text)
+
+
+/* A worker of a file operation.  Each worker has its own context and
+   processes one item at a time, so that several items are processed
+   concurrently.  */
+struct gpa_file_worker_s
+{
+  GpaContext *context;
+  gulong done_id;
+
+  /* The item being processed or NULL if the worker is idle.  */
+  gpa_file_item_t item;
+
+  /* The data objects of the item and their file descriptors, or -1
+     if they are not backed by a file.  IN and OUT are the input and
+     output of the operation.  SIG is only used for verifying.  */
+  gpgme_data_t in, out, sig;
+  int in_fd, out_fd, sig_fd;
+
+  /* The files of a detached signature.  */
+  gchar *signed_file, *signature_file;
+
+  /* The monotonic time the item was started.  */
+  gint64 start_time;
+};
+typedef struct gpa_file_worker_s *gpa_file_worker_t;
+
 
 struct _GpaFileOperation {
   GpaOperation parent;
 
   GList *input_files;
+  /* The next item to process.  */
   GList *current;
   GtkWidget *progress_dialog;
+
+  /* The workers; this is NULL until gpa_file_operation_start_files
+     has been called.  */
+  GPtrArray *workers;
+  /* The number of items and the number of processed items.  */
+  guint n_items;
+  guint n_done;
+  /* The first error of the operation.  Unless in batch mode no more
+     items are started once an error occurred.  */
+  gpg_error_t err;
+  /* True if the operation runs without any dialogs, for example for
+     the UI server.  Errors are only recorded in the items.  */
+  gboolean batch;
+  /* True once all items have been processed.  */
+  gboolean finished;
 };
 
 struct _GpaFileOperationClass {
@@ -72,6 +128,23 @@ struct _GpaFileOperationClass {
   /* Called every time a new file is created by the operation,
    * *after* the operations is done with it. */
   void (*created_file) (GpaContext *context, const gchar *file);
+  /* Called after each item has been processed.  */
+  void (*file_done) (GpaFileOperation *op, gpa_file_item_t item);
+
+  /* Virtual methods for gpa_file_operation_start_files.  */
+
+  /* Start the operation for the item of WORKER on its context.  */
+  gpg_error_t (*start_item) (GpaFileOperation *op, gpa_file_worker_t worker);
+  /* Show the error ERR of the operation for the item of WORKER.  This
+     is only called for the first error.  */
+  void (*show_error) (GpaFileOperation *op, gpa_file_worker_t worker,
+                      gpg_error_t err);
+  /* The item of WORKER has been processed with the result ERR.  The
+     data objects have already been released.  */
+  void (*item_done) (GpaFileOperation *op, gpa_file_worker_t worker,
+                     gpg_error_t err);
+  /* All items have been processed.  ERR is the first error.  */
+  void (*finish) (GpaFileOperation *op, gpg_error_t err);
 };
 
 GType gpa_file_operation_get_type (void) G_GNUC_CONST;
@@ -88,4 +161,25 @@ gpa_file_operation_input_files (GpaFileOperation *op);
 const gchar *
 gpa_file_operation_current_file (GpaFileOperation *op);
 
+/* Process all input files using a pool of workers.  */
+void
+gpa_file_operation_start_files (GpaFileOperation *op);
+
+/* Open the input file FILENAME for an item of OP.  */
+gpg_error_t
+gpa_file_operation_open_input (GpaFileOperation *op, const char *filename,
+                               gpgme_data_t *data, int *r_fd);
+
+/* Open the output file FILENAME for an item of OP.  */
+gpg_error_t
+gpa_file_operation_open_output (GpaFileOperation *op, const char *filename,
+                                gpgme_data_t *data, int *r_fd,
+                                char **r_filename_used);
+
+/* Create the data objects for the input and, if R_OUT is not NULL,
+   the output of the direct item ITEM.  */
+gpg_error_t
+gpa_file_operation_open_direct (GpaFileOperation *op, gpa_file_item_t item,
+                                gpgme_data_t *r_in, gpgme_data_t *r_out);
+
 #endif
@@ -40,15 +40,20 @@
 #include "gpawidgets.h"
 
 /* Internal functions */
-static void gpa_file_sign_operation_done_error_cb (GpaContext *context,
-						   gpg_error_t err,
-						   GpaFileSignOperation *op);
-static void gpa_file_sign_operation_done_cb (GpaContext *context,
-						gpg_error_t err,
-						GpaFileSignOperation *op);
+static gpg_error_t gpa_file_sign_operation_start (GpaFileOperation *op,
+						  gpa_file_worker_t worker);
+static void gpa_file_sign_operation_done_error_cb (GpaFileOperation *op,
+						   gpa_file_worker_t worker,
+						   gpg_error_t err);
+static void gpa_file_sign_operation_done_cb (GpaFileOperation *op,
+					     gpa_file_worker_t worker,
+					     gpg_error_t err);
+static void gpa_file_sign_operation_finish (GpaFileOperation *op,
+					    gpg_error_t err);
 static void gpa_file_sign_operation_response_cb (GtkDialog *dialog,
 						    gint response,
 						    gpointer user_data);
+static gboolean gpa_file_sign_operation_idle_cb (gpointer data);
 
 /* GObject */
 
@@ -109,11 +114,6 @@ gpa_file_sign_operation_init (GpaFileSignOperation *op)
 {
   op->sign_dialog = NULL;
   op->sign_type = GPGME_SIG_MODE_NORMAL;
-  op->sig_fd = -1;
-  op->plain_fd = -1;
-  op->sig = NULL;
-  op->plain = NULL;
-  op->sig_filename = NULL;
   op->force_armor = FALSE;
 }
 
@@ -132,6 +132,13 @@ gpa_file_sign_operation_constructor (GType type,
 				      construct_properties);
   op = GPA_FILE_SIGN_OPERATION (object);
   /* Initialize */
+  if (GPA_FILE_OPERATION (op)->batch)
+    {
+      /* The signer is set by the caller; start with the first file
+	 after going back into the main loop.  */
+      g_idle_add (gpa_file_sign_operation_idle_cb, op);
+      return object;
+    }
   /* Create the "Sign" dialog */
   op->sign_dialog = gpa_file_sign_dialog_new (GPA_OPERATION (op)->window);
   if (op->force_armor)
@@ -146,11 +153,6 @@ gpa_file_sign_operation_constructor (GType type,
 
   g_signal_connect (G_OBJECT (op->sign_dialog), "response",
 		    G_CALLBACK (gpa_file_sign_operation_response_cb), op);
-  /* Connect to the "done" signal */
-  g_signal_connect (G_OBJECT (GPA_OPERATION (op)->context), "done",
-		    G_CALLBACK (gpa_file_sign_operation_done_error_cb), op);
-  g_signal_connect (G_OBJECT (GPA_OPERATION (op)->context), "done",
-		    G_CALLBACK (gpa_file_sign_operation_done_cb), op);
   /* Give a title to the progress dialog */
   gtk_window_set_title (GTK_WINDOW (GPA_FILE_OPERATION (op)->progress_dialog),
 			_("Signing..."));
@@ -165,6 +167,7 @@ static void
 gpa_file_sign_operation_class_init (GpaFileSignOperationClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GpaFileOperationClass *file_op_class = GPA_FILE_OPERATION_CLASS (klass);
 
   parent_class = g_type_class_peek_parent (klass);
 
@@ -173,6 +176,11 @@ gpa_file_sign_operation_class_init (GpaFileSignOperationClass *klass)
   object_class->set_property = gpa_file_sign_operation_set_property;
   object_class->get_property = gpa_file_sign_operation_get_property;
 
+  file_op_class->start_item = gpa_file_sign_operation_start;
+  file_op_class->show_error = gpa_file_sign_operation_done_error_cb;
+  file_op_class->item_done = gpa_file_sign_operation_done_cb;
+  file_op_class->finish = gpa_file_sign_operation_finish;
+
   /* Properties */
   g_object_class_install_property (object_class,
 				   PROP_FORCE_ARMOR,
@@ -228,6 +236,31 @@ gpa_file_sign_operation_new (GtkWidget *window, GList *files,
   return op;
 }
 
+
+/* Create a new sign operation for FILES which runs without any
+   dialogs.  The files are signed with SIGNER using the signature
+   mode SIGN_TYPE.  Existing output files are not overwritten.  */
+GpaFileSignOperation*
+gpa_file_sign_operation_new_batch (GList *files, gpgme_key_t signer,
+				   gpgme_sig_mode_t sign_type, gboolean armor)
+{
+  GpaFileSignOperation *op;
+  gpgme_ctx_t ctx;
+
+  op = g_object_new (GPA_FILE_SIGN_OPERATION_TYPE,
+		     "input_files", files,
+		     "batch", TRUE,
+		     NULL);
+
+  ctx = GPA_OPERATION (op)->context->ctx;
+  gpgme_set_protocol (ctx, signer->protocol);
+  gpgme_set_armor (ctx, armor);
+  gpgme_signers_add (ctx, signer);
+  op->sign_type = sign_type;
+
+  return op;
+}
+
 /* Internal */
 
 static gchar*
@@ -257,30 +290,23 @@ destination_filename (const gchar *filename, gboolean armor,
 
 
 static gpg_error_t
-gpa_file_sign_operation_start (GpaFileSignOperation *op,
-			       gpa_file_item_t file_item)
+gpa_file_sign_operation_start (GpaFileOperation *file_op,
+			       gpa_file_worker_t worker)
 {
+  GpaFileSignOperation *op = GPA_FILE_SIGN_OPERATION (file_op);
+  gpa_file_item_t file_item = worker->item;
   gpg_error_t err;
 
-  if (file_item->direct_in)
+  if (GPA_FILE_ITEM_IS_DIRECT (file_item))
     {
       /* No copy is made.  */
-      err = gpgme_data_new_from_mem (&op->plain, file_item->direct_in,
-				     file_item->direct_in_len, 0);
+      err = gpa_file_operation_open_direct (file_op, file_item,
+					    &worker->in, &worker->out);
       if (err)
 	{
 	  gpa_gpgme_warning (err);
 	  return err;
 	}
-
-      err = gpgme_data_new (&op->sig);
-      if (err)
-	{
-	  gpa_gpgme_warning (err);
-	  gpgme_data_release (op->plain);
-	  op->plain = NULL;
-	  return err;
-	}
     }
   else
     {
@@ -288,26 +314,28 @@ gpa_file_sign_operation_start (GpaFileSignOperation *op,
       char *filename_used;
 
       file_item->filename_out = destination_filename
-	(plain_filename, gpgme_get_armor (GPA_OPERATION (op)->context->ctx),
-	 gpgme_get_protocol (GPA_OPERATION (op)->context->ctx), op->sign_type);
+	(plain_filename, gpgme_get_armor (worker->context->ctx),
+	 gpgme_get_protocol (worker->context->ctx), op->sign_type);
 
       /* Open the files */
-      op->plain_fd = gpa_open_input (plain_filename, &op->plain,
-				     GPA_OPERATION (op)->window);
-      if (op->plain_fd == -1)
-	/* FIXME: Error value.  */
-	return gpg_error (GPG_ERR_GENERAL);
-
-      op->sig_fd = gpa_open_output (file_item->filename_out, &op->sig,
-				    GPA_OPERATION (op)->window,
-                                    &filename_used);
-      if (op->sig_fd == -1)
+      err = gpa_file_operation_open_input (file_op, plain_filename,
+					   &worker->in, &worker->in_fd);
+      if (err)
+	{
+	  g_free (file_item->filename_out);
+	  file_item->filename_out = NULL;
+	  return err;
+	}
+
+      err = gpa_file_operation_open_output (file_op, file_item->filename_out,
+					    &worker->out, &worker->out_fd,
+					    &filename_used);
+      if (err)
 	{
-	  gpgme_data_release (op->plain);
-	  close (op->plain_fd);
           xfree (filename_used);
-	  /* FIXME: Error value.  */
-	  return gpg_error (GPG_ERR_GENERAL);
+	  g_free (file_item->filename_out);
+	  file_item->filename_out = NULL;
+	  return err;
 	}
 
       xfree (file_item->filename_out);
@@ -315,109 +343,64 @@ gpa_file_sign_operation_start (GpaFileSignOperation *op,
     }
 
   /* Start the operation */
-  err = gpgme_op_sign_start (GPA_OPERATION (op)->context->ctx, op->plain,
-			     op->sig, op->sign_type);
+  err = gpgme_op_sign_start (worker->context->ctx, worker->in,
+			     worker->out, op->sign_type);
   if (err)
     {
       gpa_gpgme_warning (err);
       return err;
     }
-  /* Show and update the progress dialog */
-  gtk_widget_show_all (GPA_FILE_OPERATION (op)->progress_dialog);
-  gpa_progress_dialog_set_label (GPA_PROGRESS_DIALOG
-				 (GPA_FILE_OPERATION (op)->progress_dialog),
-				 file_item->direct_name
-				 ? file_item->direct_name
-				 : file_item->filename_in);
 
   return 0;
 }
 
 
 static void
-gpa_file_sign_operation_next (GpaFileSignOperation *op)
-{
-  gpg_error_t err;
-
-  if (! GPA_FILE_OPERATION (op)->current)
-    {
-      g_signal_emit_by_name (GPA_OPERATION (op), "completed", 0);
-      return;
-    }
-
-  err = gpa_file_sign_operation_start (op,
-				       GPA_FILE_OPERATION (op)->current->data);
-  if (err)
-    g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
-}
-
-
-static void
-gpa_file_sign_operation_done_cb (GpaContext *context,
-				 gpg_error_t err,
-				 GpaFileSignOperation *op)
+gpa_file_sign_operation_done_cb (GpaFileOperation *op,
+				 gpa_file_worker_t worker,
+				 gpg_error_t err)
 {
-  gpa_file_item_t file_item = GPA_FILE_OPERATION (op)->current->data;
-
-  if (file_item->direct_in)
-    {
-      size_t len;
-      char *sig_gpgme = gpgme_data_release_and_get_mem (op->sig, &len);
-      op->sig = NULL;
-      /* Do the memory allocation dance.  */
-
-      if (sig_gpgme)
-	{
-	  /* Conveniently make ASCII stuff into a string.  */
-	  file_item->direct_out = g_malloc (len + 1);
-	  memcpy (file_item->direct_out, sig_gpgme, len);
-	  gpgme_free (sig_gpgme);
-	  file_item->direct_out[len] = '\0';
-	  /* Yep, excluding the trailing zero.  */
-	  file_item->direct_out_len = len;
-	}
-      else
-	{
-	  file_item->direct_out = NULL;
-	  file_item->direct_out_len = 0;
-	}
-    }
-
-  /* Do clean up on the operation */
-  gpgme_data_release (op->plain);
-  op->plain = NULL;
-  close (op->plain_fd);
-  op->plain_fd = -1;
-  gpgme_data_release (op->sig);
-  op->sig = NULL;
-  close (op->sig_fd);
-  op->sig_fd = -1;
-  gtk_widget_hide (GPA_FILE_OPERATION (op)->progress_dialog);
+  gpa_file_item_t file_item = worker->item;
 
   if (err)
     {
-      if (! file_item->direct_in)
+      if (! file_item->direct_in && file_item->filename_out)
 	{
 	  /* If an error happened, (or the user canceled) delete the
-	     created file and abort further signions.  */
-	  g_unlink (op->sig_filename);
-	  g_free (op->sig_filename);
+	     created file.  */
+	  g_unlink (file_item->filename_out);
+	  g_free (file_item->filename_out);
+	  file_item->filename_out = NULL;
 	}
-      g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
     }
   else
     {
       /* We've just created a file */
       g_signal_emit_by_name (GPA_OPERATION (op), "created_file",
 			     file_item);
-      /* Go to the next file in the list and sign it */
-      GPA_FILE_OPERATION (op)->current = g_list_next
-	(GPA_FILE_OPERATION (op)->current);
-      gpa_file_sign_operation_next (op);
     }
 }
 
 
+/* All files have been signed or an error occurred.  */
+static void
+gpa_file_sign_operation_finish (GpaFileOperation *op, gpg_error_t err)
+{
+  g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
+}
+
+
+static gboolean
+gpa_file_sign_operation_idle_cb (gpointer data)
+{
+  GpaFileSignOperation *op = data;
+
+  gpa_file_operation_start_files (GPA_FILE_OPERATION (op));
+
+  return FALSE;
+}
+
+
 /*
  * Setting the signers and the protocol for the context. The protocol
  * to use is derived from the keys.  An errro will be displayed if the
@@ -499,7 +482,7 @@ gpa_file_sign_operation_response_cb (GtkDialog *dialog,
       success = set_signers (op, signers);
       /* Actually run the operation or abort.  */
       if (success)
-	gpa_file_sign_operation_next (op);
+	gpa_file_operation_start_files (GPA_FILE_OPERATION (op));
       else
 	g_signal_emit_by_name (GPA_OPERATION (op), "completed",
 			       gpg_error (GPG_ERR_GENERAL));
@@ -515,8 +498,9 @@ gpa_file_sign_operation_response_cb (GtkDialog *dialog,
 
 
 static void
-gpa_file_sign_operation_done_error_cb (GpaContext *context, gpg_error_t err,
-				       GpaFileSignOperation *op)
+gpa_file_sign_operation_done_error_cb (GpaFileOperation *op,
+				       gpa_file_worker_t worker,
+				       gpg_error_t err)
 {
   switch (gpg_err_code (err))
     {
@@ -525,11 +509,11 @@ gpa_file_sign_operation_done_error_cb (GpaContext *context, gpg_error_t err,
       /* Ignore these */
       break;
     case GPG_ERR_BAD_PASSPHRASE:
-      gpa_show_warn (GPA_OPERATION (op)->window, GPA_OPERATION (op)->context,
+      gpa_show_warn (GPA_OPERATION (op)->window, worker->context,
                      _("Wrong passphrase!"));
       break;
     default:
-      gpa_gpgme_warn (err, NULL, GPA_OPERATION (op)->context);
+      gpa_gpgme_warn (err, NULL, worker->context);
       break;
     }
 }
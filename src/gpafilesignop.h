@@ -41,9 +41,6 @@ struct _GpaFileSignOperation {
 
   gpgme_sig_mode_t sign_type;
   GtkWidget *sign_dialog;
-  int sig_fd, plain_fd;
-  gpgme_data_t sig, plain;
-  gchar *sig_filename;
   gboolean force_armor;
 };
 
@@ -61,4 +58,10 @@ GpaFileSignOperation*
 gpa_file_sign_operation_new (GtkWidget *window,
 			     GList *files, gboolean force_armor);
 
+/* Creates a new sign operation without dialogs, for example for the
+   UI server.  */
+GpaFileSignOperation*
+gpa_file_sign_operation_new_batch (GList *files, gpgme_key_t signer,
+				   gpgme_sig_mode_t sign_type, gboolean armor);
+
 #endif
@@ -41,12 +41,15 @@
 
 /* Internal functions */
 static gboolean gpa_file_verify_operation_idle_cb (gpointer data);
-static void gpa_file_verify_operation_done_error_cb (GpaContext *context,
-						     gpg_error_t err,
-						     GpaFileVerifyOperation *op);
-static void gpa_file_verify_operation_done_cb (GpaContext *context,
-						gpg_error_t err,
-						GpaFileVerifyOperation *op);
+static gpg_error_t gpa_file_verify_operation_start
+	(GpaFileOperation *op, gpa_file_worker_t worker);
+static void gpa_file_verify_operation_done_error_cb
+	(GpaFileOperation *op, gpa_file_worker_t worker, gpg_error_t err);
+static void gpa_file_verify_operation_done_cb (GpaFileOperation *op,
+					       gpa_file_worker_t worker,
+					       gpg_error_t err);
+static void gpa_file_verify_operation_finish (GpaFileOperation *op,
+					      gpg_error_t err);
 static void gpa_file_verify_operation_response_cb (GtkDialog *dialog,
 						   gint response,
 						   gpointer user_data);
@@ -60,7 +63,8 @@ gpa_file_verify_operation_finalize (GObject *object)
 {
   GpaFileVerifyOperation *op = GPA_FILE_VERIFY_OPERATION (object);
 
-  gtk_widget_destroy (op->dialog);
+  if (op->dialog)
+    gtk_widget_destroy (op->dialog);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -69,12 +73,7 @@ gpa_file_verify_operation_finalize (GObject *object)
 static void
 gpa_file_verify_operation_init (GpaFileVerifyOperation *op)
 {
-  op->sig_fd = -1;
-  op->signed_text_fd = -1;
-  op->sig = NULL;
-  op->signed_text = NULL;
-  op->signed_file = NULL;
-  op->signature_file = NULL;
+  op->dialog = NULL;
 }
 
 static GObject*
@@ -94,19 +93,18 @@ gpa_file_verify_operation_constructor
   /* Initialize */
   /* Start with the first file after going back into the main loop */
   g_idle_add (gpa_file_verify_operation_idle_cb, op);
-  /* Connect to the "done" signal */
-  g_signal_connect (G_OBJECT (GPA_OPERATION (op)->context), "done",
-		    G_CALLBACK (gpa_file_verify_operation_done_error_cb), op);
-  g_signal_connect (G_OBJECT (GPA_OPERATION (op)->context), "done",
-		    G_CALLBACK (gpa_file_verify_operation_done_cb), op);
   /* Give a title to the progress dialog */
   gtk_window_set_title (GTK_WINDOW (GPA_FILE_OPERATION (op)->progress_dialog),
 			_("Verifying..."));
 
   /* Create the verification dialog */
-  op->dialog = gpa_file_verify_dialog_new (GPA_OPERATION (op)->window);
-  g_signal_connect (G_OBJECT (op->dialog), "response",
-		    G_CALLBACK (gpa_file_verify_operation_response_cb), op);
+  if (!GPA_FILE_OPERATION (op)->batch)
+    {
+      op->dialog = gpa_file_verify_dialog_new (GPA_OPERATION (op)->window);
+      g_signal_connect (G_OBJECT (op->dialog), "response",
+			G_CALLBACK (gpa_file_verify_operation_response_cb),
+			op);
+    }
 
   return object;
 }
@@ -116,11 +114,17 @@ static void
 gpa_file_verify_operation_class_init (GpaFileVerifyOperationClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GpaFileOperationClass *file_op_class = GPA_FILE_OPERATION_CLASS (klass);
 
   parent_class = g_type_class_peek_parent (klass);
 
   object_class->constructor = gpa_file_verify_operation_constructor;
   object_class->finalize = gpa_file_verify_operation_finalize;
+
+  file_op_class->start_item = gpa_file_verify_operation_start;
+  file_op_class->show_error = gpa_file_verify_operation_done_error_cb;
+  file_op_class->item_done = gpa_file_verify_operation_done_cb;
+  file_op_class->finish = gpa_file_verify_operation_finish;
 }
 
 GType
@@ -166,6 +170,23 @@ gpa_file_verify_operation_new (GtkWidget *window, GList *files)
   return op;
 }
 
+
+/* Create a new verify operation for FILES which runs without any
+   dialogs.  A file without a valid signature is reported as an
+   error.  */
+GpaFileVerifyOperation*
+gpa_file_verify_operation_new_batch (GList *files)
+{
+  GpaFileVerifyOperation *op;
+
+  op = g_object_new (GPA_FILE_VERIFY_OPERATION_TYPE,
+		     "input_files", files,
+		     "batch", TRUE,
+		     NULL);
+
+  return op;
+}
+
 /* Internal */
 
 static gboolean
@@ -190,11 +211,12 @@ ask_use_detached_sig (const gchar *file, const gchar *sig, GtkWidget *parent)
 
 /* Check whether the file is a detached signature and deduce the name of the
  * original file. Since we only have access to the filename, this is not
- * very solid.
+ * very solid.  If ASK is false, a detached signature for the file is not
+ * used.
  */
 static gboolean
 is_detached_sig (const gchar *filename, gchar **signature_file,
-		 gchar **signed_file, GtkWidget *window)
+		 gchar **signed_file, gboolean ask, GtkWidget *window)
 {
   const gchar *sig_extension[] = {".sig", ".asc", ".sign"};
   int i;
@@ -223,7 +245,7 @@ is_detached_sig (const gchar *filename, gchar **signature_file,
   *signed_file = NULL;
 
   /* Now, check whether a detached signature exists for this file */
-  for (i = 0; i < DIM (sig_extension); i++)
+  for (i = 0; ask && i < DIM (sig_extension); i++)
     {
       gchar *sig = g_strconcat (filename, sig_extension[i], NULL);
 
@@ -240,206 +262,151 @@ is_detached_sig (const gchar *filename, gchar **signature_file,
   return FALSE;
 }
 
-static gboolean
-gpa_file_verify_operation_start (GpaFileVerifyOperation *op,
-				 gpa_file_item_t file_item)
+static gpg_error_t
+gpa_file_verify_operation_start (GpaFileOperation *op,
+				 gpa_file_worker_t worker)
 {
+  gpa_file_item_t file_item = worker->item;
   gpgme_error_t err;
 
-  if (file_item->direct_in)
+  if (GPA_FILE_ITEM_IS_DIRECT (file_item))
     {
+      gpa_data_info_t info;
+
       /* Direct input is always an inline signature.  */
 
       /* No copy is made.  */
-      err = gpgme_data_new_from_mem (&op->sig, file_item->direct_in,
-				     file_item->direct_in_len, 0);
+      err = gpa_file_operation_open_direct (op, file_item,
+					    &worker->sig, &worker->out);
       if (err)
 	{
 	  gpa_gpgme_warning (err);
-	  return FALSE;
+	  return err;
 	}
 
-      err = gpgme_data_new (&op->plain);
-      if (err)
-	{
-	  gpa_gpgme_warning (err);
-	  gpgme_data_release (op->sig);
-	  op->sig = NULL;
-	  return FALSE;
-	}
-
-      gpgme_set_protocol (GPA_OPERATION (op)->context->ctx,
-                          is_cms_data (file_item->direct_in,
-                                       file_item->direct_in_len) ?
-                          GPGME_PROTOCOL_CMS : GPGME_PROTOCOL_OpenPGP);
+      gpa_identify_data (worker->sig, &info);
+      gpgme_set_protocol (worker->context->ctx, info.protocol);
     }
   else
     {
       const gchar *sig_filename = file_item->filename_in;
+      gpa_data_info_t info;
 
-      if (is_detached_sig (sig_filename, &op->signature_file, &op->signed_file,
-			   GPA_OPERATION (op)->window))
+      /* Open the file only once and look at its start to find out
+	 what it is.  */
+      err = gpa_file_operation_open_input (op, sig_filename,
+					   &worker->sig, &worker->sig_fd);
+      if (err)
+	return err;
+      gpa_identify_data (worker->sig, &info);
+
+      /* A signed message carries its own data; only look for the
+	 signed file of a detached signature or for a detached
+	 signature of other files.  */
+      if (!info.message
+	  && is_detached_sig (sig_filename, &worker->signature_file,
+			      &worker->signed_file,
+			      !op->batch && !info.detached_sig,
+			      GPA_OPERATION (op)->window))
 	{
-	  /* Allocate data objects for a detached signature */
-	  op->sig_fd = gpa_open_input (op->signature_file, &op->sig,
-				       GPA_OPERATION (op)->window);
-	  if (op->sig_fd == -1)
+	  if (g_str_equal (worker->signature_file, sig_filename))
 	    {
-	      return FALSE;
+	      /* The file is the detached signature.  */
+	      err = gpa_file_operation_open_input (op, worker->signed_file,
+						   &worker->in,
+						   &worker->in_fd);
+	      if (err)
+		return err;
 	    }
-	  op->signed_text_fd = gpa_open_input (op->signed_file, &op->signed_text,
-					       GPA_OPERATION (op)->window);
-	  if (op->signed_text_fd == -1)
+	  else
 	    {
-	      gpgme_data_release (op->sig);
-	      close (op->sig_fd);
-	      return FALSE;
+	      /* The file is the signed data; its signature is in
+		 another file.  */
+	      worker->in = worker->sig;
+	      worker->in_fd = worker->sig_fd;
+	      worker->sig = NULL;
+	      worker->sig_fd = -1;
+	      err = gpa_file_operation_open_input (op, worker->signature_file,
+						   &worker->sig,
+						   &worker->sig_fd);
+	      if (err)
+		return err;
+	      gpa_identify_data (worker->sig, &info);
 	    }
-	  op->plain = NULL;
 	}
       else
 	{
 	  /* Allocate data object for non-detached signatures */
-	  op->sig_fd = gpa_open_input (sig_filename, &op->sig,
-				       GPA_OPERATION (op)->window);
-	  if (op->sig_fd == -1)
-	    {
-	      return FALSE;
-	    }
-	  err = gpgme_data_new (&op->plain);
+	  err = gpgme_data_new (&worker->out);
 	  if (err)
-	    {
-	      gpgme_data_release (op->sig);
-	      close (op->sig_fd);
-	      return FALSE;
-	    }
-	  op->signed_text_fd = -1;
-	  op->signed_text = NULL;
+	    return err;
 	}
 
-      gpgme_set_protocol (GPA_OPERATION (op)->context->ctx,
-                          is_cms_file (sig_filename) ?
-                          GPGME_PROTOCOL_CMS : GPGME_PROTOCOL_OpenPGP);
+      gpgme_set_protocol (worker->context->ctx, info.protocol);
     }
 
 
   /* Start the operation */
-  err = gpgme_op_verify_start (GPA_OPERATION (op)->context->ctx, op->sig,
-			       op->signed_text, op->plain);
+  err = gpgme_op_verify_start (worker->context->ctx, worker->sig,
+			       worker->in, worker->out);
   if (err)
     {
       gpa_gpgme_warning (err);
-      return FALSE;
+      return err;
     }
-  /* Show and update the progress dialog */
-  gtk_widget_show_all (GPA_FILE_OPERATION (op)->progress_dialog);
-  gpa_progress_dialog_set_label (GPA_PROGRESS_DIALOG
-				 (GPA_FILE_OPERATION (op)->progress_dialog),
-				 file_item->direct_name
-				 ? file_item->direct_name
-				 : file_item->filename_in);
-
-  return TRUE;
+
+  return 0;
 }
 
 
 static void
-gpa_file_verify_operation_next (GpaFileVerifyOperation *op)
+gpa_file_verify_operation_done_cb (GpaFileOperation *file_op,
+				   gpa_file_worker_t worker,
+				   gpg_error_t err)
 {
-  if (! GPA_FILE_OPERATION (op)->current ||
-      ! gpa_file_verify_operation_start (op, GPA_FILE_OPERATION (op)
-					 ->current->data))
+  GpaFileVerifyOperation *op = GPA_FILE_VERIFY_OPERATION (file_op);
+  gpa_file_item_t file_item = worker->item;
+  gpgme_verify_result_t result;
+
+  if (err)
+    return;
+
+  result = gpgme_op_verify_result (worker->context->ctx);
+  if (file_op->batch)
     {
-      /* All files have been verified: show the results dialog */
-      gtk_widget_show_all (op->dialog);
+      /* There is no dialog; report a missing or bad signature as the
+	 result of the file.  */
+      file_item->err = gpa_gpgme_signature_error (result);
+      return;
     }
+  /* Add the file to the result dialog.  FIXME: Maybe we should
+     use the filename without the directory.  */
+  gpa_file_verify_dialog_add_file (GPA_FILE_VERIFY_DIALOG (op->dialog),
+				   file_item->direct_name
+				   ? file_item->direct_name
+				   : file_item->filename_in,
+				   worker->signed_file, worker->signature_file,
+				   result->signatures);
+
+  /* For a non-detached signature in direct mode we created a
+     "file".  */
+  if (!worker->signed_file && GPA_FILE_ITEM_IS_DIRECT (file_item))
+    g_signal_emit_by_name (GPA_OPERATION (op), "created_file", file_item);
 }
 
 
+/* All files have been verified or an error occurred: show the
+   results dialog.  */
 static void
-gpa_file_verify_operation_done_cb (GpaContext *context,
-				    gpg_error_t err,
-				    GpaFileVerifyOperation *op)
+gpa_file_verify_operation_finish (GpaFileOperation *file_op,
+				  gpg_error_t err)
 {
-  gpa_file_item_t file_item = GPA_FILE_OPERATION (op)->current->data;
-
-  if (file_item->direct_in)
-    {
-      size_t len;
-      char *plain_gpgme = gpgme_data_release_and_get_mem (op->plain,
-							   &len);
-      op->plain = NULL;
-      /* Do the memory allocation dance.  */
+  GpaFileVerifyOperation *op = GPA_FILE_VERIFY_OPERATION (file_op);
 
-      if (plain_gpgme)
-	{
-	  /* Conveniently make ASCII stuff into a string.  */
-	  file_item->direct_out = g_malloc (len + 1);
-	  memcpy (file_item->direct_out, plain_gpgme, len);
-	  gpgme_free (plain_gpgme);
-	  file_item->direct_out[len] = '\0';
-	  /* Yep, excluding the trailing zero.  */
-	  file_item->direct_out_len = len;
-	}
-      else
-	{
-	  file_item->direct_out = NULL;
-	  file_item->direct_out_len = 0;
-	}
-    }
-
-  /* Do clean up on the operation */
-  gpgme_data_release (op->plain);
-  op->plain = NULL;
-  gpgme_data_release (op->signed_text);
-  op->signed_text = NULL;
-  close (op->signed_text_fd);
-  op->signed_text_fd = -1;
-  gpgme_data_release (op->sig);
-  op->sig = NULL;
-  close (op->sig_fd);
-  op->sig_fd = -1;
-
-  gtk_widget_hide (GPA_FILE_OPERATION (op)->progress_dialog);
-  /* Check for error */
-  if (err)
-    {
-      /* Abort further verifications */
-    }
+  if (op->dialog)
+    gtk_widget_show_all (op->dialog);
   else
-    {
-      gpgme_verify_result_t result;
-
-      result = gpgme_op_verify_result (GPA_OPERATION (op)->context->ctx);
-      /* Add the file to the result dialog.  FIXME: Maybe we should
-	 use the filename without the directory.  */
-      gpa_file_verify_dialog_add_file (GPA_FILE_VERIFY_DIALOG (op->dialog),
-				       file_item->direct_name
-				       ? file_item->direct_name
-				       : file_item->filename_in,
-				       op->signed_file, op->signature_file,
-				       result->signatures);
-      /* If this was a dettached sig, reset the signed file */
-      if (op->signed_file)
-	{
-	  g_free (op->signed_file);
-	  op->signed_file = NULL;
-	  g_free (op->signature_file);
-	  op->signature_file = NULL;
-	}
-      else
-	{
-	  /* Otherwise, we created a "file" in direct mode.  */
-	  if (file_item->direct_in)
-	    g_signal_emit_by_name (GPA_OPERATION (op), "created_file",
-				   file_item);
-	}
-
-      /* Go to the next file in the list and verify it */
-      GPA_FILE_OPERATION (op)->current = g_list_next
-	(GPA_FILE_OPERATION (op)->current);
-      gpa_file_verify_operation_next (op);
-    }
+    g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
 }
 
 static gboolean
@@ -447,7 +414,7 @@ gpa_file_verify_operation_idle_cb (gpointer data)
 {
   GpaFileVerifyOperation *op = data;
 
-  gpa_file_verify_operation_next (op);
+  gpa_file_operation_start_files (GPA_FILE_OPERATION (op));
 
   return FALSE;
 }
@@ -465,10 +432,11 @@ gpa_file_verify_operation_response_cb (GtkDialog *dialog,
 
 
 static void
-gpa_file_verify_operation_done_error_cb (GpaContext *context, gpg_error_t err,
-					 GpaFileVerifyOperation *op)
+gpa_file_verify_operation_done_error_cb (GpaFileOperation *op,
+					 gpa_file_worker_t worker,
+					 gpg_error_t err)
 {
-  gpa_file_item_t file_item = GPA_FILE_OPERATION (op)->current->data;
+  gpa_file_item_t file_item = worker->item;
 
   switch (gpg_err_code (err))
     {
@@ -477,7 +445,7 @@ gpa_file_verify_operation_done_error_cb (GpaContext *context, gpg_error_t err,
       /* Ignore these */
       break;
     case GPG_ERR_NO_DATA:
-      gpa_show_warn (GPA_OPERATION (op)->window, GPA_OPERATION (op)->context,
+      gpa_show_warn (GPA_OPERATION (op)->window, worker->context,
                      file_item->direct_name
                      ? _("\"%s\" contained no OpenPGP data.")
                      : _("The file \"%s\" contained no OpenPGP"
@@ -487,11 +455,11 @@ gpa_file_verify_operation_done_error_cb (GpaContext *context, gpg_error_t err,
                      : file_item->filename_in);
       break;
     case GPG_ERR_BAD_PASSPHRASE:
-      gpa_show_warn (GPA_OPERATION (op)->window, GPA_OPERATION (op)->context,
+      gpa_show_warn (GPA_OPERATION (op)->window, worker->context,
                      _("Wrong passphrase!"));
       break;
     default:
-      gpa_gpgme_warn (err, NULL, GPA_OPERATION (op)->context);
+      gpa_gpgme_warn (err, NULL, worker->context);
       break;
     }
 }
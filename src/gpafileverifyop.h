@@ -39,9 +39,6 @@ typedef struct _GpaFileVerifyOperationClass GpaFileVerifyOperationClass;
 struct _GpaFileVerifyOperation {
   GpaFileOperation parent;
 
-  int sig_fd, signed_text_fd;
-  gpgme_data_t sig, signed_text, plain;
-  gchar *signed_file, *signature_file;
   GtkWidget *dialog;
 };
 
@@ -59,4 +56,9 @@ GpaFileVerifyOperation*
 gpa_file_verify_operation_new (GtkWidget *window,
 			       GList *files);
 
+/* Creates a new verify operation without dialogs, for example for
+   the UI server.  */
+GpaFileVerifyOperation*
+gpa_file_verify_operation_new_batch (GList *files);
+
 #endif
@@ -116,22 +116,24 @@ gpa_import_operation_class_init (GpaImportOperationClass *klass)
 
   /* Signals */
   klass->imported_keys = NULL;
+  klass->imported_secret_keys = NULL;
   signals[IMPORTED_KEYS] =
     g_signal_new ("imported_keys",
 		  G_TYPE_FROM_CLASS (object_class),
 		  G_SIGNAL_RUN_FIRST,
 		  G_STRUCT_OFFSET (GpaImportOperationClass, imported_keys),
 		  NULL, NULL,
-		  g_cclosure_marshal_VOID__VOID,
-		  G_TYPE_NONE, 0);
+		  g_cclosure_marshal_VOID__POINTER,
+		  G_TYPE_NONE, 1, G_TYPE_POINTER);
   signals[IMPORTED_SECRET_KEYS] =
     g_signal_new ("imported_secret_keys",
 		  G_TYPE_FROM_CLASS (object_class),
 		  G_SIGNAL_RUN_FIRST,
-		  G_STRUCT_OFFSET (GpaImportOperationClass, imported_keys),
+		  G_STRUCT_OFFSET (GpaImportOperationClass,
+				   imported_secret_keys),
 		  NULL, NULL,
-		  g_cclosure_marshal_VOID__VOID,
-		  G_TYPE_NONE, 0);
+		  g_cclosure_marshal_VOID__POINTER,
+		  G_TYPE_NONE, 1, G_TYPE_POINTER);
 
 }
 
@@ -216,20 +218,28 @@ gpa_import_operation_done_cb (GpaContext *context, gpg_error_t err,
     {
       struct gpa_import_result_s result;
       gpgme_import_result_t res;
+      GHashTable *set;
+      const char **fprs;
 
       memset (&result, 0, sizeof result);
 
       GPA_IMPORT_OPERATION_GET_CLASS (op)->complete_import (op);
 
       res = gpgme_op_import_result (GPA_OPERATION (op)->context->ctx);
-      if (res->imported > 0 && res->secret_imported )
-	{
-	  g_signal_emit_by_name (GPA_OPERATION (op), "imported_secret_keys");
-	}
-      else if (res->imported > 0)
+
+      /* Pass the changed keys so that the key list needs to reload
+         only those.  */
+      set = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+      gpa_gpgme_add_import_fprs (set, res);
+      fprs = gpa_gpgme_get_import_fprs (set);
+      if (fprs)
 	{
-	  g_signal_emit_by_name (GPA_OPERATION (op), "imported_keys");
+	  g_signal_emit (op, signals[res->secret_imported
+				     ? IMPORTED_SECRET_KEYS : IMPORTED_KEYS],
+			 0, fprs);
+	  g_free (fprs);
 	}
+      g_hash_table_destroy (set);
 
       gpa_gpgme_update_import_results (&result, 0, 0, res);
       gpa_gpgme_show_import_results (GPA_OPERATION (op)->window, &result);
@@ -59,9 +59,11 @@ struct _GpaImportOperationClass {
    */
   void (*complete_import) (GpaImportOperation *op);
 
-  /* "Some keys were imported" signal.
+  /* "Some keys were imported" signal.  FPRS is a NULL terminated
+   * array with the fingerprints of the new or changed keys.
    */
-  void (*imported_keys) (GpaImportOperation *op);
+  void (*imported_keys) (GpaImportOperation *op, const char **fprs);
+  void (*imported_secret_keys) (GpaImportOperation *op, const char **fprs);
 };
 
 GType gpa_import_operation_get_type (void) G_GNUC_CONST;
@@ -177,7 +177,7 @@ gpa_key_selector_get_selected_keys (GpaKeySelector * selector)
     gtk_tree_view_get_selection (GTK_TREE_VIEW (selector));
   GtkTreeModel *model = gtk_tree_view_get_model (GTK_TREE_VIEW (selector));
   GList *list = gtk_tree_selection_get_selected_rows (selection, &model);
-  GList *keys = NULL;
+  GQueue keys = G_QUEUE_INIT;
   GList *cur;
 
   for (cur = list; cur; cur = g_list_next (cur))
@@ -192,13 +192,13 @@ gpa_key_selector_get_selected_keys (GpaKeySelector * selector)
 				&value);
       key = g_value_get_pointer (&value);
       g_value_unset(&value);
-      keys = g_list_append (keys, key);
+      g_queue_push_tail (&keys, key);
     }
 
   g_list_foreach (list, (GFunc) gtk_tree_path_free, NULL);
   g_list_free (list);
 
-  return keys;
+  return keys.head;
 }
 
 gboolean
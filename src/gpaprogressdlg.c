@@ -198,3 +198,25 @@ gpa_progress_dialog_set_label (GpaProgressDialog *dialog, const gchar *label)
 {
   gtk_label_set_text (GTK_LABEL (dialog->label), label);
 }
+
+
+/* Show the overall progress FRACTION in the progress bar instead of
+   the progress of the context.  */
+void
+gpa_progress_dialog_set_fraction (GpaProgressDialog *dialog,
+                                  gdouble fraction)
+{
+  if (gpa_progress_bar_get_context (dialog->pbar))
+    gpa_progress_bar_set_context (dialog->pbar, NULL);
+  gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (dialog->pbar), fraction);
+}
+
+
+/* Set the text shown in the progress bar.  */
+void
+gpa_progress_dialog_set_text (GpaProgressDialog *dialog, const gchar *text)
+{
+  gtk_progress_bar_set_text (GTK_PROGRESS_BAR (dialog->pbar), text);
+  gtk_progress_bar_set_show_text (GTK_PROGRESS_BAR (dialog->pbar),
+                                  text != NULL);
+}
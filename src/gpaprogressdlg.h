@@ -77,4 +77,13 @@ GtkWidget *gpa_progress_dialog_new (GtkWidget *parent, GpaContext *context);
 void gpa_progress_dialog_set_label (GpaProgressDialog *dialog,
 				    const gchar *label);
 
+/* Show the overall progress FRACTION instead of the progress of the
+   context.  */
+void gpa_progress_dialog_set_fraction (GpaProgressDialog *dialog,
+                                       gdouble fraction);
+
+/* Set the text shown in the progress bar.  */
+void gpa_progress_dialog_set_text (GpaProgressDialog *dialog,
+                                   const gchar *text);
+
 #endif
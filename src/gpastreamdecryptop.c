@@ -336,7 +336,7 @@ done_cb (GpaContext *context, gpg_error_t err, GpaStreamDecryptOperation *op)
 	  g_free (sigdesc);
 	}
 
-      if (res->signatures)
+      if (res->signatures && !headless_server)
 	{
 	  /* Add the file to the result dialog.  */
 	  gpa_file_verify_dialog_add_file
@@ -375,7 +375,7 @@ idle_cb (gpointer data)
       g_signal_emit_by_name (GPA_OPERATION (op), "completed", err);
     }
 
-  gtk_widget_show_all (GPA_STREAM_OPERATION (op)->progress_dialog);
+  gpa_stream_operation_show_progress (GPA_STREAM_OPERATION (op));
 
   return FALSE;
 }
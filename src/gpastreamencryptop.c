@@ -379,7 +379,7 @@ start_encryption (GpaStreamEncryptOperation *op)
         }
 
       /* Show and update the progress dialog.  */
-      gtk_widget_show_all (GPA_STREAM_OPERATION (op)->progress_dialog);
+      gpa_stream_operation_show_progress (GPA_STREAM_OPERATION (op));
       gpa_progress_dialog_set_label
         (GPA_PROGRESS_DIALOG (GPA_STREAM_OPERATION (op)->progress_dialog),
          _("Message encryption"));
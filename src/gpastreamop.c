@@ -203,4 +203,13 @@ gpa_stream_operation_get_type (void)
 }
 
 
+/* Public API.  */
 
+/* Show the progress dialog of OP unless the UI server runs
+   headless.  */
+void
+gpa_stream_operation_show_progress (GpaStreamOperation *op)
+{
+  if (!headless_server)
+    gtk_widget_show_all (op->progress_dialog);
+}
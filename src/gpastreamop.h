@@ -67,6 +67,9 @@ GType gpa_stream_operation_get_type (void) G_GNUC_CONST;
 
 /*** API ***/
 
+/* Show the progress dialog of OP unless the UI server runs
+   headless.  */
+void gpa_stream_operation_show_progress (GpaStreamOperation *op);
 
 
 #endif /*GPA_STREAM_OP_H*/
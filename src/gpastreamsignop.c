@@ -61,6 +61,7 @@ enum
 static void response_cb (GtkDialog *dialog,
                          gint response,
                          gpointer user_data);
+static gboolean start_signing_cb (gpointer user_data);
 static void done_error_cb (GpaContext *context, gpg_error_t err,
                            GpaStreamSignOperation *op);
 static void done_cb (GpaContext *context, gpg_error_t err,
@@ -148,21 +149,30 @@ gpa_stream_sign_operation_ctor (GType type, guint n_construct_properties,
 				      construct_properties);
   op = GPA_STREAM_SIGN_OPERATION (object);
 
-  op->sign_dialog = gpa_file_sign_dialog_new (GPA_OPERATION (op)->window);
-  {
-    GpaFileSignDialog *dialog = GPA_FILE_SIGN_DIALOG (op->sign_dialog);
-
-    /* Note: The information here is wrong.  The actual sig_mode and
-       armor settings are determined from the selected key (which
-       determines the protocol).  We set the values here to those for
-       OpenPGP, and force (==hide) the selection widgets.  */
-    gpa_file_sign_dialog_set_armor (dialog, TRUE);
-    gpa_file_sign_dialog_set_force_armor (dialog, TRUE);
-    gpa_file_sign_dialog_set_sig_mode (dialog, GPGME_SIG_MODE_NORMAL);
-    gpa_file_sign_dialog_set_force_sig_mode (dialog, TRUE);
-  }
-  g_signal_connect (G_OBJECT (op->sign_dialog), "response",
-                    G_CALLBACK (response_cb), op);
+  if (headless_server
+      && gpa_options_get_default_key (gpa_options_get_instance ()))
+    {
+      /* Without dialogs we sign with the default key.  */
+      g_idle_add (start_signing_cb, op);
+    }
+  else
+    {
+      GpaFileSignDialog *dialog;
+
+      op->sign_dialog = gpa_file_sign_dialog_new (GPA_OPERATION (op)->window);
+      dialog = GPA_FILE_SIGN_DIALOG (op->sign_dialog);
+
+      /* Note: The information here is wrong.  The actual sig_mode and
+         armor settings are determined from the selected key (which
+         determines the protocol).  We set the values here to those for
+         OpenPGP, and force (==hide) the selection widgets.  */
+      gpa_file_sign_dialog_set_armor (dialog, TRUE);
+      gpa_file_sign_dialog_set_force_armor (dialog, TRUE);
+      gpa_file_sign_dialog_set_sig_mode (dialog, GPGME_SIG_MODE_NORMAL);
+      gpa_file_sign_dialog_set_force_sig_mode (dialog, TRUE);
+      g_signal_connect (G_OBJECT (op->sign_dialog), "response",
+                        G_CALLBACK (response_cb), op);
+    }
 
   /* We connect the done signal to two handles.  The error handler is
      called first.  */
@@ -311,12 +321,27 @@ start_signing (GpaStreamSignOperation *op)
   GList *signers;
   gpgme_protocol_t protocol;
 
-  signers = gpa_file_sign_dialog_signers
-    (GPA_FILE_SIGN_DIALOG (op->sign_dialog));
-  if (!set_signers (op, signers))
+  if (op->sign_dialog)
+    {
+      signers = gpa_file_sign_dialog_signers
+        (GPA_FILE_SIGN_DIALOG (op->sign_dialog));
+      if (!set_signers (op, signers))
+        {
+          err = gpg_error (GPG_ERR_NO_SECKEY);
+          goto leave;
+        }
+    }
+  else
     {
-      err = gpg_error (GPG_ERR_NO_SECKEY);
-      goto leave;
+      signers = g_list_append
+        (NULL, gpa_options_get_default_key (gpa_options_get_instance ()));
+      if (!set_signers (op, signers))
+        {
+          g_list_free (signers);
+          err = gpg_error (GPG_ERR_NO_SECKEY);
+          goto leave;
+        }
+      g_list_free (signers);
     }
 
   protocol = gpgme_get_protocol (GPA_OPERATION (op)->context->ctx);
@@ -357,7 +382,7 @@ start_signing (GpaStreamSignOperation *op)
         }
 
       /* Show and update the progress dialog.  */
-      gtk_widget_show_all (GPA_STREAM_OPERATION (op)->progress_dialog);
+      gpa_stream_operation_show_progress (GPA_STREAM_OPERATION (op));
       gpa_progress_dialog_set_label
         (GPA_PROGRESS_DIALOG (GPA_STREAM_OPERATION (op)->progress_dialog),
          _("Message signing"));
@@ -396,9 +421,8 @@ response_cb (GtkDialog *dialog, int response, void *user_data)
 }
 
 
-/* This is the idle function used to start the encryption if no
-   recipient key selection dialog has been requested.  */
-#if 0 /* Not yet used.  */
+/* This is the idle function used to start the signing if no signer
+   selection dialog has been requested.  */
 static gboolean
 start_signing_cb (void *user_data)
 {
@@ -408,7 +432,6 @@ start_signing_cb (void *user_data)
 
   return FALSE;  /* Remove this callback from the event loop.  */
 }
-#endif
 
 /* Show an error message. */
 static void
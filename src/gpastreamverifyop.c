@@ -380,7 +380,7 @@ idle_cb (gpointer data)
     }
   else if (! op->silent)
     {
-      gtk_widget_show_all (GPA_STREAM_OPERATION (op)->progress_dialog);
+      gpa_stream_operation_show_progress (GPA_STREAM_OPERATION (op));
     }
 
   return FALSE;
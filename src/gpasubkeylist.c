@@ -186,77 +186,119 @@ subkey_status (gpgme_subkey_t subkey)
 }
 
 
-/* Set the key whose subkeys should be displayed. */
+/* A pending lookup of the secret key for gpa_subkey_list_set_key.  */
+struct seckey_lookup_s
+{
+  GtkWidget *list;
+  gpgme_key_t key;
+};
+
+
+/* Fill the subkey list with the subkeys of the key of LOOKUP and the
+   card information from its secret key SECKEY.  This is called by
+   gpa_keytable_lookup_key_async.  */
+static void
+secret_key_found_cb (gpgme_key_t seckey, gpointer data)
+{
+  struct seckey_lookup_s *lookup = data;
+  gpgme_key_t key = lookup->key;
+  GtkListStore *store;
+  gpgme_subkey_t subkey, secsubkey;
+  gchar *p, *size, *expires;
+  const char *algostr;
+
+  /* Ignore the result if another key has been set meanwhile.  */
+  if (g_object_get_data (G_OBJECT (lookup->list), "gpa-subkey-lookup")
+      != lookup)
+    goto leave;
+  g_object_set_data (G_OBJECT (lookup->list), "gpa-subkey-lookup", NULL);
+
+  store = GTK_LIST_STORE (gtk_tree_view_get_model
+                          (GTK_TREE_VIEW (lookup->list)));
+  /* Add all the subkeys */
+  for (subkey = key->subkeys; subkey; subkey = subkey->next)
+    {
+      GtkTreeIter iter;
+
+      if (seckey)
+	{
+	  for (secsubkey = seckey->subkeys; secsubkey;
+	       secsubkey = secsubkey->next)
+	    if (subkey->fpr && secsubkey->fpr
+		&& g_str_equal (subkey->fpr, secsubkey->fpr))
+	      break;
+	}
+      else
+	secsubkey = NULL;
+
+      /* Append */
+      gtk_list_store_append (store, &iter);
+      if (subkey->curve)
+	size = g_strdup (subkey->curve);
+      else
+	size = g_strdup_printf ("%i bits", subkey->length);
+
+      /* We only want "never" and not "never expires" but we need
+	 to take care of the ">= 2038" string.  */
+      expires = gpa_expiry_date_string (subkey->expires);
+      if (*expires != '>' && (p = strchr (expires, ' ')))
+	*p = 0;
+
+      algostr = gpgme_pubkey_algo_name (subkey->pubkey_algo),
+
+      gtk_list_store_set
+	(store, &iter,
+	 SUBKEY_ID, subkey->keyid+8,
+	 SUBKEY_ALGO,
+	 algostr,
+	 SUBKEY_CREATED,
+	 gpa_creation_date_string (subkey->timestamp),
+	 SUBKEY_EXPIRE,
+	 expires,
+	 SUBKEY_CAN_SIGN, subkey->can_sign,
+	 SUBKEY_CAN_CERTIFY, subkey->can_certify,
+	 SUBKEY_CAN_ENCRYPT, subkey->can_encrypt,
+	 SUBKEY_CAN_AUTHENTICATE, subkey->can_authenticate,
+	 SUBKEY_IS_CARDKEY, secsubkey? secsubkey->is_cardkey :0,
+	 SUBKEY_CARD_NUMBER, secsubkey? secsubkey->card_number:NULL,
+	 SUBKEY_STATUS, subkey_status (subkey),
+	 -1);
+      g_free (size);
+      g_free (expires);
+    }
+
+ leave:
+  gpgme_key_unref (lookup->key);
+  g_object_unref (lookup->list);
+  g_free (lookup);
+}
+
+
+/* Set the key whose subkeys should be displayed.  The list is filled
+   once the secret keytable has been loaded.  */
 void
 gpa_subkey_list_set_key (GtkWidget *list, gpgme_key_t key)
 {
   GtkListStore *store = GTK_LIST_STORE (gtk_tree_view_get_model
                                         (GTK_TREE_VIEW (list)));
-  gpgme_subkey_t subkey, secsubkey;
-  gpgme_key_t seckey;
-  gchar *p, *size, *expires;
-  const char *algostr;
+  struct seckey_lookup_s *lookup;
 
   /* Empty the list */
   gtk_list_store_clear (store);
 
   if (key)
     {
-      seckey = gpa_keytable_lookup_key
-        (gpa_keytable_get_secret_instance (), key->subkeys->fpr);
-
-      /* Add all the subkeys */
-      for (subkey = key->subkeys; subkey; subkey = subkey->next)
-	{
-	  GtkTreeIter iter;
-
-          if (seckey)
-            {
-              for (secsubkey = seckey->subkeys; secsubkey;
-                   secsubkey = secsubkey->next)
-                if (subkey->fpr && secsubkey->fpr
-                    && g_str_equal (subkey->fpr, secsubkey->fpr))
-                  break;
-            }
-          else
-            secsubkey = NULL;
-
-	  /* Append */
-	  gtk_list_store_append (store, &iter);
-          if (subkey->curve)
-            size = g_strdup (subkey->curve);
-          else
-            size = g_strdup_printf ("%i bits", subkey->length);
-
-          /* We only want "never" and not "never expires" but we need
-             to take care of the ">= 2038" string.  */
-          expires = gpa_expiry_date_string (subkey->expires);
-          if (*expires != '>' && (p = strchr (expires, ' ')))
-            *p = 0;
-
-          algostr = gpgme_pubkey_algo_name (subkey->pubkey_algo),
-
-          gtk_list_store_set
-            (store, &iter,
-             SUBKEY_ID, subkey->keyid+8,
-             SUBKEY_ALGO,
-             algostr,
-             SUBKEY_CREATED,
-             gpa_creation_date_string (subkey->timestamp),
-             SUBKEY_EXPIRE,
-             expires,
-             SUBKEY_CAN_SIGN, subkey->can_sign,
-             SUBKEY_CAN_CERTIFY, subkey->can_certify,
-             SUBKEY_CAN_ENCRYPT, subkey->can_encrypt,
-             SUBKEY_CAN_AUTHENTICATE, subkey->can_authenticate,
-             SUBKEY_IS_CARDKEY, secsubkey? secsubkey->is_cardkey :0,
-             SUBKEY_CARD_NUMBER, secsubkey? secsubkey->card_number:NULL,
-             SUBKEY_STATUS, subkey_status (subkey),
-             -1);
-	  g_free (size);
-	  g_free (expires);
-	}
+      lookup = g_new (struct seckey_lookup_s, 1);
+      lookup->list = g_object_ref (list);
+      gpgme_key_ref (key);
+      lookup->key = key;
+      g_object_set_data (G_OBJECT (list), "gpa-subkey-lookup", lookup);
+      gpa_keytable_lookup_key_async (gpa_keytable_get_secret_instance (),
+                                     key->subkeys->fpr,
+                                     secret_key_found_cb, lookup);
     }
+  else
+    g_object_set_data (G_OBJECT (list), "gpa-subkey-lookup", NULL);
 }
 
 
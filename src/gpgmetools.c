@@ -30,6 +30,7 @@
 #include "gpa.h"
 #include "gtktools.h"
 #include "gpgmetools.h"
+#include "keytable.h"
 
 #include <fcntl.h>
 #ifdef G_OS_UNIX
@@ -54,6 +55,9 @@
 #endif
 #endif
 
+/* The size of the buffer used to copy data objects.  */
+#define DUMP_BUFFER_SIZE 65536
+
 /* Helper to strip the path from a source file name.  This helps to
    avoid showing long filenames in case of VPATH builds.  */
 static const char *
@@ -132,28 +136,28 @@ gpa_gpgme_new (void)
 /* Write the contents of the gpgme_data_t object to the file.
    Receives a filehandle instead of the filename, so that the caller
    can make sure the file is accesible before putting anything into
-   data.  This is only used for a TMP file, thus it is okay to
-   terminate the application on error. */
-void
+   data.  Returns an error if the data can't be read or written; the
+   file is then incomplete.  */
+gpg_error_t
 dump_data_to_file (gpgme_data_t data, FILE *file)
 {
-  char buffer[128];
-  int nread;
+  char *buffer;
+  ssize_t nread;
+  gpg_error_t err = 0;
 
-  nread = gpgme_data_seek (data, 0, SEEK_SET);
-  if (nread == -1)
-    {
-      gpa_window_error (strerror (errno), NULL);
-      exit (EXIT_FAILURE);
-    }
-  while ((nread = gpgme_data_read (data, buffer, sizeof (buffer))) > 0)
-    fwrite (buffer, nread, 1, file);
+  if (gpgme_data_seek (data, 0, SEEK_SET) == -1)
+    return gpg_error_from_syserror ();
+  buffer = g_malloc (DUMP_BUFFER_SIZE);
+  while ((nread = gpgme_data_read (data, buffer, DUMP_BUFFER_SIZE)) > 0)
+    if (fwrite (buffer, nread, 1, file) != 1)
+      {
+        err = gpg_error_from_syserror ();
+        break;
+      }
   if (nread == -1)
-    {
-      gpa_window_error (strerror (errno), NULL);
-      exit (EXIT_FAILURE);
-    }
-  return;
+    err = gpg_error_from_syserror ();
+  g_free (buffer);
+  return err;
 }
 
 
@@ -326,28 +330,49 @@ gpa_gpgme_data_new_from_file (gpgme_data_t *data,
 int
 dump_data_to_clipboard (gpgme_data_t data, GtkClipboard *clipboard)
 {
-  char buffer[512];
-  int nread;
-  gchar *text = NULL;
+  off_t size;
+  gchar *text;
   size_t len = 0;
+  size_t allocated;
+  ssize_t nread;
 
-  nread = gpgme_data_seek (data, 0, SEEK_SET);
-  if (nread == -1)
+  /* Allocate the whole text at once if the size is known, which is
+     the case for memory and file based data.  */
+  size = gpgme_data_seek (data, 0, SEEK_END);
+  if (gpgme_data_seek (data, 0, SEEK_SET) == -1)
     {
       gpa_window_error (strerror (errno), NULL);
       return -1;
     }
-  while ((nread = gpgme_data_read (data, buffer, sizeof (buffer))) > 0)
+  allocated = size > 0? (size_t)size + 1 : DUMP_BUFFER_SIZE;
+  text = g_malloc (allocated);
+
+  for (;;)
     {
-      text = g_realloc (text, len + nread + 1);
-      strncpy (text + len, buffer, nread);
+      if (len + 1 == allocated)
+        {
+          char c;
+
+          /* The buffer is full; check whether there is more.  */
+          nread = gpgme_data_read (data, &c, 1);
+          if (nread <= 0)
+            break;
+          allocated *= 2;
+          text = g_realloc (text, allocated);
+          text[len++] = c;
+        }
+      nread = gpgme_data_read (data, text + len, allocated - len - 1);
+      if (nread <= 0)
+        break;
       len += nread;
     }
   if (nread == -1)
     {
       gpa_window_error (strerror (errno), NULL);
+      g_free (text);
       return -1;
     }
+  text[len] = 0;
 
   gtk_clipboard_set_text (clipboard, text, (int)len);
   g_free (text);
@@ -1139,7 +1164,14 @@ gpa_gpgme_get_signature_desc (gpgme_ctx_t ctx, gpgme_signature_t sig,
 
   if (sig->fpr && ctx)
     {
-      gpgme_get_key (ctx, sig->fpr, &key, 0);
+      /* Try the key cache first to avoid running a key listing for
+         each signature.  */
+      key = gpa_keytable_lookup_keyid (gpa_keytable_get_public_instance (),
+                                       sig->fpr);
+      if (key)
+        gpgme_key_ref (key);
+      else
+        gpgme_get_key (ctx, sig->fpr, &key, 0);
       if (key)
         keydesc = gpa_gpgme_key_get_userid (key->uids);
     }
@@ -1221,6 +1253,22 @@ gpa_gpgme_get_signature_desc (gpgme_ctx_t ctx, gpgme_signature_t sig,
 }
 
 
+/* Return the error to report for the signatures of the verification
+   RESULT: GPG_ERR_NO_DATA if there are no signatures or the status
+   of the first signature which could not be verified.  */
+gpg_error_t
+gpa_gpgme_signature_error (gpgme_verify_result_t result)
+{
+  gpgme_signature_t sig;
+
+  if (!result || !result->signatures)
+    return gpg_error (GPG_ERR_NO_DATA);
+  for (sig = result->signatures; sig; sig = sig->next)
+    if (sig->status)
+      return sig->status;
+  return 0;
+}
+
 
 /* Return a string listing the capabilities of a key.  */
 const gchar *
@@ -1289,6 +1337,43 @@ gpa_gpgme_update_import_results (gpa_import_result_t result,
 }
 
 
+/* Add the fingerprints of the keys changed by the import INFO to the
+   set FPRS, a hash table with malloced strings as keys.  */
+void
+gpa_gpgme_add_import_fprs (GHashTable *fprs, gpgme_import_result_t info)
+{
+  gpgme_import_status_t imp;
+
+  for (imp = info->imports; imp; imp = imp->next)
+    if (!imp->result && imp->status && imp->fpr)
+      g_hash_table_add (fprs, g_strdup (imp->fpr));
+}
+
+
+/* Return a NULL terminated array with the fingerprints in the set
+   FPRS or NULL if the set is empty.  The strings are not copied, thus
+   only the array must be released with g_free.  */
+const char **
+gpa_gpgme_get_import_fprs (GHashTable *fprs)
+{
+  GHashTableIter iter;
+  const char **array;
+  void *key;
+  int i;
+
+  if (!g_hash_table_size (fprs))
+    return NULL;
+
+  array = g_new (const char *, g_hash_table_size (fprs) + 1);
+  i = 0;
+  g_hash_table_iter_init (&iter, fprs);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    array[i++] = key;
+  array[i] = NULL;
+  return array;
+}
+
+
 void
 gpa_gpgme_show_import_results (GtkWidget *parent, gpa_import_result_t result)
 {
@@ -112,8 +112,9 @@ gpgme_ctx_t gpa_gpgme_new (void);
 
 /* Write the contents of the gpgme_data_t object to the file. Receives
    a filehandle instead of the filename, so that the caller can make
-   sure the file is accesible before putting anything into data.  */
-void dump_data_to_file (gpgme_data_t data, FILE *file);
+   sure the file is accesible before putting anything into data.
+   Returns an error if the data can't be read or written.  */
+gpg_error_t dump_data_to_file (gpgme_data_t data, FILE *file);
 
 /* Not really a gpgme function, but needed in most places
    dump_data_to_file is used.  Opens a file for writing, asking the
@@ -183,6 +184,9 @@ void gpa_gpgme_update_import_results (gpa_import_result_t result,
                                       unsigned int files,
                                       unsigned int bad_files,
                                       gpgme_import_result_t info);
+void gpa_gpgme_add_import_fprs (GHashTable *fprs,
+                                gpgme_import_result_t info);
+const char **gpa_gpgme_get_import_fprs (GHashTable *fprs);
 void gpa_gpgme_show_import_results (GtkWidget *parent,
                                     gpa_import_result_t result);
 
@@ -235,6 +239,9 @@ const gchar *gpa_gpgme_key_sig_get_level (gpgme_key_sig_t sig);
 char *gpa_gpgme_get_signature_desc (gpgme_ctx_t ctx, gpgme_signature_t sig,
                                     char **r_keydesc, gpgme_key_t *r_key);
 
+/* Return the first error of the signatures in RESULT.  */
+gpg_error_t gpa_gpgme_signature_error (gpgme_verify_result_t result);
+
 
 /* Return a string listing the capabilities of a key.  */
 const gchar *gpa_get_key_capabilities_text (gpgme_key_t key);
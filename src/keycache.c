@@ -0,0 +1,396 @@
+/* keycache.c - The GNU Privacy Assistant key cache file.
+   Copyright (C) 2026 g10 Code GmbH.
+
+   This file is part of GPA
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The key cache file stores what the key list shows of each public
+   key, so that the key manager can show the keys right at startup
+   while the keyring is listed in the background.  The file is only
+   used if the modification stamp of the keyring files still matches
+   the one stored in the file.
+
+   The file consists of strings, each terminated by a Nul: the magic
+   string, the keyring stamp, the number of keys and then for each key
+   the protocol, the fingerprint, the flags, the creation and
+   expiration time, the owner trust, the validity of the primary user
+   ID (-1 if there is none) and the primary user ID.  Numbers are
+   written in decimal, except for the flags which are hexadecimal.  */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <glib/gstdio.h>
+
+#include "gpa.h"
+#include "keycache.h"
+#include "keytable.h"
+
+
+/* The name of the cache file in the GnuPG home directory.  */
+#define KEYCACHE_NAME "gpa-keycache"
+
+/* The magic string at the start of the file.  Bump the version
+   whenever the format changes.  */
+#define KEYCACHE_MAGIC "GPA key cache 1"
+
+/* The number of strings stored for each key.  */
+#define KEYCACHE_FIELDS 8
+
+/* The key flags.  */
+#define FLAG_REVOKED      1
+#define FLAG_EXPIRED      2
+#define FLAG_DISABLED     4
+#define FLAG_INVALID      8
+#define FLAG_UID_REVOKED 16
+#define FLAG_HAS_SECRET  32
+#define FLAG_CARDKEY     64
+
+
+/* The files below the GnuPG home directory whose modification
+   invalidates the cache.  */
+static const char *const stamp_files[] =
+  {
+    "pubring.kbx",
+    "pubring.gpg",
+    "public-keys.d/pubring.db",
+    "public-keys.d/pubring.db-wal",
+    "trustdb.gpg",
+    "secring.gpg",
+    "private-keys-v1.d",
+    NULL
+  };
+
+
+/* A key from the cache.  The strings point into the mapped file.  */
+struct keycache_entry_s
+{
+  struct _gpgme_key key;
+  struct _gpgme_subkey subkey;
+  struct _gpgme_user_id uid;
+  gboolean has_secret;
+};
+
+
+struct gpa_keycache_s
+{
+  GMappedFile *file;
+  guint n_entries;
+  struct keycache_entry_s *entries;
+};
+
+
+
+static char *
+get_cache_filename (void)
+{
+  return g_build_filename (gnupg_homedir, KEYCACHE_NAME, NULL);
+}
+
+
+/* Return a string describing the current state of the keyring
+   files.  */
+static char *
+get_keyring_stamp (void)
+{
+  GString *stamp = g_string_new (NULL);
+  GStatBuf sb;
+  char *fname;
+  int i;
+
+  for (i = 0; stamp_files[i]; i++)
+    {
+      fname = g_build_filename (gnupg_homedir, stamp_files[i], NULL);
+      if (!g_stat (fname, &sb))
+        g_string_append_printf (stamp, "%s:%lu:%lu;", stamp_files[i],
+                                (unsigned long) sb.st_mtime,
+                                (unsigned long) sb.st_size);
+      g_free (fname);
+    }
+
+  return g_string_free (stamp, FALSE);
+}
+
+
+/* Return the string at *P and advance *P to the next one.  Returns
+   NULL if there is no complete string before END.  */
+static char *
+next_field (char **p, const char *end)
+{
+  char *s = *p;
+  char *nul;
+
+  if (s >= end)
+    return NULL;
+  nul = memchr (s, 0, end - s);
+  if (!nul)
+    return NULL;
+  *p = nul + 1;
+
+  return s;
+}
+
+
+/* Parse the strings of a key at *P into ENTRY.  Returns false if the
+   file is truncated.  */
+static gboolean
+parse_entry (struct keycache_entry_s *entry, char **p, const char *end)
+{
+  char *field[KEYCACHE_FIELDS];
+  unsigned int flags;
+  size_t len;
+  int i;
+
+  for (i = 0; i < KEYCACHE_FIELDS; i++)
+    if (!(field[i] = next_field (p, end)))
+      return FALSE;
+
+  flags = strtoul (field[2], NULL, 16);
+
+  entry->subkey.fpr = field[1];
+  len = strlen (field[1]);
+  entry->subkey.keyid = len > 16? field[1] + len - 16 : field[1];
+  entry->subkey.timestamp = strtol (field[3], NULL, 10);
+  entry->subkey.expires = strtol (field[4], NULL, 10);
+  entry->subkey.revoked = !!(flags & FLAG_REVOKED);
+  entry->subkey.expired = !!(flags & FLAG_EXPIRED);
+  entry->subkey.disabled = !!(flags & FLAG_DISABLED);
+  entry->subkey.invalid = !!(flags & FLAG_INVALID);
+  entry->subkey.is_cardkey = !!(flags & FLAG_CARDKEY);
+
+  entry->uid.uid = field[7];
+  entry->uid.revoked = !!(flags & FLAG_UID_REVOKED);
+  entry->uid.validity = strtol (field[6], NULL, 10);
+
+  entry->key.protocol = strtol (field[0], NULL, 10);
+  entry->key.owner_trust = strtol (field[5], NULL, 10);
+  entry->key.revoked = entry->subkey.revoked;
+  entry->key.expired = entry->subkey.expired;
+  entry->key.disabled = entry->subkey.disabled;
+  entry->key.invalid = entry->subkey.invalid;
+  entry->key.fpr = entry->subkey.fpr;
+  entry->key.subkeys = &entry->subkey;
+  entry->key.uids = *field[6] == '-'? NULL : &entry->uid;
+
+  entry->has_secret = !!(flags & FLAG_HAS_SECRET);
+
+  return TRUE;
+}
+
+
+/* Open the key cache file.  Returns NULL if there is no cache file
+   or if it does not match the current keyring.  */
+gpa_keycache_t
+gpa_keycache_open (void)
+{
+  gpa_keycache_t cache;
+  GMappedFile *file;
+  char *fname, *stamp, *p, *field;
+  const char *end;
+  unsigned long count;
+  guint i;
+
+  fname = get_cache_filename ();
+  file = g_mapped_file_new (fname, FALSE, NULL);
+  g_free (fname);
+  if (!file)
+    return NULL;
+
+  p = g_mapped_file_get_contents (file);
+  end = p + g_mapped_file_get_length (file);
+
+  field = next_field (&p, end);
+  if (!field || strcmp (field, KEYCACHE_MAGIC))
+    goto leave;
+
+  field = next_field (&p, end);
+  stamp = get_keyring_stamp ();
+  if (!field || strcmp (field, stamp))
+    {
+      g_free (stamp);
+      goto leave;
+    }
+  g_free (stamp);
+
+  /* Each key takes at least one byte per field.  */
+  field = next_field (&p, end);
+  if (!field)
+    goto leave;
+  count = strtoul (field, NULL, 10);
+  if (count > (end - p) / KEYCACHE_FIELDS)
+    goto leave;
+
+  cache = g_new0 (struct gpa_keycache_s, 1);
+  cache->file = file;
+  cache->n_entries = count;
+  cache->entries = g_new0 (struct keycache_entry_s, count);
+  for (i = 0; i < count; i++)
+    if (!parse_entry (&cache->entries[i], &p, end))
+      {
+        gpa_keycache_release (cache);
+        return NULL;
+      }
+
+  return cache;
+
+ leave:
+  g_mapped_file_unref (file);
+  return NULL;
+}
+
+
+/* Release CACHE.  The keys returned by gpa_keycache_get_key are not
+   valid anymore.  */
+void
+gpa_keycache_release (gpa_keycache_t cache)
+{
+  if (!cache)
+    return;
+
+  g_free (cache->entries);
+  g_mapped_file_unref (cache->file);
+  g_free (cache);
+}
+
+
+/* Return the number of keys in CACHE.  */
+guint
+gpa_keycache_get_count (gpa_keycache_t cache)
+{
+  return cache->n_entries;
+}
+
+
+/* Return the key with index IDX from CACHE.  The key only carries the
+   information shown in the key list and must not be passed to any
+   gpgme function.  */
+gpgme_key_t
+gpa_keycache_get_key (gpa_keycache_t cache, guint idx)
+{
+  g_return_val_if_fail (idx < cache->n_entries, NULL);
+
+  return &cache->entries[idx].key;
+}
+
+
+/* Return true if there is a secret key for the key with index IDX of
+   CACHE.  */
+gboolean
+gpa_keycache_has_secret (gpa_keycache_t cache, guint idx)
+{
+  g_return_val_if_fail (idx < cache->n_entries, FALSE);
+
+  return cache->entries[idx].has_secret;
+}
+
+
+/* Write the key cache file for the list of public keys KEYS.  The
+   file is written to a temporary file first, so that a reader never
+   sees a partial file.  Errors are only logged; without a cache the
+   keys are just listed as usual.  */
+void
+gpa_keycache_store (GList *keys)
+{
+  GpaKeyTable *secret = gpa_keytable_get_secret_instance ();
+  char *fname, *tmpname, *stamp;
+  gpgme_key_t key, seckey;
+  unsigned int flags;
+  guint count = 0;
+  GList *cur;
+  FILE *fp;
+
+  for (cur = keys; cur; cur = g_list_next (cur))
+    {
+      key = cur->data;
+      if (key->subkeys && key->subkeys->fpr)
+        count++;
+    }
+
+  fname = get_cache_filename ();
+  tmpname = g_strconcat (fname, ".tmp", NULL);
+  fp = g_fopen (tmpname, "wb");
+  if (!fp)
+    {
+      g_debug ("can't create `%s': %s", tmpname, strerror (errno));
+      goto leave;
+    }
+
+  stamp = get_keyring_stamp ();
+  fprintf (fp, "%s%c%s%c%u%c", KEYCACHE_MAGIC, 0, stamp, 0, count, 0);
+  g_free (stamp);
+
+  for (cur = keys; cur; cur = g_list_next (cur))
+    {
+      key = cur->data;
+      if (!key->subkeys || !key->subkeys->fpr)
+        continue;
+
+      seckey = gpa_keytable_lookup_key (secret, key->subkeys->fpr);
+      flags = 0;
+      if (key->subkeys->revoked)
+        flags |= FLAG_REVOKED;
+      if (key->subkeys->expired)
+        flags |= FLAG_EXPIRED;
+      if (key->subkeys->disabled)
+        flags |= FLAG_DISABLED;
+      if (key->subkeys->invalid)
+        flags |= FLAG_INVALID;
+      if (key->uids && key->uids->revoked)
+        flags |= FLAG_UID_REVOKED;
+      if (seckey)
+        flags |= FLAG_HAS_SECRET;
+      if (seckey && seckey->subkeys && seckey->subkeys->is_cardkey)
+        flags |= FLAG_CARDKEY;
+
+      fprintf (fp, "%d%c%s%c%x%c%ld%c%ld%c%d%c%d%c%s%c",
+               (int) key->protocol, 0,
+               key->subkeys->fpr, 0,
+               flags, 0,
+               key->subkeys->timestamp, 0,
+               key->subkeys->expires, 0,
+               (int) key->owner_trust, 0,
+               key->uids? (int) key->uids->validity : -1, 0,
+               key->uids && key->uids->uid? key->uids->uid : "", 0);
+    }
+
+  if (ferror (fp))
+    {
+      g_debug ("error writing `%s': %s", tmpname, strerror (errno));
+      fclose (fp);
+      g_remove (tmpname);
+      goto leave;
+    }
+  if (fclose (fp))
+    {
+      g_debug ("error closing `%s': %s", tmpname, strerror (errno));
+      g_remove (tmpname);
+      goto leave;
+    }
+
+#ifdef G_OS_WIN32
+  /* Windows does not allow renaming over an existing file.  */
+  g_remove (fname);
+#endif
+  if (g_rename (tmpname, fname))
+    {
+      g_debug ("can't rename `%s': %s", tmpname, strerror (errno));
+      g_remove (tmpname);
+    }
+
+ leave:
+  g_free (tmpname);
+  g_free (fname);
+}
@@ -0,0 +1,52 @@
+/* keycache.h - The GNU Privacy Assistant key cache file.
+   Copyright (C) 2026 g10 Code GmbH.
+
+   This file is part of GPA
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KEYCACHE_H
+#define KEYCACHE_H
+
+#include <glib.h>
+#include <gpgme.h>
+
+/* An opened key cache file.  */
+typedef struct gpa_keycache_s *gpa_keycache_t;
+
+/* Open the key cache file.  Returns NULL if there is no cache file
+   or if it does not match the current keyring.  */
+gpa_keycache_t gpa_keycache_open (void);
+
+/* Release CACHE.  The keys returned by gpa_keycache_get_key are not
+   valid anymore.  */
+void gpa_keycache_release (gpa_keycache_t cache);
+
+/* Return the number of keys in CACHE.  */
+guint gpa_keycache_get_count (gpa_keycache_t cache);
+
+/* Return the key with index IDX from CACHE.  The key only carries the
+   information shown in the key list and must not be passed to any
+   gpgme function.  */
+gpgme_key_t gpa_keycache_get_key (gpa_keycache_t cache, guint idx);
+
+/* Return true if there is a secret key for the key with index IDX of
+   CACHE.  */
+gboolean gpa_keycache_has_secret (gpa_keycache_t cache, guint idx);
+
+/* Write the key cache file for the list of public keys KEYS.  */
+void gpa_keycache_store (GList *keys);
+
+#endif /* KEYCACHE_H */
@@ -28,6 +28,51 @@
 #include "keydeletedlg.h"
 #include "keytable.h"
 
+/* State of a secret key lookup for has_secret_key.  */
+struct secret_lookup_s
+{
+  GMainLoop *loop;
+  gboolean done;
+  gboolean found;
+};
+
+
+/* Record the result of the lookup DATA.  This is called by
+   gpa_keytable_lookup_key_async.  */
+static void
+secret_key_found_cb (gpgme_key_t seckey, gpointer data)
+{
+  struct secret_lookup_s *lookup = data;
+
+  lookup->found = (seckey != NULL);
+  lookup->done = TRUE;
+  if (lookup->loop)
+    g_main_loop_quit (lookup->loop);
+}
+
+
+/* Return true if there is a secret key for KEY.  The dialog is modal,
+   so if the secret keytable has not yet been loaded we wait for it
+   instead of possibly omitting the secret key warning.  */
+static gboolean
+has_secret_key (gpgme_key_t key)
+{
+  struct secret_lookup_s lookup = { NULL, FALSE, FALSE };
+
+  gpa_keytable_lookup_key_async (gpa_keytable_get_secret_instance (),
+                                 key->subkeys->fpr,
+                                 secret_key_found_cb, &lookup);
+  if (!lookup.done)
+    {
+      lookup.loop = g_main_loop_new (NULL, FALSE);
+      g_main_loop_run (lookup.loop);
+      g_main_loop_unref (lookup.loop);
+    }
+
+  return lookup.found;
+}
+
+
 /* Emit a last warning that a secret key is going to be deleted, and ask for
  * confirmation.
  */
@@ -78,7 +123,7 @@ confirm_delete_secret (GtkWidget * parent)
 /* Run the delete key dialog as a modal dialog and return TRUE if the
  * user chose Yes, FALSE otherwise. Display information about the public
  * key key in the dialog so that the user knows which key is to be
- * deleted. If has_secret_key is true, display a special warning for
+ * deleted. If the key has a secret key, display a special warning for
  * deleting secret keys.
  */
 gboolean
@@ -89,9 +134,7 @@ gpa_delete_dialog_run (GtkWidget * parent, gpgme_key_t key)
   GtkWidget * label;
   GtkWidget * info;
 
-  gboolean has_secret_key = (gpa_keytable_lookup_key 
-			     (gpa_keytable_get_secret_instance(), 
-			      key->subkeys->fpr) != NULL);
+  gboolean secret = has_secret_key (key);
 
   window = gtk_dialog_new_with_buttons (_("Remove Key"), GTK_WINDOW(parent),
                                         GTK_DIALOG_MODAL,
@@ -116,7 +159,7 @@ gpa_delete_dialog_run (GtkWidget * parent, gpgme_key_t key)
   info = gpa_key_info_new (key);
   gtk_box_pack_start (GTK_BOX (vbox), info, TRUE, TRUE, 5);
 
-  if (has_secret_key)
+  if (secret)
     {
       label = gtk_label_new (_("This key has a secret key."
 			       " Deleting this key cannot be undone,"
@@ -145,7 +188,7 @@ gpa_delete_dialog_run (GtkWidget * parent, gpgme_key_t key)
 
   if (gtk_dialog_run (GTK_DIALOG (window)) == GTK_RESPONSE_YES)
     {
-      if (has_secret_key)
+      if (secret)
         {
           gboolean result = confirm_delete_secret (window);
           gtk_widget_destroy (window);
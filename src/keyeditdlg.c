@@ -121,6 +121,18 @@ gpa_key_edit_dialog_finalize (GObject *object)
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
+/* Enable the expiration button given by DATA if SECKEY is not NULL.
+   This is called by gpa_keytable_lookup_key_async.  */
+static void
+secret_key_found_cb (gpgme_key_t seckey, gpointer data)
+{
+  GtkWidget *button = data;
+
+  gtk_widget_set_sensitive (button, seckey != NULL);
+  g_object_unref (button);
+}
+
+
 static GObject*
 gpa_key_edit_dialog_constructor (GType                  type,
 				 guint                  n_construct_properties,
@@ -182,9 +194,10 @@ gpa_key_edit_dialog_constructor (GType                  type,
 
   button = gtk_button_new_with_mnemonic (_("Change _expiration"));
   gtk_box_pack_start (GTK_BOX (hbox), button, FALSE, FALSE, 0);
-  gtk_widget_set_sensitive (button,(gpa_keytable_lookup_key
-			     (gpa_keytable_get_secret_instance(),
-			      dialog->key->subkeys->fpr) != NULL));
+  gtk_widget_set_sensitive (button, FALSE);
+  gpa_keytable_lookup_key_async (gpa_keytable_get_secret_instance (),
+                                 dialog->key->subkeys->fpr,
+                                 secret_key_found_cb, g_object_ref (button));
   g_signal_connect (G_OBJECT (button), "clicked",
 		    G_CALLBACK (gpa_key_edit_change_expiry), dialog);
 
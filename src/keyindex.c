@@ -0,0 +1,338 @@
+/* keyindex.c - The GNU Privacy Assistant key search index.
+   Copyright (C) 2026 g10 Code GmbH.
+
+   This file is part of GPA
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* For each key the index keeps its case folded search text: the user
+   IDs and the fingerprints of all subkeys, separated by newlines.
+   Each entry has a slot number and for each trigram (three
+   consecutive bytes) of the search texts we keep the ascending list of
+   slots whose text contains it.  A search for a pattern of three or
+   more bytes only needs to check the keys in the shortest list of
+   the pattern's trigrams.  Removed entries leave a hole in the slot
+   array; the index is compacted when there are too many holes.  */
+
+#include <config.h>
+
+#include <string.h>
+#include <ctype.h>
+
+#include "keyindex.h"
+
+
+/* Compact the index if more than this many slots and at least half
+   of all slots are unused.  */
+#define COMPACT_THRESHOLD 1024
+
+
+struct keyindex_entry_s
+{
+  char *fpr;   /* The fingerprint of the key.  */
+  char *text;  /* The case folded search text.  */
+};
+
+
+struct gpa_keyindex_s
+{
+  /* The entries indexed by slot.  Unused slots are NULL.  */
+  GPtrArray *entries;
+  /* The number of unused slots.  */
+  guint n_unused;
+  /* Maps a fingerprint to the slot number plus one.  */
+  GHashTable *slots;
+  /* Maps a trigram to a GArray with the slot numbers.  */
+  GHashTable *trigrams;
+};
+
+
+
+/* Return a case folded copy of STRING.  */
+static char *
+fold_string (const char *string)
+{
+  if (g_utf8_validate (string, -1, NULL))
+    return g_utf8_casefold (string, -1);
+  else
+    return g_ascii_strdown (string, -1);
+}
+
+
+static guint32
+get_trigram (const char *s)
+{
+  const unsigned char *p = (const unsigned char *) s;
+
+  return (p[0] << 16) | (p[1] << 8) | p[2];
+}
+
+
+/* Return the search text of KEY.  */
+static char *
+build_text (gpgme_key_t key)
+{
+  GString *text = g_string_new (NULL);
+  gpgme_user_id_t uid;
+  gpgme_subkey_t subkey;
+  char *result;
+
+  for (uid = key->uids; uid; uid = uid->next)
+    if (uid->uid)
+      {
+        g_string_append (text, uid->uid);
+        g_string_append_c (text, '\n');
+      }
+  /* The key IDs are part of the fingerprints.  */
+  for (subkey = key->subkeys; subkey; subkey = subkey->next)
+    if (subkey->fpr || subkey->keyid)
+      {
+        g_string_append (text, subkey->fpr? subkey->fpr : subkey->keyid);
+        g_string_append_c (text, '\n');
+      }
+
+  result = fold_string (text->str);
+  g_string_free (text, TRUE);
+
+  return result;
+}
+
+
+static void
+free_trigram_list (gpointer data)
+{
+  g_array_free (data, TRUE);
+}
+
+
+static void
+free_entry (struct keyindex_entry_s *entry)
+{
+  g_free (entry->fpr);
+  g_free (entry->text);
+  g_free (entry);
+}
+
+
+/* Add ENTRY to INDEX with the next free slot.  */
+static void
+insert_entry (gpa_keyindex_t index, struct keyindex_entry_s *entry)
+{
+  guint slot = index->entries->len;
+  const char *s;
+  GArray *list;
+  guint32 trigram;
+
+  g_ptr_array_add (index->entries, entry);
+  g_hash_table_insert (index->slots, entry->fpr, GUINT_TO_POINTER (slot + 1));
+
+  for (s = entry->text; s[0] && s[1] && s[2]; s++)
+    {
+      trigram = get_trigram (s);
+      list = g_hash_table_lookup (index->trigrams, GUINT_TO_POINTER (trigram));
+      if (!list)
+        {
+          list = g_array_new (FALSE, FALSE, sizeof (guint));
+          g_hash_table_insert (index->trigrams, GUINT_TO_POINTER (trigram),
+                               list);
+        }
+      /* The new slot is the highest one; thus a repeated trigram of
+         this key is always at the end.  */
+      if (list->len && g_array_index (list, guint, list->len - 1) == slot)
+        continue;
+      g_array_append_val (list, slot);
+    }
+}
+
+
+/* Rebuild INDEX without the unused slots.  */
+static void
+compact_index (gpa_keyindex_t index)
+{
+  GPtrArray *entries = index->entries;
+  guint i;
+
+  index->entries = g_ptr_array_new ();
+  index->n_unused = 0;
+  g_hash_table_remove_all (index->slots);
+  g_hash_table_remove_all (index->trigrams);
+  for (i = 0; i < entries->len; i++)
+    if (g_ptr_array_index (entries, i))
+      insert_entry (index, g_ptr_array_index (entries, i));
+  g_ptr_array_free (entries, TRUE);
+}
+
+
+
+/* Create a new empty index.  */
+gpa_keyindex_t
+gpa_keyindex_new (void)
+{
+  gpa_keyindex_t index = g_new0 (struct gpa_keyindex_s, 1);
+
+  index->entries = g_ptr_array_new ();
+  index->slots = g_hash_table_new (g_str_hash, g_str_equal);
+  index->trigrams = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                           NULL, free_trigram_list);
+
+  return index;
+}
+
+
+/* Release INDEX.  */
+void
+gpa_keyindex_release (gpa_keyindex_t index)
+{
+  if (!index)
+    return;
+
+  gpa_keyindex_clear (index);
+  g_ptr_array_free (index->entries, TRUE);
+  g_hash_table_destroy (index->slots);
+  g_hash_table_destroy (index->trigrams);
+  g_free (index);
+}
+
+
+/* Add KEY to INDEX.  An entry for a key with the same fingerprint is
+   replaced.  */
+void
+gpa_keyindex_add (gpa_keyindex_t index, gpgme_key_t key)
+{
+  struct keyindex_entry_s *entry;
+
+  if (!key->subkeys || !key->subkeys->fpr)
+    return;
+
+  gpa_keyindex_remove (index, key->subkeys->fpr);
+
+  entry = g_new (struct keyindex_entry_s, 1);
+  entry->fpr = g_strdup (key->subkeys->fpr);
+  entry->text = build_text (key);
+  insert_entry (index, entry);
+}
+
+
+/* Remove the key with fingerprint FPR from INDEX.  Its slot stays in
+   the trigram lists until the index is compacted.  */
+void
+gpa_keyindex_remove (gpa_keyindex_t index, const char *fpr)
+{
+  gpointer value;
+  guint slot;
+
+  value = g_hash_table_lookup (index->slots, fpr);
+  if (!value)
+    return;
+
+  slot = GPOINTER_TO_UINT (value) - 1;
+  g_hash_table_remove (index->slots, fpr);
+  free_entry (g_ptr_array_index (index->entries, slot));
+  g_ptr_array_index (index->entries, slot) = NULL;
+  index->n_unused++;
+
+  if (index->n_unused > COMPACT_THRESHOLD
+      && index->n_unused >= index->entries->len / 2)
+    compact_index (index);
+}
+
+
+/* Remove all keys from INDEX.  */
+void
+gpa_keyindex_clear (gpa_keyindex_t index)
+{
+  guint i;
+
+  g_hash_table_remove_all (index->slots);
+  g_hash_table_remove_all (index->trigrams);
+  for (i = 0; i < index->entries->len; i++)
+    if (g_ptr_array_index (index->entries, i))
+      free_entry (g_ptr_array_index (index->entries, i));
+  g_ptr_array_set_size (index->entries, 0);
+  index->n_unused = 0;
+}
+
+
+/* Return a new hash table with the fingerprints of all keys in INDEX
+   which contain PATTERN in a user ID, key ID or fingerprint.  Case is
+   ignored.  The fingerprints are used as keys and values.  */
+GHashTable *
+gpa_keyindex_search (gpa_keyindex_t index, const char *pattern)
+{
+  GHashTable *result;
+  struct keyindex_entry_s *entry;
+  GArray *list, *shortest = NULL;
+  char *folded;
+  const char *needle, *s;
+  guint i, slot;
+
+  result = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  folded = fold_string (pattern);
+  needle = folded;
+  /* Allow for the usual "0x" prefix of a key ID.  */
+  if (needle[0] == '0' && needle[1] == 'x' && needle[2])
+    {
+      for (s = needle + 2; *s && isxdigit ((unsigned char) *s); s++)
+        ;
+      if (!*s)
+        needle += 2;
+    }
+
+  if (strlen (needle) < 3)
+    {
+      /* Too short for the trigrams; check all keys.  */
+      for (i = 0; i < index->entries->len; i++)
+        {
+          entry = g_ptr_array_index (index->entries, i);
+          if (entry && strstr (entry->text, needle))
+            {
+              char *fpr = g_strdup (entry->fpr);
+              g_hash_table_insert (result, fpr, fpr);
+            }
+        }
+      g_free (folded);
+      return result;
+    }
+
+  /* Find the rarest trigram of the pattern.  If one of them does not
+     occur at all, nothing matches.  */
+  for (s = needle; s[0] && s[1] && s[2]; s++)
+    {
+      list = g_hash_table_lookup (index->trigrams,
+                                  GUINT_TO_POINTER (get_trigram (s)));
+      if (!list)
+        {
+          g_free (folded);
+          return result;
+        }
+      if (!shortest || list->len < shortest->len)
+        shortest = list;
+    }
+
+  for (i = 0; i < shortest->len; i++)
+    {
+      slot = g_array_index (shortest, guint, i);
+      entry = g_ptr_array_index (index->entries, slot);
+      if (entry && strstr (entry->text, needle))
+        {
+          char *fpr = g_strdup (entry->fpr);
+          g_hash_table_insert (result, fpr, fpr);
+        }
+    }
+
+  g_free (folded);
+  return result;
+}
@@ -0,0 +1,51 @@
+/* keyindex.h - The GNU Privacy Assistant key search index.
+   Copyright (C) 2026 g10 Code GmbH.
+
+   This file is part of GPA
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KEYINDEX_H
+#define KEYINDEX_H
+
+#include <glib.h>
+#include <gpgme.h>
+
+/* A substring search index over the user IDs, key IDs and
+   fingerprints of a set of keys.  */
+typedef struct gpa_keyindex_s *gpa_keyindex_t;
+
+/* Create a new empty index.  */
+gpa_keyindex_t gpa_keyindex_new (void);
+
+/* Release INDEX.  */
+void gpa_keyindex_release (gpa_keyindex_t index);
+
+/* Add KEY to INDEX.  An entry for a key with the same fingerprint is
+   replaced.  */
+void gpa_keyindex_add (gpa_keyindex_t index, gpgme_key_t key);
+
+/* Remove the key with fingerprint FPR from INDEX.  */
+void gpa_keyindex_remove (gpa_keyindex_t index, const char *fpr);
+
+/* Remove all keys from INDEX.  */
+void gpa_keyindex_clear (gpa_keyindex_t index);
+
+/* Return a new hash table with the fingerprints of all keys in INDEX
+   which contain PATTERN in a user ID, key ID or fingerprint.  Case is
+   ignored.  The fingerprints are used as keys and values.  */
+GHashTable *gpa_keyindex_search (gpa_keyindex_t index, const char *pattern);
+
+#endif /* KEYINDEX_H */
@@ -20,6 +20,8 @@
 
 #include <config.h>
 
+#include <stdarg.h>
+#include <time.h>
 #include <glib/gstdio.h>
 
 #include "gpa.h"
@@ -29,7 +31,12 @@
 #include "gtktools.h"
 #include "keytable.h"
 #include "icons.h"
-#include "format-dn.h"
+#include "keylistmodel.h"
+
+
+/* The maximum time in microseconds spent adding keys to the model
+   before control is returned to the main loop.  */
+#define FLUSH_TIME_SLICE 20000
 
 
 /* Properties */
@@ -45,37 +52,27 @@ enum
   PROP_ONLY_USABLE_KEYS
 };
 
-/* GObject */
-static GObjectClass *parent_class = NULL;
-
-
-/* Symbols to access the columns.  */
-typedef enum
+/* Signals */
+enum
 {
-  /* These are the displayed columns */
-  GPA_KEYLIST_COLUMN_IMAGE,
-  GPA_KEYLIST_COLUMN_KEYTYPE,
-  GPA_KEYLIST_COLUMN_CREATED,
-  GPA_KEYLIST_COLUMN_EXPIRY,
-  GPA_KEYLIST_COLUMN_OWNERTRUST,
-  GPA_KEYLIST_COLUMN_VALIDITY,
-  GPA_KEYLIST_COLUMN_USERID,
-  /* This column contains the gpgme_key_t */
-  GPA_KEYLIST_COLUMN_KEY,
-  /* These columns are used only internally for sorting */
-  GPA_KEYLIST_COLUMN_HAS_SECRET,
-  GPA_KEYLIST_COLUMN_CREATED_TS,
-  GPA_KEYLIST_COLUMN_EXPIRY_TS,
-  GPA_KEYLIST_COLUMN_OWNERTRUST_VALUE,
-  GPA_KEYLIST_COLUMN_VALIDITY_VALUE,
-  GPA_KEYLIST_N_COLUMNS
-} GpaKeyListColumn;
+  KEYS_UPDATED,
+  LAST_SIGNAL
+};
 
+/* GObject */
+static GObjectClass *parent_class = NULL;
+static guint signals[LAST_SIGNAL] = { 0 };
 
 
 static void add_trustdb_dialog (GpaKeyList * keylist);
 static void gpa_keylist_next (gpgme_key_t key, gpointer data);
 static void gpa_keylist_end (gpointer data);
+static void gpa_keylist_secret_loaded (gpointer data);
+static void start_update (GpaKeyList *keylist, const char **fprs);
+static void drop_pending_keys (GpaKeyList *list);
+static void drop_cached_keys (GpaKeyList *list);
+static void begin_loading (GpaKeyList *list);
+static void refresh_filter (GpaKeyList *list, gboolean force);
 
 
 
@@ -135,6 +132,9 @@ gpa_keylist_set_property (GObject     *object,
       break;
     case PROP_PUBLIC_ONLY:
       list->public_only = g_value_get_boolean (value);
+      gpa_keylist_model_set_public_only
+        (GPA_KEYLIST_MODEL (gtk_tree_view_get_model (GTK_TREE_VIEW (list))),
+         list->public_only);
       break;
     case PROP_PROTOCOL:
       list->protocol = g_value_get_int (value);
@@ -164,6 +164,8 @@ gpa_keylist_dispose (GObject *object)
   GpaKeyList *list = GPA_KEYLIST (object);
 
   list->disposed = 1;
+  drop_pending_keys (list);
+  drop_cached_keys (list);
 
   G_OBJECT_CLASS (parent_class)->dispose (object);
 }
@@ -174,47 +176,63 @@ gpa_keylist_finalize (GObject *object)
 {
   GpaKeyList *list = GPA_KEYLIST (object);
 
-  /* Dereference all keys in the list */
-  g_list_foreach (list->keys, (GFunc) gpgme_key_unref, NULL);
-  g_list_free (list->keys);
-  list->keys = NULL;
+  g_hash_table_destroy (list->rows);
+  g_strfreev (list->update_fprs);
+  if (list->next_update_fprs)
+    g_hash_table_destroy (list->next_update_fprs);
   gpa_gpgme_release_keyarray (list->initial_keys);
+  g_free (list->filter_pattern);
+  if (list->filter)
+    g_hash_table_destroy (list->filter);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
 
+/* Only rows with a real key may be selected; the rows from the key
+   cache can't be used for any operation.  */
+static gboolean
+select_row_cb (GtkTreeSelection *selection, GtkTreeModel *model,
+               GtkTreePath *path, gboolean path_currently_selected,
+               gpointer data)
+{
+  GtkTreeIter iter;
+
+  if (path_currently_selected)
+    return TRUE;
+  if (!gtk_tree_model_get_iter (model, &iter, path))
+    return FALSE;
+
+  return gpa_keylist_model_get_key (GPA_KEYLIST_MODEL (model), &iter) != NULL;
+}
+
+
 static void
 gpa_keylist_init (GTypeInstance *instance, void *class_ptr)
 {
   GpaKeyList *list = GPA_KEYLIST (instance);
-  GtkListStore *store;
+  GpaKeyListModel *model;
   GtkTreeSelection *selection;
 
-  /* Setup the model.  */
-  store = gtk_list_store_new (GPA_KEYLIST_N_COLUMNS,
-			      G_TYPE_STRING,
-			      G_TYPE_STRING,
-			      G_TYPE_STRING,
-			      G_TYPE_STRING,
-			      G_TYPE_STRING,
-			      G_TYPE_STRING,
-			      G_TYPE_STRING,
-			      G_TYPE_POINTER,
-			      G_TYPE_INT,
-			      G_TYPE_ULONG,
-			      G_TYPE_ULONG,
-			      G_TYPE_ULONG,
-			      G_TYPE_LONG);
+  /* Setup the model.  The model holds the keys of the list.  */
+  model = gpa_keylist_model_new (list->public_only);
+
+  list->rows = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                      g_free, g_free);
+  g_queue_init (&list->pending_keys);
 
   /* Setup the view.  */
-  gtk_tree_view_set_model (GTK_TREE_VIEW (list), GTK_TREE_MODEL (store));
+  gtk_tree_view_set_model (GTK_TREE_VIEW (list), GTK_TREE_MODEL (model));
+  g_object_unref (model);
   gpa_keylist_set_brief (list);
   selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (list));
   gtk_tree_selection_set_mode (selection, GTK_SELECTION_MULTIPLE);
+  gtk_tree_selection_set_select_function (selection, select_row_cb,
+                                          NULL, NULL);
 
   /* Load the keyring.  */
   add_trustdb_dialog (list);
+  begin_loading (list);
   if (list->initial_keys)
     {
       /* Initialize from the provided list.  */
@@ -233,15 +251,11 @@ gpa_keylist_init (GTypeInstance *instance, void *class_ptr)
       /* Initialize from the global keytable.
        *
        * We must forcefully load the secret keytable first to
-       * prevent concurrent access to the TOFU database. */
+       * prevent concurrent access to the TOFU database.  The public
+       * keyring is loaded by gpa_keylist_secret_loaded.  */
+      g_object_ref (list);
       gpa_keytable_force_reload (gpa_keytable_get_secret_instance (),
-                                 NULL, (GpaKeyTableEndFunc) g_application_quit,
-                                 NULL);
-      // gtk_main ();
-
-      /* Now we can load the public keyring. */
-      gpa_keytable_list_keys (gpa_keytable_get_public_instance(),
-                              gpa_keylist_next, gpa_keylist_end, list);
+                                 NULL, gpa_keylist_secret_loaded, list);
     }
 
 }
@@ -308,6 +322,16 @@ gpa_keylist_class_init (void *class_ptr, void *class_data)
       FALSE,
       G_PARAM_WRITABLE|G_PARAM_CONSTRUCT_ONLY));
 
+  /* Emitted after gpa_keylist_update_keys has updated all requested
+     rows.  */
+  signals[KEYS_UPDATED] =
+    g_signal_new ("keys_updated",
+		  G_TYPE_FROM_CLASS (object_class),
+		  G_SIGNAL_RUN_FIRST,
+		  G_STRUCT_OFFSET (GpaKeyListClass, keys_updated),
+		  NULL, NULL,
+		  g_cclosure_marshal_VOID__VOID,
+		  G_TYPE_NONE, 0);
 
 }
 
@@ -358,9 +382,13 @@ display_dialog (GpaKeyList * keylist)
 }
 
 
+static void remove_trustdb_dialog (GpaKeyList *keylist);
+
 static void
 add_trustdb_dialog (GpaKeyList * keylist)
 {
+  remove_trustdb_dialog (keylist);
+
   /* Display this warning until the first key is received.  It may be
      shown at times when it's not needed. But it shouldn't appear for
      long those times.  */
@@ -394,24 +422,28 @@ remove_trustdb_dialog (GpaKeyList * keylist)
 }
 
 
-static const gchar *
-get_key_pixbuf (gpgme_key_t key)
+/* Show the progress of a load in the trustdb dialog if it is being
+   displayed.  */
+static void
+update_progress (GpaKeyList *keylist)
 {
-  gpgme_key_t seckey;
-
-  seckey = gpa_keytable_lookup_key (gpa_keytable_get_secret_instance (),
-                                    key->subkeys->fpr);
-  if (seckey)
-    {
-      if (seckey->subkeys && seckey->subkeys->is_cardkey)
-        return "blue_yellow_cardkey"; //GPA_STOCK_SECRET_CARDKEY;
-      return "blue_yellow_key"; //GPA_STOCK_SECRET_KEY;
-    }
-  else
-    return "blue_key"; //GPA_STOCK_PUBLIC_KEY;
+  if (!keylist->dialog || keylist->timeout_id)
+    return;
+
+  g_object_set (keylist->dialog, "text", _("Loading the keys..."), NULL);
+  gtk_message_dialog_format_secondary_text
+    (GTK_MESSAGE_DIALOG (keylist->dialog),
+     ngettext ("%u key loaded", "%u keys loaded", keylist->n_loaded),
+     keylist->n_loaded);
 }
 
 
+static GpaKeyListModel *
+get_model (GpaKeyList *list)
+{
+  return GPA_KEYLIST_MODEL (gtk_tree_view_get_model (GTK_TREE_VIEW (list)));
+}
+
 
 /* For keys, gpg can't cope with, the fingerprint is set to all
    zero. This helper function returns true for such a FPR. */
@@ -425,129 +457,481 @@ is_zero_fpr (const char *fpr)
 }
 
 
+/* Return true if KEY shall be shown in LIST.  */
+static gboolean
+key_is_wanted (GpaKeyList *list, gpgme_key_t key)
+{
+  if (list->protocol != GPGME_PROTOCOL_UNKNOWN
+      && key->protocol != list->protocol)
+    return FALSE;
+
+  if (list->requested_usage)
+    {
+      if ((key->can_sign && list->requested_usage & KEY_USAGE_SIGN))
+        ;
+      else if ((key->can_encrypt && list->requested_usage & KEY_USAGE_ENCR))
+        ;
+      else if ((key->can_certify && list->requested_usage & KEY_USAGE_CERT))
+        ;
+      else
+        return FALSE;
+    }
+
+  if (list->only_usable_keys
+      && (key->revoked || key->disabled || key->expired || key->invalid))
+    return FALSE;
+
+  return TRUE;
+}
+
+
+/* Return a malloced copy of ITER for the rows table.  */
+static GtkTreeIter *
+copy_iter (GtkTreeIter *iter)
+{
+  GtkTreeIter *copy;
+
+  copy = g_new (GtkTreeIter, 1);
+  *copy = *iter;
+  return copy;
+}
+
+
+/* Remove the row of the key with fingerprint FPR from LIST.  */
+static void
+remove_key_row (GpaKeyList *list, const char *fpr)
+{
+  GtkTreeIter *iter;
+  GpaKeyListModel *model;
+
+  iter = g_hash_table_lookup (list->rows, fpr);
+  if (!iter)
+    return;
+
+  model = GPA_KEYLIST_MODEL (gtk_tree_view_get_model (GTK_TREE_VIEW (list)));
+  gpa_keylist_model_remove (model, iter);
+  g_hash_table_remove (list->rows, fpr);
+}
+
+
+/* Add a row for KEY to LIST or update the row if there is already
+   one for it.  Note that this function takes ownership of KEY.  */
+static void
+add_key_row (GpaKeyList *list, GpaKeyListModel *model, gpgme_key_t key)
+{
+  GtkTreeIter iter, *row;
+
+  if (is_zero_fpr (key->subkeys->fpr))
+    {
+      gpa_keylist_model_append (model, key, &iter);
+      return;
+    }
+
+  if (list->cached_fprs)
+    g_hash_table_remove (list->cached_fprs, key->subkeys->fpr);
+
+  row = g_hash_table_lookup (list->rows, key->subkeys->fpr);
+  if (row)
+    gpa_keylist_model_set_key (model, row, key);
+  else
+    {
+      gpa_keylist_model_append (model, key, &iter);
+      g_hash_table_replace (list->rows, g_strdup (key->subkeys->fpr),
+                            copy_iter (&iter));
+    }
+}
+
+
+/* Called when all keys of a load have been added to the model.  */
+static void
+finish_loading (GpaKeyList *list)
+{
+  GpaKeyTable *keytable = gpa_keytable_get_public_instance ();
+
+  remove_trustdb_dialog (list);
+  if (list->disposed)
+    return;
+
+  /* The new rows have already been filtered when they were added;
+     the filter needs to be applied again only if the set of matching
+     keys has changed.  */
+  if (!list->full_load)
+    {
+      /* The keys added by an update have been flushed.  */
+      refresh_filter (list, FALSE);
+      return;
+    }
+  list->full_load = FALSE;
+
+  /* Keys from the key cache which have not been listed are gone.  */
+  drop_cached_keys (list);
+  gpa_keylist_model_thaw_sort (get_model (list));
+  refresh_filter (list, FALSE);
+
+  /* The cache file is only written after a complete listing, so that
+     it neither holds a partly loaded keyring nor is rewritten for
+     each updated key.  */
+  if (list->store_keycache && keytable->initialized && !keytable->listing)
+    gpa_keycache_store (keytable->keys);
+}
+
+
+/* Filter function for the model.  */
+static gboolean
+filter_key_cb (gpgme_key_t key, gpointer data)
+{
+  GpaKeyList *list = data;
+
+  return (key->subkeys && key->subkeys->fpr
+          && g_hash_table_lookup (list->filter, key->subkeys->fpr));
+}
+
+
+/* Apply the current filter of LIST to its model.  The model is
+   detached from the view meanwhile, so that the view does not
+   process a signal for each row shown or hidden.  The selected rows
+   and the first visible row are remembered by their iterators, which
+   stay valid, and restored if they are still shown.  */
+static void
+apply_filter (GpaKeyList *list)
+{
+  GtkTreeView *view = GTK_TREE_VIEW (list);
+  GtkTreeSelection *selection = gtk_tree_view_get_selection (view);
+  GpaKeyListModel *model = get_model (list);
+  GArray *selected;
+  GList *paths, *cur;
+  GtkTreePath *path;
+  GtkTreeIter iter, top;
+  gboolean have_top = FALSE;
+  guint i;
+
+  selected = g_array_new (FALSE, FALSE, sizeof (GtkTreeIter));
+  paths = gtk_tree_selection_get_selected_rows (selection, NULL);
+  for (cur = paths; cur; cur = g_list_next (cur))
+    if (gtk_tree_model_get_iter (GTK_TREE_MODEL (model), &iter, cur->data))
+      g_array_append_val (selected, iter);
+  g_list_foreach (paths, (GFunc) gtk_tree_path_free, NULL);
+  g_list_free (paths);
+  if (gtk_tree_view_get_visible_range (view, &path, NULL))
+    {
+      have_top = gtk_tree_model_get_iter (GTK_TREE_MODEL (model), &top, path);
+      gtk_tree_path_free (path);
+    }
+
+  g_object_ref (model);
+  gtk_tree_view_set_model (view, NULL);
+  gpa_keylist_model_set_filter (model, list->filter? filter_key_cb : NULL,
+                                list);
+  gtk_tree_view_set_model (view, GTK_TREE_MODEL (model));
+  g_object_unref (model);
+
+  for (i = 0; i < selected->len; i++)
+    {
+      iter = g_array_index (selected, GtkTreeIter, i);
+      if (gpa_keylist_model_is_visible (model, &iter))
+        gtk_tree_selection_select_iter (selection, &iter);
+    }
+  g_array_free (selected, TRUE);
+  if (have_top && gpa_keylist_model_is_visible (model, &top))
+    {
+      path = gtk_tree_model_get_path (GTK_TREE_MODEL (model), &top);
+      gtk_tree_view_scroll_to_cell (view, path, NULL, TRUE, 0.0, 0.0);
+      gtk_tree_path_free (path);
+    }
+}
+
+
+/* Return true if the hash tables A and B have the same keys.  */
+static gboolean
+same_fprs (GHashTable *a, GHashTable *b)
+{
+  GHashTableIter iter;
+  gpointer fpr;
+
+  if (g_hash_table_size (a) != g_hash_table_size (b))
+    return FALSE;
+
+  g_hash_table_iter_init (&iter, a);
+  while (g_hash_table_iter_next (&iter, &fpr, NULL))
+    if (!g_hash_table_lookup (b, fpr))
+      return FALSE;
+
+  return TRUE;
+}
+
+
+/* Search the keytable again for the filter pattern of LIST after the
+   keys have changed.  Unless FORCE is set the filter is only applied
+   again if the set of matching keys has changed.  */
+static void
+refresh_filter (GpaKeyList *list, gboolean force)
+{
+  GHashTable *filter;
+
+  if (!list->filter_pattern)
+    return;
+
+  filter = gpa_keytable_search (gpa_keytable_get_public_instance (),
+                                list->filter_pattern);
+  if (!force && list->filter && same_fprs (filter, list->filter))
+    {
+      g_hash_table_destroy (filter);
+      return;
+    }
+
+  if (list->filter)
+    g_hash_table_destroy (list->filter);
+  list->filter = filter;
+  apply_filter (list);
+}
+
+
+/* Idle handler to add the pending keys to the model.  To keep the
+   user interface responsive only as many keys are added as fit into
+   FLUSH_TIME_SLICE.  */
+static gboolean
+flush_pending_keys (gpointer data)
+{
+  GpaKeyList *list = data;
+  GpaKeyListModel *model = get_model (list);
+  gint64 deadline = g_get_monotonic_time () + FLUSH_TIME_SLICE;
+  gpgme_key_t key;
+
+  while ((key = g_queue_pop_head (&list->pending_keys)))
+    {
+      add_key_row (list, model, key);
+      list->n_loaded++;
+      if (g_get_monotonic_time () >= deadline)
+        break;
+    }
+  update_progress (list);
+
+  if (!g_queue_is_empty (&list->pending_keys))
+    return TRUE;
+
+  list->flush_id = 0;
+  if (!list->loading)
+    finish_loading (list);
+  return FALSE;
+}
+
+
+/* Discard the keys not yet added to the model.  */
+static void
+drop_pending_keys (GpaKeyList *list)
+{
+  gpgme_key_t key;
+
+  if (list->flush_id)
+    {
+      g_source_remove (list->flush_id);
+      list->flush_id = 0;
+    }
+  while ((key = g_queue_pop_head (&list->pending_keys)))
+    gpgme_key_unref (key);
+}
+
+
+/* Remove the rows with keys from the key cache and release the
+   cache.  */
+static void
+drop_cached_keys (GpaKeyList *list)
+{
+  GHashTableIter iter;
+  gpointer fpr;
+
+  if (!list->keycache)
+    return;
+
+  if (!list->disposed)
+    {
+      g_hash_table_iter_init (&iter, list->cached_fprs);
+      while (g_hash_table_iter_next (&iter, &fpr, NULL))
+        remove_key_row (list, fpr);
+    }
+  g_hash_table_destroy (list->cached_fprs);
+  list->cached_fprs = NULL;
+  gpa_keycache_release (list->keycache);
+  list->keycache = NULL;
+}
+
+
+/* Prepare LIST for loading the entire keyring.  Sorting is suspended
+   until all keys have been added.  */
+static void
+begin_loading (GpaKeyList *list)
+{
+  list->loading = TRUE;
+  list->full_load = TRUE;
+  list->n_loaded = 0;
+  gpa_keylist_model_freeze_sort (get_model (list));
+}
+
+
 /* Note that this function takes ownership of KEY.  */
 static void
 gpa_keylist_next (gpgme_key_t key, gpointer data)
 {
   GpaKeyList *list = data;
-  GtkListStore *store;
-  GtkTreeIter iter;
-  const gchar *ownertrust, *validity;
-  gchar *userid, *created, *expiry;
-  gboolean has_secret;
-  long int val_value;
-  const char *keytype;
 
-  /* Remove the dialog if it is being displayed */
-  remove_trustdb_dialog (list);
+  /* The trustdb check is finished once the first key arrives.  If
+     the dialog is not yet displayed it is not needed anymore;
+     otherwise it shows the progress until all keys are loaded.  */
+  if (list->timeout_id)
+    remove_trustdb_dialog (list);
 
   if (list->disposed)
-    return;  /* Should not access our store anymore.  */
+    {
+      gpgme_key_unref (key);
+      return;  /* Should not access our store anymore.  */
+    }
 
   /* Filter out keys we don't want.  */
-  if (key && list->protocol != GPGME_PROTOCOL_UNKNOWN
-      && key->protocol != list->protocol)
+  if (key && !key_is_wanted (list, key))
     {
       gpgme_key_unref (key);
       return;
     }
 
-  if (key && list->requested_usage)
+  /* Queue the key.  The keys are added in chunks so that the view is
+     not updated for every single key.  The flush handler runs at the
+     priority of the I/O callbacks so that it is not starved while
+     gpg is still sending keys.  */
+  g_queue_push_tail (&list->pending_keys, key);
+  if (!list->flush_id)
+    list->flush_id = g_idle_add_full (G_PRIORITY_DEFAULT, flush_pending_keys,
+                                      list, NULL);
+}
+
+
+/* Update the row of KEY or add a new row for it.  Note that this
+   function takes ownership of KEY.  */
+static void
+gpa_keylist_update_next (gpgme_key_t key, gpointer data)
+{
+  GpaKeyList *list = data;
+  GtkTreeIter *iter;
+  GpaKeyListModel *model;
+
+  if (list->disposed)
     {
-      if ((key->can_sign && list->requested_usage & KEY_USAGE_SIGN))
-        ;
-      else if ((key->can_encrypt && list->requested_usage & KEY_USAGE_ENCR))
-        ;
-      else if ((key->can_certify && list->requested_usage & KEY_USAGE_CERT))
-        ;
-      else
-        {
-          gpgme_key_unref (key);
-          return;
-        }
+      gpgme_key_unref (key);
+      return;
     }
 
-  if (key && list->only_usable_keys
-      && (key->revoked || key->disabled || key->expired || key->invalid))
+  iter = g_hash_table_lookup (list->rows, key->subkeys->fpr);
+  if (!iter)
+    {
+      gpa_keylist_next (key, list);
+      return;
+    }
+
+  if (!key_is_wanted (list, key))
     {
+      remove_key_row (list, key->subkeys->fpr);
       gpgme_key_unref (key);
       return;
     }
 
-  /* Append the key to the list.  */
-  list->keys = g_list_append (list->keys, key);
-  store = GTK_LIST_STORE (gtk_tree_view_get_model (GTK_TREE_VIEW (list)));
-  /* Get the column values */
-  keytype = (key->protocol == GPGME_PROTOCOL_OpenPGP? "P" :
-             key->protocol == GPGME_PROTOCOL_CMS? "X" : "?");
-  created = gpa_creation_date_string (key->subkeys->timestamp);
-  expiry = gpa_expiry_date_string (key->subkeys->expires);
-  ownertrust = gpa_key_ownertrust_string (key);
-  validity = gpa_key_validity_string (key);
-  if (key->protocol == GPGME_PROTOCOL_CMS)
-    userid = gpa_format_dn (key->uids? key->uids->uid : NULL);
-  else
-    userid = gpa_gpgme_key_get_userid (key->uids);
-  if (list->public_only)
-    has_secret = 0;
-  else
-    has_secret = (!is_zero_fpr (key->subkeys->fpr)
-                  && gpa_keytable_lookup_key
-                  (gpa_keytable_get_secret_instance(), key->subkeys->fpr));
-
-  /* Append the key to the list */
-  gtk_list_store_append (store, &iter);
-
-  /* Set an appropiate value for sorting revoked and expired keys. This
-   * includes a hack for forcing a value to a range outside the
-   * usual validity values */
-  if (key->subkeys->revoked)
-      val_value = GPGME_VALIDITY_UNKNOWN-2;
-  else if (key->subkeys->expired)
-      val_value = GPGME_VALIDITY_UNKNOWN-1;
-  else if (key->uids)
-      val_value = key->uids->validity;
+  /* Replace the key in place so that selection and scroll position
+     are kept.  */
+  if (list->cached_fprs)
+    g_hash_table_remove (list->cached_fprs, key->subkeys->fpr);
+  model = GPA_KEYLIST_MODEL (gtk_tree_view_get_model (GTK_TREE_VIEW (list)));
+  gpa_keylist_model_set_key (model, iter, key);
+}
+
+
+/* Finish an update of the list by removing the rows of all keys
+   which are gone.  */
+static void
+gpa_keylist_update_end (gpointer data)
+{
+  GpaKeyList *list = data;
+  GpaKeyTable *keytable = gpa_keytable_get_public_instance ();
+  const char **next = NULL;
+  int i;
+
+  remove_trustdb_dialog (list);
+
+  if (!list->disposed && keytable->initialized && list->update_fprs)
+    for (i = 0; list->update_fprs[i]; i++)
+      if (!gpa_keytable_lookup_key (keytable, list->update_fprs[i]))
+        remove_key_row (list, list->update_fprs[i]);
+  if (!list->disposed)
+    refresh_filter (list, FALSE);
+
+  g_strfreev (list->update_fprs);
+  list->update_fprs = NULL;
+
+  /* Run the updates requested meanwhile as one; the strings in NEXT
+     are owned by the set, which is thus destroyed last.  */
+  if (list->next_update_fprs)
+    next = gpa_gpgme_get_import_fprs (list->next_update_fprs);
+  if (list->disposed)
+    ;
+  else if (next)
+    start_update (list, next);
   else
-      val_value = GPGME_VALIDITY_UNKNOWN;
-
-  gtk_list_store_set (store, &iter,
-		      GPA_KEYLIST_COLUMN_KEYTYPE, keytype,
-		      GPA_KEYLIST_COLUMN_CREATED, created,
-		      GPA_KEYLIST_COLUMN_EXPIRY, expiry,
-		      GPA_KEYLIST_COLUMN_OWNERTRUST, ownertrust,
-		      GPA_KEYLIST_COLUMN_VALIDITY, validity,
-		      GPA_KEYLIST_COLUMN_USERID, userid,
-		      GPA_KEYLIST_COLUMN_KEY, key,
-		      GPA_KEYLIST_COLUMN_HAS_SECRET, has_secret,
-		      GPA_KEYLIST_COLUMN_CREATED_TS, key->subkeys->timestamp,
-
-		      /* Set "no expiration" to a large value for sorting */
-		      GPA_KEYLIST_COLUMN_EXPIRY_TS,
-		      key->subkeys->expires ?
-		      key->subkeys->expires : G_MAXULONG,
-
-		      GPA_KEYLIST_COLUMN_OWNERTRUST_VALUE,
-		      key->owner_trust,
-		      /* Set revoked and expired keys to "never trust"
-		         for sorting.  */
-		      GPA_KEYLIST_COLUMN_VALIDITY_VALUE, val_value,
-                      /* Store the image only if enabled.  */
-		      list->public_only ? -1 : GPA_KEYLIST_COLUMN_IMAGE,
-                      list->public_only ? NULL : get_key_pixbuf (key),
-		      -1);
-  /* Clean up */
-  g_free (userid);
-  g_free (created);
-  g_free (expiry);
+    g_signal_emit (list, signals[KEYS_UPDATED], 0);
+  g_free (next);
+  if (list->next_update_fprs)
+    {
+      g_hash_table_destroy (list->next_update_fprs);
+      list->next_update_fprs = NULL;
+    }
+
+  g_object_unref (list);
 }
 
 
+/* The secret keys of an update have been reloaded; now reload the
+   public keys.  */
+static void
+gpa_keylist_update_secret_end (gpointer data)
+{
+  GpaKeyList *list = data;
+
+  gpa_keytable_reload_keys (gpa_keytable_get_public_instance (),
+                            (const char **) list->update_fprs,
+                            gpa_keylist_update_next,
+                            gpa_keylist_update_end, list);
+}
+
+
+/* End function for a load of the entire keyring.  */
 static void
 gpa_keylist_end (gpointer data)
 {
   GpaKeyList *list = data;
 
-  remove_trustdb_dialog (list);
+  list->loading = FALSE;
+  if (!list->flush_id)
+    finish_loading (list);
+}
+
+
+/* End function for the public keyring listing started by
+   gpa_keylist_secret_loaded.  */
+static void
+gpa_keylist_initial_end (gpointer data)
+{
+  GpaKeyList *list = data;
+
+  gpa_keylist_end (list);
+  g_object_unref (list);
+}
+
+
+/* The secret keytable has been loaded; now load the public
+   keyring.  */
+static void
+gpa_keylist_secret_loaded (gpointer data)
+{
+  GpaKeyList *list = data;
+
+  gpa_keytable_list_keys (gpa_keytable_get_public_instance (),
+                          gpa_keylist_next, gpa_keylist_initial_end, list);
 }
 
 
@@ -593,14 +977,49 @@ search_keylist_function (GtkTreeModel *model, gint column,
 }
 
 
+/* Give COLUMN a fixed width large enough for the NULL terminated
+   list of sample texts starting at SAMPLE.  With fixed size columns
+   the view does not need to render every row to compute the layout;
+   thus the model only needs to provide the visible rows.  */
+static void
+fix_column_width (GpaKeyList *keylist, GtkTreeViewColumn *column,
+                  const char *sample, ...)
+{
+  va_list arg_ptr;
+  PangoLayout *layout;
+  int width, max_width = 0;
+
+  layout = gtk_widget_create_pango_layout (GTK_WIDGET (keylist), NULL);
+  va_start (arg_ptr, sample);
+  for (; sample; sample = va_arg (arg_ptr, const char *))
+    {
+      pango_layout_set_text (layout, sample, -1);
+      pango_layout_get_pixel_size (layout, &width, NULL);
+      if (width > max_width)
+        max_width = width;
+    }
+  va_end (arg_ptr);
+  g_object_unref (layout);
+
+  /* Leave room for the cell padding and the sort indicator.  */
+  gtk_tree_view_column_set_sizing (column, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_column_set_fixed_width (column, max_width + 24);
+  gtk_tree_view_column_set_resizable (column, TRUE);
+}
+
+
 static void
 setup_columns (GpaKeyList *keylist, gboolean detailed)
 {
   GtkCellRenderer *renderer;
   GtkTreeViewColumn *column;
+  char *date, *never;
 
   gpa_keylist_clear_columns (keylist);
 
+  date = gpa_creation_date_string (time (NULL));
+  never = gpa_expiry_date_string (0);
+
   if (!keylist->public_only)
     {
       renderer = gtk_cell_renderer_pixbuf_new ();
@@ -614,6 +1033,8 @@ setup_columns (GpaKeyList *keylist, gboolean detailed)
         (NULL, renderer, "icon-name",
          GPA_KEYLIST_COLUMN_IMAGE,
          NULL);
+      gtk_tree_view_column_set_sizing (column, GTK_TREE_VIEW_COLUMN_FIXED);
+      gtk_tree_view_column_set_fixed_width (column, 32);
       gtk_tree_view_append_column (GTK_TREE_VIEW (keylist), column);
       gtk_tree_view_column_set_sort_column_id
         (column, GPA_KEYLIST_COLUMN_HAS_SECRET);
@@ -627,6 +1048,7 @@ setup_columns (GpaKeyList *keylist, gboolean detailed)
     (column, " ",
      _("This columns lists the type of the certificate."
        "  A 'P' denotes OpenPGP and a 'X' denotes X.509 (S/MIME)."));
+  fix_column_width (keylist, column, "X", NULL);
   gtk_tree_view_append_column (GTK_TREE_VIEW (keylist), column);
 
   renderer = gtk_cell_renderer_text_new ();
@@ -635,6 +1057,7 @@ setup_columns (GpaKeyList *keylist, gboolean detailed)
   gpa_set_column_title
     (column, _("Created"),
      _("The Creation Date is the date the certificate was created."));
+  fix_column_width (keylist, column, _("Created"), date, NULL);
   gtk_tree_view_append_column (GTK_TREE_VIEW (keylist), column);
   gtk_tree_view_column_set_sort_column_id
     (column, GPA_KEYLIST_COLUMN_CREATED_TS);
@@ -648,6 +1071,7 @@ setup_columns (GpaKeyList *keylist, gboolean detailed)
       gpa_set_column_title
         (column, _("Expiry Date"),
          _("The Expiry Date is the date until the certificate is valid."));
+      fix_column_width (keylist, column, _("Expiry Date"), date, never, NULL);
       gtk_tree_view_append_column (GTK_TREE_VIEW (keylist), column);
       gtk_tree_view_column_set_sort_column_id
         (column, GPA_KEYLIST_COLUMN_EXPIRY_TS);
@@ -661,6 +1085,9 @@ setup_columns (GpaKeyList *keylist, gboolean detailed)
          _("The Owner Trust has been set by you and describes how far you"
            " trust the holder of the certificate to correctly sign (certify)"
            " other certificates.  It is only meaningful for OpenPGP."));
+      fix_column_width (keylist, column, _("Owner Trust"), _("Unknown"),
+                        _("Never"), _("Marginal"), _("Full"), _("Ultimate"),
+                        NULL);
       gtk_tree_view_append_column (GTK_TREE_VIEW (keylist), column);
       gtk_tree_view_column_set_sort_column_id
         (column, GPA_KEYLIST_COLUMN_OWNERTRUST_VALUE);
@@ -674,6 +1101,9 @@ setup_columns (GpaKeyList *keylist, gboolean detailed)
          _("The Validity describes the trust level the system has"
            " in this certificate.  That is how sure it is that the named"
            " user is actually that user."));
+      fix_column_width (keylist, column, _("Validity"), _("Unknown"),
+                        _("Revoked"), _("Expired"), _("Disabled"),
+                        _("Incomplete"), _("Fully Valid"), NULL);
       gtk_tree_view_append_column (GTK_TREE_VIEW (keylist), column);
       gtk_tree_view_column_set_sort_column_id
         (column, GPA_KEYLIST_COLUMN_VALIDITY_VALUE);
@@ -687,10 +1117,19 @@ setup_columns (GpaKeyList *keylist, gboolean detailed)
     (column, _("User Name"),
      _("The User Name is the name and often also the email address "
        " of the certificate."));
+  fix_column_width (keylist, column, _("User Name"),
+                    "Firstname Lastname <firstname@example.org>", NULL);
+  gtk_tree_view_column_set_expand (column, TRUE);
   gtk_tree_view_append_column (GTK_TREE_VIEW (keylist), column);
   gtk_tree_view_column_set_sort_column_id (column, GPA_KEYLIST_COLUMN_USERID);
   gtk_tree_view_column_set_sort_indicator (column, TRUE);
 
+  /* All columns have a fixed size; this allows the view to skip
+     measuring the rows which are not visible.  */
+  gtk_tree_view_set_fixed_height_mode (GTK_TREE_VIEW (keylist), TRUE);
+  g_free (date);
+  g_free (never);
+
   gtk_tree_view_set_enable_search (GTK_TREE_VIEW(keylist), TRUE);
   gtk_tree_view_set_search_equal_func (GTK_TREE_VIEW(keylist),
                                        search_keylist_function, NULL, NULL);
@@ -792,20 +1231,23 @@ gpa_keylist_has_single_secret_selection (GpaKeyList *keylist)
       GtkTreeModel *model = gtk_tree_view_get_model (GTK_TREE_VIEW (keylist));
       GList *list = gtk_tree_selection_get_selected_rows (selection, &model);
       gpgme_key_t key;
+      gint has_secret;
       GtkTreeIter iter;
       GtkTreePath *path = list->data;
-      GValue value = {0,};
 
+      /* Use the secret key status shown by the row instead of looking
+         up the key; rows from the key cache are shown before the
+         secret keytable has been loaded.  */
       gtk_tree_model_get_iter (model, &iter, path);
-      gtk_tree_model_get_value (model, &iter, GPA_KEYLIST_COLUMN_KEY,
-				&value);
-      key = g_value_get_pointer (&value);
-      g_value_unset(&value);
+      gtk_tree_model_get (model, &iter,
+                          GPA_KEYLIST_COLUMN_KEY, &key,
+                          GPA_KEYLIST_COLUMN_HAS_SECRET, &has_secret,
+                          -1);
 
       g_list_foreach (list, (GFunc) gtk_tree_path_free, NULL);
       g_list_free (list);
-      return (gpa_keytable_lookup_key (gpa_keytable_get_secret_instance(),
-				       key->subkeys->fpr) != NULL);
+      /* Keys from the key cache can't be acted upon.  */
+      return key && has_secret;
     }
   else
     {
@@ -825,7 +1267,7 @@ gpa_keylist_get_selected_keys (GpaKeyList * keylist, gpgme_protocol_t protocol)
     gtk_tree_view_get_selection (GTK_TREE_VIEW (keylist));
   GtkTreeModel *model = gtk_tree_view_get_model (GTK_TREE_VIEW (keylist));
   GList *list = gtk_tree_selection_get_selected_rows (selection, &model);
-  GList *keys = NULL;
+  GQueue keys = G_QUEUE_INIT;
   GList *cur;
 
   for (cur = list; cur; cur = g_list_next (cur))
@@ -844,13 +1286,13 @@ gpa_keylist_get_selected_keys (GpaKeyList * keylist, gpgme_protocol_t protocol)
       /* Fixme: Why don't we ref KEY? */
       if (key && (protocol == GPGME_PROTOCOL_UNKNOWN
                   || protocol == key->protocol))
-        keys = g_list_append (keys, key);
+        g_queue_push_tail (&keys, key);
     }
 
   g_list_foreach (list, (GFunc) gtk_tree_path_free, NULL);
   g_list_free (list);
 
-  return keys;
+  return keys.head;
 }
 
 
@@ -897,51 +1339,173 @@ gpa_keylist_start_reload (GpaKeyList * keylist)
   GtkTreeSelection *selection =
     gtk_tree_view_get_selection (GTK_TREE_VIEW (keylist));
   gtk_tree_selection_unselect_all (selection);
-  gtk_list_store_clear (GTK_LIST_STORE (gtk_tree_view_get_model
-					(GTK_TREE_VIEW (keylist))));
-  g_list_foreach (keylist->keys, (GFunc) gpgme_key_unref, NULL);
-  g_list_free (keylist->keys);
-  keylist->keys = NULL;
+  drop_pending_keys (keylist);
+  g_hash_table_remove_all (keylist->rows);
+  gpa_keylist_model_clear (get_model (keylist));
+  drop_cached_keys (keylist);
   add_trustdb_dialog (keylist);
+  begin_loading (keylist);
 
   gpa_keytable_force_reload (gpa_keytable_get_public_instance (),
 			     gpa_keylist_next, gpa_keylist_end, keylist);
 }
 
 
+/* Start the update of the keys with the fingerprints FPRS.  */
+static void
+start_update (GpaKeyList *keylist, const char **fprs)
+{
+  /* UPDATE_FPRS is non-NULL while the update is in progress.  */
+  keylist->update_fprs = fprs? g_strdupv ((char **) fprs)
+                             : g_new0 (char *, 1);
+  add_trustdb_dialog (keylist);
+
+  /* The secret keys are reloaded first so that the rows show the
+     current secret key status.  The keylist is kept alive until the
+     update has finished.  */
+  g_object_ref (keylist);
+  gpa_keytable_reload_keys (gpa_keytable_get_secret_instance (),
+                            (const char **) keylist->update_fprs,
+                            NULL, gpa_keylist_update_secret_end, keylist);
+}
+
+
+/* Reload only the keys with the fingerprints given by the NULL
+   terminated array FPRS.  Their rows are updated in place, rows for
+   new keys are added and rows of deleted keys are removed; the
+   selection and the scroll position are kept.  If an update is
+   already in progress, the keys are updated after it.  The
+   "keys_updated" signal is emitted once all rows are updated.  */
+void
+gpa_keylist_update_keys (GpaKeyList *keylist, const char **fprs)
+{
+  int i;
+
+  g_return_if_fail (GPA_IS_KEYLIST (keylist));
+
+  if (!keylist->update_fprs)
+    {
+      start_update (keylist, fprs);
+      return;
+    }
+
+  if (!keylist->next_update_fprs)
+    keylist->next_update_fprs = g_hash_table_new_full (g_str_hash,
+                                                       g_str_equal,
+                                                       g_free, NULL);
+  for (i = 0; fprs && fprs[i]; i++)
+    g_hash_table_add (keylist->next_update_fprs, g_strdup (fprs[i]));
+}
+
+
 /* Let the keylist know that a new key with the given fingerprint is
    available.  */
 void
 gpa_keylist_new_key (GpaKeyList * keylist, const char *fpr)
 {
-  /* FIXME: I don't understand the code.  Investigate this and
-     implement public_only.  */
+  const char *fprs[2] = { fpr, NULL };
 
-  add_trustdb_dialog (keylist);
-  gpa_keytable_load_new (gpa_keytable_get_secret_instance (), fpr,
-			 NULL, (GpaKeyTableEndFunc) g_application_quit, NULL);
-  /* Hack. Turn the asynchronous listing into a synchronous one */
-  gtk_main ();
-  remove_trustdb_dialog (keylist);
-  /* The trustdb seems not to be updated for a --list-secret, so we
-   * cdisplay the dialog both times, just in case */
-  add_trustdb_dialog (keylist);
-  gpa_keytable_load_new (gpa_keytable_get_public_instance (), fpr,
-			 gpa_keylist_next, gpa_keylist_end, keylist);
+  /* This loads the secret key first and then adds or updates the
+     row of the public key.  */
+  gpa_keylist_update_keys (keylist, fprs);
 }
 
 
-/* Let the keylist know that a new sceret key has been imported. */
+/* End function for the secret keytable reload started by
+   gpa_keylist_imported_secret_key.  */
+static void
+gpa_keylist_secret_reloaded (gpointer data)
+{
+  GpaKeyList *list = data;
+
+  if (!list->disposed)
+    gpa_keylist_start_reload (list);
+  g_object_unref (list);
+}
+
+
+/* Let the keylist know that a new sceret key has been imported.  The
+   secret keys are reloaded and then the entire keylist.  */
 void
 gpa_keylist_imported_secret_key (GpaKeyList *keylist)
 {
-  /* KEYLIST is currently not used. */
+  g_object_ref (keylist);
+  gpa_keytable_force_reload (gpa_keytable_get_secret_instance (),
+                             NULL, gpa_keylist_secret_reloaded, keylist);
+}
+
+
+/* Show the keys from the key cache file until the keyring has been
+   loaded and write the cache file after each complete load.  This
+   does nothing unless the key cache is enabled in gpa.conf.  It needs
+   to be called right after creating KEYLIST.  */
+void
+gpa_keylist_use_key_cache (GpaKeyList *keylist)
+{
+  GpaKeyListModel *model;
+  GtkTreeIter iter;
+  gpgme_key_t key;
+  guint idx, count;
+
+  g_return_if_fail (GPA_IS_KEYLIST (keylist));
+
+  if (!gpa_options_get_key_cache (gpa_options_get_instance ()))
+    return;
+  keylist->store_keycache = TRUE;
 
-  gpa_keytable_load_new (gpa_keytable_get_secret_instance (), NULL,
-			 NULL, (GpaKeyTableEndFunc) g_application_quit, NULL);
-  /* Hack. Turn the asynchronous listing into a synchronous one */
-  /* FIXME:  Does that work well with the server shutdown code? */
-  // gtk_main ();
+  /* The cache is only of use before any key has arrived.  */
+  if (!keylist->loading || keylist->keycache || keylist->n_loaded
+      || !g_queue_is_empty (&keylist->pending_keys))
+    return;
+
+  keylist->keycache = gpa_keycache_open ();
+  if (!keylist->keycache)
+    return;
+  keylist->cached_fprs = g_hash_table_new (g_str_hash, g_str_equal);
+
+  /* The rows are replaced by the listed keys via add_key_row.  */
+  model = get_model (keylist);
+  count = gpa_keycache_get_count (keylist->keycache);
+  for (idx = 0; idx < count; idx++)
+    {
+      key = gpa_keycache_get_key (keylist->keycache, idx);
+      if (is_zero_fpr (key->subkeys->fpr)
+          || !key_is_wanted (keylist, key)
+          || g_hash_table_lookup (keylist->rows, key->subkeys->fpr))
+        continue;
+
+      gpa_keylist_model_append_cached
+        (model, key, gpa_keycache_has_secret (keylist->keycache, idx), &iter);
+      g_hash_table_replace (keylist->rows, g_strdup (key->subkeys->fpr),
+                            copy_iter (&iter));
+      g_hash_table_insert (keylist->cached_fprs, key->subkeys->fpr,
+                           key->subkeys->fpr);
+    }
 }
 
 
+/* Show only the keys which contain PATTERN in a user ID, key ID or
+   fingerprint.  Case is ignored.  If PATTERN is NULL or empty all
+   keys are shown.  The search uses the index of the public keytable
+   and is thus only meaningful for a list of the entire keyring.  */
+void
+gpa_keylist_set_filter (GpaKeyList *keylist, const char *pattern)
+{
+  g_return_if_fail (GPA_IS_KEYLIST (keylist));
+
+  g_free (keylist->filter_pattern);
+  keylist->filter_pattern = NULL;
+  if (keylist->filter)
+    {
+      g_hash_table_destroy (keylist->filter);
+      keylist->filter = NULL;
+    }
+
+  if (pattern && *pattern)
+    {
+      keylist->filter_pattern = g_strdup (pattern);
+      refresh_filter (keylist, TRUE);
+    }
+  else
+    apply_filter (keylist);
+}
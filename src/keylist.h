@@ -23,6 +23,8 @@
 
 #include <gtk/gtk.h>
 
+#include "keycache.h"
+
 /* GObject stuff */
 #define GPA_KEYLIST_TYPE	  (gpa_keylist_get_type ())
 #define GPA_KEYLIST(obj)	  (G_TYPE_CHECK_INSTANCE_CAST ((obj), GPA_KEYLIST_TYPE, GpaKeyList))
@@ -40,8 +42,6 @@ struct _GpaKeyList {
   gboolean secret;
   /* Parent window for dialogs */
   GtkWidget *window;
-  /* Keys loaded into the model */
-  GList *keys;
   /* Dialog for warning about a trustdb rebuilding */
   GtkWidget *dialog;
   /* ID of the timeout that displays the dialog */
@@ -55,6 +55,34 @@ struct _GpaKeyList {
   const char *initial_pattern;
   int requested_usage;
   gboolean only_usable_keys;
+  /* The rows of the model indexed by fingerprint.  */
+  GHashTable *rows;
+  /* The fingerprints of an update in progress.  */
+  char **update_fprs;
+  /* The fingerprints of the updates requested while another one was
+     in progress or NULL.  */
+  GHashTable *next_update_fprs;
+  /* Keys received but not yet added to the model.  */
+  GQueue pending_keys;
+  /* ID of the idle handler adding the pending keys or 0.  */
+  guint flush_id;
+  /* True while the entire keyring is being loaded.  */
+  gboolean loading;
+  /* True until finish_loading has completed a load of the entire
+     keyring.  */
+  gboolean full_load;
+  /* The number of keys added by the current load.  */
+  guint n_loaded;
+  /* The key cache shown until the keyring has been loaded or NULL.  */
+  gpa_keycache_t keycache;
+  /* The fingerprints of the rows with a key from KEYCACHE.  */
+  GHashTable *cached_fprs;
+  /* True if the key cache file is written after each load.  */
+  gboolean store_keycache;
+  /* The filter pattern or NULL.  */
+  char *filter_pattern;
+  /* The fingerprints of the keys matching FILTER_PATTERN.  */
+  GHashTable *filter;
 
   int disposed;
 };
@@ -64,6 +92,7 @@ struct _GpaKeyListClass {
 
   /* Signal handlers */
   void (*context_menu) (GpaKeyList *keylist);
+  void (*keys_updated) (GpaKeyList *keylist);
 };
 
 GType gpa_keylist_get_type (void) G_GNUC_CONST;
@@ -117,6 +146,10 @@ gpgme_key_t gpa_keylist_get_selected_key (GpaKeyList *keylist);
 /* Begin a reload of the keyring. */
 void gpa_keylist_start_reload (GpaKeyList * keylist);
 
+/* Reload only the keys with the fingerprints given by the NULL
+   terminated array FPRS and update their rows.  */
+void gpa_keylist_update_keys (GpaKeyList *keylist, const char **fprs);
+
 /* Let the keylist know that a new key with the given fingerprint is
    available. */
 void gpa_keylist_new_key (GpaKeyList * keylist, const char *fpr);
@@ -124,5 +157,13 @@ void gpa_keylist_new_key (GpaKeyList * keylist, const char *fpr);
 /* Let the keylist know that a new sceret key has been imported.  */
 void gpa_keylist_imported_secret_key (GpaKeyList * keylist);
 
+/* Show the keys from the key cache file until the keyring has been
+   loaded and keep the cache file up to date.  */
+void gpa_keylist_use_key_cache (GpaKeyList *keylist);
+
+/* Show only the keys which contain PATTERN in a user ID, key ID or
+   fingerprint.  If PATTERN is NULL or empty all keys are shown.  */
+void gpa_keylist_set_filter (GpaKeyList *keylist, const char *pattern);
+
 
 #endif /* GPA_KEYLIST_H */
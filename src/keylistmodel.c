@@ -0,0 +1,1084 @@
+/* keylistmodel.c - The GNU Privacy Assistant key list model.
+   Copyright (C) 2026 g10 Code GmbH.
+
+   This file is part of GPA
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* This is a list model for the key list which keeps only the
+   gpgme_key_t objects of the key table.  The cell texts are computed
+   when the view asks for them and only the texts of a limited number
+   of rows are kept; thus the memory used by the model does not depend
+   much on the size of the keyring.  Sorting is done directly on the
+   key fields.  */
+
+#include <config.h>
+
+#include "gpa.h"
+#include "keylistmodel.h"
+#include "convert.h"
+#include "keytable.h"
+#include "format-dn.h"
+
+
+/* The number of rows whose cell texts are cached.  This should be
+   well above the number of rows visible at once.  */
+#define CACHED_ROWS 512
+
+/* Compare two numbers the way strcmp compares strings.  */
+#define CMP(a,b) ((a) < (b)? -1 : (a) > (b)? 1 : 0)
+
+
+/* A row of the model.  */
+struct keylist_model_row_s
+{
+  gpgme_key_t key;   /* The key; we hold a reference.  */
+  guint pos;         /* The current position of the row.  */
+  gboolean hidden;   /* True if the row is hidden by the filter.  */
+  int cache_slot;    /* The slot in the cache ring or -1.  */
+
+  /* True if KEY is from the key cache file.  We don't own such a key
+     and it must not be passed to gpgme.  */
+  gboolean cached;
+  /* True if there is a secret key for a key from the key cache.  */
+  gboolean cached_secret;
+
+  /* The cell texts; only valid if CACHE_SLOT is not -1.  */
+  char *created;
+  char *expiry;
+  char *userid;
+
+  /* The collation key of the user ID; only set while sorting.  */
+  char *sort_key;
+};
+
+
+/* GObject */
+static GObjectClass *parent_class = NULL;
+
+
+
+/************************************************************
+ ******************  Internal Functions  ********************
+ ************************************************************/
+
+/* For keys, gpg can't cope with, the fingerprint is set to all
+   zero. This helper function returns true for such a FPR. */
+static int
+is_zero_fpr (const char *fpr)
+{
+  for (; *fpr; fpr++)
+    if (*fpr != '0')
+      return 0;
+  return 1;
+}
+
+
+/* Return the icon name for a key.  SECKEY is the corresponding
+   secret key or NULL.  */
+static const gchar *
+get_key_pixbuf (gpgme_key_t seckey)
+{
+  if (seckey)
+    {
+      if (seckey->subkeys && seckey->subkeys->is_cardkey)
+        return "blue_yellow_cardkey"; //GPA_STOCK_SECRET_CARDKEY;
+      return "blue_yellow_key"; //GPA_STOCK_SECRET_KEY;
+    }
+  else
+    return "blue_key"; //GPA_STOCK_PUBLIC_KEY;
+}
+
+
+/* Return the secret key for the key of ROW or NULL.  For keys from
+   the key cache the cached key itself is returned.  */
+static gpgme_key_t
+lookup_seckey (GpaKeyListModel *model, struct keylist_model_row_s *row)
+{
+  if (model->public_only || is_zero_fpr (row->key->subkeys->fpr))
+    return NULL;
+
+  if (row->cached)
+    return row->cached_secret? row->key : NULL;
+
+  return gpa_keytable_lookup_key (gpa_keytable_get_secret_instance (),
+                                  row->key->subkeys->fpr);
+}
+
+
+/* Return the user ID of KEY as displayed.  */
+static char *
+get_userid (gpgme_key_t key)
+{
+  if (key->protocol == GPGME_PROTOCOL_CMS)
+    return gpa_format_dn (key->uids? key->uids->uid : NULL);
+  else
+    return gpa_gpgme_key_get_userid (key->uids);
+}
+
+
+/* Return the expiration time of KEY with "no expiration" mapped to a
+   large value for sorting.  */
+static gulong
+get_expiry_value (gpgme_key_t key)
+{
+  return key->subkeys->expires ? key->subkeys->expires : G_MAXULONG;
+}
+
+
+/* Return a validity value for KEY suitable for sorting.  This
+   includes a hack for forcing revoked and expired keys to a range
+   outside the usual validity values.  */
+static long
+get_validity_value (gpgme_key_t key)
+{
+  if (key->subkeys->revoked)
+    return GPGME_VALIDITY_UNKNOWN-2;
+  else if (key->subkeys->expired)
+    return GPGME_VALIDITY_UNKNOWN-1;
+  else if (key->uids)
+    return key->uids->validity;
+  else
+    return GPGME_VALIDITY_UNKNOWN;
+}
+
+
+/* Release the cached cell texts of ROW.  */
+static void
+uncache_row (GpaKeyListModel *model, struct keylist_model_row_s *row)
+{
+  if (row->cache_slot == -1)
+    return;
+
+  model->cache[row->cache_slot] = NULL;
+  row->cache_slot = -1;
+  g_free (row->created);
+  row->created = NULL;
+  g_free (row->expiry);
+  row->expiry = NULL;
+  g_free (row->userid);
+  row->userid = NULL;
+}
+
+
+/* Make sure that the cell texts of ROW are available.  The oldest
+   cached row is evicted if the cache is full.  */
+static void
+cache_row (GpaKeyListModel *model, struct keylist_model_row_s *row)
+{
+  struct keylist_model_row_s *old;
+
+  if (row->cache_slot != -1)
+    return;
+
+  old = model->cache[model->cache_next];
+  if (old)
+    uncache_row (model, old);
+
+  row->created = gpa_creation_date_string (row->key->subkeys->timestamp);
+  row->expiry = gpa_expiry_date_string (row->key->subkeys->expires);
+  row->userid = get_userid (row->key);
+
+  row->cache_slot = model->cache_next;
+  model->cache[model->cache_next] = row;
+  model->cache_next = (model->cache_next + 1) % CACHED_ROWS;
+}
+
+
+static void
+free_row (GpaKeyListModel *model, struct keylist_model_row_s *row)
+{
+  uncache_row (model, row);
+  if (!row->cached)
+    gpgme_key_unref (row->key);
+  g_free (row->sort_key);
+  g_free (row);
+}
+
+
+/* Return true if the filter of MODEL accepts ROW.  */
+static gboolean
+row_is_visible (GpaKeyListModel *model, struct keylist_model_row_s *row)
+{
+  return !model->filter_func || model->filter_func (row->key,
+                                                    model->filter_data);
+}
+
+
+/* Point ITER to the row at position IDX.  Returns false if there is
+   no such row.  */
+static gboolean
+set_iter (GpaKeyListModel *model, GtkTreeIter *iter, gint idx)
+{
+  if (idx < 0 || idx >= (gint) model->rows->len)
+    {
+      iter->stamp = 0;
+      return FALSE;
+    }
+
+  iter->stamp = model->stamp;
+  iter->user_data = g_ptr_array_index (model->rows, idx);
+  iter->user_data2 = NULL;
+  iter->user_data3 = NULL;
+  return TRUE;
+}
+
+
+static gint
+compare_rows (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+  GpaKeyListModel *model = user_data;
+  struct keylist_model_row_s *ra = *(struct keylist_model_row_s **) a;
+  struct keylist_model_row_s *rb = *(struct keylist_model_row_s **) b;
+  gint result;
+
+  switch (model->sort_column_id)
+    {
+    case GPA_KEYLIST_COLUMN_IMAGE:
+    case GPA_KEYLIST_COLUMN_HAS_SECRET:
+      result = CMP (lookup_seckey (model, ra) != NULL,
+                    lookup_seckey (model, rb) != NULL);
+      break;
+    case GPA_KEYLIST_COLUMN_KEYTYPE:
+      result = CMP (ra->key->protocol, rb->key->protocol);
+      break;
+    case GPA_KEYLIST_COLUMN_CREATED:
+    case GPA_KEYLIST_COLUMN_CREATED_TS:
+      result = CMP (ra->key->subkeys->timestamp, rb->key->subkeys->timestamp);
+      break;
+    case GPA_KEYLIST_COLUMN_EXPIRY:
+    case GPA_KEYLIST_COLUMN_EXPIRY_TS:
+      result = CMP (get_expiry_value (ra->key), get_expiry_value (rb->key));
+      break;
+    case GPA_KEYLIST_COLUMN_OWNERTRUST:
+    case GPA_KEYLIST_COLUMN_OWNERTRUST_VALUE:
+      result = CMP (ra->key->owner_trust, rb->key->owner_trust);
+      break;
+    case GPA_KEYLIST_COLUMN_VALIDITY:
+    case GPA_KEYLIST_COLUMN_VALIDITY_VALUE:
+      result = CMP (get_validity_value (ra->key),
+                    get_validity_value (rb->key));
+      break;
+    case GPA_KEYLIST_COLUMN_USERID:
+      result = strcmp (ra->sort_key, rb->sort_key);
+      break;
+    default:
+      result = 0;
+      break;
+    }
+
+  if (model->sort_order == GTK_SORT_DESCENDING)
+    result = -result;
+
+  /* Keep the previous order of equal rows.  */
+  if (!result)
+    result = CMP (ra->pos, rb->pos);
+
+  return result;
+}
+
+
+/* Sort the rows according to the current sort column.  */
+static void
+resort (GpaKeyListModel *model)
+{
+  struct keylist_model_row_s *row;
+  GtkTreePath *path;
+  gint *new_order;
+  guint i, n;
+
+  if (model->resort_id)
+    {
+      g_source_remove (model->resort_id);
+      model->resort_id = 0;
+    }
+
+  n = model->rows->len;
+  if (n < 2 || model->sort_column_id < 0)
+    return;
+
+  /* Collating the user IDs on each comparison would be too slow, so
+     we compute the collation keys once.  */
+  if (model->sort_column_id == GPA_KEYLIST_COLUMN_USERID)
+    for (i = 0; i < n; i++)
+      {
+        char *userid;
+
+        row = g_ptr_array_index (model->rows, i);
+        userid = get_userid (row->key);
+        row->sort_key = g_utf8_collate_key (userid, -1);
+        g_free (userid);
+      }
+
+  g_ptr_array_sort_with_data (model->rows, compare_rows, model);
+
+  new_order = g_new (gint, n);
+  for (i = 0; i < n; i++)
+    {
+      row = g_ptr_array_index (model->rows, i);
+      new_order[i] = row->pos;
+      row->pos = i;
+      g_free (row->sort_key);
+      row->sort_key = NULL;
+    }
+
+  path = gtk_tree_path_new ();
+  gtk_tree_model_rows_reordered (GTK_TREE_MODEL (model), path, NULL,
+                                 new_order);
+  gtk_tree_path_free (path);
+  g_free (new_order);
+}
+
+
+static gboolean
+resort_idle (gpointer data)
+{
+  GpaKeyListModel *model = data;
+
+  model->resort_id = 0;
+  resort (model);
+
+  return FALSE;
+}
+
+
+/* Sort the rows once the main loop is idle.  Thus adding many rows
+   in a row only sorts once.  */
+static void
+schedule_resort (GpaKeyListModel *model)
+{
+  if (model->sort_column_id >= 0 && !model->sort_frozen
+      && !model->resort_id)
+    model->resort_id = g_idle_add (resort_idle, model);
+}
+
+
+
+/************************************************************
+ ******************  GtkTreeModel  **************************
+ ************************************************************/
+
+static GtkTreeModelFlags
+model_get_flags (GtkTreeModel *tree_model)
+{
+  return GTK_TREE_MODEL_ITERS_PERSIST | GTK_TREE_MODEL_LIST_ONLY;
+}
+
+
+static gint
+model_get_n_columns (GtkTreeModel *tree_model)
+{
+  return GPA_KEYLIST_N_COLUMNS;
+}
+
+
+static GType
+model_get_column_type (GtkTreeModel *tree_model, gint column)
+{
+  switch (column)
+    {
+    case GPA_KEYLIST_COLUMN_KEY:
+      return G_TYPE_POINTER;
+    case GPA_KEYLIST_COLUMN_HAS_SECRET:
+      return G_TYPE_INT;
+    case GPA_KEYLIST_COLUMN_CREATED_TS:
+    case GPA_KEYLIST_COLUMN_EXPIRY_TS:
+    case GPA_KEYLIST_COLUMN_OWNERTRUST_VALUE:
+      return G_TYPE_ULONG;
+    case GPA_KEYLIST_COLUMN_VALIDITY_VALUE:
+      return G_TYPE_LONG;
+    default:
+      return G_TYPE_STRING;
+    }
+}
+
+
+static gboolean
+model_get_iter (GtkTreeModel *tree_model, GtkTreeIter *iter,
+                GtkTreePath *path)
+{
+  GpaKeyListModel *model = GPA_KEYLIST_MODEL (tree_model);
+
+  if (gtk_tree_path_get_depth (path) != 1)
+    {
+      iter->stamp = 0;
+      return FALSE;
+    }
+
+  return set_iter (model, iter, gtk_tree_path_get_indices (path)[0]);
+}
+
+
+static GtkTreePath *
+model_get_path (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+  GpaKeyListModel *model = GPA_KEYLIST_MODEL (tree_model);
+  struct keylist_model_row_s *row;
+
+  g_return_val_if_fail (iter->stamp == model->stamp, NULL);
+
+  row = iter->user_data;
+  return gtk_tree_path_new_from_indices (row->pos, -1);
+}
+
+
+static void
+model_get_value (GtkTreeModel *tree_model, GtkTreeIter *iter, gint column,
+                 GValue *value)
+{
+  GpaKeyListModel *model = GPA_KEYLIST_MODEL (tree_model);
+  struct keylist_model_row_s *row;
+  gpgme_key_t key;
+
+  g_return_if_fail (iter->stamp == model->stamp);
+  g_return_if_fail (column >= 0 && column < GPA_KEYLIST_N_COLUMNS);
+
+  row = iter->user_data;
+  key = row->key;
+  g_value_init (value, model_get_column_type (tree_model, column));
+
+  switch (column)
+    {
+    case GPA_KEYLIST_COLUMN_IMAGE:
+      /* Provide the image only if enabled.  */
+      if (!model->public_only)
+        g_value_set_static_string (value,
+                                   get_key_pixbuf (lookup_seckey (model,
+                                                                  row)));
+      break;
+    case GPA_KEYLIST_COLUMN_KEYTYPE:
+      g_value_set_static_string
+        (value, (key->protocol == GPGME_PROTOCOL_OpenPGP? "P" :
+                 key->protocol == GPGME_PROTOCOL_CMS? "X" : "?"));
+      break;
+    case GPA_KEYLIST_COLUMN_CREATED:
+      cache_row (model, row);
+      g_value_set_string (value, row->created);
+      break;
+    case GPA_KEYLIST_COLUMN_EXPIRY:
+      cache_row (model, row);
+      g_value_set_string (value, row->expiry);
+      break;
+    case GPA_KEYLIST_COLUMN_OWNERTRUST:
+      g_value_set_string (value, gpa_key_ownertrust_string (key));
+      break;
+    case GPA_KEYLIST_COLUMN_VALIDITY:
+      g_value_set_string (value, gpa_key_validity_string (key));
+      break;
+    case GPA_KEYLIST_COLUMN_USERID:
+      cache_row (model, row);
+      g_value_set_string (value, row->userid);
+      break;
+    case GPA_KEYLIST_COLUMN_KEY:
+      /* Keys from the key cache are not real keys.  */
+      g_value_set_pointer (value, row->cached? NULL : key);
+      break;
+    case GPA_KEYLIST_COLUMN_HAS_SECRET:
+      g_value_set_int (value, lookup_seckey (model, row) != NULL);
+      break;
+    case GPA_KEYLIST_COLUMN_CREATED_TS:
+      g_value_set_ulong (value, key->subkeys->timestamp);
+      break;
+    case GPA_KEYLIST_COLUMN_EXPIRY_TS:
+      g_value_set_ulong (value, get_expiry_value (key));
+      break;
+    case GPA_KEYLIST_COLUMN_OWNERTRUST_VALUE:
+      g_value_set_ulong (value, key->owner_trust);
+      break;
+    case GPA_KEYLIST_COLUMN_VALIDITY_VALUE:
+      g_value_set_long (value, get_validity_value (key));
+      break;
+    }
+}
+
+
+static gboolean
+model_iter_next (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+  GpaKeyListModel *model = GPA_KEYLIST_MODEL (tree_model);
+  struct keylist_model_row_s *row = iter->user_data;
+
+  return set_iter (model, iter, (gint) row->pos + 1);
+}
+
+
+static gboolean
+model_iter_previous (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+  GpaKeyListModel *model = GPA_KEYLIST_MODEL (tree_model);
+  struct keylist_model_row_s *row = iter->user_data;
+
+  return set_iter (model, iter, (gint) row->pos - 1);
+}
+
+
+static gboolean
+model_iter_children (GtkTreeModel *tree_model, GtkTreeIter *iter,
+                     GtkTreeIter *parent)
+{
+  GpaKeyListModel *model = GPA_KEYLIST_MODEL (tree_model);
+
+  if (parent)
+    {
+      iter->stamp = 0;
+      return FALSE;
+    }
+
+  return set_iter (model, iter, 0);
+}
+
+
+static gboolean
+model_iter_has_child (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+  return FALSE;
+}
+
+
+static gint
+model_iter_n_children (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+  GpaKeyListModel *model = GPA_KEYLIST_MODEL (tree_model);
+
+  return iter? 0 : (gint) model->rows->len;
+}
+
+
+static gboolean
+model_iter_nth_child (GtkTreeModel *tree_model, GtkTreeIter *iter,
+                      GtkTreeIter *parent, gint n)
+{
+  GpaKeyListModel *model = GPA_KEYLIST_MODEL (tree_model);
+
+  if (parent)
+    {
+      iter->stamp = 0;
+      return FALSE;
+    }
+
+  return set_iter (model, iter, n);
+}
+
+
+static gboolean
+model_iter_parent (GtkTreeModel *tree_model, GtkTreeIter *iter,
+                   GtkTreeIter *child)
+{
+  iter->stamp = 0;
+  return FALSE;
+}
+
+
+static void
+gpa_keylist_model_tree_model_init (gpointer g_iface, gpointer iface_data)
+{
+  GtkTreeModelIface *iface = g_iface;
+
+  iface->get_flags = model_get_flags;
+  iface->get_n_columns = model_get_n_columns;
+  iface->get_column_type = model_get_column_type;
+  iface->get_iter = model_get_iter;
+  iface->get_path = model_get_path;
+  iface->get_value = model_get_value;
+  iface->iter_next = model_iter_next;
+  iface->iter_previous = model_iter_previous;
+  iface->iter_children = model_iter_children;
+  iface->iter_has_child = model_iter_has_child;
+  iface->iter_n_children = model_iter_n_children;
+  iface->iter_nth_child = model_iter_nth_child;
+  iface->iter_parent = model_iter_parent;
+}
+
+
+
+/************************************************************
+ ******************  GtkTreeSortable  ***********************
+ ************************************************************/
+
+static gboolean
+model_get_sort_column_id (GtkTreeSortable *sortable, gint *sort_column_id,
+                          GtkSortType *order)
+{
+  GpaKeyListModel *model = GPA_KEYLIST_MODEL (sortable);
+
+  if (sort_column_id)
+    *sort_column_id = model->sort_column_id;
+  if (order)
+    *order = model->sort_order;
+
+  return model->sort_column_id >= 0;
+}
+
+
+static void
+model_set_sort_column_id (GtkTreeSortable *sortable, gint sort_column_id,
+                          GtkSortType order)
+{
+  GpaKeyListModel *model = GPA_KEYLIST_MODEL (sortable);
+
+  if (model->sort_column_id == sort_column_id && model->sort_order == order)
+    return;
+
+  /* We don't have a default sort function; treat it as unsorted.  */
+  if (sort_column_id == GTK_TREE_SORTABLE_DEFAULT_SORT_COLUMN_ID)
+    sort_column_id = GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID;
+
+  model->sort_column_id = sort_column_id;
+  model->sort_order = order;
+  gtk_tree_sortable_sort_column_changed (sortable);
+  resort (model);
+}
+
+
+static void
+model_set_sort_func (GtkTreeSortable *sortable, gint sort_column_id,
+                     GtkTreeIterCompareFunc func, gpointer data,
+                     GDestroyNotify destroy)
+{
+  g_warning ("custom sort functions are not supported by GpaKeyListModel");
+}
+
+
+static void
+model_set_default_sort_func (GtkTreeSortable *sortable,
+                             GtkTreeIterCompareFunc func, gpointer data,
+                             GDestroyNotify destroy)
+{
+  g_warning ("custom sort functions are not supported by GpaKeyListModel");
+}
+
+
+static gboolean
+model_has_default_sort_func (GtkTreeSortable *sortable)
+{
+  return FALSE;
+}
+
+
+static void
+gpa_keylist_model_sortable_init (gpointer g_iface, gpointer iface_data)
+{
+  GtkTreeSortableIface *iface = g_iface;
+
+  iface->get_sort_column_id = model_get_sort_column_id;
+  iface->set_sort_column_id = model_set_sort_column_id;
+  iface->set_sort_func = model_set_sort_func;
+  iface->set_default_sort_func = model_set_default_sort_func;
+  iface->has_default_sort_func = model_has_default_sort_func;
+}
+
+
+
+/************************************************************
+ ******************  Object Management  *********************
+ ************************************************************/
+
+static void
+gpa_keylist_model_finalize (GObject *object)
+{
+  GpaKeyListModel *model = GPA_KEYLIST_MODEL (object);
+  guint i;
+
+  if (model->resort_id)
+    g_source_remove (model->resort_id);
+  for (i = 0; i < model->rows->len; i++)
+    free_row (model, g_ptr_array_index (model->rows, i));
+  g_ptr_array_free (model->rows, TRUE);
+  for (i = 0; i < model->hidden_rows->len; i++)
+    free_row (model, g_ptr_array_index (model->hidden_rows, i));
+  g_ptr_array_free (model->hidden_rows, TRUE);
+  g_free (model->cache);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+
+static void
+gpa_keylist_model_init (GTypeInstance *instance, void *class_ptr)
+{
+  GpaKeyListModel *model = GPA_KEYLIST_MODEL (instance);
+
+  model->stamp = g_random_int ();
+  model->rows = g_ptr_array_new ();
+  model->hidden_rows = g_ptr_array_new ();
+  model->sort_column_id = GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID;
+  model->sort_order = GTK_SORT_ASCENDING;
+  model->cache = g_new0 (struct keylist_model_row_s *, CACHED_ROWS);
+}
+
+
+static void
+gpa_keylist_model_class_init (void *class_ptr, void *class_data)
+{
+  GpaKeyListModelClass *klass = class_ptr;
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  parent_class = g_type_class_peek_parent (klass);
+
+  object_class->finalize = gpa_keylist_model_finalize;
+}
+
+
+GType
+gpa_keylist_model_get_type (void)
+{
+  static GType model_type = 0;
+
+  if (!model_type)
+    {
+      static const GTypeInfo model_info =
+      {
+        sizeof (GpaKeyListModelClass),
+        (GBaseInitFunc) NULL,
+        (GBaseFinalizeFunc) NULL,
+        gpa_keylist_model_class_init,
+        NULL,           /* class_finalize */
+        NULL,           /* class_data */
+        sizeof (GpaKeyListModel),
+        0,              /* n_preallocs */
+        gpa_keylist_model_init,
+      };
+      static const GInterfaceInfo tree_model_info =
+      {
+        gpa_keylist_model_tree_model_init,
+        NULL,           /* interface_finalize */
+        NULL,           /* interface_data */
+      };
+      static const GInterfaceInfo sortable_info =
+      {
+        gpa_keylist_model_sortable_init,
+        NULL,           /* interface_finalize */
+        NULL,           /* interface_data */
+      };
+
+      model_type = g_type_register_static (G_TYPE_OBJECT,
+                                           "GpaKeyListModel",
+                                           &model_info, 0);
+      g_type_add_interface_static (model_type, GTK_TYPE_TREE_MODEL,
+                                   &tree_model_info);
+      g_type_add_interface_static (model_type, GTK_TYPE_TREE_SORTABLE,
+                                   &sortable_info);
+    }
+
+  return model_type;
+}
+
+
+
+/************************************************************
+ **********************  Public API  ************************
+ ************************************************************/
+
+/* Create a new empty key list model.  If PUBLIC_ONLY is set no
+   secret key information is provided.  */
+GpaKeyListModel *
+gpa_keylist_model_new (gboolean public_only)
+{
+  GpaKeyListModel *model;
+
+  model = g_object_new (GPA_KEYLIST_MODEL_TYPE, NULL);
+  model->public_only = public_only;
+
+  return model;
+}
+
+
+/* Change the public-only mode of MODEL.  */
+void
+gpa_keylist_model_set_public_only (GpaKeyListModel *model,
+                                   gboolean public_only)
+{
+  g_return_if_fail (GPA_IS_KEYLIST_MODEL (model));
+
+  model->public_only = public_only;
+}
+
+
+/* Do not sort rows added to MODEL until gpa_keylist_model_thaw_sort
+   is called.  This is used while loading many keys.  */
+void
+gpa_keylist_model_freeze_sort (GpaKeyListModel *model)
+{
+  g_return_if_fail (GPA_IS_KEYLIST_MODEL (model));
+
+  model->sort_frozen = TRUE;
+  if (model->resort_id)
+    {
+      g_source_remove (model->resort_id);
+      model->resort_id = 0;
+    }
+}
+
+
+/* Sort all rows of MODEL and keep new rows sorted again.  */
+void
+gpa_keylist_model_thaw_sort (GpaKeyListModel *model)
+{
+  g_return_if_fail (GPA_IS_KEYLIST_MODEL (model));
+
+  if (!model->sort_frozen)
+    return;
+  model->sort_frozen = FALSE;
+  resort (model);
+}
+
+
+static void
+append_row (GpaKeyListModel *model, struct keylist_model_row_s *row,
+            GtkTreeIter *iter)
+{
+  GtkTreePath *path;
+
+  row->cache_slot = -1;
+  iter->stamp = model->stamp;
+  iter->user_data = row;
+  iter->user_data2 = NULL;
+  iter->user_data3 = NULL;
+
+  if (!row_is_visible (model, row))
+    {
+      /* Hidden rows are not announced to the view.  */
+      row->hidden = TRUE;
+      row->pos = model->hidden_rows->len;
+      g_ptr_array_add (model->hidden_rows, row);
+      return;
+    }
+
+  row->pos = model->rows->len;
+  g_ptr_array_add (model->rows, row);
+
+  path = gtk_tree_path_new_from_indices (row->pos, -1);
+  gtk_tree_model_row_inserted (GTK_TREE_MODEL (model), path, iter);
+  gtk_tree_path_free (path);
+
+  schedule_resort (model);
+}
+
+
+/* Append a row for KEY to MODEL and store it at ITER.  This function
+   takes ownership of KEY.  If the model is sorted the row is moved
+   to its place once the main loop is idle.  */
+void
+gpa_keylist_model_append (GpaKeyListModel *model, gpgme_key_t key,
+                          GtkTreeIter *iter)
+{
+  struct keylist_model_row_s *row;
+
+  g_return_if_fail (GPA_IS_KEYLIST_MODEL (model));
+  g_return_if_fail (key);
+
+  row = g_new0 (struct keylist_model_row_s, 1);
+  row->key = key;
+  append_row (model, row, iter);
+}
+
+
+/* Append a row for the key KEY from the key cache to MODEL and store
+   it at ITER.  HAS_SECRET tells whether there is a secret key for
+   it.  KEY must stay valid until the row is removed or its key is
+   replaced using gpa_keylist_model_set_key.  */
+void
+gpa_keylist_model_append_cached (GpaKeyListModel *model, gpgme_key_t key,
+                                 gboolean has_secret, GtkTreeIter *iter)
+{
+  struct keylist_model_row_s *row;
+
+  g_return_if_fail (GPA_IS_KEYLIST_MODEL (model));
+  g_return_if_fail (key);
+
+  row = g_new0 (struct keylist_model_row_s, 1);
+  row->key = key;
+  row->cached = TRUE;
+  row->cached_secret = has_secret;
+  append_row (model, row, iter);
+}
+
+
+/* Replace the key of the row ITER by KEY.  This function takes
+   ownership of KEY.  */
+void
+gpa_keylist_model_set_key (GpaKeyListModel *model, GtkTreeIter *iter,
+                           gpgme_key_t key)
+{
+  struct keylist_model_row_s *row;
+  GtkTreePath *path;
+
+  g_return_if_fail (GPA_IS_KEYLIST_MODEL (model));
+  g_return_if_fail (iter->stamp == model->stamp);
+
+  row = iter->user_data;
+  uncache_row (model, row);
+  if (!row->cached)
+    gpgme_key_unref (row->key);
+  row->key = key;
+  row->cached = FALSE;
+  if (row->hidden)
+    return;
+
+  path = gtk_tree_path_new_from_indices (row->pos, -1);
+  gtk_tree_model_row_changed (GTK_TREE_MODEL (model), path, iter);
+  gtk_tree_path_free (path);
+
+  schedule_resort (model);
+}
+
+
+/* Remove the row ITER from MODEL.  */
+void
+gpa_keylist_model_remove (GpaKeyListModel *model, GtkTreeIter *iter)
+{
+  struct keylist_model_row_s *row;
+  GtkTreePath *path;
+  guint i;
+
+  g_return_if_fail (GPA_IS_KEYLIST_MODEL (model));
+  g_return_if_fail (iter->stamp == model->stamp);
+
+  row = iter->user_data;
+  iter->stamp = 0;
+  if (row->hidden)
+    {
+      /* The order of the hidden rows does not matter.  */
+      g_ptr_array_remove_index_fast (model->hidden_rows, row->pos);
+      if (row->pos < model->hidden_rows->len)
+        ((struct keylist_model_row_s *)
+         g_ptr_array_index (model->hidden_rows, row->pos))->pos = row->pos;
+      free_row (model, row);
+      return;
+    }
+
+  path = gtk_tree_path_new_from_indices (row->pos, -1);
+  g_ptr_array_remove_index (model->rows, row->pos);
+  for (i = row->pos; i < model->rows->len; i++)
+    ((struct keylist_model_row_s *)
+     g_ptr_array_index (model->rows, i))->pos = i;
+  free_row (model, row);
+
+  gtk_tree_model_row_deleted (GTK_TREE_MODEL (model), path);
+  gtk_tree_path_free (path);
+}
+
+
+/* Remove all rows from MODEL.  */
+void
+gpa_keylist_model_clear (GpaKeyListModel *model)
+{
+  GtkTreePath *path;
+  guint pos;
+
+  g_return_if_fail (GPA_IS_KEYLIST_MODEL (model));
+
+  if (model->resort_id)
+    {
+      g_source_remove (model->resort_id);
+      model->resort_id = 0;
+    }
+
+  for (pos = 0; pos < model->hidden_rows->len; pos++)
+    free_row (model, g_ptr_array_index (model->hidden_rows, pos));
+  g_ptr_array_set_size (model->hidden_rows, 0);
+
+  /* Removing from the end does not require renumbering.  */
+  while (model->rows->len)
+    {
+      pos = model->rows->len - 1;
+      free_row (model, g_ptr_array_index (model->rows, pos));
+      g_ptr_array_set_size (model->rows, pos);
+
+      path = gtk_tree_path_new_from_indices (pos, -1);
+      gtk_tree_model_row_deleted (GTK_TREE_MODEL (model), path);
+      gtk_tree_path_free (path);
+    }
+}
+
+
+/* Return the key of the row ITER.  The key belongs to MODEL.  NULL
+   is returned for a row from the key cache.  */
+gpgme_key_t
+gpa_keylist_model_get_key (GpaKeyListModel *model, GtkTreeIter *iter)
+{
+  struct keylist_model_row_s *row;
+
+  g_return_val_if_fail (GPA_IS_KEYLIST_MODEL (model), NULL);
+  g_return_val_if_fail (iter->stamp == model->stamp, NULL);
+
+  row = iter->user_data;
+  return row->cached? NULL : row->key;
+}
+
+
+/* Return true if the row ITER is not hidden by the filter of
+   MODEL.  */
+gboolean
+gpa_keylist_model_is_visible (GpaKeyListModel *model, GtkTreeIter *iter)
+{
+  struct keylist_model_row_s *row;
+
+  g_return_val_if_fail (GPA_IS_KEYLIST_MODEL (model), FALSE);
+  g_return_val_if_fail (iter->stamp == model->stamp, FALSE);
+
+  row = iter->user_data;
+  return !row->hidden;
+}
+
+
+/* Show only the rows of MODEL for whose key FUNC returns true; FUNC
+   is called with DATA as second argument.  If FUNC is NULL all rows
+   are shown.  The rows are not announced one by one, thus MODEL must
+   not be attached to a view while calling this function.  Iterators
+   stay valid.  */
+void
+gpa_keylist_model_set_filter (GpaKeyListModel *model,
+                              GpaKeyListModelFilterFunc func, gpointer data)
+{
+  GPtrArray *rows, *hidden_rows;
+  struct keylist_model_row_s *row;
+  guint i;
+
+  g_return_if_fail (GPA_IS_KEYLIST_MODEL (model));
+
+  model->filter_func = func;
+  model->filter_data = data;
+
+  rows = g_ptr_array_sized_new (model->rows->len);
+  hidden_rows = g_ptr_array_new ();
+  for (i = 0; i < model->rows->len + model->hidden_rows->len; i++)
+    {
+      if (i < model->rows->len)
+        row = g_ptr_array_index (model->rows, i);
+      else
+        row = g_ptr_array_index (model->hidden_rows, i - model->rows->len);
+
+      row->hidden = !row_is_visible (model, row);
+      if (row->hidden)
+        {
+          row->pos = hidden_rows->len;
+          g_ptr_array_add (hidden_rows, row);
+        }
+      else
+        {
+          row->pos = rows->len;
+          g_ptr_array_add (rows, row);
+        }
+    }
+  g_ptr_array_free (model->rows, TRUE);
+  g_ptr_array_free (model->hidden_rows, TRUE);
+  model->rows = rows;
+  model->hidden_rows = hidden_rows;
+
+  /* Rows shown again are at the end.  */
+  if (!model->sort_frozen)
+    resort (model);
+}
@@ -0,0 +1,154 @@
+/* keylistmodel.h - The GNU Privacy Assistant key list model.
+   Copyright (C) 2026 g10 Code GmbH.
+
+   This file is part of GPA
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GPA_KEYLIST_MODEL_H
+#define GPA_KEYLIST_MODEL_H
+
+#include <gtk/gtk.h>
+#include <gpgme.h>
+
+/* Symbols to access the columns.  */
+typedef enum
+{
+  /* These are the displayed columns */
+  GPA_KEYLIST_COLUMN_IMAGE,
+  GPA_KEYLIST_COLUMN_KEYTYPE,
+  GPA_KEYLIST_COLUMN_CREATED,
+  GPA_KEYLIST_COLUMN_EXPIRY,
+  GPA_KEYLIST_COLUMN_OWNERTRUST,
+  GPA_KEYLIST_COLUMN_VALIDITY,
+  GPA_KEYLIST_COLUMN_USERID,
+  /* This column contains the gpgme_key_t */
+  GPA_KEYLIST_COLUMN_KEY,
+  /* These columns are used only internally for sorting */
+  GPA_KEYLIST_COLUMN_HAS_SECRET,
+  GPA_KEYLIST_COLUMN_CREATED_TS,
+  GPA_KEYLIST_COLUMN_EXPIRY_TS,
+  GPA_KEYLIST_COLUMN_OWNERTRUST_VALUE,
+  GPA_KEYLIST_COLUMN_VALIDITY_VALUE,
+  GPA_KEYLIST_N_COLUMNS
+} GpaKeyListColumn;
+
+
+/* GObject stuff */
+#define GPA_KEYLIST_MODEL_TYPE	  (gpa_keylist_model_get_type ())
+#define GPA_KEYLIST_MODEL(obj)	  (G_TYPE_CHECK_INSTANCE_CAST ((obj), GPA_KEYLIST_MODEL_TYPE, GpaKeyListModel))
+#define GPA_KEYLIST_MODEL_CLASS(klass)  (G_TYPE_CHECK_CLASS_CAST ((klass), GPA_KEYLIST_MODEL_TYPE, GpaKeyListModelClass))
+#define GPA_IS_KEYLIST_MODEL(obj)	  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GPA_KEYLIST_MODEL_TYPE))
+#define GPA_IS_KEYLIST_MODEL_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), GPA_KEYLIST_MODEL_TYPE))
+#define GPA_KEYLIST_MODEL_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), GPA_KEYLIST_MODEL_TYPE, GpaKeyListModelClass))
+
+typedef struct _GpaKeyListModel GpaKeyListModel;
+typedef struct _GpaKeyListModelClass GpaKeyListModelClass;
+
+struct keylist_model_row_s;
+
+/* A function deciding whether the row of KEY is shown.  */
+typedef gboolean (*GpaKeyListModelFilterFunc) (gpgme_key_t key,
+                                               gpointer data);
+
+struct _GpaKeyListModel {
+  GObject parent;
+
+  /* Private: Do not use!  */
+  gint stamp;
+  gboolean public_only;
+  /* The rows in display order.  */
+  GPtrArray *rows;
+  /* The rows hidden by the filter in no particular order.  */
+  GPtrArray *hidden_rows;
+  /* The filter function and its data or NULL.  */
+  GpaKeyListModelFilterFunc filter_func;
+  gpointer filter_data;
+  /* The current sort column and order.  */
+  gint sort_column_id;
+  GtkSortType sort_order;
+  /* ID of the idle handler which resorts the rows or 0.  */
+  guint resort_id;
+  /* True if new rows are not to be sorted.  */
+  gboolean sort_frozen;
+  /* A ring of the rows which have their cell texts cached.  */
+  struct keylist_model_row_s **cache;
+  guint cache_next;
+};
+
+struct _GpaKeyListModelClass {
+  GObjectClass parent_class;
+};
+
+GType gpa_keylist_model_get_type (void) G_GNUC_CONST;
+
+/* API */
+
+/* Create a new empty key list model.  If PUBLIC_ONLY is set no
+   secret key information is provided.  */
+GpaKeyListModel *gpa_keylist_model_new (gboolean public_only);
+
+/* Change the public-only mode of MODEL.  */
+void gpa_keylist_model_set_public_only (GpaKeyListModel *model,
+                                        gboolean public_only);
+
+/* Do not sort rows added to MODEL until gpa_keylist_model_thaw_sort
+   is called.  */
+void gpa_keylist_model_freeze_sort (GpaKeyListModel *model);
+
+/* Sort all rows of MODEL and keep new rows sorted again.  */
+void gpa_keylist_model_thaw_sort (GpaKeyListModel *model);
+
+/* Append a row for KEY to MODEL and store it at ITER.  This function
+   takes ownership of KEY.  */
+void gpa_keylist_model_append (GpaKeyListModel *model, gpgme_key_t key,
+                               GtkTreeIter *iter);
+
+/* Append a row for the key KEY from the key cache to MODEL and store
+   it at ITER.  HAS_SECRET tells whether there is a secret key for
+   it.  KEY must stay valid until the row is removed or its key is
+   replaced.  */
+void gpa_keylist_model_append_cached (GpaKeyListModel *model,
+                                      gpgme_key_t key, gboolean has_secret,
+                                      GtkTreeIter *iter);
+
+/* Replace the key of the row ITER by KEY.  This function takes
+   ownership of KEY.  */
+void gpa_keylist_model_set_key (GpaKeyListModel *model, GtkTreeIter *iter,
+                                gpgme_key_t key);
+
+/* Remove the row ITER from MODEL.  */
+void gpa_keylist_model_remove (GpaKeyListModel *model, GtkTreeIter *iter);
+
+/* Remove all rows from MODEL.  */
+void gpa_keylist_model_clear (GpaKeyListModel *model);
+
+/* Return the key of the row ITER.  The key belongs to MODEL.  NULL
+   is returned for a row from the key cache.  */
+gpgme_key_t gpa_keylist_model_get_key (GpaKeyListModel *model,
+                                       GtkTreeIter *iter);
+
+/* Return true if the row ITER is not hidden by the filter of
+   MODEL.  */
+gboolean gpa_keylist_model_is_visible (GpaKeyListModel *model,
+                                       GtkTreeIter *iter);
+
+/* Show only the rows of MODEL for whose key FUNC returns true.  MODEL
+   must not be attached to a view while calling this function.  */
+void gpa_keylist_model_set_filter (GpaKeyListModel *model,
+                                   GpaKeyListModelFilterFunc func,
+                                   gpointer data);
+
+#endif /* GPA_KEYLIST_MODEL_H */
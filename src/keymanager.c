@@ -141,6 +141,8 @@ typedef gboolean (*sensitivity_func_t) (gpointer);
 /* Local prototypes */
 static int idle_update_details (gpointer param);
 static void keyring_update_details (GpaKeyManager *self);
+static void key_manager_selection_changed (GtkTreeSelection *treeselection,
+                                           gpointer param);
 
 static void gpa_key_manager_finalize (GObject *object);
 
@@ -297,21 +299,82 @@ gpa_key_manager_changed_wot_cb (gpointer data)
 }
 
 
+/* Update the keys with the fingerprints FPRS after an import.  */
 static void
-gpa_key_manager_changed_wot_secret_cb (gpointer data)
+gpa_key_manager_imported_keys_cb (gpointer data, const char **fprs)
 {
   GpaKeyManager *self = data;
 
-  gpa_keylist_imported_secret_key (self->keylist);
-  gpa_keylist_start_reload (self->keylist);
+  gpa_keylist_update_keys (self->keylist, fprs);
+}
+
+/* Return a NULL terminated array with the fingerprints of KEYS.  */
+static char **
+get_key_fprs (GList *keys)
+{
+  char **fprs;
+  int i;
+
+  fprs = g_new (char *, g_list_length (keys) + 1);
+  for (i = 0; keys; keys = g_list_next (keys))
+    {
+      gpgme_key_t key = keys->data;
+
+      if (key && key->subkeys && key->subkeys->fpr)
+        fprs[i++] = g_strdup (key->subkeys->fpr);
+    }
+  fprs[i] = NULL;
+
+  return fprs;
+}
+
+
+/* The keys of OP have been changed.  Unless one of them is a trusted
+   introducer, the validity of other keys is not affected and only
+   those keys need to be reloaded.  */
+static void
+gpa_key_manager_changed_keys_cb (gpointer data, GpaKeyOperation *op)
+{
+  GpaKeyManager *self = data;
+  GList *keys = gpa_key_operation_keys (op);
+  GList *cur;
+  char **fprs;
+
+  for (cur = keys; cur; cur = g_list_next (cur))
+    {
+      gpgme_key_t key = cur->data;
+
+      if (key->protocol == GPGME_PROTOCOL_OpenPGP
+          && key->owner_trust >= GPGME_VALIDITY_MARGINAL)
+        {
+          gpa_keylist_start_reload (self->keylist);
+          return;
+        }
+    }
+
+  fprs = get_key_fprs (keys);
+  gpa_keylist_update_keys (self->keylist, (const char **) fprs);
+  g_strfreev (fprs);
 }
 
+
 static void
 gpa_key_manager_key_modified (GpaKeyEditDialog *dialog, gpgme_key_t key,
 				 gpointer data)
 {
   GpaKeyManager *self = data;
-  gpa_keylist_start_reload (self->keylist);
+  const char *fprs[2] = { NULL, NULL };
+
+  /* Extending the expiration date of an expired key may make other
+     keys valid again.  */
+  if (!key || !key->subkeys || key->expired)
+    {
+      gpa_keylist_start_reload (self->keylist);
+      return;
+    }
+
+  fprs[0] = key->subkeys->fpr;
+  gpa_keylist_update_keys (self->keylist, fprs);
 }
 
 
@@ -326,12 +389,21 @@ gpa_key_manager_new_key_cb (gpointer data, const gchar *fpr)
 }
 
 
+/* Register a key operation.  If AFFECTS_WOT is set, the operation may
+   change the validity of other keys than those it operates on and
+   thus the entire keyring is reloaded after it.  */
 static void
-register_key_operation (GpaKeyManager *self, GpaKeyOperation *op)
+register_key_operation (GpaKeyManager *self, GpaKeyOperation *op,
+                        gboolean affects_wot)
 {
-  g_signal_connect_swapped (G_OBJECT (op), "changed_wot",
-			    G_CALLBACK (gpa_key_manager_changed_wot_cb),
-			    self);
+  if (affects_wot)
+    g_signal_connect_swapped (G_OBJECT (op), "changed_wot",
+                              G_CALLBACK (gpa_key_manager_changed_wot_cb),
+                              self);
+  else
+    g_signal_connect_swapped (G_OBJECT (op), "changed_wot",
+                              G_CALLBACK (gpa_key_manager_changed_keys_cb),
+                              self);
   g_signal_connect (G_OBJECT (op), "completed",
 		    G_CALLBACK (g_object_unref), self);
 }
@@ -341,12 +413,11 @@ static void
 register_import_operation (GpaKeyManager *self, GpaImportOperation *op)
 {
   g_signal_connect_swapped (G_OBJECT (op), "imported_keys",
-			    G_CALLBACK (gpa_key_manager_changed_wot_cb),
+			    G_CALLBACK (gpa_key_manager_imported_keys_cb),
+			    self);
+  g_signal_connect_swapped (G_OBJECT (op), "imported_secret_keys",
+			    G_CALLBACK (gpa_key_manager_imported_keys_cb),
 			    self);
-  g_signal_connect_swapped
-    (G_OBJECT (op), "imported_secret_keys",
-     G_CALLBACK (gpa_key_manager_changed_wot_secret_cb),
-     self);
   g_signal_connect (G_OBJECT (op), "completed",
 		    G_CALLBACK (g_object_unref), self);
 }
@@ -380,7 +451,7 @@ key_manager_delete (GSimpleAction *simple, GVariant *parameter, gpointer param)
                                                     GPGME_PROTOCOL_UNKNOWN);
   GpaKeyDeleteOperation *op = gpa_key_delete_operation_new (GTK_WIDGET (self),
 							    selection);
-  register_key_operation (self, GPA_KEY_OPERATION (op));
+  register_key_operation (self, GPA_KEY_OPERATION (op), FALSE);
 }
 
 
@@ -458,7 +529,7 @@ key_manager_sign (GSimpleAction *simple, GVariant *parameter, gpointer param)
   if (selection)
     {
       op = gpa_key_sign_operation_new (GTK_WIDGET (self), selection);
-      register_key_operation (self, GPA_KEY_OPERATION (op));
+      register_key_operation (self, GPA_KEY_OPERATION (op), FALSE);
     }
 }
 
@@ -502,7 +573,7 @@ key_manager_trust (GSimpleAction *simple, GVariant *parameter, gpointer param)
   if (selection)
     {
       op = gpa_key_trust_operation_new (GTK_WIDGET (self), selection);
-      register_key_operation (self, GPA_KEY_OPERATION (op));
+      register_key_operation (self, GPA_KEY_OPERATION (op), TRUE);
     }
 }
 
@@ -681,6 +752,15 @@ key_manager_key_listed (GpaContext *ctx, gpgme_key_t key, gpointer param)
 }
 
 
+/* Signal handler for the end of a key list update.  Reload the
+   details of the selected key, which may have been updated.  */
+static void
+key_manager_keys_updated (GpaKeyList *keylist, gpointer param)
+{
+  key_manager_selection_changed (NULL, param);
+}
+
+
 /* FIXME: CHECK! Signal handler for selection changes. */
 static void
 key_manager_selection_changed (GtkTreeSelection *treeselection,
@@ -747,6 +827,18 @@ key_manager_selection_changed (GtkTreeSelection *treeselection,
 }
 
 
+/* Signal handler for the "search-changed" signal of the filter
+   entry.  */
+static void
+key_manager_filter_changed (GtkSearchEntry *entry, gpointer param)
+{
+  GpaKeyManager *self = param;
+
+  gpa_keylist_set_filter (self->keylist,
+                          gtk_entry_get_text (GTK_ENTRY (entry)));
+}
+
+
 /* FIXME:  CHECK THIS!
    Signal handler for the map signal.  If the simplified_ui flag is
    set and there's no private key in the key ring, ask the user
@@ -963,10 +1055,8 @@ key_manager_refresh (GSimpleAction *simple, GVariant *parameter, gpointer user_d
   GpaKeyManager *self = user_data;
 
   /* Hack: To force reloading of secret keys we claim that a secret
-     key has been imported.  */
+     key has been imported.  This also reloads the key list.  */
   gpa_keylist_imported_secret_key (self->keylist);
-
-  gpa_keylist_start_reload (self->keylist);
 }
 
 
@@ -1751,6 +1841,7 @@ construct_widgets (GpaKeyManager *self)
   GtkWidget *toolbar;
   GtkWidget *hbox;
   GtkWidget *icon;
+  GtkWidget *entry;
   GtkWidget *paned;
   GtkWidget *statusbar;
   GtkWidget *main_box;
@@ -1815,6 +1906,7 @@ construct_widgets (GpaKeyManager *self)
 
   keylist = gpa_keylist_new (GTK_WIDGET (self));
   self->keylist = GPA_KEYLIST (keylist);
+  gpa_keylist_use_key_cache (self->keylist);
   if (gpa_options_get_detailed_view (gpa_options_get_instance()))
     gpa_keylist_set_detailed (self->keylist);
   else
@@ -1824,6 +1916,17 @@ construct_widgets (GpaKeyManager *self)
 
   gtk_menu_attach_to_widget (GTK_MENU (self->popup_menu), GTK_WIDGET (keylist), NULL);
 
+  /* A live filter for the key list.  */
+  entry = gtk_search_entry_new ();
+  gtk_entry_set_placeholder_text (GTK_ENTRY (entry), _("Filter keys"));
+  gtk_widget_set_tooltip_text
+    (entry, _("Show only the keys with this text in a user ID,"
+              " key ID or fingerprint"));
+  gtk_widget_set_valign (entry, GTK_ALIGN_CENTER);
+  gtk_box_pack_end (GTK_BOX (hbox), entry, FALSE, TRUE, 5);
+  g_signal_connect (G_OBJECT (entry), "search-changed",
+                    G_CALLBACK (key_manager_filter_changed), self);
+
   g_signal_connect (G_OBJECT (gtk_tree_view_get_selection
 			      (GTK_TREE_VIEW (keylist))),
 		    "changed", G_CALLBACK (key_manager_selection_changed),
@@ -1832,6 +1935,9 @@ construct_widgets (GpaKeyManager *self)
   g_signal_connect_swapped (G_OBJECT (keylist), "button_press_event",
                             G_CALLBACK (display_popup_menu), self);
 
+  g_signal_connect (G_OBJECT (keylist), "keys_updated",
+		    G_CALLBACK (key_manager_keys_updated), self);
+
   self->details = gpa_key_details_new ();
   gtk_paned_pack2 (GTK_PANED (paned), self->details, TRUE, TRUE);
   gtk_paned_set_position (GTK_PANED (paned), 250);
@@ -1960,6 +2066,19 @@ gpa_key_manager_is_open (void)
 }
 
 
+/* Update the keys with the fingerprints given by the NULL terminated
+   array FPRS, for example after they have been imported.  This does
+   nothing if the key manager is not open.  */
+void
+gpa_key_manager_update_keys (const char **fprs)
+{
+  if (!this_instance || !fprs || !*fprs)
+    return;
+
+  gpa_keylist_update_keys (this_instance->keylist, fprs);
+}
+
+
 /* Return true if we should ask for a first time key generation.
  *
  * This function basically duplicates the conditions from
@@ -52,6 +52,8 @@ GtkWidget *gpa_key_manager_get_instance (gboolean *r_created);
 
 gboolean gpa_key_manager_is_open (void);
 
+void gpa_key_manager_update_keys (const char **fprs);
+
 gboolean key_manager_maybe_firsttime (void);
 
 
@@ -19,6 +19,7 @@
 
 #include <config.h>
 
+#include <string.h>
 #include <glib.h>
 #include <gtk/gtk.h>
 #include "gpa.h"
@@ -26,11 +27,47 @@
 #include "keytable.h"
 #include "gtktools.h"
 
+/* The maximum number of fingerprints passed to a single key listing
+   by gpa_keytable_reload_keys.  All keys are reloaded if more keys
+   are requested.  */
+#define MAX_RELOAD_PATTERNS 256
+
 /* Internal */
-static void first_half_done_cb (GpaContext *context, gpg_error_t err,
-                                GpaKeyTable *keytable);
+static void list_done_cb (GpaContext *context, gpg_error_t err,
+                          GpaKeyTable *keytable);
 static void next_key_cb (GpaContext *context, gpgme_key_t key,
 			 GpaKeyTable *keytable);
+static void clear_patterns (GpaKeyTable *keytable);
+static void release_waiters (GpaKeyTable *keytable);
+static void release_request (struct keytable_request_s *request);
+static void start_queued_requests (GpaKeyTable *keytable);
+
+/* The kinds of listing requests.  */
+enum request_type
+  {
+    REQUEST_LIST_KEYS,
+    REQUEST_FORCE_RELOAD,
+    REQUEST_LOAD_NEW,
+    REQUEST_RELOAD_KEYS
+  };
+
+/* A listing request waiting for the running listing to finish.  */
+struct keytable_request_s
+{
+  enum request_type type;
+  char **fprs;
+  GpaKeyTableNextFunc next;
+  GpaKeyTableEndFunc end;
+  gpointer data;
+};
+
+/* A lookup waiting for the keytable to be loaded.  */
+struct lookup_waiter_s
+{
+  char *fpr;
+  GpaKeyTableLookupFunc func;
+  gpointer data;
+};
 
 /* GObject type functions */
 
@@ -86,20 +123,35 @@ gpa_keytable_init (GpaKeyTable *keytable)
   keytable->next = NULL;
   keytable->end = NULL;
   keytable->data = NULL;
-  keytable->did_first_half = 0;
-  keytable->first_half_err = 0;
+  keytable->running = 0;
+  keytable->pgp_err = 0;
+  keytable->cms_err = 0;
   keytable->context = gpa_context_new ();
+  keytable->cms_context = NULL;
   keytable->keys = NULL;
   keytable->secret = FALSE;
   keytable->initialized = FALSE;
+  keytable->listing = FALSE;
   keytable->new_key = FALSE;
+  keytable->waiters = NULL;
+  g_queue_init (&keytable->requests);
+  keytable->requests_id = 0;
+  keytable->dispatching = FALSE;
   keytable->tmp_list = NULL;
+  keytable->cms_tmp_list = NULL;
+  keytable->patterns = NULL;
+  keytable->pending = NULL;
+  keytable->fpr_index = g_hash_table_new (g_str_hash, g_str_equal);
+  keytable->keyid_index = g_hash_table_new (g_str_hash, g_str_equal);
+  keytable->keygrip_index = g_hash_table_new (g_str_hash, g_str_equal);
+  keytable->search_index = NULL;
   /* Note, that the next_key and done signals are emitted by means of
      gpgme events with the help of gpacontext.c:gpa_context_event_cb.  */
+  gpgme_set_protocol (keytable->context->ctx, GPGME_PROTOCOL_OpenPGP);
   g_signal_connect (G_OBJECT (keytable->context), "next_key",
 		    G_CALLBACK (next_key_cb), keytable);
   g_signal_connect (G_OBJECT (keytable->context), "done",
-		    G_CALLBACK (first_half_done_cb), keytable);
+		    G_CALLBACK (list_done_cb), keytable);
 }
 
 static void
@@ -108,56 +160,233 @@ gpa_keytable_finalize (GObject *object)
   GpaKeyTable *keytable = GPA_KEYTABLE (object);
 
   g_object_unref (keytable->context);
+  if (keytable->cms_context)
+    g_object_unref (keytable->cms_context);
+  clear_patterns (keytable);
+  release_waiters (keytable);
+  if (keytable->requests_id)
+    g_source_remove (keytable->requests_id);
+  g_queue_foreach (&keytable->requests, (GFunc) release_request, NULL);
+  g_queue_clear (&keytable->requests);
+  g_hash_table_destroy (keytable->fpr_index);
+  g_hash_table_destroy (keytable->keyid_index);
+  g_hash_table_destroy (keytable->keygrip_index);
+  gpa_keyindex_release (keytable->search_index);
   g_list_foreach (keytable->keys, (GFunc) gpgme_key_unref, NULL);
   g_list_free (keytable->keys);
 }
 
 /* Internal functions */
 
+/* Add the key stored at LINK of the key list to the indices.  */
 static void
-reload_cache (GpaKeyTable *keytable, const char *fpr)
+index_key (GpaKeyTable *keytable, GList *link)
 {
-  gpg_error_t err;
+  gpgme_key_t key = link->data;
+  gpgme_subkey_t subkey;
 
-  /* We select the Open PGP protocol here.  At the end
-     first_half_done_cb will do another keylist_start for X,509.  */
-  keytable->did_first_half = 0;
-  keytable->first_half_err = 0;
-  keytable->fpr = fpr;
-  gpgme_set_protocol (keytable->context->ctx, GPGME_PROTOCOL_OpenPGP);
-  err = gpgme_op_keylist_start (keytable->context->ctx, fpr,
-				keytable->secret);
-  if (gpg_err_code (err) != GPG_ERR_NO_ERROR)
+  if (!key->subkeys || !key->subkeys->fpr)
+    return;
+
+  g_hash_table_replace (keytable->fpr_index, key->subkeys->fpr, link);
+  if (keytable->search_index)
+    gpa_keyindex_add (keytable->search_index, key);
+  for (subkey = key->subkeys; subkey; subkey = subkey->next)
     {
-      gpa_gpgme_warning (err);
-      if (keytable->end)
-	{
-	  keytable->end (keytable->data);
-	}
-      return;
+      if (subkey->keyid)
+        g_hash_table_replace (keytable->keyid_index, subkey->keyid, key);
+      if (subkey->keygrip)
+        g_hash_table_replace (keytable->keygrip_index, subkey->keygrip, key);
     }
-  keytable->tmp_list = NULL;
 }
 
+
+/* Remove KEY from the indices.  Entries which meanwhile refer to
+   another key with the same identifier are kept.  */
+static void
+unindex_key (GpaKeyTable *keytable, gpgme_key_t key)
+{
+  gpgme_subkey_t subkey;
+  GList *link;
+
+  if (!key->subkeys || !key->subkeys->fpr)
+    return;
+
+  link = g_hash_table_lookup (keytable->fpr_index, key->subkeys->fpr);
+  if (link && link->data == key)
+    {
+      g_hash_table_remove (keytable->fpr_index, key->subkeys->fpr);
+      if (keytable->search_index)
+        gpa_keyindex_remove (keytable->search_index, key->subkeys->fpr);
+    }
+  for (subkey = key->subkeys; subkey; subkey = subkey->next)
+    {
+      if (subkey->keyid
+          && g_hash_table_lookup (keytable->keyid_index, subkey->keyid) == key)
+        g_hash_table_remove (keytable->keyid_index, subkey->keyid);
+      if (subkey->keygrip
+          && g_hash_table_lookup (keytable->keygrip_index,
+                                  subkey->keygrip) == key)
+        g_hash_table_remove (keytable->keygrip_index, subkey->keygrip);
+    }
+}
+
+
+/* Rebuild all indices from the key list.  */
+static void
+rebuild_index (GpaKeyTable *keytable)
+{
+  GList *link;
+
+  g_hash_table_remove_all (keytable->fpr_index);
+  g_hash_table_remove_all (keytable->keyid_index);
+  g_hash_table_remove_all (keytable->keygrip_index);
+  if (keytable->search_index)
+    gpa_keyindex_clear (keytable->search_index);
+  for (link = keytable->keys; link; link = g_list_next (link))
+    index_key (keytable, link);
+}
+
+
+/* Release the patterns and the set of pending fingerprints of the
+   current listing.  */
+static void
+clear_patterns (GpaKeyTable *keytable)
+{
+  g_strfreev (keytable->patterns);
+  keytable->patterns = NULL;
+  if (keytable->pending)
+    {
+      g_hash_table_destroy (keytable->pending);
+      keytable->pending = NULL;
+    }
+}
+
+
+/* Hand the keys to all lookups waiting for the keytable to be
+   loaded.  */
+static void
+dispatch_waiters (GpaKeyTable *keytable)
+{
+  GList *waiters, *cur;
+
+  /* Detach the list first; the callbacks may start new lookups.  */
+  waiters = g_list_reverse (keytable->waiters);
+  keytable->waiters = NULL;
+  for (cur = waiters; cur; cur = g_list_next (cur))
+    {
+      struct lookup_waiter_s *waiter = cur->data;
+
+      waiter->func (gpa_keytable_lookup_key (keytable, waiter->fpr),
+                    waiter->data);
+      g_free (waiter->fpr);
+      g_free (waiter);
+    }
+  g_list_free (waiters);
+}
+
+
+/* Release all waiting lookups without calling them.  */
 static void
-done_cb (GpaContext *context, gpg_error_t err, GpaKeyTable *keytable)
+release_waiters (GpaKeyTable *keytable)
 {
-  if (err || keytable->first_half_err)
+  GList *cur;
+
+  for (cur = keytable->waiters; cur; cur = g_list_next (cur))
     {
-      if (keytable->first_half_err)
-        gpa_gpgme_warning (keytable->first_half_err);
-      if (err)
-        gpa_gpgme_warning (err);
+      struct lookup_waiter_s *waiter = cur->data;
+
+      g_free (waiter->fpr);
+      g_free (waiter);
+    }
+  g_list_free (keytable->waiters);
+  keytable->waiters = NULL;
+}
+
+
+/* Return the context used for listing X.509 keys.  It is created on
+   first use.  */
+static GpaContext *
+get_cms_context (GpaKeyTable *keytable)
+{
+  if (!keytable->cms_context)
+    {
+      keytable->cms_context = gpa_context_new ();
+      gpgme_set_protocol (keytable->cms_context->ctx, GPGME_PROTOCOL_CMS);
+      g_signal_connect (G_OBJECT (keytable->cms_context), "next_key",
+                        G_CALLBACK (next_key_cb), keytable);
+      g_signal_connect (G_OBJECT (keytable->cms_context), "done",
+                        G_CALLBACK (list_done_cb), keytable);
+    }
+  return keytable->cms_context;
+}
+
+
+/* Finish a listing after all contexts are done.  */
+static void
+done_cb (GpaKeyTable *keytable)
+{
+  GList *link;
+
+  if (keytable->pgp_err || keytable->cms_err)
+    {
+      if (keytable->pgp_err)
+        gpa_gpgme_warning (keytable->pgp_err);
+      if (keytable->cms_err)
+        gpa_gpgme_warning (keytable->cms_err);
+      g_list_foreach (keytable->tmp_list, (GFunc) gpgme_key_unref, NULL);
+      g_list_free (keytable->tmp_list);
+      keytable->tmp_list = NULL;
+      g_list_foreach (keytable->cms_tmp_list, (GFunc) gpgme_key_unref, NULL);
+      g_list_free (keytable->cms_tmp_list);
+      keytable->cms_tmp_list = NULL;
+      keytable->new_key = FALSE;
+      keytable->listing = FALSE;
+      clear_patterns (keytable);
+      keytable->dispatching = TRUE;
+      if (keytable->end)
+        keytable->end (keytable->data);
+      dispatch_waiters (keytable);
+      keytable->dispatching = FALSE;
+      start_queued_requests (keytable);
       return;
     }
-  /* Reverse the list to have the keys come up in the same order they
-   * were listed */
-  keytable->tmp_list = g_list_reverse (keytable->tmp_list);
+  /* Reverse the lists to have the keys come up in the same order they
+   * were listed.  The OpenPGP keys always go before the X.509 keys
+   * regardless of which listing finished first.  */
+  keytable->tmp_list = g_list_concat
+    (g_list_reverse (keytable->tmp_list),
+     g_list_reverse (keytable->cms_tmp_list));
+  keytable->cms_tmp_list = NULL;
   if (keytable->new_key)
     {
-      /* Append the new key(s)
+      /* Append the new key(s).  Keys which were already cached have
+       * been replaced in place by next_key_cb.
        */
+      for (link = keytable->tmp_list; link; link = g_list_next (link))
+        index_key (keytable, link);
       keytable->keys = g_list_concat (keytable->keys, keytable->tmp_list);
+
+      /* Requested keys which have not been listed are gone.  */
+      if (keytable->pending)
+        {
+          GHashTableIter iter;
+          gpointer fpr;
+
+          g_hash_table_iter_init (&iter, keytable->pending);
+          while (g_hash_table_iter_next (&iter, &fpr, NULL))
+            {
+              link = g_hash_table_lookup (keytable->fpr_index, fpr);
+              if (link)
+                {
+                  gpgme_key_t key = link->data;
+
+                  unindex_key (keytable, key);
+                  keytable->keys = g_list_delete_link (keytable->keys, link);
+                  gpgme_key_unref (key);
+                }
+            }
+        }
     }
   else
     {
@@ -170,46 +399,55 @@ done_cb (GpaContext *context, gpg_error_t err, GpaKeyTable *keytable)
 	  g_list_free (keytable->keys);
 	}
       keytable->keys = keytable->tmp_list;
+      rebuild_index (keytable);
     }
+  keytable->tmp_list = NULL;
+  keytable->new_key = FALSE;
+  clear_patterns (keytable);
+  keytable->listing = FALSE;
   keytable->initialized = TRUE;
+  keytable->dispatching = TRUE;
   if (keytable->end)
     {
       keytable->end (keytable->data);
     }
+  dispatch_waiters (keytable);
+  keytable->dispatching = FALSE;
+  start_queued_requests (keytable);
 }
 
 
+/* Start listing the keys matching PATTERNS, which is a NULL
+   terminated array of strings.  If PATTERNS is NULL all keys are
+   listed.  The OpenPGP and, if enabled, the X.509 keys are listed
+   concurrently on two contexts; done_cb is called after both have
+   finished.  */
 static void
-first_half_done_cb (GpaContext *context, gpg_error_t err,
-                    GpaKeyTable *keytable)
+reload_cache (GpaKeyTable *keytable, const char **patterns)
 {
-  if (keytable->did_first_half || !cms_hack)
-    {
-      /* We are here for the second time and thus we continue with the
-         real done handler.  We do this also if the CMS_HACK has not
-         been enabled.  We reset the protocol to OpenPGP because some
-         old code might assume that it is in OpenPGP mode.  */
-      keytable->fpr = NULL; /* Not needed anymore.  */
-      gpgme_set_protocol (keytable->context->ctx, GPGME_PROTOCOL_OpenPGP);
-      done_cb (context, err, keytable);
-      return;
-    }
+  gpg_error_t err;
 
-  /* Now continue with a key listing for X.509 keys but save the error
-     of the the PGP key listing.  */
-  keytable->first_half_err = err;
-  keytable->did_first_half = 1;
+  keytable->running = 0;
+  keytable->pgp_err = 0;
+  keytable->cms_err = 0;
+  keytable->tmp_list = NULL;
+  keytable->cms_tmp_list = NULL;
+  g_strfreev (keytable->patterns);
+  keytable->patterns = patterns? g_strdupv ((char **) patterns) : NULL;
 
-  gpgme_set_protocol (context->ctx, GPGME_PROTOCOL_CMS);
-  err = gpgme_op_keylist_start (keytable->context->ctx,
-                                keytable->fpr,
-				keytable->secret);
-  keytable->fpr = NULL; /* Not needed anymore.  */
+  err = gpgme_op_keylist_ext_start (keytable->context->ctx,
+                                    (const char **) keytable->patterns,
+                                    keytable->secret, 0);
   if (err)
-    {
-      if (keytable->first_half_err)
-        gpa_gpgme_warning (keytable->first_half_err);
+    keytable->pgp_err = err;
+  else
+    keytable->running++;
 
+  if (cms_hack)
+    {
+      err = gpgme_op_keylist_ext_start (get_cms_context (keytable)->ctx,
+                                        (const char **) keytable->patterns,
+                                        keytable->secret, 0);
       if ((gpg_err_code (err) == GPG_ERR_INV_ENGINE
            || gpg_err_code (err) == GPG_ERR_UNSUPPORTED_PROTOCOL)
           && gpg_err_source (err) == GPG_ERR_SOURCE_GPGME)
@@ -223,23 +461,64 @@ first_half_done_cb (GpaContext *context, gpg_error_t err,
                "Please install a CMS engine or invoke this program\n"
                "with the option --disable-x509 ."), NULL);
           cms_hack = 0;
-          err = 0;
         }
+      else if (err)
+        keytable->cms_err = err;
       else
-        gpa_gpgme_warning (err);
-      if (keytable->end)
-	{
-	  keytable->end (keytable->data);
-	}
+        keytable->running++;
     }
+
+  if (keytable->running)
+    keytable->listing = TRUE;
+  else
+    done_cb (keytable);
+}
+
+
+/* Called by the "done" signal of both listing contexts.  */
+static void
+list_done_cb (GpaContext *context, gpg_error_t err, GpaKeyTable *keytable)
+{
+  if (!keytable->running)
+    return;
+
+  if (context == keytable->cms_context)
+    keytable->cms_err = err;
+  else
+    keytable->pgp_err = err;
+
+  if (--keytable->running)
+    return;  /* Wait for the other listing.  */
+
+  done_cb (keytable);
 }
 
 
 static void
 next_key_cb (GpaContext *context, gpgme_key_t key, GpaKeyTable *keytable)
 {
-  keytable->tmp_list = g_list_prepend (keytable->tmp_list, key);
+  GList *link = NULL;
+
+  /* A key loaded by gpa_keytable_load_new replaces the cached copy
+     right away, so that lookups never see a stale key.  */
+  if (keytable->new_key && key->subkeys && key->subkeys->fpr)
+    link = g_hash_table_lookup (keytable->fpr_index, key->subkeys->fpr);
+  if (link)
+    {
+      gpgme_key_t oldkey = link->data;
+
+      unindex_key (keytable, oldkey);
+      link->data = key;
+      index_key (keytable, link);
+      gpgme_key_unref (oldkey);
+    }
+  else if (context == keytable->cms_context)
+    keytable->cms_tmp_list = g_list_prepend (keytable->cms_tmp_list, key);
+  else
+    keytable->tmp_list = g_list_prepend (keytable->tmp_list, key);
   gpgme_key_ref (key);
+  if (keytable->pending && key->subkeys && key->subkeys->fpr)
+    g_hash_table_remove (keytable->pending, key->subkeys->fpr);
   if (keytable->next)
     {
       keytable->next (key, keytable->data);
@@ -281,6 +560,9 @@ gpa_keytable_new (gboolean secret)
 
   keytable = g_object_new (GPA_KEYTABLE_TYPE, NULL);
   keytable->secret = secret;
+  /* Only the public keys are searched.  */
+  if (!secret)
+    keytable->search_index = gpa_keyindex_new ();
 
   return keytable;
 }
@@ -307,6 +589,141 @@ GpaKeyTable *gpa_keytable_get_secret_instance ()
   return secret_instance;
 }
 
+/* Run REQUEST, which must not be called while a listing is running.
+ */
+static void
+run_request (GpaKeyTable *keytable, struct keytable_request_s *request)
+{
+  const char **fprs = (const char **) request->fprs;
+  int i;
+
+  /* Set up callbacks */
+  keytable->next = request->next;
+  keytable->end = request->end;
+  keytable->data = request->data;
+
+  switch (request->type)
+    {
+    case REQUEST_LIST_KEYS:
+      if (keytable->keys)
+        {
+          /* There is a cached list */
+          list_cache (keytable);
+        }
+      else
+        {
+          reload_cache (keytable, NULL);
+        }
+      break;
+
+    case REQUEST_FORCE_RELOAD:
+      keytable->new_key = FALSE;
+      reload_cache (keytable, NULL);
+      break;
+
+    case REQUEST_LOAD_NEW:
+      keytable->new_key = TRUE;
+      reload_cache (keytable, fprs);
+      break;
+
+    case REQUEST_RELOAD_KEYS:
+      if (!keytable->initialized || !fprs
+          || g_strv_length ((char **) fprs) > MAX_RELOAD_PATTERNS)
+        {
+          keytable->new_key = FALSE;
+          reload_cache (keytable, NULL);
+          break;
+        }
+      if (!*fprs)
+        {
+          if (keytable->end)
+            keytable->end (keytable->data);
+          break;
+        }
+
+      keytable->new_key = TRUE;
+      if (keytable->pending)
+        g_hash_table_destroy (keytable->pending);
+      keytable->pending = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                 g_free, NULL);
+      for (i = 0; fprs[i]; i++)
+        g_hash_table_add (keytable->pending, g_strdup (fprs[i]));
+      reload_cache (keytable, fprs);
+      break;
+    }
+}
+
+
+static void
+release_request (struct keytable_request_s *request)
+{
+  g_strfreev (request->fprs);
+  g_free (request);
+}
+
+
+/* Idle handler to run the queued requests.  */
+static gboolean
+run_queued_requests_cb (gpointer data)
+{
+  GpaKeyTable *keytable = data;
+  struct keytable_request_s *request;
+
+  keytable->requests_id = 0;
+  while (!keytable->listing
+         && (request = g_queue_pop_head (&keytable->requests)))
+    {
+      run_request (keytable, request);
+      release_request (request);
+    }
+
+  return FALSE;
+}
+
+
+/* Schedule the queued requests of KEYTABLE after a listing has
+   finished.  A new listing may not be started from within the done
+   event of the context.  */
+static void
+start_queued_requests (GpaKeyTable *keytable)
+{
+  if (!keytable->requests_id && !g_queue_is_empty (&keytable->requests))
+    keytable->requests_id = g_idle_add (run_queued_requests_cb, keytable);
+}
+
+
+/* Run a request of TYPE for the fingerprints FPRS right away or, if a
+   listing is running or other requests are waiting, after them.  The
+   next and end functions of each request are called only for its own
+   listing.  */
+static void
+submit_request (GpaKeyTable *keytable, enum request_type type,
+                const char **fprs, GpaKeyTableNextFunc next,
+                GpaKeyTableEndFunc end, gpointer data)
+{
+  struct keytable_request_s *request;
+
+  request = g_new0 (struct keytable_request_s, 1);
+  request->type = type;
+  request->fprs = fprs? g_strdupv ((char **) fprs) : NULL;
+  request->next = next;
+  request->end = end;
+  request->data = data;
+
+  if (keytable->listing || keytable->dispatching
+      || !g_queue_is_empty (&keytable->requests))
+    {
+      g_queue_push_tail (&keytable->requests, request);
+      if (!keytable->listing)
+        start_queued_requests (keytable);
+      return;
+    }
+
+  run_request (keytable, request);
+  release_request (request);
+}
+
+
 /* List all keys, return cached copies if they are available.
  *
  * The "next" function is called for every key, providing a new
@@ -326,20 +743,7 @@ gpa_keytable_list_keys (GpaKeyTable *keytable,
   g_return_if_fail (keytable != NULL);
   g_return_if_fail (GPA_IS_KEYTABLE (keytable));
 
-  /* Set up callbacks */
-  keytable->next = next;
-  keytable->end = end;
-  keytable->data = data;
-  /* List keys */
-  if (keytable->keys)
-    {
-      /* There is a cached list */
-      list_cache (keytable);
-    }
-  else
-    {
-      reload_cache (keytable, NULL);
-    }
+  submit_request (keytable, REQUEST_LIST_KEYS, NULL, next, end, data);
 }
 
 /* Same as list_keys, but forces the internal cache to be rebuilt.
@@ -353,12 +757,7 @@ gpa_keytable_force_reload (GpaKeyTable *keytable,
   g_return_if_fail (keytable != NULL);
   g_return_if_fail (GPA_IS_KEYTABLE (keytable));
 
-  /* Set up callbacks */
-  keytable->next = next;
-  keytable->end = end;
-  keytable->data = data;
-  /* List keys */
-  reload_cache (keytable, NULL);
+  submit_request (keytable, REQUEST_FORCE_RELOAD, NULL, next, end, data);
 }
 
 /* Load the key with the given fingerprint from GnuPG, replacing it in the
@@ -371,46 +770,150 @@ gpa_keytable_load_new (GpaKeyTable *keytable,
                        GpaKeyTableEndFunc end,
                        gpointer data)
 {
+  const char *patterns[2] = { fpr, NULL };
+
   g_return_if_fail (keytable != NULL);
   g_return_if_fail (GPA_IS_KEYTABLE (keytable));
 
-  /* Set up callbacks */
-  keytable->next = next;
-  keytable->end = end;
-  keytable->data = data;
-  /* List keys */
-  keytable->new_key = TRUE;
-  reload_cache (keytable, fpr);
+  submit_request (keytable, REQUEST_LOAD_NEW, fpr? patterns : NULL,
+                  next, end, data);
+}
+
+
+/* Reload the keys with the fingerprints given by the NULL terminated
+ * array FPRS from GnuPG and update them in the keytable.  Keys which
+ * are not found anymore are removed from the keytable; callers may
+ * use gpa_keytable_lookup_key to detect this.  The "next" and "end"
+ * functions are used like with gpa_keytable_load_new.  If the
+ * keytable has not yet been loaded or too many keys are requested,
+ * all keys are reloaded.
+ */
+void
+gpa_keytable_reload_keys (GpaKeyTable *keytable,
+                          const char **fprs,
+                          GpaKeyTableNextFunc next,
+                          GpaKeyTableEndFunc end,
+                          gpointer data)
+{
+  g_return_if_fail (keytable != NULL);
+  g_return_if_fail (GPA_IS_KEYTABLE (keytable));
+
+  submit_request (keytable, REQUEST_RELOAD_KEYS, fprs, next, end, data);
 }
 
 /* Return the key with a given fingerprint from the keytable, NULL if
-   there is none. No reference is provided.  */
+   there is none or the keytable has not yet been loaded.  No
+   reference is provided.  Use gpa_keytable_lookup_key_async to wait
+   for the keytable.  */
 gpgme_key_t
 gpa_keytable_lookup_key (GpaKeyTable *keytable, const char *fpr)
 {
-  if (keytable->initialized)
-    {
-      GList *cur;
-      for (cur = keytable->keys; cur; cur = g_list_next (cur))
-	{
-	  gpgme_key_t key = (gpgme_key_t) cur->data;
-	  if (g_str_equal (fpr, key->subkeys->fpr))
-	    {
-	      return key;
-	    }
-	}
-      return NULL;
-    }
-  else
+  GList *link;
+
+  g_return_val_if_fail (GPA_IS_KEYTABLE (keytable), NULL);
+  g_return_val_if_fail (fpr != NULL, NULL);
+
+  if (!keytable->initialized)
+    return NULL;
+
+  link = g_hash_table_lookup (keytable->fpr_index, fpr);
+  return link? (gpgme_key_t) link->data : NULL;
+}
+
+
+/* Call FUNC with the key with the given fingerprint as soon as the
+ * keytable has been loaded; the key is NULL if there is none.  If the
+ * keytable is already loaded FUNC is called right away, otherwise
+ * loading is started if needed.  The lookup is completed by the
+ * "done" signal of the keytable's context; no nested main loop is
+ * used.  No reference is provided.
+ */
+void
+gpa_keytable_lookup_key_async (GpaKeyTable *keytable, const char *fpr,
+                               GpaKeyTableLookupFunc func, gpointer data)
+{
+  struct lookup_waiter_s *waiter;
+
+  g_return_if_fail (GPA_IS_KEYTABLE (keytable));
+  g_return_if_fail (fpr != NULL);
+  g_return_if_fail (func != NULL);
+
+  if (keytable->initialized && !keytable->listing)
     {
-      /* There is no list yet. We really, really, need to one, so we list it.
-       * FIXME: This is a hack and a basic problem. Hopefully it won't cause
-       * any real problems.
-       */
-      keytable->end = (GpaKeyTableEndFunc) gtk_main_quit;
-      reload_cache (keytable, NULL);
-      gtk_main ();
-      keytable->end = NULL;
-      return gpa_keytable_lookup_key (keytable, fpr);
+      func (gpa_keytable_lookup_key (keytable, fpr), data);
+      return;
     }
+
+  waiter = g_new (struct lookup_waiter_s, 1);
+  waiter->fpr = g_strdup (fpr);
+  waiter->func = func;
+  waiter->data = data;
+  keytable->waiters = g_list_prepend (keytable->waiters, waiter);
+
+  /* Any queued request lists the keys of a keytable not yet
+     loaded.  */
+  if (!keytable->listing && g_queue_is_empty (&keytable->requests))
+    submit_request (keytable, REQUEST_FORCE_RELOAD, NULL, NULL, NULL, NULL);
+}
+
+
+/* Return the key which has a subkey with the given long key ID from
+   the keytable, NULL if there is none.  A fingerprint or a key ID
+   with a "0x" prefix is also accepted.  No reference is provided.
+   Unlike gpa_keytable_lookup_key this function does not load the
+   keytable if that has not yet been done.  */
+gpgme_key_t
+gpa_keytable_lookup_keyid (GpaKeyTable *keytable, const char *keyid)
+{
+  char buffer[17];
+  size_t len;
+  int i;
+
+  g_return_val_if_fail (GPA_IS_KEYTABLE (keytable), NULL);
+  g_return_val_if_fail (keyid != NULL, NULL);
+
+  if (keyid[0] == '0' && (keyid[1] == 'x' || keyid[1] == 'X'))
+    keyid += 2;
+  len = strlen (keyid);
+  if (len < 16)
+    return NULL;
+  /* The key ID is the leftmost part of a v5 fingerprint but the
+     rightmost part of a v4 or X.509 fingerprint.  */
+  if (len != 64)
+    keyid += len - 16;
+  for (i = 0; i < 16; i++)
+    buffer[i] = g_ascii_toupper (keyid[i]);
+  buffer[i] = 0;
+
+  return g_hash_table_lookup (keytable->keyid_index, buffer);
+}
+
+
+/* Return the key which has a subkey with the given keygrip from the
+   keytable, NULL if there is none.  No reference is provided.  Like
+   gpa_keytable_lookup_keyid this does not load the keytable.  */
+gpgme_key_t
+gpa_keytable_lookup_keygrip (GpaKeyTable *keytable, const char *keygrip)
+{
+  g_return_val_if_fail (GPA_IS_KEYTABLE (keytable), NULL);
+  g_return_val_if_fail (keygrip != NULL, NULL);
+
+  return g_hash_table_lookup (keytable->keygrip_index, keygrip);
+}
+
+
+/* Return a new hash table with the fingerprints of all keys in the
+   keytable which contain PATTERN in a user ID, key ID or
+   fingerprint.  Case is ignored.  Like gpa_keytable_lookup_keyid
+   this does not load the keytable.  Only the public keytable can be
+   searched; for the secret keytable the result is empty.  */
+GHashTable *
+gpa_keytable_search (GpaKeyTable *keytable, const char *pattern)
+{
+  g_return_val_if_fail (GPA_IS_KEYTABLE (keytable), NULL);
+  g_return_val_if_fail (pattern != NULL, NULL);
+
+  if (!keytable->search_index)
+    return g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  return gpa_keyindex_search (keytable->search_index, pattern);
 }
@@ -28,6 +28,7 @@
 #include <gtk/gtk.h>
 #include <gpgme.h>
 #include "gpacontext.h"
+#include "keyindex.h"
 
 /* GObject stuff */
 #define GPA_KEYTABLE_TYPE	  (gpa_keytable_get_type ())
@@ -42,23 +43,53 @@ typedef struct _GpaKeyTableClass GpaKeyTableClass;
 
 typedef void (*GpaKeyTableNextFunc) (gpgme_key_t key, gpointer data);
 typedef void (*GpaKeyTableEndFunc) (gpointer data);
+typedef void (*GpaKeyTableLookupFunc) (gpgme_key_t key, gpointer data);
 
 struct _GpaKeyTable {
   GObject parent;
 
+  /* The contexts used for listing OpenPGP and X.509 keys.  The
+     latter is only created if X.509 support is enabled.  */
   GpaContext *context;
+  GpaContext *cms_context;
 
   gboolean secret;
   gboolean new_key;
   gboolean initialized;
+  gboolean listing;
   GpaKeyTableNextFunc next;
   GpaKeyTableEndFunc end;
   gpointer data;
-  const char *fpr;
-  int did_first_half;
-  gpg_error_t first_half_err;
-
-  GList *keys, *tmp_list;
+  char **patterns;
+  GHashTable *pending;
+  /* The number of listings still running and their errors.  */
+  int running;
+  gpg_error_t pgp_err;
+  gpg_error_t cms_err;
+
+  GList *keys, *tmp_list, *cms_tmp_list;
+
+  /* Lookups waiting for the keytable to be loaded.  */
+  GList *waiters;
+
+  /* Requests waiting for the running listing to finish, the idle
+     handler starting them, and a flag set while the end function and
+     the waiters of a listing are called.  */
+  GQueue requests;
+  guint requests_id;
+  gboolean dispatching;
+
+  /* Indices into KEYS.  FPR_INDEX maps the primary fingerprint to
+     the GList link holding the key, KEYID_INDEX and KEYGRIP_INDEX map
+     the long key ID and the keygrip of every subkey to the key.  The
+     strings are owned by the keys; no extra references are held.  */
+  GHashTable *fpr_index;
+  GHashTable *keyid_index;
+  GHashTable *keygrip_index;
+
+  /* The substring search index over the keys; NULL for the secret
+     keytable, which is not searched.  */
+  gpa_keyindex_t search_index;
 };
 
 struct _GpaKeyTableClass {
@@ -81,7 +112,8 @@ GpaKeyTable *gpa_keytable_get_secret_instance ();
  * The "end" function is called when the listing is complete.
  *
  * This function MAY not do anything until the application goes back into
- * the GLib main loop.
+ * the GLib main loop.  Requests made while a listing is running are
+ * queued; each of them has its functions called in turn.
  */
 void gpa_keytable_list_keys (GpaKeyTable *keytable,
 			     GpaKeyTableNextFunc next,
@@ -104,8 +136,47 @@ void gpa_keytable_load_new (GpaKeyTable *keytable,
 			    GpaKeyTableEndFunc end,
 			    gpointer data);
 
+/* Reload the keys with the fingerprints given by the NULL terminated
+ * array FPRS from GnuPG and update them in the keytable.  Keys which
+ * are not found anymore are removed from the keytable.
+ */
+void gpa_keytable_reload_keys (GpaKeyTable *keytable,
+                               const char **fprs,
+                               GpaKeyTableNextFunc next,
+                               GpaKeyTableEndFunc end,
+                               gpointer data);
+
 /* Return the key with a given fingerprint from the keytable, NULL if
-   there is none. No reference is provided.  */
+   there is none or the keytable has not yet been loaded.  No
+   reference is provided.  */
 gpgme_key_t gpa_keytable_lookup_key (GpaKeyTable *keytable, const char *fpr);
 
+/* Call FUNC with the key with the given fingerprint as soon as the
+ * keytable has been loaded; the key is NULL if there is none.  If the
+ * keytable is already loaded FUNC is called right away, otherwise
+ * loading is started if needed.  No reference is provided.
+ */
+void gpa_keytable_lookup_key_async (GpaKeyTable *keytable,
+                                    const char *fpr,
+                                    GpaKeyTableLookupFunc func,
+                                    gpointer data);
+
+/* Return the key which has a subkey with the given long key ID from
+   the keytable, NULL if there is none.  A fingerprint or a key ID
+   with a "0x" prefix is also accepted.  No reference is provided.  */
+gpgme_key_t gpa_keytable_lookup_keyid (GpaKeyTable *keytable,
+                                       const char *keyid);
+
+/* Return the key which has a subkey with the given keygrip from the
+   keytable, NULL if there is none.  No reference is provided.  */
+gpgme_key_t gpa_keytable_lookup_keygrip (GpaKeyTable *keytable,
+                                         const char *keygrip);
+
+/* Return a new hash table with the fingerprints of all keys in the
+   keytable which contain PATTERN in a user ID, key ID or
+   fingerprint.  Case is ignored.  Like gpa_keytable_lookup_keyid
+   this does not load the keytable.  Only the public keytable can be
+   searched; for the secret keytable the result is empty.  */
+GHashTable *gpa_keytable_search (GpaKeyTable *keytable, const char *pattern);
+
 #endif /* KEYTABLE_H */
@@ -150,6 +150,7 @@ gpa_options_init (GpaOptions *options)
   options->default_key_fpr = NULL;
   options->default_keyserver = NULL;
   options->detailed_view = FALSE;
+  options->key_cache = FALSE;
 }
 
 static void
@@ -400,6 +401,15 @@ gpa_options_get_detailed_view (GpaOptions *options)
 }
 
 
+/* Return whether the key manager shall use the key cache file.  This
+   can only be enabled in gpa.conf.  */
+gboolean
+gpa_options_get_key_cache (GpaOptions *options)
+{
+  return options->key_cache;
+}
+
+
 /* Remember whether the default key has already been backed up */
 void
 gpa_options_set_backup_generated (GpaOptions *options, gboolean value)
@@ -454,6 +464,10 @@ gpa_options_save_settings (GpaOptions *options)
         {
           fprintf (options_file, "%s\n", "detailed-view");
         }
+      if (options->key_cache)
+        {
+          fprintf (options_file, "%s\n", "key-cache");
+        }
       fclose (options_file);
     }
 
@@ -552,6 +566,10 @@ gpa_options_read_settings (GpaOptions *options)
                 {
                   options->detailed_view = TRUE;
                 }
+              else if (g_str_equal (next_word, "key-cache"))
+                {
+                  options->key_cache = TRUE;
+                }
               break;
             case PARSE_OPTIONS_STATE_HAVE_KEY:
               options->default_key_fpr = g_strdup (next_word);
@@ -50,6 +50,8 @@ struct _GpaOptions {
   gchar *default_keyserver;
 
   gboolean detailed_view;
+
+  gboolean key_cache;
 };
 
 struct _GpaOptionsClass {
@@ -109,5 +111,8 @@ gboolean gpa_options_get_backup_generated (GpaOptions *options);
 void gpa_options_set_detailed_view (GpaOptions *options, gboolean value);
 gboolean gpa_options_get_detailed_view (GpaOptions *options);
 
+/* Return whether the key manager shall use the key cache file.  */
+gboolean gpa_options_get_key_cache (GpaOptions *options);
+
 #endif /*OPTIONS_H*/
 
@@ -0,0 +1,482 @@
+/* recipientcache.c - The GNU Privacy Assistant recipient key cache.
+   Copyright (C) 2026 g10 Code GmbH.
+
+   This file is part of GPA
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Finding the keys of a mail recipient requires a key listing, which
+   for OpenPGP may even locate the key on the net.  The results are
+   cached by protocol and normalized mailbox.  The cache is cleared
+   whenever one of the keyring files in the GnuPG home directory
+   changes; without a working file watcher nothing is cached.  The
+   lookups missing in the cache are run asynchronously on a small set
+   of GpaContexts, thus a slow lookup neither blocks the GUI nor the
+   other lookups.  */
+
+#include <config.h>
+
+#include <string.h>
+
+#include "gpa.h"
+#include "gpacontext.h"
+#include "recipientcache.h"
+
+
+/* For performance reasons we truncate the listing of ambiguous keys
+   at a reasonable value.  */
+#define TRUNCATE_KEYSEARCH_AT 40
+
+/* The number of seconds a result is kept.  A key may expire and a
+   key not found may show up on the net, thus results are not kept
+   forever even if the keyring does not change.  */
+#define CACHE_TTL          3600
+#define NEGATIVE_CACHE_TTL  600
+
+/* The maximum number of concurrent lookups.  The lookups mostly wait
+   for gpg or the network.  */
+#define MAX_LOOKUPS 8
+
+/* The files in the GnuPG home directory and its keyboxd directory
+   whose change clears the cache.  */
+static const char *const keyring_files[] =
+  {
+    "pubring.kbx",
+    "pubring.gpg",
+    "trustdb.gpg",
+    "trustlist.txt",
+    "pubring.db",
+    "pubring.db-wal",
+    NULL
+  };
+
+
+/* A cached result.  */
+struct cache_entry_s
+{
+  gpgme_key_t *keys;
+  int truncated;
+  gint64 expires;     /* The monotonic time the entry expires.  */
+};
+
+
+/* The key listing for one mailbox and protocol.  */
+struct lookup_s
+{
+  char *cache_key;
+  char *mailbox;
+  gpgme_protocol_t protocol;
+  GPtrArray *keys;
+  int truncated;
+  /* The value of GENERATION when the listing was started.  A lookup
+     started before the cache was cleared is stale.  */
+  unsigned int generation;
+  /* The requests waiting for the result.  */
+  GList *requests;
+};
+
+
+struct gpa_recipient_request_s
+{
+  struct lookup_s *lookup;
+  gpa_recipient_cache_cb_t cb;
+  void *opaque;
+};
+
+
+/* A context to run a lookup.  */
+struct slot_s
+{
+  GpaContext *context;
+  /* The lookup running on CONTEXT or NULL.  */
+  struct lookup_s *lookup;
+};
+
+
+/* Maps the cache key to a cache entry.  */
+static GHashTable *cache;
+
+/* Maps the cache key to the queued or running lookup.  */
+static GHashTable *lookups;
+
+/* The lookups waiting for a free slot.  */
+static GQueue queue = G_QUEUE_INIT;
+
+static struct slot_s slots[MAX_LOOKUPS];
+
+/* The source id of the idle handler starting queued lookups.  */
+static guint start_source;
+
+/* Incremented each time the cache is cleared, so that the result of a
+   lookup started before is not cached.  */
+static unsigned int generation;
+
+/* True if changes of the keyring are noticed.  */
+static gboolean watching;
+
+
+
+static void
+free_cache_entry (gpointer data)
+{
+  struct cache_entry_s *entry = data;
+
+  gpa_gpgme_release_keyarray (entry->keys);
+  g_free (entry);
+}
+
+
+/* Return the key for the cache entry of MAILBOX and PROTOCOL.  Case
+   and surrounding spaces of the mailbox are ignored.  */
+static char *
+make_cache_key (const char *mailbox, gpgme_protocol_t protocol)
+{
+  char *folded, *key;
+
+  folded = g_ascii_strdown (mailbox, -1);
+  key = g_strdup_printf ("%d:%s", protocol, g_strstrip (folded));
+  g_free (folded);
+
+  return key;
+}
+
+
+/* The file watcher callback for the GnuPG home directory.  */
+static void
+keyring_changed_cb (void *opaque, const char *filename, const char *reason)
+{
+  const char *name;
+  int i;
+
+  (void)opaque;
+  (void)reason;
+
+  if (!filename)
+    {
+      g_debug ("file events lost; clearing the recipient cache");
+      gpa_recipient_cache_clear ();
+      return;
+    }
+
+  name = strrchr (filename, G_DIR_SEPARATOR);
+  name = name? name + 1 : filename;
+  for (i = 0; keyring_files[i]; i++)
+    if (!strcmp (name, keyring_files[i]))
+      {
+        g_debug ("%s changed; clearing the recipient cache", name);
+        gpa_recipient_cache_clear ();
+        break;
+      }
+}
+
+
+/* Set up the cache if this has not yet been done.  */
+static void
+init_cache (void)
+{
+  static int initialized;
+  char *dirname;
+
+  if (initialized)
+    return;
+  initialized = 1;
+
+  cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                 g_free, free_cache_entry);
+  lookups = g_hash_table_new (g_str_hash, g_str_equal);
+  watching = !!gpa_add_filewatch (gnupg_homedir, "wydm",
+                                  keyring_changed_cb, NULL);
+  if (!watching)
+    g_debug ("keyring changes are not noticed; not caching recipients");
+
+  /* The keys are kept here if keyboxd is used.  */
+  dirname = g_build_filename (gnupg_homedir, "public-keys.d", NULL);
+  if (watching && g_file_test (dirname, G_FILE_TEST_IS_DIR))
+    watching = !!gpa_add_filewatch (dirname, "wydm",
+                                    keyring_changed_cb, NULL);
+  g_free (dirname);
+}
+
+
+static void
+release_lookup (struct lookup_s *lookup)
+{
+  if (g_hash_table_lookup (lookups, lookup->cache_key) == lookup)
+    g_hash_table_remove (lookups, lookup->cache_key);
+  if (lookup->keys)
+    {
+      g_ptr_array_foreach (lookup->keys, (GFunc) gpgme_key_unref, NULL);
+      g_ptr_array_free (lookup->keys, TRUE);
+    }
+  g_free (lookup->cache_key);
+  g_free (lookup->mailbox);
+  g_free (lookup);
+}
+
+
+/* Cache the result of LOOKUP unless ERR is set, hand it to all
+   waiting requests and release LOOKUP.  */
+static void
+finish_lookup (struct lookup_s *lookup, gpg_error_t err)
+{
+  struct cache_entry_s *entry;
+  gpgme_key_t *keys = NULL;
+  GList *requests, *cur;
+
+  if (err && gpg_err_code (err) != GPG_ERR_EOF)
+    g_debug ("listing the keys for `%s' failed: %s",
+             lookup->mailbox, gpg_strerror (err));
+
+  if (lookup->keys->len)
+    {
+      g_ptr_array_add (lookup->keys, NULL);
+      keys = (gpgme_key_t *) g_ptr_array_free (lookup->keys, FALSE);
+    }
+  else
+    g_ptr_array_free (lookup->keys, TRUE);
+  lookup->keys = NULL;
+
+  if ((!err || gpg_err_code (err) == GPG_ERR_EOF)
+      && watching && lookup->generation == generation)
+    {
+      entry = g_new0 (struct cache_entry_s, 1);
+      entry->keys = gpa_gpgme_copy_keyarray (keys);
+      entry->truncated = lookup->truncated;
+      entry->expires = (g_get_monotonic_time ()
+                        + ((keys? CACHE_TTL : NEGATIVE_CACHE_TTL)
+                           * G_USEC_PER_SEC));
+      g_hash_table_replace (cache, g_strdup (lookup->cache_key), entry);
+    }
+
+  /* Detach the requests first; the callbacks may start or cancel
+     other lookups.  */
+  requests = lookup->requests;
+  lookup->requests = NULL;
+  if (g_hash_table_lookup (lookups, lookup->cache_key) == lookup)
+    g_hash_table_remove (lookups, lookup->cache_key);
+  for (cur = requests; cur; cur = g_list_next (cur))
+    {
+      gpa_recipient_request_t request = cur->data;
+
+      request->cb (request->opaque, lookup->protocol,
+                   gpa_gpgme_copy_keyarray (keys), lookup->truncated);
+      g_free (request);
+    }
+  g_list_free (requests);
+  gpa_gpgme_release_keyarray (keys);
+  release_lookup (lookup);
+}
+
+
+static void
+next_key_cb (GpaContext *context, gpgme_key_t key, struct slot_s *slot)
+{
+  struct lookup_s *lookup = slot->lookup;
+
+  if (!lookup || key->revoked || key->disabled || key->expired
+      || !key->can_encrypt)
+    return;
+
+  if (lookup->keys->len >= TRUNCATE_KEYSEARCH_AT)
+    {
+      /* Note that the truncation flag is not 100% correct.  In case
+         the listing would not yield a further usable key we have not
+         actually truncated the search.  */
+      lookup->truncated = 1;
+      return;
+    }
+  gpgme_key_ref (key);
+  g_ptr_array_add (lookup->keys, key);
+}
+
+
+static gboolean start_queued_lookups (gpointer unused);
+
+static void
+done_cb (GpaContext *context, gpg_error_t err, struct slot_s *slot)
+{
+  struct lookup_s *lookup = slot->lookup;
+
+  if (!lookup)
+    return;
+  slot->lookup = NULL;
+  finish_lookup (lookup, err);
+
+  /* A new operation may not be started from within the done event
+     of the context.  */
+  if (!start_source && !g_queue_is_empty (&queue))
+    start_source = g_idle_add (start_queued_lookups, NULL);
+}
+
+
+/* Start the key listing for LOOKUP on SLOT.  */
+static void
+start_lookup (struct slot_s *slot, struct lookup_s *lookup)
+{
+  static int have_locate = -1;
+  gpgme_keylist_mode_t mode = GPGME_KEYLIST_MODE_LOCAL;
+  gpg_error_t err;
+
+  if (have_locate == -1)
+    have_locate = is_gpg_version_at_least ("2.0.10");
+
+  if (!slot->context)
+    {
+      slot->context = gpa_context_new ();
+      g_signal_connect (G_OBJECT (slot->context), "next_key",
+                        G_CALLBACK (next_key_cb), slot);
+      g_signal_connect (G_OBJECT (slot->context), "done",
+                        G_CALLBACK (done_cb), slot);
+    }
+
+  if (lookup->protocol == GPGME_PROTOCOL_OpenPGP && have_locate)
+    mode |= GPGME_KEYLIST_MODE_EXTERN;
+  gpgme_set_protocol (slot->context->ctx, lookup->protocol);
+  gpgme_set_keylist_mode (slot->context->ctx, mode);
+
+  lookup->generation = generation;
+  lookup->keys = g_ptr_array_new ();
+  slot->lookup = lookup;
+  err = gpgme_op_keylist_start (slot->context->ctx, lookup->mailbox, 0);
+  if (err)
+    {
+      slot->lookup = NULL;
+      finish_lookup (lookup, err);
+    }
+}
+
+
+/* Run queued lookups on the free slots.  */
+static gboolean
+start_queued_lookups (gpointer unused)
+{
+  struct lookup_s *lookup;
+  int i;
+
+  (void)unused;
+
+  start_source = 0;
+  for (i = 0; i < MAX_LOOKUPS; i++)
+    {
+      if (slots[i].lookup
+          || (slots[i].context && gpa_context_busy (slots[i].context)))
+        continue;
+
+      /* Skip lookups whose requests have all been canceled.  */
+      while ((lookup = g_queue_pop_head (&queue)) && !lookup->requests)
+        release_lookup (lookup);
+      if (!lookup)
+        break;
+      start_lookup (&slots[i], lookup);
+    }
+
+  return FALSE;
+}
+
+
+
+/* Find the keys of MAILBOX for PROTOCOL, which is either OpenPGP or
+   CMS, and pass them to CB.  Only usable encryption keys are
+   returned.  If the result is cached, CB is called right away and
+   NULL is returned.  Otherwise the lookup runs in the background and
+   a handle for gpa_recipient_cache_cancel is returned; CB is called
+   from the main loop once the keys are known.  */
+gpa_recipient_request_t
+gpa_recipient_cache_lookup (const char *mailbox, gpgme_protocol_t protocol,
+                            gpa_recipient_cache_cb_t cb, void *opaque)
+{
+  gpa_recipient_request_t request;
+  struct cache_entry_s *entry;
+  struct lookup_s *lookup;
+  char *cache_key;
+
+  init_cache ();
+
+  cache_key = make_cache_key (mailbox, protocol);
+  entry = g_hash_table_lookup (cache, cache_key);
+  if (entry && entry->expires > g_get_monotonic_time ())
+    {
+      g_free (cache_key);
+      cb (opaque, protocol, gpa_gpgme_copy_keyarray (entry->keys),
+          entry->truncated);
+      return NULL;
+    }
+
+  /* Do not look up the same mailbox twice.  */
+  lookup = g_hash_table_lookup (lookups, cache_key);
+  if (lookup)
+    g_free (cache_key);
+  else
+    {
+      lookup = g_new0 (struct lookup_s, 1);
+      lookup->cache_key = cache_key;
+      lookup->mailbox = g_strdup (mailbox);
+      lookup->protocol = protocol;
+      g_hash_table_insert (lookups, lookup->cache_key, lookup);
+      g_queue_push_tail (&queue, lookup);
+      if (!start_source)
+        start_source = g_idle_add (start_queued_lookups, NULL);
+    }
+
+  request = g_new0 (struct gpa_recipient_request_s, 1);
+  request->lookup = lookup;
+  request->cb = cb;
+  request->opaque = opaque;
+  lookup->requests = g_list_append (lookup->requests, request);
+
+  return request;
+}
+
+
+/* Do not call the callback of REQUEST.  A running key listing is
+   finished anyway to fill the cache.  */
+void
+gpa_recipient_cache_cancel (gpa_recipient_request_t request)
+{
+  if (!request)
+    return;
+
+  request->lookup->requests = g_list_remove (request->lookup->requests,
+                                             request);
+  g_free (request);
+}
+
+
+/* Forget all cached keys.  The running lookups may have listed the
+   keys before the change; their results are not cached and they are
+   detached, so that new requests start a fresh lookup.  The queued
+   lookups have not yet listed anything and are kept.  */
+void
+gpa_recipient_cache_clear (void)
+{
+  GHashTableIter iter;
+  gpointer value;
+
+  generation++;
+  if (cache)
+    g_hash_table_remove_all (cache);
+  if (lookups)
+    {
+      g_hash_table_iter_init (&iter, lookups);
+      while (g_hash_table_iter_next (&iter, NULL, &value))
+        {
+          struct lookup_s *lookup = value;
+
+          /* A lookup collects keys while it is running.  */
+          if (lookup->keys)
+            g_hash_table_iter_remove (&iter);
+        }
+    }
+}
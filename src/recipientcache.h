@@ -0,0 +1,49 @@
+/* recipientcache.h - The GNU Privacy Assistant recipient key cache.
+   Copyright (C) 2026 g10 Code GmbH.
+
+   This file is part of GPA
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RECIPIENTCACHE_H
+#define RECIPIENTCACHE_H
+
+#include <glib.h>
+#include <gpgme.h>
+
+/* Called with the usable encryption keys found for a recipient.  KEYS
+   is a NULL terminated array or NULL if no key was found; the callee
+   owns the array and the key references.  TRUNCATED is set if there
+   are more matching keys than passed.  */
+typedef void (*gpa_recipient_cache_cb_t) (void *opaque,
+                                          gpgme_protocol_t protocol,
+                                          gpgme_key_t *keys, int truncated);
+
+/* A pending lookup.  */
+typedef struct gpa_recipient_request_s *gpa_recipient_request_t;
+
+/* Find the keys of MAILBOX for PROTOCOL, which is either OpenPGP or
+   CMS, and pass them to CB.  */
+gpa_recipient_request_t
+gpa_recipient_cache_lookup (const char *mailbox, gpgme_protocol_t protocol,
+                            gpa_recipient_cache_cb_t cb, void *opaque);
+
+/* Do not call the callback of REQUEST.  */
+void gpa_recipient_cache_cancel (gpa_recipient_request_t request);
+
+/* Forget all cached keys.  */
+void gpa_recipient_cache_clear (void);
+
+#endif /* RECIPIENTCACHE_H */
@@ -27,6 +27,7 @@
 
 #include "gtktools.h"
 #include "selectkeydlg.h"
+#include "recipientcache.h"
 #include "recipientdlg.h"
 
 
@@ -56,6 +57,9 @@ struct _RecipientDlg
 
   /* The selected protocol.  This is also set by update_statushint.  */
   gpgme_protocol_t selected_protocol;
+
+  /* The management information of all recipients in the list.  */
+  GList *recipients;
 };
 
 
@@ -79,11 +83,6 @@ enum
   };
 
 
-/* For performance reasons we truncate the listing of ambiguous keys
-   at a reasonable value.  */
-#define TRUNCATE_KEYSEARCH_AT 40
-
-
 /* An object to keep information about keys.  */
 struct keyinfo_s
 {
@@ -96,6 +95,9 @@ struct keyinfo_s
 
   /* If set, indicates that the KEYS array has been truncated.  */
   int truncated:1;
+
+  /* The pending lookup of the keys or NULL.  */
+  gpa_recipient_request_t request;
 };
 
 
@@ -116,6 +118,9 @@ struct userdata_s
      required for the recipient.  */
   int ignore_recipient;
 
+  /* The dialog and the row of the recipient.  */
+  RecipientDlg *dialog;
+  GtkTreeIter iter;
 };
 
 
@@ -224,6 +229,7 @@ update_statushint (RecipientDlg *dialog)
   GtkTreeModel *model;
   GtkTreeIter iter;
   int missing_keys = 0;
+  int resolving = 0;
   int ambiguous_pgp_keys = 0;
   int ambiguous_x509_keys = 0;
   int n_pgp_keys = 0;
@@ -263,6 +269,8 @@ update_statushint (RecipientDlg *dialog)
             missing_keys++;  /* Oops */
           else if (info->ignore_recipient)
             ;
+          else if (info->pgp.request || info->x509.request)
+            resolving++;
           else if (!info->pgp.keys && !info->x509.keys)
             missing_keys++;
           else if ((req_protocol == GPGME_PROTOCOL_OpenPGP && !has_pgp)
@@ -301,7 +309,9 @@ update_statushint (RecipientDlg *dialog)
     sel_protocol = req_protocol;
 
 
-  if (missing_keys)
+  if (resolving)
+    hint = _("Looking up the keys of the recipients ...");
+  else if (missing_keys)
     hint = _("You need to select a key for each recipient.\n"
              "To select a key right-click on the respective line.");
   else if ((sel_protocol == GPGME_PROTOCOL_OpenPGP
@@ -384,6 +394,8 @@ clear_keyinfo (struct keyinfo_s *keyinfo)
 
   if (keyinfo)
     {
+      gpa_recipient_cache_cancel (keyinfo->request);
+      keyinfo->request = NULL;
       if (keyinfo->keys)
         {
           for (nkeys=0; keyinfo->keys[nkeys]; nkeys++)
@@ -417,6 +429,8 @@ update_recplist_row (GtkListStore *store, GtkTreeIter *iter,
 
   if (info->ignore_recipient)
     infostr = NULL;
+  else if (info->pgp.request || info->x509.request)
+    infostr = g_strdup (_("[Resolving ...]"));
   else if (any_pgp && any_x509 && info->pgp.keys[1] && info->x509.keys[1])
     infostr = g_strdup (_("[Ambiguous keys. Right-click to select]"));
   else if (any_pgp && info->pgp.keys[1])
@@ -460,104 +474,52 @@ update_recplist_row (GtkListStore *store, GtkTreeIter *iter,
 }
 
 
-/* Parse one recipient, this is the working horse of parse_recipeints. */
+/* Called with the keys found for a recipient.  */
 static void
-parse_one_recipient (gpgme_ctx_t ctx, GtkListStore *store, GtkTreeIter *iter,
-                     struct userdata_s *info)
+lookup_done_cb (void *opaque, gpgme_protocol_t protocol,
+                gpgme_key_t *keys, int truncated)
 {
-  static int have_locate = -1;
-  gpgme_key_t key = NULL;
-  gpgme_keylist_mode_t mode;
-
-  if (have_locate == -1)
-    have_locate = is_gpg_version_at_least ("2.0.10");
-
-  g_return_if_fail (info);
-
-  clear_keyinfo (&info->pgp);
-  gpgme_set_protocol (ctx, GPGME_PROTOCOL_OpenPGP);
-  mode = gpgme_get_keylist_mode (ctx);
-  if (have_locate)
-    gpgme_set_keylist_mode (ctx, (mode | (GPGME_KEYLIST_MODE_LOCAL
-                                          | GPGME_KEYLIST_MODE_EXTERN)));
-  if (!gpgme_op_keylist_start (ctx, info->mailbox, 0))
-    {
-      while (!gpgme_op_keylist_next (ctx, &key))
-        {
-          if (key->revoked || key->disabled || key->expired
-              || !key->can_encrypt)
-            gpgme_key_unref (key);
-          else if (append_key_to_keyinfo (&info->pgp, key)
-                   >= TRUNCATE_KEYSEARCH_AT)
-            {
-              /* Note that the truncation flag is not 100% correct.  In
-                 case the next iteration would not yield a new key we
-                 have not actually truncated the search.  */
-              info->pgp.truncated = 1;
-              break;
-            }
-        }
-    }
-  gpgme_op_keylist_end (ctx);
-  gpgme_set_keylist_mode (ctx, mode);
+  struct userdata_s *info = opaque;
+  struct keyinfo_s *keyinfo;
+  GtkListStore *store;
+  unsigned int n;
 
-  clear_keyinfo (&info->x509);
-  gpgme_set_protocol (ctx, GPGME_PROTOCOL_CMS);
-  if (!gpgme_op_keylist_start (ctx, info->mailbox, 0))
-    {
-      while (!gpgme_op_keylist_next (ctx, &key))
-        {
-          if (key->revoked || key->disabled || key->expired
-              || !key->can_encrypt)
-            gpgme_key_unref (key);
-          else if (append_key_to_keyinfo (&info->x509,key)
-                   >= TRUNCATE_KEYSEARCH_AT)
-            {
-              info->x509.truncated = 1;
-              break;
-            }
-        }
-    }
-  gpgme_op_keylist_end (ctx);
+  keyinfo = protocol == GPGME_PROTOCOL_CMS? &info->x509 : &info->pgp;
+  keyinfo->request = NULL;
+  clear_keyinfo (keyinfo);
+  for (n = 0; keys && keys[n]; n++)
+    append_key_to_keyinfo (keyinfo, keys[n]);
+  keyinfo->truncated = truncated;
+  g_free (keys);
 
-  update_recplist_row (store, iter, info);
+  store = GTK_LIST_STORE (gtk_tree_view_get_model
+                          (GTK_TREE_VIEW (info->dialog->clist_keys)));
+  update_recplist_row (store, &info->iter, info);
 }
 
 
-/* Parse the list of recipients, find possible keys and update the
-   store.  */
+/* Start looking up the keys of the recipient described by INFO.  The
+   row of the recipient is updated as soon as the keys are known.  */
 static void
-parse_recipients (GtkListStore *store)
+parse_recipient (struct userdata_s *info)
 {
-  GtkTreeModel *model;
-  GtkTreeIter iter;
-  gpg_error_t err;
-  gpgme_ctx_t ctx;
-
-  err = gpgme_new (&ctx);
-  if (err)
-    gpa_gpgme_error (err);
-
-
-  model = GTK_TREE_MODEL (store);
-  /* Walk through the list, reading each row. */
-
-  if (gtk_tree_model_get_iter_first (model, &iter))
-    do
-      {
-        struct userdata_s *info;
-
-        gtk_tree_model_get (model, &iter,
-                            RECPLIST_USERDATA, &info,
-                            -1);
+  /* Note that the callback may be called right away for cached keys
+     and thus before the request is returned.  */
+  info->pgp.request = gpa_recipient_cache_lookup
+    (info->mailbox, GPGME_PROTOCOL_OpenPGP, lookup_done_cb, info);
+  info->x509.request = gpa_recipient_cache_lookup
+    (info->mailbox, GPGME_PROTOCOL_CMS, lookup_done_cb, info);
+}
 
-        /* Do something with the data */
-        /*g_print ("parsing mailbox `%s'\n", info? info->mailbox:"(null)");*/
-        parse_one_recipient (ctx, store, &iter,info);
-      }
-    while (gtk_tree_model_iter_next (model, &iter));
 
-  gpgme_release (ctx);
+/* Release the management information of a recipient.  */
+static void
+release_userdata (struct userdata_s *info)
+{
+  clear_keyinfo (&info->pgp);
+  clear_keyinfo (&info->x509);
+  g_free (info->mailbox);
+  g_free (info);
 }
 
 
@@ -658,6 +620,8 @@ select_key_response_cb (SelectKeyDlg *seldlg, int response, void *user_data)
           gtk_tree_model_get (model, &iter, RECPLIST_USERDATA, &info, -1);
           if (info)
             {
+              /* Note that clear_keyinfo also cancels a pending
+                 lookup.  */
               if (key->protocol == GPGME_PROTOCOL_OpenPGP)
                 {
                   clear_keyinfo (&info->pgp);
@@ -916,10 +880,37 @@ recipient_dlg_set_property (GObject *object, guint prop_id,
 }
 
 
+static void
+recipient_dlg_dispose (GObject *object)
+{
+  RecipientDlg *dialog = RECIPIENT_DLG (object);
+  GList *item;
+
+  /* The rows can't be updated anymore.  */
+  for (item = dialog->recipients; item; item = g_list_next (item))
+    {
+      struct userdata_s *info = item->data;
+
+      gpa_recipient_cache_cancel (info->pgp.request);
+      info->pgp.request = NULL;
+      gpa_recipient_cache_cancel (info->x509.request);
+      info->x509.request = NULL;
+    }
+
+  G_OBJECT_CLASS (parent_class)->dispose (object);
+}
+
+
 static void
 recipient_dlg_finalize (GObject *object)
 {
+  RecipientDlg *dialog = RECIPIENT_DLG (object);
+
   /* Fixme:  Release the store.  */
+  g_list_foreach (dialog->recipients, (GFunc) release_userdata, NULL);
+  g_list_free (dialog->recipients);
+  dialog->recipients = NULL;
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -1042,6 +1033,7 @@ recipient_dlg_class_init (RecipientDlgClass *klass)
   parent_class = g_type_class_peek_parent (klass);
 
   object_class->constructor = recipient_dlg_constructor;
+  object_class->dispose = recipient_dlg_dispose;
   object_class->finalize = recipient_dlg_finalize;
   object_class->set_property = recipient_dlg_set_property;
   object_class->get_property = recipient_dlg_get_property;
@@ -1139,6 +1131,9 @@ recipient_dlg_set_recipients (RecipientDlg *dialog, GSList *recipients,
                           (GTK_TREE_VIEW (dialog->clist_keys)));
 
   gtk_list_store_clear (store);
+  g_list_foreach (dialog->recipients, (GFunc) release_userdata, NULL);
+  g_list_free (dialog->recipients);
+  dialog->recipients = NULL;
   for (recp = recipients; recp; recp = g_slist_next (recp))
     {
       name = recp->data;
@@ -1147,6 +1142,7 @@ recipient_dlg_set_recipients (RecipientDlg *dialog, GSList *recipients,
           struct userdata_s *info = g_malloc0 (sizeof *info);
 
           info->mailbox = g_strdup (name);
+          info->dialog = dialog;
           gtk_list_store_append (store, &iter);
           gtk_list_store_set (store, &iter,
                               RECPLIST_MAILBOX, g_strdup (""),
@@ -1155,10 +1151,14 @@ recipient_dlg_set_recipients (RecipientDlg *dialog, GSList *recipients,
                               RECPLIST_KEYID,  NULL,
                               RECPLIST_USERDATA, info,
                               -1);
+          /* The iterators of a list store persist.  */
+          info->iter = iter;
+          dialog->recipients = g_list_prepend (dialog->recipients, info);
+          parse_recipient (info);
+          update_recplist_row (store, &iter, info);
         }
     }
 
-  parse_recipients (store);
   dialog->freeze_update_statushint--;
   update_statushint (dialog);
 }
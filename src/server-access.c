@@ -539,6 +539,7 @@ server_send_keys (const gchar *server, const gchar *keyid,
   FILE *command;
   gchar *scheme, *host, *port, *opaque;
   gboolean success;
+  gpg_error_t err;
 
   /* Parse the URI */
   if (!parse_keyserver_uri (keyserver, &scheme, &host, &port, &opaque))
@@ -553,9 +554,20 @@ server_send_keys (const gchar *server, const gchar *keyid,
   write_command (command, scheme, host, port, opaque, "SEND");
   /* Write the keys to the file */
   fprintf (command, "\nKEY %s BEGIN\n", keyid);
-  dump_data_to_file (data, command);
-  fprintf (command, "\nKEY %s END\n", keyid);
-  fclose (command);
+  err = dump_data_to_file (data, command);
+  if (!err)
+    fprintf (command, "\nKEY %s END\n", keyid);
+  if (fclose (command) && !err)
+    err = gpg_error_from_syserror ();
+  if (err)
+    {
+      /* Do not leave a partial command file behind.  */
+      gpa_window_error (gpg_strerror (err), parent);
+      unlink (command_filename);
+      g_free (command_filename);
+      g_free (keyserver);
+      return FALSE;
+    }
   success = invoke_helper (server, scheme, command_filename,
                            &output_filename, parent);
   g_free (keyserver);
@@ -28,14 +28,17 @@
 #ifndef HAVE_W32_SYSTEM
 # include <sys/socket.h>
 # include <sys/un.h>
+# include <sys/stat.h>
 #endif /*HAVE_W32_SYSTEM*/
 
 #include <gpgme.h>
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <assuan.h>
 
 #include "gpa.h"
 #include "i18n.h"
+#include "gtktools.h"
 #include "gpastreamencryptop.h"
 #include "gpastreamsignop.h"
 #include "gpastreamdecryptop.h"
@@ -46,6 +49,8 @@
 #include "gpafiledecryptop.h"
 #include "gpafileverifyop.h"
 #include "gpafileimportop.h"
+#include "keymanager.h"
+#include "checksum.h"
 
 
 #define set_error(e,t) assuan_set_error (ctx, gpg_error (e), (t))
@@ -58,6 +63,13 @@ struct conn_ctrl_s
   /* True if we are currently processing a command.  */
   int in_command;
 
+  /* The channel of the connection, the source ID of its watch or 0
+     if the connection is currently not watched, and the source ID of
+     the idle handler processing already buffered input lines.  */
+  GIOChannel *channel;
+  guint watch_id;
+  guint resume_id;
+
   /* NULL or continuation function for a command.  */
   void (*cont_cmd) (assuan_context_t, gpg_error_t);
 
@@ -106,8 +118,24 @@ struct conn_ctrl_s
   unsigned int session_number;
   char *session_title;
 
-  /* The list of all files to be processed.  */
-  GList *files;
+  /* The list of all files to be processed.  A queue is used so that
+     adding a file does not need to walk the list.  */
+  GQueue files;
+
+  /* True if the connection holds one of the slots for running
+     operations.  */
+  int has_slot;
+
+  /* The command waiting for a free slot and its malloced argument
+     line.  */
+  gpg_error_t (*waiting_cmd) (assuan_context_t, char *);
+  char *waiting_line;
+
+  /* The number of operations run by this connection, their total run
+     time and the start time of the current one in microseconds.  */
+  unsigned int n_operations;
+  gint64 operations_time;
+  gint64 slot_start_time;
 };
 
 
@@ -117,6 +145,15 @@ static int connection_counter;
 /* A flag requesting a shutdown.  */
 static gboolean shutdown_pending;
 
+/* The number of running operations, the queue of connections waiting
+   for a free slot and the source ID of the idle handler starting the
+   waiting commands.  Each connection runs at most one operation at a
+   time and waits at the end of the queue, so that all connections get
+   their turn.  */
+static int running_operations;
+static GQueue waiting_connections = G_QUEUE_INIT;
+static guint dispatch_id;
+
 
 /* The nonce used by the server connection.  This nonce is required
    under Windows to emulate Unix Domain Sockets.  This is managed by
@@ -127,6 +164,8 @@ static assuan_sock_nonce_t socket_nonce;
 
 /* Forward declarations.  */
 static void run_server_continuation (assuan_context_t ctx, gpg_error_t err);
+static void resume_input (assuan_context_t ctx);
+static gboolean dispatch_waiting_cb (void *data);
 
 
 
@@ -185,6 +224,114 @@ skip_options (char *line)
   return line;
 }
 
+/* Return the maximum number of operations running at the same
+   time.  */
+static int
+max_operations (void)
+{
+  return server_jobs > 0? server_jobs : (int) g_get_num_processors ();
+}
+
+
+/* Give a slot for running operations to the connection CTRL.  */
+static void
+grant_slot (conn_ctrl_t ctrl)
+{
+  running_operations++;
+  ctrl->has_slot = 1;
+  ctrl->slot_start_time = g_get_monotonic_time ();
+}
+
+
+/* Release the slot of the connection CTRL, if any, and start the next
+   waiting command.  */
+static void
+release_slot (conn_ctrl_t ctrl)
+{
+  if (!ctrl->has_slot)
+    return;
+
+  ctrl->has_slot = 0;
+  running_operations--;
+  ctrl->n_operations++;
+  ctrl->operations_time += g_get_monotonic_time () - ctrl->slot_start_time;
+
+  if (!dispatch_id && !g_queue_is_empty (&waiting_connections))
+    dispatch_id = g_idle_add (dispatch_waiting_cb, NULL);
+}
+
+
+/* Placeholder continuation of a command waiting for a slot.  It keeps
+   further input of the connection from being processed.  */
+static void
+cont_waiting (assuan_context_t ctx, gpg_error_t err)
+{
+  assuan_process_done (ctx, err);
+}
+
+
+/* Acquire a slot for running an operation for the command handler CMD
+   with argument LINE.  Returns true if the command may run now.
+   Otherwise the command has been queued and will be called again
+   with the same LINE as soon as a slot is available; the caller
+   shall return with not_finished.  */
+static int
+acquire_slot (assuan_context_t ctx,
+              gpg_error_t (*cmd) (assuan_context_t, char *), char *line)
+{
+  conn_ctrl_t ctrl = assuan_get_pointer (ctx);
+
+  if (ctrl->has_slot)
+    return 1;
+  if (running_operations < max_operations ()
+      && g_queue_is_empty (&waiting_connections))
+    {
+      grant_slot (ctrl);
+      return 1;
+    }
+
+  g_debug ("%d operations running; queuing command", running_operations);
+  ctrl->waiting_cmd = cmd;
+  ctrl->waiting_line = g_strdup (line);
+  ctrl->cont_cmd = cont_waiting;
+  g_queue_push_tail (&waiting_connections, ctx);
+  return 0;
+}
+
+
+/* This function is called by the main event loop to run the commands
+   waiting for a slot.  */
+static gboolean
+dispatch_waiting_cb (void *data)
+{
+  (void)data;
+
+  dispatch_id = 0;
+  while (running_operations < max_operations ()
+         && !g_queue_is_empty (&waiting_connections))
+    {
+      assuan_context_t ctx = g_queue_pop_head (&waiting_connections);
+      conn_ctrl_t ctrl = assuan_get_pointer (ctx);
+      gpg_error_t (*cmd) (assuan_context_t, char *) = ctrl->waiting_cmd;
+      char *line = ctrl->waiting_line;
+
+      ctrl->waiting_cmd = NULL;
+      ctrl->waiting_line = NULL;
+      ctrl->cont_cmd = NULL;
+      grant_slot (ctrl);
+      cmd (ctx, line);
+      g_free (line);
+      if (!ctrl->cont_cmd)
+        {
+          /* The command failed without starting an operation.  */
+          release_slot (ctrl);
+          resume_input (ctx);
+        }
+    }
+  return FALSE;
+}
+
+
 /* Helper to be used as a GFunc for free. */
 static void
 free_func (void *p, void *dummy)
@@ -343,12 +490,11 @@ free_file_item (gpa_file_item_t item)
 static void
 release_files (conn_ctrl_t ctrl)
 {
-  if (! ctrl->files)
+  if (g_queue_is_empty (&ctrl->files))
     return;
 
-  g_list_foreach (ctrl->files, (GFunc) free_file_item, NULL);
-  g_list_free (ctrl->files);
-  ctrl->files = NULL;
+  g_queue_foreach (&ctrl->files, (GFunc) free_file_item, NULL);
+  g_queue_clear (&ctrl->files);
 }
 
 
@@ -460,6 +606,25 @@ translate_io_streams (assuan_context_t ctx)
 }
 
 
+/* Return true if gpgme may directly read from or write to FD.  This
+   is the case for files and pipes; for sockets and everything else we
+   go through a GIOChannel.  */
+static int
+use_fd_directly (int fd)
+{
+#ifdef HAVE_W32_SYSTEM
+  (void)fd;
+  return 0;
+#else
+  struct stat st;
+
+  if (fstat (fd, &st))
+    return 0;
+  return S_ISREG (st.st_mode) || S_ISFIFO (st.st_mode);
+#endif
+}
+
+
 static gpg_error_t
 prepare_io_streams (assuan_context_t ctx,
                     gpgme_data_t *r_input_data, gpgme_data_t *r_output_data,
@@ -475,7 +640,14 @@ prepare_io_streams (assuan_context_t ctx,
   if (r_message_data)
     *r_message_data = NULL;
 
-  if (ctrl->input_fd != -1 && r_input_data)
+  if (ctrl->input_fd != -1 && r_input_data
+      && use_fd_directly (ctrl->input_fd))
+    {
+      err = gpgme_data_new_from_fd (r_input_data, ctrl->input_fd);
+      if (err)
+        goto leave;
+    }
+  else if (ctrl->input_fd != -1 && r_input_data)
     {
 #ifdef HAVE_W32_SYSTEM
       ctrl->input_channel = g_io_channel_win32_new_fd (ctrl->input_fd);
@@ -492,7 +664,16 @@ prepare_io_streams (assuan_context_t ctx,
       g_io_channel_set_buffered (ctrl->input_channel, FALSE);
     }
 
-  if (ctrl->output_fd != -1 && r_output_data)
+  if (ctrl->output_fd != -1 && r_output_data
+      && use_fd_directly (ctrl->output_fd))
+    {
+      err = gpgme_data_new_from_fd (r_output_data, ctrl->output_fd);
+      if (err)
+        goto leave;
+      if (ctrl->output_binary)
+        gpgme_data_set_encoding (*r_output_data, GPGME_DATA_ENCODING_BINARY);
+    }
+  else if (ctrl->output_fd != -1 && r_output_data)
     {
 #ifdef HAVE_W32_SYSTEM
       ctrl->output_channel = g_io_channel_win32_new_fd (ctrl->output_fd);
@@ -509,7 +690,14 @@ prepare_io_streams (assuan_context_t ctx,
       g_io_channel_set_buffered (ctrl->output_channel, FALSE);
     }
 
-  if (ctrl->message_fd != -1 && r_message_data)
+  if (ctrl->message_fd != -1 && r_message_data
+      && use_fd_directly (ctrl->message_fd))
+    {
+      err = gpgme_data_new_from_fd (r_message_data, ctrl->message_fd);
+      if (err)
+        goto leave;
+    }
+  else if (ctrl->message_fd != -1 && r_message_data)
     {
 #ifdef HAVE_W32_SYSTEM
       ctrl->message_channel = g_io_channel_win32_new_fd (ctrl->message_fd);
@@ -675,6 +863,9 @@ cmd_encrypt (assuan_context_t ctx, char *line)
   gpgme_data_t input_data = NULL;
   gpgme_data_t output_data = NULL;
 
+  if (!acquire_slot (ctx, cmd_encrypt, line))
+    return not_finished (ctrl);
+
   err = parse_protocol_option (ctx, line, 1, &protocol);
   if (err)
     goto leave;
@@ -886,6 +1077,9 @@ cmd_sign (assuan_context_t ctx, char *line)
   gpgme_data_t input_data = NULL;
   gpgme_data_t output_data = NULL;
 
+  if (!acquire_slot (ctx, cmd_sign, line))
+    return not_finished (ctrl);
+
   err = parse_protocol_option (ctx, line, 1, &protocol);
   if (err)
     goto leave;
@@ -963,6 +1157,9 @@ cmd_decrypt (assuan_context_t ctx, char *line)
   gpgme_data_t input_data = NULL;
   gpgme_data_t output_data = NULL;
 
+  if (!acquire_slot (ctx, cmd_decrypt, line))
+    return not_finished (ctrl);
+
   err = parse_protocol_option (ctx, line, 1, &protocol);
   if (err)
     goto leave;
@@ -1080,11 +1277,14 @@ cmd_verify (assuan_context_t ctx, char *line)
   gpgme_data_t message_data = NULL;
   enum { VERIFY_DETACH, VERIFY_OPAQUE, VERIFY_OPAQUE_WITH_OUTPUT } op_mode;
 
+  if (!acquire_slot (ctx, cmd_verify, line))
+    return not_finished (ctrl);
+
   err = parse_protocol_option (ctx, line, 1, &protocol);
   if (err)
     goto leave;
 
-  silent = has_option (line, "--silent");
+  silent = headless_server || has_option (line, "--silent");
 
   line = skip_options (line);
   if (*line)
@@ -1230,7 +1430,9 @@ static const char hlp_getinfo[] =
   "\n"
   "  version     - Return the version of the program.\n"
   "  name        - Return the name of the program\n"
-  "  pid         - Return the process id of the server.";
+  "  pid         - Return the process id of the server.\n"
+  "  jobs        - Return the number of running and waiting operations\n"
+  "                and the maximum number of running operations.";
 static gpg_error_t
 cmd_getinfo (assuan_context_t ctx, char *line)
 {
@@ -1253,6 +1455,15 @@ cmd_getinfo (assuan_context_t ctx, char *line)
       const char *s = PACKAGE_NAME;
       err = assuan_send_data (ctx, s, strlen (s));
     }
+  else if (!strcmp (line, "jobs"))
+    {
+      char numbuf[50];
+
+      snprintf (numbuf, sizeof numbuf, "%d %u %d", running_operations,
+                g_queue_get_length (&waiting_connections),
+                max_operations ());
+      err = assuan_send_data (ctx, numbuf, strlen (numbuf));
+    }
   else
     err = set_error (GPG_ERR_ASS_PARAMETER, "unknown value for WHAT");
 
@@ -1288,43 +1499,178 @@ cmd_file (assuan_context_t ctx, char *line)
 
   file_item = g_malloc0 (sizeof (*file_item));
   file_item->filename_in = g_strdup (line);
-  ctrl->files = g_list_append (ctrl->files, file_item);
+  g_queue_push_tail (&ctrl->files, file_item);
 
   return assuan_process_done (ctx, err);
 }
 
 
+/* The state of a file command run without --nohup.  */
+struct file_cmd_s
+{
+  assuan_context_t ctx;
+  /* The first error of a file.  */
+  gpg_error_t err;
+};
+
+
+/* Continuation for the file commands.  */
+static void
+cont_files (assuan_context_t ctx, gpg_error_t err)
+{
+  assuan_process_done (ctx, err);
+}
+
+
+/* Report the result for one file of a file command.  The status line
+   gives the error code, the input and output file, the number of
+   bytes written and the time taken in milliseconds.  */
+static void
+file_done_cb (GpaFileOperation *op, gpa_file_item_t item, void *opaque)
+{
+  struct file_cmd_s *cmd = opaque;
+  char *fname_in, *fname_out, *status;
+  GStatBuf st;
+  guint64 nbytes = 0;
+
+  if (item->err && !cmd->err)
+    cmd->err = item->err;
+
+  if (item->filename_out && !g_stat (item->filename_out, &st))
+    nbytes = st.st_size;
+  fname_in = percent_escape (item->filename_in, NULL, 0);
+  fname_out = (item->filename_out
+               ? percent_escape (item->filename_out, NULL, 0)
+               : g_strdup ("-"));
+  status = g_strdup_printf ("%s %u %s %s %" G_GUINT64_FORMAT
+                            " %" G_GINT64_FORMAT,
+                            item->err? "ERROR" : "OK", item->err,
+                            fname_in, fname_out, nbytes,
+                            item->elapsed / 1000);
+  assuan_write_status (cmd->ctx, "FILE", status);
+  g_free (status);
+  g_free (fname_out);
+  g_free (fname_in);
+}
+
+
+/* Finish a file command.  ERR is the first error of the operation,
+   but a bad signature is only known to FILE_DONE_CB.  */
+static void
+file_completed_cb (GpaOperation *op, gpg_error_t err, void *opaque)
+{
+  struct file_cmd_s *cmd = opaque;
+  assuan_context_t ctx = cmd->ctx;
+
+  if (!err)
+    err = cmd->err;
+  g_free (cmd);
+  run_server_continuation (ctx, err);
+}
+
+
+/* Run the file operation OP for the connection CTX without any
+   dialogs.  The command completes after all files have been
+   processed.  */
+static gpg_error_t
+run_file_operation (assuan_context_t ctx, GpaFileOperation *op)
+{
+  conn_ctrl_t ctrl = assuan_get_pointer (ctx);
+  struct file_cmd_s *cmd;
+
+  cmd = g_new0 (struct file_cmd_s, 1);
+  cmd->ctx = ctx;
+  ctrl->cont_cmd = cont_files;
+  g_signal_connect (G_OBJECT (op), "file_done",
+                    G_CALLBACK (file_done_cb), cmd);
+  g_signal_connect (G_OBJECT (op), "completed",
+                    G_CALLBACK (file_completed_cb), cmd);
+  g_signal_connect (G_OBJECT (op), "completed",
+		    G_CALLBACK (g_object_unref), NULL);
+
+  return not_finished (ctrl);
+}
+
+
+/* Keys have been imported by a file operation.  */
+static void
+imported_keys_cb (GpaFileImportOperation *op, const char **fprs,
+                  void *opaque)
+{
+  gpa_key_manager_update_keys (fprs);
+}
+
+
 /* Encrypt or sign files.  If neither ENCR nor SIGN is set, import
-   files. */
+   files.  With NOHUP the files are passed to the file manager and the
+   command returns immediately; otherwise the files are processed
+   without dialogs and each of them is reported with a status line.
+   The recipients must have been set with PREP_ENCRYPT and the default
+   key is used for signing.  */
 static gpg_error_t
-impl_encrypt_sign_files (assuan_context_t ctx, int encr, int sign)
+impl_encrypt_sign_files (assuan_context_t ctx, int encr, int sign, int nohup)
 {
   gpg_error_t err = 0;
   conn_ctrl_t ctrl = assuan_get_pointer (ctx);
   GpaFileOperation *op;
+  gpgme_key_t signer = NULL;
 
-  if (! ctrl->files)
+  if (g_queue_is_empty (&ctrl->files))
     {
       err = set_error (GPG_ERR_ASS_SYNTAX, "no files specified");
       return assuan_process_done (ctx, err);
     }
 
+  if (!nohup)
+    {
+      if (sign)
+        {
+          signer = gpa_options_get_default_key (gpa_options_get_instance ());
+          if (!signer)
+            {
+              err = set_error (GPG_ERR_NO_SECKEY, "no default key");
+              return assuan_process_done (ctx, err);
+            }
+        }
+      if (encr && !ctrl->recipient_keys)
+        {
+          err = set_error (GPG_ERR_NO_PUBKEY, "recipients not prepared");
+          return assuan_process_done (ctx, err);
+        }
+
+      if (encr)
+        op = (GpaFileOperation *) gpa_file_encrypt_operation_new_batch
+          (ctrl->files.head, ctrl->recipient_keys, signer, FALSE);
+      else
+        op = (GpaFileOperation *) gpa_file_sign_operation_new_batch
+          (ctrl->files.head, signer, GPGME_SIG_MODE_NORMAL, FALSE);
+      /* Ownership of the list of CTRL->files was passed to callee.  */
+      g_queue_init (&ctrl->files);
+      return run_file_operation (ctx, op);
+    }
+
   /* FIXME: Needs a root window.  Need to set "sign" default.  */
   if (encr && sign)
     op = (GpaFileOperation *)
-      gpa_file_encrypt_sign_operation_new (NULL, ctrl->files, FALSE);
+      gpa_file_encrypt_sign_operation_new (NULL, ctrl->files.head, FALSE);
   else if (encr)
     op = (GpaFileOperation *)
-      gpa_file_encrypt_operation_new (NULL, ctrl->files, FALSE);
+      gpa_file_encrypt_operation_new (NULL, ctrl->files.head, FALSE);
   else if (sign)
     op = (GpaFileOperation *)
-      gpa_file_sign_operation_new (NULL, ctrl->files, FALSE);
+      gpa_file_sign_operation_new (NULL, ctrl->files.head, FALSE);
   else
-    op = (GpaFileOperation *)
-      gpa_file_import_operation_new (NULL, ctrl->files);
+    {
+      op = (GpaFileOperation *)
+        gpa_file_import_operation_new (NULL, ctrl->files.head);
+      g_signal_connect (G_OBJECT (op), "imported_keys",
+                        G_CALLBACK (imported_keys_cb), NULL);
+      g_signal_connect (G_OBJECT (op), "imported_secret_keys",
+                        G_CALLBACK (imported_keys_cb), NULL);
+    }
 
-  /* Ownership of CTRL->files was passed to callee.  */
-  ctrl->files = NULL;
+  /* Ownership of the list of CTRL->files was passed to callee.  */
+  g_queue_init (&ctrl->files);
   g_signal_connect (G_OBJECT (op), "completed",
 		    G_CALLBACK (g_object_unref), NULL);
 
@@ -1332,17 +1678,17 @@ impl_encrypt_sign_files (assuan_context_t ctx, int encr, int sign)
 }
 
 
-/* ENCRYPT_FILES --nohup  */
+/* ENCRYPT_FILES [--nohup]  */
 static gpg_error_t
 cmd_encrypt_files (assuan_context_t ctx, char *line)
 {
+  conn_ctrl_t ctrl = assuan_get_pointer (ctx);
   gpg_error_t err;
+  int nohup;
 
-  if (! has_option (line, "--nohup"))
-    {
-      err = set_error (GPG_ERR_ASS_PARAMETER, "file ops require --nohup");
-      return assuan_process_done (ctx, err);
-    }
+  nohup = has_option (line, "--nohup");
+  if (!nohup && !acquire_slot (ctx, cmd_encrypt_files, line))
+    return not_finished (ctrl);
 
   line = skip_options (line);
   if (*line)
@@ -1351,21 +1697,21 @@ cmd_encrypt_files (assuan_context_t ctx, char *line)
       return assuan_process_done (ctx, err);
     }
 
-  return impl_encrypt_sign_files (ctx, 1, 0);
+  return impl_encrypt_sign_files (ctx, 1, 0, nohup);
 }
 
 
-/* SIGN_FILES --nohup  */
+/* SIGN_FILES [--nohup]  */
 static gpg_error_t
 cmd_sign_files (assuan_context_t ctx, char *line)
 {
+  conn_ctrl_t ctrl = assuan_get_pointer (ctx);
   gpg_error_t err;
+  int nohup;
 
-  if (! has_option (line, "--nohup"))
-    {
-      err = set_error (GPG_ERR_ASS_PARAMETER, "file ops require --nohup");
-      return assuan_process_done (ctx, err);
-    }
+  nohup = has_option (line, "--nohup");
+  if (!nohup && !acquire_slot (ctx, cmd_sign_files, line))
+    return not_finished (ctrl);
 
   line = skip_options (line);
   if (*line)
@@ -1374,21 +1720,21 @@ cmd_sign_files (assuan_context_t ctx, char *line)
       return assuan_process_done (ctx, err);
     }
 
-  return impl_encrypt_sign_files (ctx, 0, 1);
+  return impl_encrypt_sign_files (ctx, 0, 1, nohup);
 }
 
 
-/* ENCRYPT_SIGN_FILES --nohup  */
+/* ENCRYPT_SIGN_FILES [--nohup]  */
 static gpg_error_t
 cmd_encrypt_sign_files (assuan_context_t ctx, char *line)
 {
+  conn_ctrl_t ctrl = assuan_get_pointer (ctx);
   gpg_error_t err;
+  int nohup;
 
-  if (! has_option (line, "--nohup"))
-    {
-      err = set_error (GPG_ERR_ASS_PARAMETER, "file ops require --nohup");
-      return assuan_process_done (ctx, err);
-    }
+  nohup = has_option (line, "--nohup");
+  if (!nohup && !acquire_slot (ctx, cmd_encrypt_sign_files, line))
+    return not_finished (ctrl);
 
   line = skip_options (line);
   if (*line)
@@ -1397,36 +1743,50 @@ cmd_encrypt_sign_files (assuan_context_t ctx, char *line)
       return assuan_process_done (ctx, err);
     }
 
-  return impl_encrypt_sign_files (ctx, 1, 1);
+  return impl_encrypt_sign_files (ctx, 1, 1, nohup);
 }
 
 
 static gpg_error_t
-impl_decrypt_verify_files (assuan_context_t ctx, int decrypt, int verify)
+impl_decrypt_verify_files (assuan_context_t ctx, int decrypt, int verify,
+                           int nohup)
 {
   gpg_error_t err = 0;
   conn_ctrl_t ctrl = assuan_get_pointer (ctx);
   GpaFileOperation *op;
 
-  if (! ctrl->files)
+  if (g_queue_is_empty (&ctrl->files))
     {
       err = set_error (GPG_ERR_ASS_SYNTAX, "no files specified");
       return assuan_process_done (ctx, err);
     }
 
+  if (!nohup)
+    {
+      if (decrypt)
+        op = (GpaFileOperation *) gpa_file_decrypt_operation_new_batch
+          (ctrl->files.head, verify);
+      else
+        op = (GpaFileOperation *) gpa_file_verify_operation_new_batch
+          (ctrl->files.head);
+      /* Ownership of the list of CTRL->files was passed to callee.  */
+      g_queue_init (&ctrl->files);
+      return run_file_operation (ctx, op);
+    }
+
   /* FIXME: Needs a root window.  Need to enable "verify".  */
   if (decrypt && verify)
     op = (GpaFileOperation *)
-      gpa_file_decrypt_verify_operation_new (NULL, ctrl->files);
+      gpa_file_decrypt_verify_operation_new (NULL, ctrl->files.head);
   else if (decrypt)
     op = (GpaFileOperation *)
-      gpa_file_decrypt_operation_new (NULL, ctrl->files);
+      gpa_file_decrypt_operation_new (NULL, ctrl->files.head);
   else
     op = (GpaFileOperation *)
-      gpa_file_verify_operation_new (NULL, ctrl->files);
+      gpa_file_verify_operation_new (NULL, ctrl->files.head);
 
-  /* Ownership of CTRL->files was passed to callee.  */
-  ctrl->files = NULL;
+  /* Ownership of the list of CTRL->files was passed to callee.  */
+  g_queue_init (&ctrl->files);
   g_signal_connect (G_OBJECT (op), "completed",
 		    G_CALLBACK (g_object_unref), NULL);
 
@@ -1434,17 +1794,17 @@ impl_decrypt_verify_files (assuan_context_t ctx, int decrypt, int verify)
 }
 
 
-/* DECRYPT_FILES --nohup  */
+/* DECRYPT_FILES [--nohup]  */
 static gpg_error_t
 cmd_decrypt_files (assuan_context_t ctx, char *line)
 {
+  conn_ctrl_t ctrl = assuan_get_pointer (ctx);
   gpg_error_t err;
+  int nohup;
 
-  if (! has_option (line, "--nohup"))
-    {
-      err = set_error (GPG_ERR_ASS_PARAMETER, "file ops require --nohup");
-      return assuan_process_done (ctx, err);
-    }
+  nohup = has_option (line, "--nohup");
+  if (!nohup && !acquire_slot (ctx, cmd_decrypt_files, line))
+    return not_finished (ctrl);
 
   line = skip_options (line);
   if (*line)
@@ -1453,21 +1813,21 @@ cmd_decrypt_files (assuan_context_t ctx, char *line)
       return assuan_process_done (ctx, err);
     }
 
-  return impl_decrypt_verify_files (ctx, 1, 0);
+  return impl_decrypt_verify_files (ctx, 1, 0, nohup);
 }
 
 
-/* VERIFY_FILES --nohup  */
+/* VERIFY_FILES [--nohup]  */
 static gpg_error_t
 cmd_verify_files (assuan_context_t ctx, char *line)
 {
+  conn_ctrl_t ctrl = assuan_get_pointer (ctx);
   gpg_error_t err;
+  int nohup;
 
-  if (! has_option (line, "--nohup"))
-    {
-      err = set_error (GPG_ERR_ASS_PARAMETER, "file ops require --nohup");
-      return assuan_process_done (ctx, err);
-    }
+  nohup = has_option (line, "--nohup");
+  if (!nohup && !acquire_slot (ctx, cmd_verify_files, line))
+    return not_finished (ctrl);
 
   line = skip_options (line);
   if (*line)
@@ -1476,21 +1836,21 @@ cmd_verify_files (assuan_context_t ctx, char *line)
       return assuan_process_done (ctx, err);
     }
 
-  return impl_decrypt_verify_files (ctx, 0, 1);
+  return impl_decrypt_verify_files (ctx, 0, 1, nohup);
 }
 
 
-/* DECRYPT_VERIFY_FILES --nohup  */
+/* DECRYPT_VERIFY_FILES [--nohup]  */
 static gpg_error_t
 cmd_decrypt_verify_files (assuan_context_t ctx, char *line)
 {
+  conn_ctrl_t ctrl = assuan_get_pointer (ctx);
   gpg_error_t err;
+  int nohup;
 
-  if (! has_option (line, "--nohup"))
-    {
-      err = set_error (GPG_ERR_ASS_PARAMETER, "file ops require --nohup");
-      return assuan_process_done (ctx, err);
-    }
+  nohup = has_option (line, "--nohup");
+  if (!nohup && !acquire_slot (ctx, cmd_decrypt_verify_files, line))
+    return not_finished (ctrl);
 
   line = skip_options (line);
   if (*line)
@@ -1499,7 +1859,7 @@ cmd_decrypt_verify_files (assuan_context_t ctx, char *line)
       return assuan_process_done (ctx, err);
     }
 
-  return impl_decrypt_verify_files (ctx, 1, 1);
+  return impl_decrypt_verify_files (ctx, 1, 1, nohup);
 }
 
 
@@ -1522,23 +1882,154 @@ cmd_import_files (assuan_context_t ctx, char *line)
       return assuan_process_done (ctx, err);
     }
 
-  return impl_encrypt_sign_files (ctx, 0, 0);
+  return impl_encrypt_sign_files (ctx, 0, 0, 1);
 }
 
 
 
-/* CHECKSUM_CREATE_FILES --nohup  */
+/* The state of a checksum command.  CTX is NULL for a command run
+   with --nohup.  */
+struct checksum_cmd_s
+{
+  assuan_context_t ctx;
+  int verify;
+  unsigned int n_files;
+  unsigned int n_failed;
+};
+
+
+/* Continuation for the checksum commands.  */
+static void
+cont_checksum (assuan_context_t ctx, gpg_error_t err)
+{
+  assuan_process_done (ctx, err);
+}
+
+
+/* Report the result for one file of a checksum command.  */
+static void
+checksum_file_cb (void *opaque, const char *filename,
+                  gpa_checksum_result_t result, gpg_error_t err)
+{
+  struct checksum_cmd_s *cmd = opaque;
+  char *fname, *status;
+
+  cmd->n_files++;
+  if (result != GPA_CHECKSUM_OK)
+    cmd->n_failed++;
+  if (result == GPA_CHECKSUM_BAD)
+    err = gpg_error (GPG_ERR_CHECKSUM);
+
+  if (!cmd->ctx)
+    {
+      if (err)
+        g_debug ("checksum of `%s': %s", filename, gpg_strerror (err));
+      return;
+    }
+
+  fname = percent_escape (filename, NULL, 0);
+  status = g_strdup_printf ("%s %u %s",
+                            result == GPA_CHECKSUM_OK? "OK" :
+                            result == GPA_CHECKSUM_BAD? "BAD" : "ERROR",
+                            err, fname);
+  assuan_write_status (cmd->ctx, "CHECKSUM", status);
+  g_free (status);
+  g_free (fname);
+}
+
+
+/* Finish a checksum command.  */
+static void
+checksum_done_cb (void *opaque, gpg_error_t err)
+{
+  struct checksum_cmd_s *cmd = opaque;
+
+  if (cmd->ctx)
+    run_server_continuation (cmd->ctx, err);
+  else if (headless_server)
+    ;
+  else if (cmd->verify && cmd->n_failed)
+    {
+      char *msg = g_strdup_printf
+        (_("%u of %u files did not match their checksum"
+           " or could not be read."), cmd->n_failed, cmd->n_files);
+      gpa_window_error (msg, NULL);
+      g_free (msg);
+    }
+  else if (cmd->verify)
+    gpa_show_info (NULL, _("The checksums of all %u files are correct."),
+                   cmd->n_files);
+  else if (cmd->n_failed)
+    {
+      char *msg = g_strdup_printf
+        (_("%u of %u files could not be checksummed."),
+         cmd->n_failed, cmd->n_files);
+      gpa_window_error (msg, NULL);
+      g_free (msg);
+    }
+  else
+    gpa_show_info (NULL, _("Checksums for %u files have been created."),
+                   cmd->n_files);
+
+  g_free (cmd);
+}
+
+
+/* Create or verify the checksums of the files.  The files are hashed
+   in the background.  Without NOHUP the command completes after all
+   files have been processed and reports each of them with a status
+   line.  */
 static gpg_error_t
-cmd_checksum_create_files (assuan_context_t ctx, char *line)
+impl_checksum_files (assuan_context_t ctx, int verify, int nohup,
+                     GChecksumType type)
 {
-  gpg_error_t err;
+  conn_ctrl_t ctrl = assuan_get_pointer (ctx);
+  struct checksum_cmd_s *cmd;
+  GPtrArray *files;
+  GList *cur;
 
-  if (! has_option (line, "--nohup"))
+  if (g_queue_is_empty (&ctrl->files))
     {
-      err = set_error (GPG_ERR_ASS_PARAMETER, "file ops require --nohup");
+      gpg_error_t err = set_error (GPG_ERR_ASS_SYNTAX, "no files specified");
       return assuan_process_done (ctx, err);
     }
 
+  files = g_ptr_array_new ();
+  for (cur = ctrl->files.head; cur; cur = g_list_next (cur))
+    g_ptr_array_add (files, ((gpa_file_item_t) cur->data)->filename_in);
+  g_ptr_array_add (files, NULL);
+
+  cmd = g_new0 (struct checksum_cmd_s, 1);
+  cmd->ctx = nohup? NULL : ctx;
+  cmd->verify = verify;
+  if (!nohup)
+    ctrl->cont_cmd = cont_checksum;
+
+  if (verify)
+    gpa_checksum_verify ((const char *const *) files->pdata,
+                         checksum_file_cb, checksum_done_cb, cmd);
+  else
+    gpa_checksum_create ((const char *const *) files->pdata, type,
+                         checksum_file_cb, checksum_done_cb, cmd);
+  g_ptr_array_free (files, TRUE);
+  release_files (ctrl);
+
+  if (nohup)
+    return assuan_process_done (ctx, 0);
+  return not_finished (ctrl);
+}
+
+
+/* CHECKSUM_CREATE_FILES [--nohup] [--sha512]  */
+static gpg_error_t
+cmd_checksum_create_files (assuan_context_t ctx, char *line)
+{
+  gpg_error_t err;
+  int nohup, sha512;
+
+  nohup = has_option (line, "--nohup");
+  sha512 = has_option (line, "--sha512");
+
   line = skip_options (line);
   if (*line)
     {
@@ -1546,22 +2037,19 @@ cmd_checksum_create_files (assuan_context_t ctx, char *line)
       return assuan_process_done (ctx, err);
     }
 
-  err = set_error (GPG_ERR_NOT_IMPLEMENTED, "not implemented");
-  return assuan_process_done (ctx, err);
+  return impl_checksum_files (ctx, 0, nohup,
+                              sha512? G_CHECKSUM_SHA512 : G_CHECKSUM_SHA256);
 }
 
-
-/* CHECKSUM_VERIFY_FILES --nohup  */
+
+/* CHECKSUM_VERIFY_FILES [--nohup]  */
 static gpg_error_t
 cmd_checksum_verify_files (assuan_context_t ctx, char *line)
 {
   gpg_error_t err;
+  int nohup;
 
-  if (! has_option (line, "--nohup"))
-    {
-      err = set_error (GPG_ERR_ASS_PARAMETER, "file ops require --nohup");
-      return assuan_process_done (ctx, err);
-    }
+  nohup = has_option (line, "--nohup");
 
   line = skip_options (line);
   if (*line)
@@ -1570,12 +2058,11 @@ cmd_checksum_verify_files (assuan_context_t ctx, char *line)
       return assuan_process_done (ctx, err);
     }
 
-  err = set_error (GPG_ERR_NOT_IMPLEMENTED, "not implemented");
-  return assuan_process_done (ctx, err);
+  return impl_checksum_files (ctx, 1, nohup, G_CHECKSUM_SHA256);
 }
 
 
-
+
 /* KILL_UISERVER  */
 static gpg_error_t
 cmd_kill_uiserver (assuan_context_t ctx, char *line)
@@ -1735,6 +2222,23 @@ connection_startup (assuan_fd_t fd)
 }
 
 
+/* Stop processing the input of the connection CTRL.  */
+static void
+stop_input (conn_ctrl_t ctrl)
+{
+  if (ctrl->watch_id)
+    {
+      g_source_remove (ctrl->watch_id);
+      ctrl->watch_id = 0;
+    }
+  if (ctrl->resume_id)
+    {
+      g_source_remove (ctrl->resume_id);
+      ctrl->resume_id = 0;
+    }
+}
+
+
 /* Finish a connection.  This releases all resources and needs to be
    called becore the file descriptor is closed.  */
 static void
@@ -1744,8 +2248,16 @@ connection_finish (assuan_context_t ctx)
     {
       conn_ctrl_t ctrl = assuan_get_pointer (ctx);
 
+      stop_input (ctrl);
+      release_slot (ctrl);
+      g_queue_remove (&waiting_connections, ctx);
+      g_free (ctrl->waiting_line);
+      g_debug ("connection finished after %u operations taking %.3fs",
+               ctrl->n_operations, ctrl->operations_time / 1e6);
       reset_notify (ctx, NULL);
       assuan_release (ctx);
+      if (ctrl->channel)
+        g_io_channel_unref (ctrl->channel);
       g_free (ctrl);
       connection_counter--;
       if (!connection_counter && shutdown_pending)
@@ -1772,6 +2284,8 @@ run_server_continuation (assuan_context_t ctx, gpg_error_t err)
     {
       g_debug ("no continuation defined; using default");
       assuan_process_done (ctx, err);
+      release_slot (ctrl);
+      resume_input (ctx);
     }
   else if (ctrl->client_died)
     {
@@ -1783,11 +2297,90 @@ run_server_continuation (assuan_context_t ctx, gpg_error_t err)
       cont_cmd = ctrl->cont_cmd;
       ctrl->cont_cmd = NULL;
       cont_cmd (ctx, err);
+      release_slot (ctrl);
+      resume_input (ctx);
     }
   g_debug ("leaving gpa_run_server_continuation");
 }
 
 
+/* Process the next input line of the connection CTX.  Returns false
+   if the client has closed the connection.  In this case the
+   connection has already been finished or will be finished by the
+   pending continuation.  */
+static gboolean
+process_next_line (assuan_context_t ctx)
+{
+  conn_ctrl_t ctrl = assuan_get_pointer (ctx);
+  gpg_error_t err;
+  int done = 0;
+
+  ctrl->is_unfinished = 0;
+  ctrl->in_command++;
+  err = assuan_process_next (ctx, &done);
+  ctrl->in_command--;
+  if (!ctrl->cont_cmd)
+    release_slot (ctrl);
+  if (err)
+    {
+      g_debug ("assuan_process_next returned: %s <%s>",
+               gpg_strerror (err), gpg_strsource (err));
+    }
+  else
+    {
+      g_debug ("assuan_process_next returned: %s",
+               done ? "done" : "success");
+    }
+  if (gpg_err_code (err) == GPG_ERR_EAGAIN)
+    ; /* Ignore.  */
+  else if (!err && done)
+    {
+      /* A command still waiting for a slot has not started anything
+         yet; drop it along with the connection.  */
+      if (ctrl->cont_cmd && ctrl->cont_cmd != cont_waiting)
+        {
+          ctrl->client_died = 1; /* Need to delay the cleanup.  */
+          stop_input (ctrl);
+        }
+      else
+        connection_finish (ctx);
+      return FALSE;
+    }
+  else if (gpg_err_code (err) == GPG_ERR_UNFINISHED)
+    {
+      if (!ctrl->is_unfinished)
+        {
+          /* It is quite possible that some other subsystem
+             returns that error code.  Tell the user about
+             this curiosity and finish the command.  */
+          g_debug ("note: Unfinished error code not emitted by us");
+          if (ctrl->cont_cmd)
+            g_debug ("OOPS: pending continuation!");
+          assuan_process_done (ctx, err);
+        }
+    }
+  else
+    assuan_process_done (ctx, err);
+
+  return TRUE;
+}
+
+
+/* This function is called by the main event loop to process an input
+   line which has already been buffered by Assuan.  */
+static gboolean
+resume_cb (void *data)
+{
+  assuan_context_t ctx = data;
+  conn_ctrl_t ctrl = assuan_get_pointer (ctx);
+
+  ctrl->resume_id = 0;
+  if (process_next_line (ctx))
+    resume_input (ctx);
+  return FALSE;
+}
+
+
 /* This function is called by the main event loop if data can be read
    from the status channel.  */
 static gboolean
@@ -1795,66 +2388,58 @@ receive_cb (GIOChannel *channel, GIOCondition condition, void *data)
 {
   assuan_context_t ctx = data;
   conn_ctrl_t ctrl = assuan_get_pointer (ctx);
-  gpg_error_t err;
 
   assert (ctrl);
   if (condition & G_IO_IN)
     {
       g_debug ("receive_cb");
-      if (ctrl->cont_cmd)
+      if (ctrl->cont_cmd || ctrl->in_command)
         {
-          g_debug ("  input received while waiting for continuation");
-          g_usleep (2000000);
+          /* Do not read any further input while a command is pending;
+             resume_input watches the connection again.  */
+          g_debug ("  input received while a command is pending");
+          stop_input (ctrl);
+          return FALSE;
         }
-      else if (ctrl->in_command)
+      if (!process_next_line (ctx))
+        return FALSE;
+      if (ctrl->cont_cmd || !ctrl->watch_id || assuan_pending_line (ctx))
         {
-          g_debug ("  input received while still processing command");
-          g_usleep (2000000);
+          stop_input (ctrl);
+          resume_input (ctx);
+          return FALSE;
         }
-      else
+    }
+  return TRUE;
+}
+
+
+/* Continue processing the input of the connection CTX unless a
+   command is still pending.  While the connection is not watched,
+   further input is kept in the socket buffer, which eventually blocks
+   the client instead of us.  Lines Assuan has already read from the
+   socket are processed from an idle handler, one at a time, so that
+   pipelined commands do not starve other connections.  */
+static void
+resume_input (assuan_context_t ctx)
+{
+  conn_ctrl_t ctrl = assuan_get_pointer (ctx);
+
+  if (ctrl->cont_cmd || ctrl->in_command || ctrl->client_died
+      || ctrl->resume_id)
+    return;
+
+  if (assuan_pending_line (ctx))
+    {
+      if (ctrl->watch_id)
         {
-	  int done = 0;
-          ctrl->in_command++;
-          err = assuan_process_next (ctx, &done);
-          ctrl->in_command--;
-	  if (err)
-	    {
-	      g_debug ("assuan_process_next returned: %s <%s>",
-		       gpg_strerror (err), gpg_strsource (err));
-	    }
-	  else
-	    {
-	      g_debug ("assuan_process_next returned: %s",
-		       done ? "done" : "success");
-	    }
-          if (gpg_err_code (err) == GPG_ERR_EAGAIN)
-            ; /* Ignore.  */
-          else if (!err && done)
-            {
-              if (ctrl->cont_cmd)
-                ctrl->client_died = 1; /* Need to delay the cleanup.  */
-              else
-                connection_finish (ctx);
-              return FALSE; /* Remove from the watch.  */
-            }
-          else if (gpg_err_code (err) == GPG_ERR_UNFINISHED)
-            {
-              if (!ctrl->is_unfinished)
-                {
-                  /* It is quite possible that some other subsystem
-                     returns that error code.  Tell the user about
-                     this curiosity and finish the command.  */
-                  g_debug ("note: Unfinished error code not emitted by us");
-                  if (ctrl->cont_cmd)
-                    g_debug ("OOPS: pending continuation!");
-                  assuan_process_done (ctx, err);
-                }
-            }
-          else
-            assuan_process_done (ctx, err);
+          g_source_remove (ctrl->watch_id);
+          ctrl->watch_id = 0;
         }
+      ctrl->resume_id = g_idle_add (resume_cb, ctx);
     }
-  return TRUE;
+  else if (!ctrl->watch_id)
+    ctrl->watch_id = g_io_add_watch (ctrl->channel, G_IO_IN, receive_cb, ctx);
 }
 
 
@@ -1870,6 +2455,7 @@ accept_connection_cb (GIOChannel *listen_channel,
   struct sockaddr_un paddr;
   socklen_t plen = sizeof paddr;
   assuan_context_t ctx;
+  conn_ctrl_t ctrl;
   GIOChannel *channel;
   unsigned int source_id;
 
@@ -1916,6 +2502,9 @@ accept_connection_cb (GIOChannel *listen_channel,
       g_io_channel_shutdown (channel, 0, NULL);
       goto leave;
     }
+  ctrl = assuan_get_pointer (ctx);
+  ctrl->channel = channel;
+  ctrl->watch_id = source_id;
   err = assuan_accept (ctx);
   if (err)
     {
@@ -0,0 +1,381 @@
+/* textdata.c - The GNU Privacy Assistant text buffer data objects.
+   Copyright (C) 2026 g10 Code GmbH.
+
+   This file is part of GPA
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* These gpgme data objects let an operation read its input directly
+   from a GtkTextBuffer and write its output into the same buffer,
+   without first copying the whole text into memory.  The input is
+   read in chunks of a few thousand characters.  The output is
+   appended as hidden text after the input and replaces the input only
+   when the operation succeeded.  */
+
+#include <config.h>
+
+#include <string.h>
+#include <errno.h>
+
+#include "gpa.h"
+#include "textdata.h"
+
+
+/* The number of characters read from the buffer at once.  */
+#define CHUNK_CHARS 16384
+
+
+struct gpa_text_data_s
+{
+  GtkTextBuffer *buffer;
+  gboolean include_hidden;
+
+  /* The end of the input text; the input starts at the start of the
+     buffer.  The output is stored between INPUT_END and OUTPUT_END
+     and marked with HIDDEN_TAG.  */
+  GtkTextMark *input_end;
+  GtkTextMark *output_end;
+  GtkTextTag *hidden_tag;
+  gboolean committed;
+
+  /* The character offset of the next chunk to read, the current chunk
+     and the number of bytes already read from it, and the read
+     position in bytes.  */
+  gint read_offset;
+  char *chunk;
+  size_t chunk_len;
+  size_t chunk_used;
+  off_t read_pos;
+
+  /* An incomplete UTF-8 character at the end of the last write.  */
+  char partial[4];
+  size_t partial_len;
+  /* The number of bytes written to the buffer and the offset of the
+     first invalid UTF-8 byte or -1.  */
+  gsize written;
+  gssize invalid_pos;
+};
+
+
+gpa_text_data_t
+gpa_text_data_new (GtkTextBuffer *buffer, gboolean include_hidden)
+{
+  gpa_text_data_t td;
+  GtkTextIter end;
+
+  td = g_malloc0 (sizeof *td);
+  td->buffer = g_object_ref (buffer);
+  td->include_hidden = include_hidden;
+  td->invalid_pos = -1;
+
+  gtk_text_buffer_get_end_iter (buffer, &end);
+  td->input_end = gtk_text_buffer_create_mark (buffer, NULL, &end, TRUE);
+
+  return td;
+}
+
+
+void
+gpa_text_data_release (gpa_text_data_t td)
+{
+  GtkTextIter start, end;
+
+  if (!td)
+    return;
+
+  if (td->output_end)
+    {
+      if (!td->committed)
+        {
+          gtk_text_buffer_get_iter_at_mark (td->buffer, &start,
+                                            td->input_end);
+          gtk_text_buffer_get_iter_at_mark (td->buffer, &end,
+                                            td->output_end);
+          gtk_text_buffer_delete (td->buffer, &start, &end);
+        }
+      gtk_text_buffer_delete_mark (td->buffer, td->output_end);
+      gtk_text_tag_table_remove (gtk_text_buffer_get_tag_table (td->buffer),
+                                 td->hidden_tag);
+    }
+  gtk_text_buffer_delete_mark (td->buffer, td->input_end);
+  g_object_unref (td->buffer);
+  g_free (td->chunk);
+  g_free (td);
+}
+
+
+/* Make sure there is something left in the current chunk of TD.
+   Returns false at the end of the input.  */
+static gboolean
+fill_chunk (gpa_text_data_t td)
+{
+  GtkTextIter start, end, limit;
+
+  while (td->chunk_used == td->chunk_len)
+    {
+      g_free (td->chunk);
+      td->chunk = NULL;
+      td->chunk_len = td->chunk_used = 0;
+
+      gtk_text_buffer_get_iter_at_offset (td->buffer, &start,
+                                          td->read_offset);
+      gtk_text_buffer_get_iter_at_mark (td->buffer, &limit, td->input_end);
+      if (gtk_text_iter_compare (&start, &limit) >= 0)
+        return FALSE;
+      end = start;
+      gtk_text_iter_forward_chars (&end, CHUNK_CHARS);
+      if (gtk_text_iter_compare (&end, &limit) > 0)
+        end = limit;
+
+      if (td->include_hidden)
+        td->chunk = gtk_text_buffer_get_slice (td->buffer, &start, &end,
+                                               TRUE);
+      else
+        td->chunk = gtk_text_buffer_get_text (td->buffer, &start, &end,
+                                              FALSE);
+      td->chunk_len = strlen (td->chunk);
+      td->read_offset = gtk_text_iter_get_offset (&end);
+    }
+
+  return TRUE;
+}
+
+
+static ssize_t
+input_read_cb (void *handle, void *buffer, size_t size)
+{
+  gpa_text_data_t td = handle;
+  size_t n;
+
+  if (!size || !fill_chunk (td))
+    return 0;
+
+  n = MIN (size, td->chunk_len - td->chunk_used);
+  memcpy (buffer, td->chunk + td->chunk_used, n);
+  td->chunk_used += n;
+  td->read_pos += n;
+  return n;
+}
+
+
+/* The length of the input is not known without reading it, thus
+   seeking relative to the end is not supported.  Seeking back within
+   the current chunk, as done to identify the data, is cheap.  */
+static off_t
+input_seek_cb (void *handle, off_t offset, int whence)
+{
+  gpa_text_data_t td = handle;
+  char scratch[512];
+
+  if (whence == SEEK_CUR)
+    offset += td->read_pos;
+  else if (whence != SEEK_SET)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+  if (offset < 0)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  if (offset < td->read_pos)
+    {
+      if (td->read_pos - offset <= td->chunk_used)
+        {
+          td->chunk_used -= td->read_pos - offset;
+          td->read_pos = offset;
+          return offset;
+        }
+      /* Start over.  */
+      g_free (td->chunk);
+      td->chunk = NULL;
+      td->chunk_len = td->chunk_used = 0;
+      td->read_offset = 0;
+      td->read_pos = 0;
+    }
+
+  while (td->read_pos < offset)
+    if (input_read_cb (td, scratch,
+                       MIN (sizeof scratch, offset - td->read_pos)) <= 0)
+      break;
+
+  return td->read_pos;
+}
+
+
+static struct gpgme_data_cbs input_cbs =
+  {
+    input_read_cb,
+    NULL,
+    input_seek_cb,
+    NULL
+  };
+
+
+gpg_error_t
+gpa_text_data_new_input (gpa_text_data_t td, gpgme_data_t *r_data)
+{
+  g_free (td->chunk);
+  td->chunk = NULL;
+  td->chunk_len = td->chunk_used = 0;
+  td->read_offset = 0;
+  td->read_pos = 0;
+
+  return gpgme_data_new_from_cbs (r_data, &input_cbs, td);
+}
+
+
+/* Append the valid UTF-8 string (TEXT,LEN) to the output of TD.  */
+static void
+insert_output (gpa_text_data_t td, const char *text, gsize len)
+{
+  GtkTextIter iter;
+
+  if (!len)
+    return;
+  gtk_text_buffer_get_iter_at_mark (td->buffer, &iter, td->output_end);
+  gtk_text_buffer_insert_with_tags (td->buffer, &iter, text, len,
+                                    td->hidden_tag, NULL);
+}
+
+
+/* Append the Latin-1 string (TEXT,LEN) to the output of TD.  */
+static void
+insert_latin1 (gpa_text_data_t td, const char *text, gsize len)
+{
+  char *str;
+  gsize nbytes;
+
+  str = g_convert (text, len, "UTF-8", "ISO-8859-1", NULL, &nbytes, NULL);
+  if (str)
+    insert_output (td, str, nbytes);
+  g_free (str);
+}
+
+
+static ssize_t
+output_write_cb (void *handle, const void *buffer, size_t size)
+{
+  gpa_text_data_t td = handle;
+  const char *data = buffer;
+  char *joined = NULL;
+  const gchar *end;
+  size_t len = size;
+
+  if (td->invalid_pos != -1)
+    {
+      insert_latin1 (td, data, len);
+      td->written += len;
+      return size;
+    }
+
+  if (td->partial_len)
+    {
+      joined = g_malloc (td->partial_len + size);
+      memcpy (joined, td->partial, td->partial_len);
+      memcpy (joined + td->partial_len, buffer, size);
+      data = joined;
+      len += td->partial_len;
+      td->partial_len = 0;
+    }
+
+  if (!g_utf8_validate (data, len, &end))
+    {
+      size_t valid = end - data;
+      size_t rest = len - valid;
+
+      insert_output (td, data, valid);
+      td->written += valid;
+      if (rest < sizeof td->partial
+          && g_utf8_get_char_validated (end, rest) == (gunichar)-2)
+        {
+          /* An incomplete character; wait for the next write.  */
+          memcpy (td->partial, end, rest);
+          td->partial_len = rest;
+        }
+      else
+        {
+          td->invalid_pos = td->written;
+          insert_latin1 (td, end, rest);
+          td->written += rest;
+        }
+    }
+  else
+    {
+      insert_output (td, data, len);
+      td->written += len;
+    }
+
+  g_free (joined);
+  return size;
+}
+
+
+static struct gpgme_data_cbs output_cbs =
+  {
+    NULL,
+    output_write_cb,
+    NULL,
+    NULL
+  };
+
+
+gpg_error_t
+gpa_text_data_new_output (gpa_text_data_t td, gpgme_data_t *r_data)
+{
+  GtkTextIter end;
+
+  if (td->output_end)
+    return gpg_error (GPG_ERR_CONFLICT);
+
+  gtk_text_buffer_get_end_iter (td->buffer, &end);
+  td->output_end = gtk_text_buffer_create_mark (td->buffer, NULL, &end,
+                                                FALSE);
+  td->hidden_tag = gtk_text_buffer_create_tag (td->buffer, NULL,
+                                               "invisible", TRUE, NULL);
+
+  return gpgme_data_new_from_cbs (r_data, &output_cbs, td);
+}
+
+
+gssize
+gpa_text_data_commit (gpa_text_data_t td)
+{
+  GtkTextIter start, end;
+
+  if (!td->output_end || td->committed)
+    return td->invalid_pos;
+
+  if (td->partial_len)
+    {
+      /* The output ended within a character.  */
+      if (td->invalid_pos == -1)
+        td->invalid_pos = td->written;
+      insert_latin1 (td, td->partial, td->partial_len);
+      td->partial_len = 0;
+    }
+
+  gtk_text_buffer_get_start_iter (td->buffer, &start);
+  gtk_text_buffer_get_iter_at_mark (td->buffer, &end, td->input_end);
+  gtk_text_buffer_delete (td->buffer, &start, &end);
+  gtk_text_buffer_get_bounds (td->buffer, &start, &end);
+  gtk_text_buffer_remove_tag (td->buffer, td->hidden_tag, &start, &end);
+  gtk_text_buffer_place_cursor (td->buffer, &start);
+  td->committed = TRUE;
+
+  return td->invalid_pos;
+}
@@ -0,0 +1,55 @@
+/* textdata.h - The GNU Privacy Assistant text buffer data objects.
+   Copyright (C) 2026 g10 Code GmbH.
+
+   This file is part of GPA
+
+   GPA is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   GPA is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+   or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+   License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TEXTDATA_H
+#define TEXTDATA_H
+
+#include <gtk/gtk.h>
+#include <gpgme.h>
+
+/* The text of a GtkTextBuffer used as input of an operation and to be
+   replaced by its output.  */
+typedef struct gpa_text_data_s *gpa_text_data_t;
+
+/* Create a text data object for the current text of BUFFER.  If
+   INCLUDE_HIDDEN is set, the input includes hidden text and a
+   placeholder for embedded objects as with gtk_text_buffer_get_slice.
+   The text of BUFFER must not be changed until the object is
+   released.  */
+gpa_text_data_t gpa_text_data_new (GtkTextBuffer *buffer,
+                                   gboolean include_hidden);
+
+/* Release TD.  An output not committed is removed from the buffer.  */
+void gpa_text_data_release (gpa_text_data_t td);
+
+/* Create a gpgme data object reading the input text of TD.  */
+gpg_error_t gpa_text_data_new_input (gpa_text_data_t td,
+                                     gpgme_data_t *r_data);
+
+/* Create a gpgme data object writing the output of TD.  The output
+   is stored hidden in the buffer until it is committed.  */
+gpg_error_t gpa_text_data_new_output (gpa_text_data_t td,
+                                      gpgme_data_t *r_data);
+
+/* Replace the input text of TD by its output.  Returns -1 or, if the
+   output is not valid UTF-8, the offset of the first invalid byte;
+   the output is then taken as Latin-1 from there on.  */
+gssize gpa_text_data_commit (gpa_text_data_t td);
+
+#endif /* TEXTDATA_H */